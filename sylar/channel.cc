@@ -0,0 +1,197 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 19:05:50
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 19:05:50
+ * @FilePath: /sylar_from_nanasaki/sylar/channel.cc
+ */
+#include "channel.h"
+#include "iomanager.h"
+#include "macro.h"
+
+namespace sylar {
+
+ChannelBase::ChannelBase(size_t capacity)
+  : m_capacity(capacity) {
+  SYLAR_ASSERT2(capacity > 0, "channel capacity must be greater than 0");
+  m_waiting[0] = 0;
+  m_waiting[1] = 0;
+}
+
+void ChannelBase::close() {
+  std::vector<Waiter::ptr> ws;
+  {
+    Spinlock::Lock lock(m_mutex);
+    if (m_closed) {
+      return;
+    }
+    m_closed.store(true, std::memory_order_release);
+    for (auto& q : m_waiters) {
+      for (auto& e : q) {
+        e->queued = false;
+        if (!e->waiter->fired.exchange(true)) {
+          e->waiter->index = e->index;
+          ws.push_back(e->waiter);
+        }
+      }
+      q.clear();
+    }
+    m_waiting[0] = 0;
+    m_waiting[1] = 0;
+  }
+  for (auto& w : ws) {
+    w->scheduler->schedule(w->fiber);
+  }
+}
+
+void ChannelBase::wakeOne(bool send) {
+  Waiter::ptr w;
+  {
+    Spinlock::Lock lock(m_mutex);
+    auto& q = m_waiters[send];
+    while (!q.empty()) {
+      WaitEntry::ptr e = q.front();
+      q.pop_front();
+      e->queued = false;
+      --m_waiting[send];
+      // 同时在多个通道上等待的协程可能已经被其他通道唤醒了，跳过它继续唤醒下一个
+      if (!e->waiter->fired.exchange(true)) {
+        e->waiter->index = e->index;
+        w = e->waiter;
+        break;
+      }
+    }
+  }
+  if (w) {
+    w->scheduler->schedule(w->fiber);
+  }
+}
+
+void ChannelBase::addWaiter(const WaitEntry::ptr& entry, bool send) {
+  Spinlock::Lock lock(m_mutex);
+  entry->it = m_waiters[send].insert(m_waiters[send].end(), entry);
+  entry->queued = true;
+  m_waiting[send].fetch_add(1, std::memory_order_seq_cst);
+}
+
+void ChannelBase::removeWaiter(const WaitEntry::ptr& entry, bool send) {
+  Spinlock::Lock lock(m_mutex);
+  if (entry->queued) {
+    m_waiters[send].erase(entry->it);
+    entry->queued = false;
+    --m_waiting[send];
+  }
+}
+
+uint64_t ChannelBase::Deadline(uint64_t timeout_ms) {
+  if (timeout_ms == ~0ull) {
+    return ~0ull;
+  }
+  return sylar::util::GetElapsedMS() + timeout_ms;
+}
+
+int ChannelBase::Park(const std::vector<std::pair<ChannelBase*, bool>>& cases,
+                      uint64_t deadline) {
+  uint64_t timeout_ms = ~0ull;
+  if (deadline != ~0ull) {
+    uint64_t now = sylar::util::GetElapsedMS();
+    if (now >= deadline) {
+      return -1;
+    }
+    timeout_ms = deadline - now;
+  }
+
+  Scheduler* sc = Scheduler::GetThis();
+  SYLAR_ASSERT2(sc, "channel wait must be called in scheduler");
+  Fiber::ptr fiber = Fiber::GetThis();
+  SYLAR_ASSERT2(fiber.get() != Scheduler::GetMainFiber(), "channel wait in scheduler main fiber");
+
+  Waiter::ptr w(new Waiter);
+  w->scheduler = sc;
+  w->fiber = fiber;
+
+  std::vector<WaitEntry::ptr> entries;
+  entries.reserve(cases.size());
+  for (size_t i = 0; i < cases.size(); ++i) {
+    WaitEntry::ptr e(new WaitEntry);
+    e->waiter = w;
+    e->index = i;
+    cases[i].first->addWaiter(e, cases[i].second);
+    entries.push_back(e);
+  }
+
+  // 登记之后再检查一次，与notify中的屏障配对，保证不会错过登记之前完成的操作
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int ready = -1;
+  for (size_t i = 0; i < cases.size(); ++i) {
+    if (cases[i].first->ready(cases[i].second)) {
+      ready = i;
+      break;
+    }
+  }
+
+  int rt = -2;
+  if (ready < 0 || w->fired.exchange(true)) {
+    // 还未就绪，或者已经被唤醒加入了调度，都必须yield
+    if (timeout_ms != ~0ull) {
+      IOManager* iom = IOManager::GetThis();
+      SYLAR_ASSERT2(iom, "channel timed wait must be called in IOManager");
+      w->timer = iom->addTimer(timeout_ms, [w]() {
+        if (!w->fired.exchange(true)) {
+          w->index = -1;
+          w->scheduler->schedule(w->fiber);
+        }
+      });
+    }
+    // 唤醒方可能在yield之前就把协程加入了调度，调度器会跳过还未yield的协程
+    fiber->yield();
+    rt = w->index;
+    if (w->timer) {
+      w->timer->cancel();
+    }
+  }
+
+  for (size_t i = 0; i < cases.size(); ++i) {
+    cases[i].first->removeWaiter(entries[i], cases[i].second);
+  }
+  // 定时器回调持有等待者，这里断开引用
+  w->fiber.reset();
+  w->timer.reset();
+  return rt;
+}
+
+int ChannelSelect::tryCases(int hint) {
+  if (hint >= 0 && m_cases[hint].op()) {
+    return hint;
+  }
+  for (size_t i = 0; i < m_cases.size(); ++i) {
+    if (m_cases[i].op()) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int ChannelSelect::wait(uint64_t timeout_ms) {
+  uint64_t deadline = ChannelBase::Deadline(timeout_ms);
+  std::vector<std::pair<ChannelBase*, bool>> cases;
+  cases.reserve(m_cases.size());
+  for (auto& i : m_cases) {
+    cases.push_back(std::make_pair(i.channel, i.send));
+  }
+
+  int hint = -1;
+  while (true) {
+    // 优先尝试唤醒自己的通道，避免把唤醒让给其他通道后导致这个通道上的就绪被浪费
+    int idx = tryCases(hint);
+    if (idx >= 0) {
+      return idx;
+    }
+    hint = ChannelBase::Park(cases, deadline);
+    if (hint == -1) {
+      return tryCases(-1);
+    }
+  }
+}
+
+}   // namespace sylar
@@ -0,0 +1,446 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 19:05:44
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 19:05:44
+ * @FilePath: /sylar_from_nanasaki/sylar/channel.h
+ */
+#ifndef __SYLAR_CHANNEL_H__
+#define __SYLAR_CHANNEL_H__
+
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "timer.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace sylar {
+
+class Scheduler;
+class ChannelSelect;
+
+/**
+ * @brief 通道基类
+ * @details 与元素类型无关的部分：读写位置、关闭状态以及挂起协程的等待队列。
+ *          等待的协程被唤醒只表示通道可能就绪，被唤醒后需要重新尝试，所以一个协程可以同时在多个通道上等待(select)
+ */
+class ChannelBase : Noncopyable {
+  friend class ChannelSelect;
+
+public:
+  /**
+   * @brief 构造函数
+   * @param[in] capacity 容量，至少为1
+   */
+  ChannelBase(size_t capacity);
+
+  virtual ~ChannelBase() = default;
+
+  /**
+   * @brief 关闭通道
+   * @details 关闭后send失败，recv取完剩余元素后失败，所有挂起的协程都会被唤醒
+   */
+  void close();
+
+  /**
+   * @brief 通道是否已关闭
+   */
+  bool isClosed() const {
+    return m_closed.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief 通道中的元素数，并发时为近似值
+   */
+  size_t size() const {
+    size_t enq = m_enqueuePos.load(std::memory_order_acquire);
+    size_t deq = m_dequeuePos.load(std::memory_order_acquire);
+    return enq > deq ? enq - deq : 0;
+  }
+
+  /**
+   * @brief 通道容量
+   */
+  size_t capacity() const {
+    return m_capacity;
+  }
+
+protected:
+  /**
+   * @brief 挂起的协程
+   */
+  struct Waiter {
+    using ptr = std::shared_ptr<Waiter>;
+    /// 协程所属的调度器
+    Scheduler* scheduler = nullptr;
+    /// 挂起的协程
+    Fiber::ptr fiber;
+    /// 超时定时器
+    Timer::ptr timer;
+    /// 是否已被唤醒，保证只被调度一次
+    std::atomic<bool> fired = {false};
+    /// 唤醒它的等待项下标，-1表示超时
+    int index = -1;
+  };
+
+  /**
+   * @brief 等待项，一个协程在每个等待的通道上各有一个
+   */
+  struct WaitEntry {
+    using ptr = std::shared_ptr<WaitEntry>;
+    Waiter::ptr waiter;
+    /// 在Park的cases中的下标
+    int index = 0;
+    /// 是否还在等待队列中
+    bool queued = false;
+    /// 在等待队列中的位置
+    std::list<ptr>::iterator it;
+  };
+
+  /**
+   * @brief 挂起当前协程直到cases中的某个通道可能就绪，或者超时
+   * @param[in] cases 通道和等待的方向，true表示等待可写，false表示等待可读
+   * @param[in] deadline 截止时间(GetElapsedMS)，~0ull表示不超时
+   * @return 唤醒它的下标，-1表示超时，-2表示登记时就已经就绪、没有挂起
+   * @attention 只能在调度器调度的协程中调用
+   */
+  static int Park(const std::vector<std::pair<ChannelBase*, bool>>& cases, uint64_t deadline);
+
+  /**
+   * @brief 计算截止时间
+   */
+  static uint64_t Deadline(uint64_t timeout_ms);
+
+  /**
+   * @brief 操作成功后唤醒另一方向上的一个等待者
+   * @param[in] send true唤醒等待可写的协程，false唤醒等待可读的协程
+   * @details 没有等待者时只有一次内存屏障和一次原子读，不加锁
+   */
+  void notify(bool send) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting[send].load(std::memory_order_relaxed) > 0) {
+      wakeOne(send);
+    }
+  }
+
+  /**
+   * @brief 指定方向的操作是否可能立即完成
+   */
+  bool ready(bool send) const {
+    if (isClosed()) {
+      return true;
+    }
+    return send ? size() < m_capacity : size() > 0;
+  }
+
+private:
+  void wakeOne(bool send);
+  void addWaiter(const WaitEntry::ptr& entry, bool send);
+  void removeWaiter(const WaitEntry::ptr& entry, bool send);
+
+protected:
+  /// 容量
+  const size_t m_capacity;
+  /// 写位置，只增不减
+  alignas(64) std::atomic<size_t> m_enqueuePos = {0};
+  /// 读位置，只增不减
+  alignas(64) std::atomic<size_t> m_dequeuePos = {0};
+
+private:
+  /// 是否已关闭
+  alignas(64) std::atomic<bool> m_closed = {false};
+  /// 保护等待队列
+  Spinlock m_mutex;
+  /// 等待队列，[0]等待可读，[1]等待可写
+  std::list<WaitEntry::ptr> m_waiters[2];
+  /// 等待队列长度，fast path无锁读取
+  std::atomic<size_t> m_waiting[2];
+};
+
+/**
+ * @brief 有界通道
+ * @details 缓冲区是一个有界MPMC无锁环形队列，不需要挂起时send/recv不加锁；
+ *          缓冲区满时send挂起当前协程，缓冲区空时recv挂起当前协程，不阻塞线程
+ * @tparam T 元素类型，需要可默认构造和移动赋值
+ */
+template <class T>
+class Channel : public ChannelBase {
+public:
+  using ptr = std::shared_ptr<Channel>;
+
+  /**
+   * @brief 构造函数
+   * @param[in] capacity 容量，至少为1
+   */
+  Channel(size_t capacity)
+    : ChannelBase(capacity)
+    , m_ringSize(std::max<size_t>(capacity, 2))
+    , m_cells(new Cell[m_ringSize]) {
+    for (size_t i = 0; i < m_ringSize; ++i) {
+      m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief 尝试发送，不挂起
+   * @return 通道已满或已关闭时返回false
+   */
+  bool trySend(const T& v) {
+    return trySendImpl(v);
+  }
+
+  /**
+   * @brief 尝试发送，不挂起，失败时v保持不变
+   */
+  bool trySend(T&& v) {
+    return trySendImpl(std::move(v));
+  }
+
+  /**
+   * @brief 发送，通道已满时挂起当前协程
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+   * @return 超时或通道已关闭时返回false
+   */
+  bool send(const T& v, uint64_t timeout_ms = ~0ull) {
+    return sendImpl(v, timeout_ms);
+  }
+
+  /**
+   * @brief 发送，通道已满时挂起当前协程，失败时v保持不变
+   */
+  bool send(T&& v, uint64_t timeout_ms = ~0ull) {
+    return sendImpl(std::move(v), timeout_ms);
+  }
+
+  /**
+   * @brief 尝试接收，不挂起
+   * @return 通道为空时返回false
+   */
+  bool tryRecv(T& v) {
+    if (!pop(v)) {
+      return false;
+    }
+    notify(true);
+    return true;
+  }
+
+  /**
+   * @brief 接收，通道为空时挂起当前协程
+   * @param[out] v 接收到的元素
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+   * @return 超时或者通道已关闭且为空时返回false，可以通过isClosed()区分
+   */
+  bool recv(T& v, uint64_t timeout_ms = ~0ull) {
+    uint64_t deadline = Deadline(timeout_ms);
+    while (true) {
+      if (tryRecv(v)) {
+        return true;
+      }
+      if (isClosed()) {
+        // 关闭前完成的send需要被取走
+        return tryRecv(v);
+      }
+      // 等待列表只在需要挂起时构造，无竞争的快速路径不分配内存
+      if (Park({{this, false}}, deadline) == -1) {
+        return tryRecv(v);
+      }
+    }
+  }
+
+private:
+  template <class U>
+  bool trySendImpl(U&& v) {
+    if (isClosed() || !push(std::forward<U>(v))) {
+      return false;
+    }
+    notify(false);
+    return true;
+  }
+
+  template <class U>
+  bool sendImpl(U&& v, uint64_t timeout_ms) {
+    uint64_t deadline = Deadline(timeout_ms);
+    while (true) {
+      if (isClosed()) {
+        return false;
+      }
+      if (trySendImpl(std::forward<U>(v))) {
+        return true;
+      }
+      if (Park({{this, true}}, deadline) == -1) {
+        return trySendImpl(std::forward<U>(v));
+      }
+    }
+  }
+
+  /**
+   * @brief 入队，只有抢到位置后才移动v
+   */
+  template <class U>
+  bool push(U&& v) {
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &m_cells[pos % m_ringSize];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (m_ringSize != m_capacity &&
+            pos - m_dequeuePos.load(std::memory_order_acquire) >= m_capacity) {
+          return false;
+        }
+        if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::forward<U>(v);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& v) {
+    size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &m_cells[pos % m_ringSize];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+    v = std::move(cell->data);
+    cell->data = T();
+    cell->seq.store(pos + m_ringSize, std::memory_order_release);
+    return true;
+  }
+
+private:
+  /**
+   * @brief 环形队列的槽位
+   * @details seq等于写位置时可写，等于写位置+1时可读
+   */
+  struct Cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  /// 槽位数，容量为1时槽位的可读和下一轮可写的seq会重合，至少需要2个槽位，由push额外限制容量
+  const size_t m_ringSize;
+  std::unique_ptr<Cell[]> m_cells;
+};
+
+/**
+ * @brief 在多个通道上同时等待
+ * @details 按添加顺序检查，第一个就绪的分支被执行；都未就绪时挂起当前协程，任意一个通道就绪后被唤醒。
+ *          已关闭的通道上的分支视为就绪，ok返回false
+ * @code
+ *   int a;
+ *   std::string b;
+ *   bool ok;
+ *   sylar::ChannelSelect sel;
+ *   sel.recv(ch_a, a, &ok).recv(ch_b, b);
+ *   int idx = sel.wait(100);
+ * @endcode
+ */
+class ChannelSelect {
+public:
+  /**
+   * @brief 添加接收分支
+   * @param[in] ch 通道
+   * @param[out] v 接收到的元素
+   * @param[out] ok 是否接收成功，通道关闭时为false
+   */
+  template <class T>
+  ChannelSelect& recv(Channel<T>& ch, T& v, bool* ok = nullptr) {
+    m_cases.push_back({&ch, false, [&ch, &v, ok]() {
+                         bool rt = ch.tryRecv(v);
+                         if (!rt && ch.isClosed()) {
+                           rt = ch.tryRecv(v);
+                           if (ok) {
+                             *ok = rt;
+                           }
+                           return true;
+                         }
+                         if (rt && ok) {
+                           *ok = true;
+                         }
+                         return rt;
+                       }});
+    return *this;
+  }
+
+  /**
+   * @brief 添加发送分支
+   * @param[in] ch 通道
+   * @param[in] v 要发送的元素，只有该分支被选中时才会发送
+   * @param[out] ok 是否发送成功，通道关闭时为false
+   */
+  template <class T>
+  ChannelSelect& send(Channel<T>& ch, const T& v, bool* ok = nullptr) {
+    m_cases.push_back({&ch, true, [&ch, v, ok]() {
+                         if (ch.isClosed()) {
+                           if (ok) {
+                             *ok = false;
+                           }
+                           return true;
+                         }
+                         bool rt = ch.trySend(v);
+                         if (rt && ok) {
+                           *ok = true;
+                         }
+                         return rt;
+                       }});
+    return *this;
+  }
+
+  /**
+   * @brief 等待任意一个分支完成
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时，0表示不挂起
+   * @return 完成的分支下标，超时返回-1
+   */
+  int wait(uint64_t timeout_ms = ~0ull);
+
+  /**
+   * @brief 尝试执行任意一个就绪的分支，不挂起
+   * @return 完成的分支下标，都未就绪返回-1
+   */
+  int trySelect() {
+    return wait(0);
+  }
+
+private:
+  struct Case {
+    ChannelBase* channel;
+    bool send;
+    std::function<bool()> op;
+  };
+
+  /**
+   * @brief 按顺序尝试所有分支，hint优先
+   */
+  int tryCases(int hint);
+
+private:
+  std::vector<Case> m_cases;
+};
+
+}   // namespace sylar
+
+#endif
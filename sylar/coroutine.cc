@@ -0,0 +1,160 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 09:12:40
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 09:12:40
+ * @FilePath: /sylar_from_nanasaki/sylar/coroutine.cc
+ */
+#ifdef SYLAR_COROUTINE
+
+#include "coroutine.h"
+#include "fd_manager.h"
+#include "hook.h"
+#include "log.h"
+#include <errno.h>
+
+namespace sylar {
+namespace co {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+void SleepAwaiter::await_suspend(std::coroutine_handle<> h) {
+  if (!m_tm) {
+    m_tm = FutureStateBase::GetTimerManager();
+  }
+  m_tm->addTimer(m_ms, [h]() { h.resume(); });
+}
+
+SleepAwaiter Sleep(uint64_t ms, TimerManager* tm) {
+  return SleepAwaiter(ms, tm);
+}
+
+bool EventAwaiter::await_suspend(std::coroutine_handle<> h) {
+  IOManager* iom = IOManager::GetThis();
+  SYLAR_ASSERT2(iom, "co_await WaitEvent must be called in IOManager");
+  m_cancelled = std::make_shared<int>(0);
+  if (m_timeoutMs != ~0ull) {
+    std::weak_ptr<int> weak_cancelled(m_cancelled);
+    int fd = m_fd;
+    IOManager::Event event = m_event;
+    m_timer = iom->addConditionTimer(
+      m_timeoutMs,
+      [weak_cancelled, fd, iom, event]() {
+        auto cancelled = weak_cancelled.lock();
+        if (!cancelled || *cancelled) {
+          return;
+        }
+        *cancelled = ETIMEDOUT;
+        iom->cancelEvent(fd, event);
+      },
+      weak_cancelled);
+  }
+  if (iom->addEvent(m_fd, m_event, [h]() { h.resume(); })) {
+    m_error = errno ? errno : EINVAL;
+    SYLAR_LOG_ERROR(g_logger) << "co::WaitEvent addEvent(" << m_fd << ", " << m_event << ")";
+    return false;
+  }
+  // 事件可能已经在其他线程上触发并恢复了协程，之后不能再访问成员
+  return true;
+}
+
+int EventAwaiter::await_resume() {
+  if (m_timer) {
+    m_timer->cancel();
+  }
+  if (m_error) {
+    errno = m_error;
+    return -1;
+  }
+  if (*m_cancelled) {
+    errno = *m_cancelled;
+    return -1;
+  }
+  return 0;
+}
+
+EventAwaiter WaitEvent(int fd, IOManager::Event event, uint64_t timeout_ms) {
+  return EventAwaiter(fd, event, timeout_ms);
+}
+
+/**
+ * @brief 通用的非阻塞IO，EAGAIN时等待事件后重试，同hook中的do_io
+ * @param[in] fun 调用原始(未hook的)系统调用
+ */
+template <class Func>
+static Task<ssize_t> DoIo(int fd, IOManager::Event event, int timeout_so, uint64_t timeout_ms,
+                          Func fun) {
+  // 确保socket是非阻塞的
+  FdCtx::ptr ctx = FdMgr::GetInstance()->get(fd, true);
+  if (ctx && ctx->isClose()) {
+    errno = EBADF;
+    co_return -1;
+  }
+  if (timeout_ms == ~0ull && ctx) {
+    timeout_ms = ctx->getTimeout(timeout_so);
+  }
+  while (true) {
+    ssize_t n = fun();
+    while (n == -1 && errno == EINTR) {
+      n = fun();
+    }
+    if (n != -1 || errno != EAGAIN) {
+      co_return n;
+    }
+    if (co_await WaitEvent(fd, event, timeout_ms)) {
+      co_return -1;
+    }
+  }
+}
+
+Task<ssize_t> Read(int fd, void* buf, size_t len, uint64_t timeout_ms) {
+  co_return co_await DoIo(fd, IOManager::READ, SO_RCVTIMEO, timeout_ms,
+                          [fd, buf, len]() { return read_f(fd, buf, len); });
+}
+
+Task<ssize_t> Write(int fd, const void* buf, size_t len, uint64_t timeout_ms) {
+  co_return co_await DoIo(fd, IOManager::WRITE, SO_SNDTIMEO, timeout_ms,
+                          [fd, buf, len]() { return write_f(fd, buf, len); });
+}
+
+Task<int> Accept(int fd, sockaddr* addr, socklen_t* addrlen, uint64_t timeout_ms) {
+  int rt = co_await DoIo(fd, IOManager::READ, SO_RCVTIMEO, timeout_ms, [fd, addr, addrlen]() {
+    return (ssize_t)accept_f(fd, addr, addrlen);
+  });
+  if (rt >= 0) {
+    FdMgr::GetInstance()->create(rt);
+  }
+  co_return rt;
+}
+
+Task<int> Connect(int fd, const sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) {
+  FdCtx::ptr ctx = FdMgr::GetInstance()->get(fd, true);
+  if (ctx && ctx->isClose()) {
+    errno = EBADF;
+    co_return -1;
+  }
+  int n = connect_f(fd, addr, addrlen);
+  if (n == 0) {
+    co_return 0;
+  } else if (n != -1 || errno != EINPROGRESS) {
+    co_return n;
+  }
+  if (co_await WaitEvent(fd, IOManager::WRITE, timeout_ms)) {
+    co_return -1;
+  }
+  int error = 0;
+  socklen_t len = sizeof(int);
+  if (-1 == getsockopt_f(fd, SOL_SOCKET, SO_ERROR, &error, &len)) {
+    co_return -1;
+  }
+  if (error) {
+    errno = error;
+    co_return -1;
+  }
+  co_return 0;
+}
+
+}   // namespace co
+}   // namespace sylar
+
+#endif
@@ -0,0 +1,424 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 09:12:40
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 09:12:40
+ * @FilePath: /sylar_from_nanasaki/sylar/coroutine.h
+ */
+#ifndef __SYLAR_COROUTINE_H__
+#define __SYLAR_COROUTINE_H__
+
+#ifndef SYLAR_COROUTINE
+#error "sylar/coroutine.h requires C++20, configure with -DSYLAR_COROUTINE=ON"
+#endif
+
+#include "future.h"
+#include "iomanager.h"
+#include "macro.h"
+#include "noncopyable.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <sys/socket.h>
+#include <type_traits>
+
+/**
+ * @brief 基于C++20 co_await的无栈协程
+ * @details 与有栈的Fiber共用IOManager：IO事件和定时器到期后，在回调协程上resume挂起的协程，
+ *          挂起期间协程只占用自己的帧，不占用栈，适合大量并发的扇出请求。
+ *          协程中应使用这里的Read/Write等接口等待IO，调用hook后的阻塞函数会挂起执行它的回调协程。
+ *          与hook相同，fd的状态记录在FdManager中，fd应在hook开启的线程上关闭
+ */
+namespace sylar {
+namespace co {
+
+template <class T = void>
+class Task;
+
+namespace detail {
+
+/**
+ * @brief Task的promise中与返回值无关的部分
+ */
+struct PromiseBase {
+  /**
+   * @brief 协程结束时恢复等待它的协程
+   */
+  struct FinalAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    template <class Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+      std::coroutine_handle<> continuation = h.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {
+    }
+  };
+
+  /// 惰性启动，co_await或Spawn时才开始执行
+  std::suspend_always initial_suspend() const noexcept {
+    return {};
+  }
+
+  FinalAwaiter final_suspend() const noexcept {
+    return {};
+  }
+
+  void unhandled_exception() noexcept {
+    exception = std::current_exception();
+  }
+
+  /// co_await该任务的协程
+  std::coroutine_handle<> continuation;
+  /// 协程抛出的异常
+  std::exception_ptr exception;
+};
+
+template <class T>
+struct TaskPromise : PromiseBase {
+  Task<T> get_return_object() noexcept;
+
+  template <class U>
+  void return_value(U&& v) {
+    value.emplace(std::forward<U>(v));
+  }
+
+  /**
+   * @brief 取出结果，有异常时重新抛出
+   */
+  T result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return std::move(*value);
+  }
+
+  std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : PromiseBase {
+  Task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {
+  }
+
+  void result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+};
+
+}   // namespace detail
+
+/**
+ * @brief 无栈协程任务
+ * @details 协程函数返回Task<T>，调用后不立即执行，被co_await时开始执行并在结束后恢复等待方，
+ *          或者通过Spawn放到调度器上执行。Task独占协程帧，析构时销毁
+ */
+template <class T>
+class Task : Noncopyable {
+public:
+  using promise_type = detail::TaskPromise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  Task(Task&& rhs) noexcept
+    : m_handle(rhs.m_handle) {
+    rhs.m_handle = nullptr;
+  }
+
+  Task& operator=(Task&& rhs) noexcept {
+    if (this != &rhs) {
+      if (m_handle) {
+        m_handle.destroy();
+      }
+      m_handle = rhs.m_handle;
+      rhs.m_handle = nullptr;
+    }
+    return *this;
+  }
+
+  ~Task() {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  /**
+   * @brief 是否关联了协程
+   */
+  bool valid() const {
+    return m_handle != nullptr;
+  }
+
+  /**
+   * @brief 协程是否已经执行完
+   */
+  bool done() const {
+    return m_handle.done();
+  }
+
+  /**
+   * @brief 开始执行任务，当前协程挂起直到任务结束
+   * @return 任务的返回值，任务抛出的异常在这里重新抛出
+   */
+  auto operator co_await() noexcept {
+    struct Awaiter {
+      handle_type handle;
+
+      bool await_ready() const noexcept {
+        return handle.done();
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+      }
+
+      T await_resume() {
+        return handle.promise().result();
+      }
+    };
+    SYLAR_ASSERT2(m_handle, "co_await invalid task");
+    return Awaiter{m_handle};
+  }
+
+private:
+  friend struct detail::TaskPromise<T>;
+
+  explicit Task(handle_type h)
+    : m_handle(h) {
+  }
+
+private:
+  handle_type m_handle;
+};
+
+namespace detail {
+
+template <class T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+/**
+ * @brief Spawn使用的自行销毁的顶层协程
+ */
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept {
+      return Detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    /// 创建后挂起，由调度器resume
+    std::suspend_always initial_suspend() const noexcept {
+      return {};
+    }
+
+    /// 结束时自动销毁协程帧
+    std::suspend_never final_suspend() const noexcept {
+      return {};
+    }
+
+    void return_void() noexcept {
+    }
+
+    /// 异常已经在协程体内交给了Promise
+    void unhandled_exception() noexcept {
+      std::terminate();
+    }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+template <class T>
+Detached RunDetached(Task<T> task, Promise<T> promise) {
+  try {
+    if constexpr (std::is_void<T>::value) {
+      co_await task;
+      promise.setValue();
+    } else {
+      promise.setValue(co_await task);
+    }
+  } catch (...) {
+    promise.setException(std::current_exception());
+  }
+}
+
+}   // namespace detail
+
+/**
+ * @brief 在调度器上启动任务
+ * @param[in] sc 执行任务的调度器
+ * @param[in] task 任务
+ * @return 任务结果的Future，协程中可以co_await Await(future)，有栈协程中可以直接get
+ */
+template <class T>
+Future<T> Spawn(Scheduler* sc, Task<T> task) {
+  Promise<T> promise;
+  Future<T> future = promise.getFuture();
+  auto handle = detail::RunDetached(std::move(task), std::move(promise)).handle;
+  sc->schedule([handle]() { handle.resume(); });
+  return future;
+}
+
+/**
+ * @brief 等待Future的结果
+ * @details 挂起时记录当前线程的调度器，结果就绪后在该调度器上恢复
+ */
+template <class T>
+class FutureAwaiter {
+public:
+  explicit FutureAwaiter(Future<T> future)
+    : m_future(std::move(future)) {
+  }
+
+  bool await_ready() const {
+    return m_future.isReady();
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    Scheduler* sc = Scheduler::GetThis();
+    m_future.getState()->addCallback([h, sc]() {
+      if (sc) {
+        sc->schedule([h]() { h.resume(); });
+      } else {
+        h.resume();
+      }
+    });
+  }
+
+  /**
+   * @brief 获取结果，结果是异常时抛出
+   */
+  T await_resume() const {
+    return m_future.get();
+  }
+
+private:
+  Future<T> m_future;
+};
+
+/**
+ * @brief co_await Await(future)等待Future的结果，如等待Async交给其他调度器的计算
+ */
+template <class T>
+FutureAwaiter<T> Await(Future<T> future) {
+  return FutureAwaiter<T>(std::move(future));
+}
+
+/**
+ * @brief 等待定时器到期
+ */
+class SleepAwaiter {
+public:
+  SleepAwaiter(uint64_t ms, TimerManager* tm)
+    : m_ms(ms)
+    , m_tm(tm) {
+  }
+
+  bool await_ready() const noexcept {
+    return m_ms == 0;
+  }
+
+  void await_suspend(std::coroutine_handle<> h);
+
+  void await_resume() const noexcept {
+  }
+
+private:
+  uint64_t m_ms;
+  TimerManager* m_tm;
+};
+
+/**
+ * @brief 挂起当前协程ms毫秒
+ * @param[in] ms 毫秒数
+ * @param[in] tm 定时器管理器，nullptr表示当前线程的IOManager
+ */
+SleepAwaiter Sleep(uint64_t ms, TimerManager* tm = nullptr);
+
+/**
+ * @brief 等待fd上的IO事件
+ * @details 通过IOManager::addEvent注册一次性事件，超时通过cancelEvent提前触发
+ */
+class EventAwaiter {
+public:
+  EventAwaiter(int fd, IOManager::Event event, uint64_t timeout_ms)
+    : m_fd(fd)
+    , m_event(event)
+    , m_timeoutMs(timeout_ms) {
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  /**
+   * @return 注册事件失败时返回false，不挂起
+   */
+  bool await_suspend(std::coroutine_handle<> h);
+
+  /**
+   * @return 事件就绪返回0，超时或注册失败返回-1并设置errno
+   */
+  int await_resume();
+
+private:
+  int m_fd;
+  IOManager::Event m_event;
+  uint64_t m_timeoutMs;
+  Timer::ptr m_timer;
+  /// 超时后设置为ETIMEDOUT，定时器通过weak_ptr引用
+  std::shared_ptr<int> m_cancelled;
+  /// 注册事件失败时的errno
+  int m_error = 0;
+};
+
+/**
+ * @brief 等待fd可读或可写
+ * @param[in] fd 文件句柄
+ * @param[in] event IOManager::READ或IOManager::WRITE
+ * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+ */
+EventAwaiter WaitEvent(int fd, IOManager::Event event, uint64_t timeout_ms = ~0ull);
+
+/**
+ * @brief 读数据，语义同read
+ * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示使用socket的接收超时(SO_RCVTIMEO)
+ */
+Task<ssize_t> Read(int fd, void* buf, size_t len, uint64_t timeout_ms = ~0ull);
+
+/**
+ * @brief 写数据，语义同write
+ * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示使用socket的发送超时(SO_SNDTIMEO)
+ */
+Task<ssize_t> Write(int fd, const void* buf, size_t len, uint64_t timeout_ms = ~0ull);
+
+/**
+ * @brief 接受连接，语义同accept，返回的socket为非阻塞
+ * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示使用socket的接收超时(SO_RCVTIMEO)
+ */
+Task<int> Accept(int fd, sockaddr* addr = nullptr, socklen_t* addrlen = nullptr,
+                 uint64_t timeout_ms = ~0ull);
+
+/**
+ * @brief 发起连接，语义同connect
+ * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+ */
+Task<int> Connect(int fd, const sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms = ~0ull);
+
+}   // namespace co
+}   // namespace sylar
+
+#endif
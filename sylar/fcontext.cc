@@ -0,0 +1,149 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 16:20:18
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 16:20:18
+ * @FilePath: /sylar_from_nanasaki/sylar/fcontext.cc
+ */
+#include "fcontext.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifdef SYLAR_HAVE_FCONTEXT
+
+#  if defined(__x86_64__)
+
+/*
+x86_64 System V ABI，被调用者保存寄存器为rbx/rbp/r12-r15，另外还需要保存MXCSR和x87控制字
+切走时在当前栈上压入这些寄存器，然后把rsp保存到*from，再把rsp换成to，弹出寄存器后ret
+
+切走后栈上的布局(从低地址到高地址)
+    +0   MXCSR
+    +4   x87 FPU control word
+    +8   r12
+    +16  r13
+    +24  r14
+    +32  r15
+    +40  rbx
+    +48  rbp
+    +56  返回地址
+*/
+asm(R"(
+.text
+.globl sylar_jump_fcontext
+.type sylar_jump_fcontext,@function
+.align 16
+sylar_jump_fcontext:
+    pushq  %rbp
+    pushq  %rbx
+    pushq  %r15
+    pushq  %r14
+    pushq  %r13
+    pushq  %r12
+    leaq   -0x8(%rsp), %rsp
+    stmxcsr (%rsp)
+    fnstcw 0x4(%rsp)
+    movq   %rsp, (%rdi)
+    movq   %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw  0x4(%rsp)
+    leaq   0x8(%rsp), %rsp
+    popq   %r12
+    popq   %r13
+    popq   %r14
+    popq   %r15
+    popq   %rbx
+    popq   %rbp
+    ret
+.size sylar_jump_fcontext,.-sylar_jump_fcontext
+)");
+
+namespace sylar {
+
+/// 寄存器保存区加上返回地址的大小
+static const size_t CONTEXT_SIZE = 0x40;
+
+fcontext_t make_fcontext(void* stack, size_t size, void (*fn)()) {
+  // 栈顶按16字节对齐，预留一个假的返回地址，使得fn开始执行时满足rsp+8按16字节对齐的约定
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  top -= sizeof(void*);
+  *(void**)top = nullptr;
+
+  uint8_t* sp = (uint8_t*)(top - CONTEXT_SIZE);
+  memset(sp, 0, CONTEXT_SIZE);
+  // MXCSR和x87控制字使用上电默认值
+  *(uint32_t*)sp = 0x1F80;
+  *(uint16_t*)(sp + 4) = 0x037F;
+  *(void**)(sp + 0x38) = (void*)fn;
+  return sp;
+}
+
+}   // namespace sylar
+
+#  elif defined(__aarch64__)
+
+/*
+AArch64 AAPCS64，被调用者保存寄存器为x19-x28、x29(fp)、x30(lr)以及d8-d15
+切走时在当前栈上保存这些寄存器，然后把sp保存到*from，再把sp换成to，恢复寄存器后ret到x30
+
+切走后栈上的布局(从低地址到高地址)
+    +0x00  d8  - d15
+    +0x40  x19 - x28
+    +0x90  x29
+    +0x98  x30
+*/
+asm(R"(
+.text
+.globl sylar_jump_fcontext
+.type sylar_jump_fcontext,%function
+.align 4
+sylar_jump_fcontext:
+    sub  sp, sp, #0xb0
+    stp  d8,  d9,  [sp, #0x00]
+    stp  d10, d11, [sp, #0x10]
+    stp  d12, d13, [sp, #0x20]
+    stp  d14, d15, [sp, #0x30]
+    stp  x19, x20, [sp, #0x40]
+    stp  x21, x22, [sp, #0x50]
+    stp  x23, x24, [sp, #0x60]
+    stp  x25, x26, [sp, #0x70]
+    stp  x27, x28, [sp, #0x80]
+    stp  x29, x30, [sp, #0x90]
+    mov  x9, sp
+    str  x9, [x0]
+    mov  sp, x1
+    ldp  d8,  d9,  [sp, #0x00]
+    ldp  d10, d11, [sp, #0x10]
+    ldp  d12, d13, [sp, #0x20]
+    ldp  d14, d15, [sp, #0x30]
+    ldp  x19, x20, [sp, #0x40]
+    ldp  x21, x22, [sp, #0x50]
+    ldp  x23, x24, [sp, #0x60]
+    ldp  x25, x26, [sp, #0x70]
+    ldp  x27, x28, [sp, #0x80]
+    ldp  x29, x30, [sp, #0x90]
+    add  sp, sp, #0xb0
+    ret
+.size sylar_jump_fcontext,.-sylar_jump_fcontext
+)");
+
+namespace sylar {
+
+/// 寄存器保存区大小
+static const size_t CONTEXT_SIZE = 0xb0;
+
+fcontext_t make_fcontext(void* stack, size_t size, void (*fn)()) {
+  // 栈顶按16字节对齐，恢复寄存器后sp正好回到栈顶
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  uint8_t* sp = (uint8_t*)(top - CONTEXT_SIZE);
+  memset(sp, 0, CONTEXT_SIZE);
+  // 第一次切入时ret到x30，也就是fn，x29为0作为栈回溯的终点
+  *(void**)(sp + 0x98) = (void*)fn;
+  return sp;
+}
+
+}   // namespace sylar
+
+#  endif
+
+#endif
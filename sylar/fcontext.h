@@ -0,0 +1,60 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 16:20:13
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 16:20:13
+ * @FilePath: /sylar_from_nanasaki/sylar/fcontext.h
+ */
+#ifndef __SYLAR_FCONTEXT_H__
+#define __SYLAR_FCONTEXT_H__
+
+#include <stddef.h>
+
+/**
+ * 协程上下文切换后端选择
+ * 默认在x86_64/aarch64上使用汇编实现的上下文切换，只保存被调用者保存寄存器，不涉及信号屏蔽字，没有系统调用
+ * 定义SYLAR_FIBER_UCONTEXT或者在其他平台上时，回退到ucontext的swapcontext
+ */
+#if !defined(SYLAR_FIBER_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#  define SYLAR_FIBER_UCONTEXT
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+/// 当前平台是否有汇编实现的上下文切换
+#  define SYLAR_HAVE_FCONTEXT 1
+#endif
+
+#ifdef SYLAR_HAVE_FCONTEXT
+
+namespace sylar {
+
+/**
+ * @brief 汇编实现的协程上下文
+ * @details 上下文就是切走时的栈顶指针，寄存器都保存在各自的栈上
+ */
+using fcontext_t = void*;
+
+/**
+ * @brief 在一段栈内存上创建上下文
+ * @param[in] stack 栈的低地址
+ * @param[in] size 栈大小
+ * @param[in] fn 上下文第一次被切入时执行的函数，该函数不允许返回
+ * @return 新的上下文
+ */
+fcontext_t make_fcontext(void* stack, size_t size, void (*fn)());
+
+}   // namespace sylar
+
+extern "C" {
+/**
+ * @brief 保存当前上下文到from，并切换到to
+ * @details 作用同swapcontext(from, to)，只保存被调用者保存寄存器和浮点控制字
+ * @param[out] from 保存当前上下文
+ * @param[in] to 要切换到的上下文
+ */
+void sylar_jump_fcontext(sylar::fcontext_t* from, sylar::fcontext_t to);
+}
+
+#endif
+
+#endif
@@ -7,16 +7,22 @@
  */
 #include "fd_manager.h"
 #include "hook.h"
+#include <atomic>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 namespace sylar {
 
+static std::atomic<uint32_t> s_fd_generation = {0};
+
 FdCtx::FdCtx(int fd)
   : m_fd(fd)
   , m_recvTimeout(-1)
   , m_sendTimeout(-1) {
+  do {
+    m_generation = ++s_fd_generation;
+  } while (!m_generation);
   init();
 }
 
@@ -92,6 +98,19 @@ FdCtx::ptr FdManager::get(int fd, bool auto_create /*= false*/) {
   return ctx;
 }
 
+FdCtx::ptr FdManager::create(int fd) {
+  if (fd < 0) {
+    return nullptr;
+  }
+  FdCtx::ptr ctx(new FdCtx(fd));
+  RWMutexType::WriteLock lock(m_mutex);
+  if (fd >= (int)m_datas.size()) {
+    m_datas.resize(fd * 1.5 + 1);
+  }
+  m_datas[fd] = ctx;
+  return ctx;
+}
+
 void FdManager::del(int fd) {
   RWMutexType::WriteLock lock(m_mutex);
   if ((int)m_datas.size() <= fd) {
@@ -55,6 +55,13 @@ public:
     return m_isClosed;
   }
 
+  /**
+   * @brief 标记为已关闭，被唤醒的IO发现后不再重新等待
+   */
+  void setClose() {
+    m_isClosed = true;
+  }
+
   /**
    * @brief 设置用户主动设置非阻塞
    * @param[in] v 是否阻塞
@@ -99,6 +106,14 @@ public:
    */
   uint64_t getTimeout(int type);
 
+  /**
+   * @brief 代数，每创建一个FdCtx加1，从不为0
+   * @details fd号会被复用，代数不同说明是关闭后重新创建的另一个fd
+   */
+  uint32_t getGeneration() const {
+    return m_generation;
+  }
+
 private:
   /**
    * @brief 初始化
@@ -122,6 +137,8 @@ private:
   uint64_t m_recvTimeout;
   /// 写超时时间毫秒
   uint64_t m_sendTimeout;
+  /// 代数
+  uint32_t m_generation;
 };
 
 class FdManager {
@@ -142,6 +159,13 @@ public:
    */
   FdCtx::ptr get(int fd, bool auto_create = false);
 
+  /**
+   * @brief 为新创建的fd建立FdCtx
+   * @details 替换同一个fd号上残留的FdCtx，fd没有经过hook的close关闭时(如未开启hook的线程上关闭)会残留
+   * @param[in] fd 文件句柄
+   */
+  FdCtx::ptr create(int fd);
+
   /**
    * @brief 删除文件句柄类
    * @param[in] fd 文件句柄
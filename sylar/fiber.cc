@@ -7,10 +7,17 @@
  */
 #include "fiber.h"
 #include "config.h"
+#include "fiber_watchdog.h"
 #include "log.h"
 #include "macro.h"
+#include "runtime_stats.h"
 #include "scheduler.h"
+#include "stack_allocator.h"
+#include <algorithm>
 #include <atomic>
+#include <mutex>
+#include <string.h>
+#include <vector>
 
 /*
 上下文结构体定义
@@ -66,20 +73,181 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
   Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
 
+// 协程栈分配器，可选malloc/mmap/pooled，mmap和pooled带保护页
+static ConfigVar<std::string>::ptr g_fiber_stack_allocator = Config::Lookup<std::string>(
+  "fiber.stack_allocator", "malloc", "fiber stack allocator, malloc/mmap/pooled");
+
+// pooled分配器每个线程最多缓存的栈数量
+static ConfigVar<uint32_t>::ptr g_fiber_stack_pool_max =
+  Config::Lookup<uint32_t>("fiber.stack_pool_max", 64, "pooled stack allocator max cached per thread");
+
+// pooled分配器每个线程常驻物理内存的栈数量
+static ConfigVar<uint32_t>::ptr g_fiber_stack_pool_hot =
+  Config::Lookup<uint32_t>("fiber.stack_pool_hot", 8, "pooled stack allocator hot cached per thread");
+
+// mmap和pooled分配器新分配的栈是否优先使用分配线程所在NUMA节点的内存
+static ConfigVar<bool>::ptr g_fiber_stack_numa_local = Config::Lookup<bool>(
+  "fiber.stack_numa_local", false, "allocate fiber stacks on the numa node of the allocating thread");
+
+/// 当前使用的栈分配器，配置变更只影响之后创建的协程
+static std::atomic<StackAllocator*> s_stack_allocator{nullptr};
+
+static StackAllocator* GetStackAllocator() {
+  StackAllocator* alloc = s_stack_allocator.load(std::memory_order_acquire);
+  if (SYLAR_UNLIKELY(!alloc)) {
+    alloc = StackAllocator::GetByName(g_fiber_stack_allocator->getValue());
+    if (!alloc) {
+      alloc = StackAllocator::GetByName("malloc");
+    }
+    s_stack_allocator = alloc;
+  }
+  return alloc;
+}
+
+struct _StackAllocatorIniter {
+  _StackAllocatorIniter() {
+    g_fiber_stack_allocator->addListener(
+      [](const std::string& old_value, const std::string& new_value) {
+        StackAllocator* alloc = StackAllocator::GetByName(new_value);
+        if (!alloc) {
+          SYLAR_LOG_ERROR(g_logger) << "invalid fiber.stack_allocator " << new_value
+                                    << ", keep " << old_value;
+          return;
+        }
+        SYLAR_LOG_INFO(g_logger) << "fiber.stack_allocator changed from " << old_value
+                                 << " to " << new_value;
+        s_stack_allocator = alloc;
+      });
+
+    auto pooled = static_cast<PooledStackAllocator*>(StackAllocator::GetByName("pooled"));
+    pooled->setMaxCached(g_fiber_stack_pool_max->getValue());
+    pooled->setHotCached(g_fiber_stack_pool_hot->getValue());
+    g_fiber_stack_pool_max->addListener([pooled](const uint32_t&, const uint32_t& new_value) {
+      pooled->setMaxCached(new_value);
+    });
+    g_fiber_stack_pool_hot->addListener([pooled](const uint32_t&, const uint32_t& new_value) {
+      pooled->setHotCached(new_value);
+    });
+
+    auto mmap = static_cast<MmapStackAllocator*>(StackAllocator::GetByName("mmap"));
+    mmap->setNumaLocal(g_fiber_stack_numa_local->getValue());
+    pooled->setNumaLocal(g_fiber_stack_numa_local->getValue());
+    g_fiber_stack_numa_local->addListener([mmap, pooled](const bool&, const bool& new_value) {
+      mmap->setNumaLocal(new_value);
+      pooled->setNumaLocal(new_value);
+    });
+  }
+};
+
+static _StackAllocatorIniter s_stack_allocator_initer;
+
+// 共享栈大小，共享栈模式下协程实际可用的最大栈空间
+static ConfigVar<uint32_t>::ptr g_fiber_shared_stack_size = Config::Lookup<uint32_t>(
+  "fiber.shared_stack_size", 1024 * 1024, "fiber shared stack size");
+
+// 每个线程的共享栈数量，越多则协程换入换出时拷贝栈的概率越低
+static ConfigVar<uint32_t>::ptr g_fiber_shared_stack_count = Config::Lookup<uint32_t>(
+  "fiber.shared_stack_count", 4, "fiber shared stack count per thread");
+
 /**
- * @brief malloc栈内存分配器
+ * @brief 共享栈
  */
-class MallocStackAllocator {
-public:
-  static void* Alloc(size_t size) {
-    return malloc(size);
+struct SharedStack {
+  /// 栈的低地址
+  void* stack = nullptr;
+  /// 栈大小
+  size_t size = 0;
+  /// 当前占用该栈的协程，栈上保存的是该协程的内容
+  Fiber* occupant = nullptr;
+};
+
+namespace {
+
+/**
+ * @brief 线程局部的共享栈池
+ * @details 第一次使用时按配置创建，线程退出时释放。共享栈使用mmap分配，带保护页，且只有被用到的页才占用物理内存
+ */
+struct SharedStackPool {
+  ~SharedStackPool() {
+    StackAllocator* alloc = StackAllocator::GetByName("mmap");
+    for (auto& i : stacks) {
+      alloc->dealloc(i.stack, i.size);
+    }
   }
-  static void Dealloc(void* vp, size_t size) {
-    return free(vp);
+
+  /**
+   * @brief 获取一个共享栈，优先选择没有被占用的栈，否则轮流分配
+   */
+  SharedStack* get() {
+    if (stacks.empty()) {
+      StackAllocator* alloc = StackAllocator::GetByName("mmap");
+      size_t count = std::max<uint32_t>(g_fiber_shared_stack_count->getValue(), 1);
+      stacks.resize(count);
+      for (auto& i : stacks) {
+        i.size = g_fiber_shared_stack_size->getValue();
+        i.stack = alloc->alloc(i.size);
+        SYLAR_ASSERT2(i.stack, "alloc shared stack");
+      }
+    }
+    for (auto& i : stacks) {
+      if (!i.occupant) {
+        return &i;
+      }
+    }
+    return &stacks[next++ % stacks.size()];
+  }
+
+  std::vector<SharedStack> stacks;
+  size_t next = 0;
+};
+
+static thread_local SharedStackPool t_shared_stacks;
+
+/**
+ * @brief 线程局部的协程缓存，保存已结束、可以reset复用的协程，线程退出时释放
+ */
+struct FiberPool {
+  /// 独立栈协程
+  std::vector<Fiber::ptr> fibers;
+  /// 共享栈协程
+  std::vector<Fiber::ptr> shared;
+};
+
+static thread_local FiberPool t_fiber_pool;
+
+}   // namespace
+
+// 每个线程最多缓存的已结束协程数量，0表示不缓存
+static ConfigVar<uint32_t>::ptr g_fiber_pool_max =
+  Config::Lookup<uint32_t>("fiber.pool_max", 32, "terminated fibers cached per thread for reuse");
+
+// 线程空闲时保留的缓存协程数量
+static ConfigVar<uint32_t>::ptr g_fiber_pool_idle =
+  Config::Lookup<uint32_t>("fiber.pool_idle", 4, "cached fibers kept per thread when idle");
+
+/// 以下配置在调度热路径上读取，缓存一份避免每次加读锁
+static std::atomic<uint32_t> s_fiber_pool_max{32};
+static std::atomic<uint32_t> s_fiber_pool_idle{4};
+static std::atomic<uint32_t> s_fiber_stack_size{128 * 1024};
+
+struct _FiberPoolIniter {
+  _FiberPoolIniter() {
+    s_fiber_pool_max = g_fiber_pool_max->getValue();
+    s_fiber_pool_idle = g_fiber_pool_idle->getValue();
+    s_fiber_stack_size = g_fiber_stack_size->getValue();
+    g_fiber_pool_max->addListener([](const uint32_t&, const uint32_t& new_value) {
+      s_fiber_pool_max = new_value;
+    });
+    g_fiber_pool_idle->addListener([](const uint32_t&, const uint32_t& new_value) {
+      s_fiber_pool_idle = new_value;
+    });
+    g_fiber_stack_size->addListener([](const uint32_t&, const uint32_t& new_value) {
+      s_fiber_stack_size = new_value;
+    });
   }
 };
 
-using StackAllocator = MallocStackAllocator;
+static _FiberPoolIniter s_fiber_pool_initer;
 
 uint64_t Fiber::GetFiberId() {
   if (t_fiber) {
@@ -92,11 +260,16 @@ Fiber::Fiber() {
   SetThis(this);
   m_state = RUNNING;
 
+#ifdef SYLAR_FIBER_UCONTEXT
   if (getcontext(&m_ctx)) {
     SYLAR_ASSERT2(false, "getcontext");
   }
+#endif
 
   ++s_fiber_count;
+  if (RuntimeStats::IsEnabled()) {
+    RuntimeStats::ThreadStats::Add(RuntimeStats::GetThis()->fibersCreated);
+  }
   m_id = s_fiber_id++;   // 协程id从0开始，用完加1
 
   SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber() main id = " << m_id;
@@ -123,23 +296,35 @@ Fiber::ptr Fiber::GetThis() {
 /**
  * 带参数的构造函数用于创建其他协程，需要分配栈
  */
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
+Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler, bool shared_stack)
   : m_id(s_fiber_id++)
   , m_cb(cb)
   , m_runInScheduler(run_in_scheduler) {
   ++s_fiber_count;
-  m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
-  m_stack = StackAllocator::Alloc(m_stacksize);
-
-  if (getcontext(&m_ctx)) {
-    SYLAR_ASSERT2(false, "getcontext");
+  if (RuntimeStats::IsEnabled()) {
+    RuntimeStats::ThreadStats::Add(RuntimeStats::GetThis()->fibersCreated);
   }
+#ifdef SYLAR_FIBER_UCONTEXT
+  if (shared_stack) {
+    static std::once_flag s_warn_once;
+    std::call_once(s_warn_once, []() {
+      SYLAR_LOG_WARN(g_logger) << "shared stack is not supported with ucontext, use private stack";
+    });
+    shared_stack = false;
+  }
+#endif
+  m_shared = shared_stack;
+  if (m_shared) {
+    // 共享栈在第一次resume时才绑定，上下文也推迟到那时创建
+    m_stacksize = g_fiber_shared_stack_size->getValue();
+  } else {
+    m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
+    m_allocator = GetStackAllocator();
+    m_stack = m_allocator->alloc(m_stacksize);
+    SYLAR_ASSERT2(m_stack, "alloc fiber stack");
 
-  m_ctx.uc_link = nullptr;
-  m_ctx.uc_stack.ss_sp = m_stack;
-  m_ctx.uc_stack.ss_size = m_stacksize;
-
-  makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    makeContext();
+  }
 
   SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber() id = " << m_id;
 }
@@ -150,10 +335,22 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
 Fiber::~Fiber() {
   SYLAR_LOG_DEBUG(g_logger) << "Fiber::~Fiber() id = " << m_id;
   --s_fiber_count;
-  if (m_stack) {
+  if (RuntimeStats::IsEnabled()) {
+    RuntimeStats::ThreadStats::Add(RuntimeStats::GetThis()->fibersDestroyed);
+  }
+  // 子协程结束时已经释放过，这里释放的是线程主协程的局部存储
+  clearLocals();
+  if (m_watchSlot) {
+    FiberWatchdog::Unregister(this);
+  }
+  if (m_shared) {
+    // 共享栈协程结束时已经让出了共享栈，只需要释放保存栈内容的内存
+    SYLAR_ASSERT(m_state == TERM);
+    free(m_savedStack);
+  } else if (m_stack) {
     // 有栈，说明是子协程，需要确保子协程一定是结束状态
     SYLAR_ASSERT(m_state == TERM);
-    StackAllocator::Dealloc(m_stack, m_stacksize);
+    m_allocator->dealloc(m_stack, m_stacksize);
     SYLAR_LOG_DEBUG(g_logger) << "dealloc stack, id = " << m_id;
   } else {
     // 没有栈，说明是线程的主协程
@@ -171,9 +368,27 @@ Fiber::~Fiber() {
  * 这里为了简化状态管理，强制只有TERM状态的协程才可以重置，但其实刚创建好但没执行过的协程也应该允许重置的
  */
 void Fiber::reset(std::function<void()> cb) {
-  SYLAR_ASSERT(m_stack);
+  SYLAR_ASSERT(m_stack || m_shared);
   SYLAR_ASSERT(m_state == TERM);
   m_cb = cb;
+  m_priority = NORMAL;
+  // 从缓存中复用的协程不能看到上一个任务留下的局部存储
+  clearLocals();
+  m_runUs.store(0, std::memory_order_relaxed);
+  m_switches.store(0, std::memory_order_relaxed);
+  if (m_shared) {
+    // 下次resume时重新绑定共享栈
+    m_sharedStack = nullptr;
+    m_stackThread = -1;
+    m_savedSize = 0;
+  } else {
+    makeContext();
+  }
+  m_state = READY;
+}
+
+void Fiber::makeContext() {
+#ifdef SYLAR_FIBER_UCONTEXT
   if (getcontext(&m_ctx)) {
     SYLAR_ASSERT2(false, "getcontext");
   }
@@ -183,47 +398,180 @@ void Fiber::reset(std::function<void()> cb) {
   m_ctx.uc_stack.ss_size = m_stacksize;
 
   makecontext(&m_ctx, &Fiber::MainFunc, 0);
-  m_state = READY;
+#else
+  m_ctx = make_fcontext(m_stack, m_stacksize, &Fiber::MainFunc);
+#endif
+}
+
+void Fiber::SwapContext(Fiber* from, Fiber* to) {
+#ifdef SYLAR_FIBER_UCONTEXT
+  if (swapcontext(&from->m_ctx, &to->m_ctx)) {
+    SYLAR_ASSERT2(false, "swapcontext");
+  }
+#else
+  sylar_jump_fcontext(&from->m_ctx, to->m_ctx);
+#endif
+}
+
+void Fiber::prepareSharedStack() {
+#ifndef SYLAR_FIBER_UCONTEXT
+  if (!m_sharedStack) {
+    m_sharedStack = t_shared_stacks.get();
+    m_stackThread = sylar::util::GetThreadId();
+  }
+  SYLAR_ASSERT2(m_stackThread == sylar::util::GetThreadId(),
+                "shared stack fiber resumed on another thread, id = " << m_id);
+
+  SharedStack* ss = m_sharedStack;
+  if (ss->occupant == this) {
+    return;
+  }
+  // 当前正在运行的协程不能和目标协程在同一个共享栈上，否则换入时会覆盖正在使用的栈
+  SYLAR_ASSERT2(!t_fiber || t_fiber->m_sharedStack != ss,
+                "resume fiber on the running shared stack, id = " << m_id);
+  if (ss->occupant) {
+    ss->occupant->saveSharedStack();
+  }
+  ss->occupant = this;
+
+  if (m_savedSize) {
+    memcpy((char*)ss->stack + ss->size - m_savedSize, m_savedStack, m_savedSize);
+    m_savedSize = 0;
+  } else {
+    m_ctx = make_fcontext(ss->stack, ss->size, &Fiber::MainFunc);
+  }
+#endif
+}
+
+void Fiber::saveSharedStack() {
+#ifndef SYLAR_FIBER_UCONTEXT
+  // 切出时的栈顶就是保存的上下文，只需要拷贝栈顶到栈底之间已使用的部分
+  char* sp = (char*)m_ctx;
+  char* top = (char*)m_sharedStack->stack + m_sharedStack->size;
+  size_t used = top - sp;
+  if (used > m_savedCap || used < m_savedCap / 2) {
+    free(m_savedStack);
+    m_savedStack = (char*)malloc(used);
+    SYLAR_ASSERT2(m_savedStack, "alloc saved stack");
+    m_savedCap = used;
+  }
+  memcpy(m_savedStack, sp, used);
+  m_savedSize = used;
+#endif
 }
 
 void Fiber::resume() {
   SYLAR_ASSERT(m_state != TERM && m_state != RUNNING);
+  if (m_shared) {
+    prepareSharedStack();
+  }
+  uint64_t begin = 0;
+  FiberWatchdog::Running prev;
+  if (m_accounting && FiberWatchdog::IsAccounting()) {
+    begin = sylar::util::GetElapsedUS();
+    m_resumeAt.store(begin, std::memory_order_relaxed);
+    prev = FiberWatchdog::OnResume(this, begin);
+  }
   SetThis(this);
   m_state = RUNNING;
 
   // 如果协程参与调度器调度，那么应该和调度器的主协程进行swap，而不是线程主协程
   if (m_runInScheduler) {
-    if (swapcontext(&(Scheduler::GetMainFiber()->m_ctx), &m_ctx)) {
-      SYLAR_ASSERT2(false, "swapcontext");
-    }
+    SwapContext(Scheduler::GetMainFiber(), this);
   } else {
-    if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx)) {
-      SYLAR_ASSERT2(false, "swapcontext");
-    }
+    SwapContext(t_thread_fiber.get(), this);
+  }
+
+  // 标记为READY之前只有本线程能访问协程，统计不需要原子读改写
+  if (begin) {
+    uint64_t now = sylar::util::GetElapsedUS();
+    m_runUs.store(m_runUs.load(std::memory_order_relaxed) + (now > begin ? now - begin : 0),
+                  std::memory_order_relaxed);
+    m_switches.store(m_switches.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_resumeAt.store(0, std::memory_order_relaxed);
+    FiberWatchdog::OnYield(prev);
   }
+
+  // 回到这里时协程的上下文已经保存完毕，此时才能标记为READY，否则其他线程可能resume一个还未保存完的上下文
+  State expected = RUNNING;
+  m_state.compare_exchange_strong(expected, READY, std::memory_order_release);
 }
 
 void Fiber::yield() {
   /// 协程运行完之后会自动yield一次，用于回到主协程，此时状态已为结束状态
   SYLAR_ASSERT(m_state == RUNNING || m_state == TERM);
-  if (m_state != TERM) {
-    m_state = READY;
+  if (m_state == RUNNING && (m_stack || m_sharedStack) && RuntimeStats::IsEnabled()) {
+    // 挂起时栈上保留的字节数，本函数的栈帧近似为栈顶
+    char* top = m_sharedStack ? (char*)m_sharedStack->stack + m_sharedStack->size
+                              : (char*)m_stack + m_stacksize;
+    RuntimeStats::GetThis()->addStackUsage(top - (char*)__builtin_frame_address(0));
+  }
+  if (m_state == TERM && m_sharedStack) {
+    // 结束的协程不需要再保存栈内容，直接让出共享栈
+    m_sharedStack->occupant = nullptr;
+    free(m_savedStack);
+    m_savedStack = nullptr;
+    m_savedCap = 0;
   }
 
   // 如果协程参与调度器调度，那么应该和调度器的主协程进行swap，而不是线程主协程
   if (m_runInScheduler) {
     SetThis(Scheduler::GetMainFiber());
-    if (swapcontext(&m_ctx, &(Scheduler::GetMainFiber()->m_ctx))) {
-      SYLAR_ASSERT2(false, "swapcontext");
-    }
+    SwapContext(this, Scheduler::GetMainFiber());
   } else {
     SetThis(t_thread_fiber.get());
-    if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx))) {
-      SYLAR_ASSERT2(false, "swapcontext");
+    SwapContext(this, t_thread_fiber.get());
+  }
+}
+
+Fiber::ptr Fiber::Acquire(std::function<void()> cb, bool shared_stack) {
+#ifdef SYLAR_FIBER_UCONTEXT
+  // ucontext后端的共享栈协程退化为独立栈，缓存在独立栈协程中
+  auto& pool = t_fiber_pool.fibers;
+#else
+  auto& pool = shared_stack ? t_fiber_pool.shared : t_fiber_pool.fibers;
+#endif
+  if (!pool.empty()) {
+    Fiber::ptr fiber = std::move(pool.back());
+    pool.pop_back();
+    fiber->reset(std::move(cb));
+    return fiber;
+  }
+  return Fiber::ptr(new Fiber(std::move(cb), 0, true, shared_stack));
+}
+
+void Fiber::Recycle(Fiber::ptr& fiber) {
+  // 中途yield的协程被等待方持有，引用计数大于1，不能复用
+  if (fiber && fiber->m_state == TERM && fiber->m_runInScheduler && fiber.use_count() == 1) {
+    auto& pool = fiber->m_shared ? t_fiber_pool.shared : t_fiber_pool.fibers;
+    // 栈大小或分配器配置变更之后，旧协程不再复用
+    bool match = fiber->m_shared || (fiber->m_stacksize == s_fiber_stack_size &&
+                                     fiber->m_allocator == GetStackAllocator());
+    if (match && pool.size() < s_fiber_pool_max) {
+      pool.push_back(std::move(fiber));
+    }
+  }
+  fiber.reset();
+}
+
+void Fiber::TrimPool() {
+  size_t keep = s_fiber_pool_idle;
+  for (auto pool : {&t_fiber_pool.fibers, &t_fiber_pool.shared}) {
+    if (pool->size() > keep) {
+      pool->resize(keep);
     }
   }
 }
 
+void Fiber::ClearPool() {
+  t_fiber_pool.fibers.clear();
+  t_fiber_pool.shared.clear();
+}
+
+size_t Fiber::PooledFibers() {
+  return t_fiber_pool.fibers.size() + t_fiber_pool.shared.size();
+}
+
 /**
  * 这里没有处理协程函数出现异常的情况，同样是为了简化状态管理，并且个人认为协程的异常不应该由框架处理，应该由开发者自行处理
  */
@@ -233,6 +581,8 @@ void Fiber::MainFunc() {
 
   cur->m_cb();
   cur->m_cb = nullptr;
+  // 在协程自己的栈上释放局部存储，析构函数里仍然可以使用协程相关的接口
+  cur->clearLocals();
   cur->m_state = TERM;
 
   auto raw_ptr = cur.get();   // 手动让t_fiber的引用计数减1
@@ -240,4 +590,54 @@ void Fiber::MainFunc() {
   raw_ptr->yield();
 }
 
-}   // namespace sylar
\ No newline at end of file
+static std::atomic<size_t> s_fiber_local_count{0};
+
+size_t Fiber::AllocLocalIndex() {
+  return s_fiber_local_count++;
+}
+
+void* Fiber::GetLocal(size_t index) {
+  Fiber* cur = t_fiber ? t_fiber : GetThis().get();
+  if (index >= cur->m_locals.size()) {
+    return nullptr;
+  }
+  return cur->m_locals[index].value;
+}
+
+void Fiber::SetLocal(size_t index, void* value, void (*deleter)(void*)) {
+  Fiber* cur = t_fiber ? t_fiber : GetThis().get();
+  if (index >= cur->m_locals.size()) {
+    if (!value) {
+      return;
+    }
+    // 一次扩到已分配的下标数，避免逐个扩容
+    cur->m_locals.resize(std::max(index + 1, s_fiber_local_count.load()));
+  }
+  LocalSlot old = cur->m_locals[index];
+  cur->m_locals[index].value = value;
+  cur->m_locals[index].deleter = deleter;
+  if (old.value && old.deleter) {
+    old.deleter(old.value);
+  }
+}
+
+void Fiber::clearLocals() {
+  // 保留槽位数组，复用的协程不用重新扩容；析构函数里可能新建其他局部存储，直到一轮没有释放任何对象为止
+  bool cleared = true;
+  while (cleared) {
+    cleared = false;
+    for (size_t i = 0; i < m_locals.size(); ++i) {
+      LocalSlot slot = m_locals[i];
+      if (!slot.value) {
+        continue;
+      }
+      m_locals[i] = LocalSlot();
+      if (slot.deleter) {
+        slot.deleter(slot.value);
+      }
+      cleared = true;
+    }
+  }
+}
+
+}   // namespace sylar
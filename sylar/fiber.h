@@ -8,12 +8,20 @@
 #ifndef __SYLAR_FIBER_H__
 #define __SYLAR_FIBER_H__
 
+#include "fcontext.h"
+#include "fiber_watchdog.h"
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <ucontext.h>
+#include <vector>
 
 namespace sylar {
 
+class StackAllocator;
+class FiberWatchdog;
+struct SharedStack;
+
 /**
  * @brief 协程类
  */
@@ -36,6 +44,21 @@ public:
     TERM
   };
 
+  /**
+   * @brief 协程调度类别
+   * @details 调度器按类别分道排队，各道之间按权重轮流取任务，后台任务也能按权重分到执行机会
+   */
+  enum Priority {
+    /// 延迟敏感的任务，如处理请求的协程
+    HIGH,
+    /// 默认类别
+    NORMAL,
+    /// 后台批量任务
+    BACKGROUND,
+    /// 类别数量
+    PRIORITY_COUNT
+  };
+
 private:
   /**
    * @brief 构造函数
@@ -50,8 +73,14 @@ public:
    * @param[in] cb 协程入口函数
    * @param[in] stacksize 栈大小
    * @param[in] run_in_scheduler 本协程是否参与调度器调度，默认为true
+   * @param[in] shared_stack 是否运行在共享栈上，默认为false
+   * @details 共享栈模式下协程不独占栈，第一次resume时绑定当前线程的一个共享栈，之后只能在该线程上运行，
+   *          yield后被同一共享栈上的其他协程换入时，才把已使用的部分拷贝到按需分配的堆内存中，大量空闲协程时可以大幅节省内存
+   * @attention 共享栈模式下协程栈上的变量地址在切出后会失效，不能把栈上变量的地址交给其他协程使用。
+   *            使用ucontext后端时不支持共享栈，会退化为独立栈
    */
-  Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+  Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true,
+        bool shared_stack = false);
 
   /**
    * @brief 析构函数
@@ -73,6 +102,7 @@ public:
   /**
    * @brief 当前协程让出执行权
    * @details 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY，后者状态变为RUNNING
+   *          READY状态在切换完成后才设置，状态为READY的协程上下文一定已经保存好，可以被其他线程resume
    */
   void yield();
 
@@ -90,6 +120,67 @@ public:
     return m_state;
   }
 
+  /**
+   * @brief 获取协程的调度类别
+   */
+  Priority getPriority() const {
+    return m_priority;
+  }
+
+  /**
+   * @brief 设置协程的调度类别
+   * @details 正在运行的协程可以借此提升或降低自己的类别，在下一次被加入调度时生效，
+   *          如yield后被IO事件、定时器或同步原语重新唤醒时。reset后恢复为NORMAL
+   */
+  void setPriority(Priority priority) {
+    m_priority = priority;
+  }
+
+  /**
+   * @brief 获取累计运行时间，单位微秒
+   * @details 只有开启配置项fiber.accounting或fiber.watchdog_ms时才统计，reset后清零
+   */
+  uint64_t getRunTime() const {
+    return m_runUs.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 获取统计期间被resume的次数
+   */
+  uint64_t getSwitches() const {
+    return m_switches.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 获取本次resume的时间，取自sylar::util::GetElapsedUS()，没有在运行或未统计时为0
+   */
+  uint64_t getResumeTime() const {
+    return m_resumeAt.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 设置是否统计本协程的运行时间
+   * @details 调度器的idle协程等本来就会长时间阻塞的协程应关闭，避免被看门狗误报
+   */
+  void setAccounting(bool v) {
+    m_accounting = v;
+  }
+
+  /**
+   * @brief 是否运行在共享栈上
+   */
+  bool isSharedStack() const {
+    return m_shared;
+  }
+
+  /**
+   * @brief 获取共享栈所属的线程id
+   * @details 共享栈协程第一次resume之后只能在该线程上运行，独立栈协程或还未运行过的协程返回-1
+   */
+  int getStackThread() const {
+    return m_stackThread;
+  }
+
 public:
   /**
    * @brief 设置当前正在运行的协程，即设置线程局部变量t_fiber的值
@@ -120,21 +211,147 @@ public:
    */
   static uint64_t GetFiberId();
 
+  /**
+   * @brief 获取一个运行cb的调度协程，优先复用当前线程缓存的已结束协程
+   * @param[in] cb 协程入口函数
+   * @param[in] shared_stack 是否运行在共享栈上
+   * @details 缓存中有同类协程时直接reset复用其栈，否则按默认栈大小创建新协程
+   */
+  static Fiber::ptr Acquire(std::function<void()> cb, bool shared_stack = false);
+
+  /**
+   * @brief 回收协程到当前线程的缓存
+   * @details 只有已结束、没有其他引用、参与调度器调度且使用默认栈的协程会被缓存，
+   *          缓存数量不超过配置项fiber.pool_max，其他情况直接释放。调用后fiber被置空
+   */
+  static void Recycle(Fiber::ptr& fiber);
+
+  /**
+   * @brief 释放当前线程缓存中多余的协程，只保留配置项fiber.pool_idle个
+   * @details 适合在线程空闲时调用
+   */
+  static void TrimPool();
+
+  /**
+   * @brief 释放当前线程缓存的所有协程
+   */
+  static void ClearPool();
+
+  /**
+   * @brief 当前线程缓存的协程数量
+   */
+  static size_t PooledFibers();
+
+  /**
+   * @brief 分配一个协程局部存储的下标，供FiberLocal使用
+   * @details 下标全局递增，不回收
+   */
+  static size_t AllocLocalIndex();
+
+  /**
+   * @brief 获取当前协程指定下标的局部存储，没有设置过时返回nullptr
+   */
+  static void* GetLocal(size_t index);
+
+  /**
+   * @brief 设置当前协程指定下标的局部存储
+   * @param[in] index 下标，取自AllocLocalIndex()
+   * @param[in] value 存储的对象，为nullptr时只释放旧对象
+   * @param[in] deleter 协程结束、reset或者被覆盖时释放value的函数
+   */
+  static void SetLocal(size_t index, void* value, void (*deleter)(void*));
+
+private:
+  friend class FiberWatchdog;
+
+  /**
+   * @brief 在协程栈上创建上下文，入口为MainFunc
+   */
+  void makeContext();
+
+  /**
+   * @brief 保存from的上下文，并切换到to的上下文
+   */
+  static void SwapContext(Fiber* from, Fiber* to);
+
+  /**
+   * @brief resume之前准备共享栈
+   * @details 第一次运行时绑定当前线程的一个共享栈，之后如果共享栈被其他协程占用，则先把占用者的栈拷贝出去，
+   *          再把本协程保存的栈拷贝回来
+   */
+  void prepareSharedStack();
+
+  /**
+   * @brief 把共享栈上已使用的部分拷贝到m_savedStack
+   */
+  void saveSharedStack();
+
+  /**
+   * @brief 释放所有协程局部存储
+   * @details 释放时其他局部存储仍可访问，释放过程中新建的局部存储也会一并释放
+   */
+  void clearLocals();
+
+private:
+  /**
+   * @brief 协程局部存储的一个槽位
+   */
+  struct LocalSlot {
+    void* value = nullptr;
+    void (*deleter)(void*) = nullptr;
+  };
+
 private:
   /// 协程id
   uint64_t m_id = 0;
   /// 协程栈大小
   uint32_t m_stacksize = 0;
-  /// 协程状态
-  State m_state = READY;
+  /// 协程状态，yield后由resume的调用方在切换回来之后置为READY
+  std::atomic<State> m_state = {READY};
   /// 协程上下文
+#ifdef SYLAR_FIBER_UCONTEXT
   ucontext_t m_ctx;
+#else
+  fcontext_t m_ctx = nullptr;
+#endif
   /// 协程栈地址
   void* m_stack = nullptr;
+  /// 分配协程栈的分配器，析构时归还给同一个分配器
+  StackAllocator* m_allocator = nullptr;
   /// 协程入口函数
   std::function<void()> m_cb;
   /// 本协程是否参与调度器调度
   bool m_runInScheduler;
+  /// 调度类别
+  Priority m_priority = NORMAL;
+  /// 是否运行在共享栈上
+  bool m_shared = false;
+  /// 绑定的共享栈，第一次resume时分配
+  SharedStack* m_sharedStack = nullptr;
+  /// 共享栈所属的线程id
+  int m_stackThread = -1;
+  /// 被换出时保存的栈内容
+  char* m_savedStack = nullptr;
+  /// 保存的栈内容大小
+  size_t m_savedSize = 0;
+  /// m_savedStack的容量
+  size_t m_savedCap = 0;
+  /// 协程局部存储，按FiberLocal的下标直接索引
+  std::vector<LocalSlot> m_locals;
+  /// 累计运行时间，单位微秒
+  std::atomic<uint64_t> m_runUs = {0};
+  /// 统计期间被resume的次数
+  std::atomic<uint64_t> m_switches = {0};
+  /// 本次resume的时间，单位微秒
+  std::atomic<uint64_t> m_resumeAt = {0};
+  /// 是否统计运行时间
+  bool m_accounting = true;
+  /// 登记到的FiberWatchdog线程槽，nullptr表示未登记
+  FiberWatchdog::ThreadSlot* m_watchSlot = nullptr;
+  /// 线程槽协程链表中的前一个协程
+  Fiber* m_watchPrev = nullptr;
+  /// 线程槽协程链表中的后一个协程
+  Fiber* m_watchNext = nullptr;
 };
 
 }   // namespace sylar
@@ -0,0 +1,85 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 03:48:10
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 03:48:10
+ * @FilePath: /sylar_from_nanasaki/sylar/fiber_local.h
+ */
+#ifndef __SYLAR_FIBER_LOCAL_H__
+#define __SYLAR_FIBER_LOCAL_H__
+
+#include "fiber.h"
+#include "noncopyable.h"
+#include <utility>
+
+namespace sylar {
+
+/**
+ * @brief 协程局部存储
+ * @details 每个协程各有一份T对象，随协程在调度线程间迁移，适合保存请求id、trace上下文、内存池指针等请求级数据。
+ *          对象在协程第一次访问时默认构造，协程结束(TERM)或被reset时析构，从协程缓存中复用的协程看不到上一个任务的数据。
+ *          每个FiberLocal分配一个固定下标，查找只是一次数组下标访问
+ * @attention FiberLocal的下标不回收，应定义为静态或全局变量，不要在循环中反复创建。
+ *            内联任务运行在调度协程上，访问的是调度协程的局部存储
+ */
+template <class T>
+class FiberLocal : Noncopyable {
+public:
+  FiberLocal()
+    : m_index(Fiber::AllocLocalIndex()) {}
+
+  /**
+   * @brief 获取当前协程的对象，不存在时默认构造一个
+   */
+  T* get() {
+    void* v = Fiber::GetLocal(m_index);
+    if (v) {
+      return static_cast<T*>(v);
+    }
+    T* t = new T();
+    Fiber::SetLocal(m_index, t, &FiberLocal::Delete);
+    return t;
+  }
+
+  /**
+   * @brief 设置当前协程的对象，旧对象会被析构
+   */
+  void set(T value) {
+    Fiber::SetLocal(m_index, new T(std::move(value)), &FiberLocal::Delete);
+  }
+
+  /**
+   * @brief 当前协程是否已经构造了对象
+   */
+  bool has() const {
+    return Fiber::GetLocal(m_index) != nullptr;
+  }
+
+  /**
+   * @brief 提前析构当前协程的对象，下次访问时重新构造
+   */
+  void reset() {
+    Fiber::SetLocal(m_index, nullptr, nullptr);
+  }
+
+  T& operator*() {
+    return *get();
+  }
+
+  T* operator->() {
+    return get();
+  }
+
+private:
+  static void Delete(void* v) {
+    delete static_cast<T*>(v);
+  }
+
+private:
+  /// 在协程局部存储数组中的下标
+  size_t m_index;
+};
+
+}   // namespace sylar
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 18:10:31
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 18:10:31
+ * @FilePath: /sylar_from_nanasaki/sylar/fiber_sync.cc
+ */
+#include "fiber_sync.h"
+#include "iomanager.h"
+#include "macro.h"
+
+namespace sylar {
+
+FiberWaitQueue::FiberWaitQueue()
+  : m_state(std::make_shared<State>()) {
+}
+
+bool FiberWaitQueue::wait(MutexType::Lock& lock, uint64_t timeout_ms,
+                          const std::function<void()>& before_yield) {
+  Scheduler* sc = Scheduler::GetThis();
+  SYLAR_ASSERT2(sc, "fiber wait must be called in scheduler");
+  Fiber::ptr fiber = Fiber::GetThis();
+  SYLAR_ASSERT2(fiber.get() != Scheduler::GetMainFiber(), "fiber wait in scheduler main fiber");
+
+  Waiter::ptr w(new Waiter);
+  w->scheduler = sc;
+  w->fiber = fiber;
+  w->queued = true;
+  w->it = m_state->waiters.insert(m_state->waiters.end(), w);
+  // 释放锁之后队列可能随着被唤醒的一方销毁，带超时时持有状态的引用
+  std::shared_ptr<State> state;
+  if (timeout_ms != ~0ull) {
+    state = m_state;
+  }
+  lock.unlock();
+
+  if (state) {
+    // 添加定时器要加定时器的读写锁、分配内存，还可能tickle，放在自旋锁外面，不让通知方空等
+    IOManager* iom = IOManager::GetThis();
+    SYLAR_ASSERT2(iom, "fiber timed wait must be called in IOManager");
+    std::weak_ptr<State> weak_state(state);
+    Timer::ptr timer = iom->addConditionTimer(
+      timeout_ms,
+      [weak_state, w]() {
+        auto state = weak_state.lock();
+        if (!state) {
+          return;
+        }
+        {
+          MutexType::Lock lock(state->mutex);
+          if (!w->queued) {
+            // 已经被唤醒了
+            return;
+          }
+          state->waiters.erase(w->it);
+          w->queued = false;
+          w->timeout = true;
+        }
+        w->scheduler->schedule(w->fiber);
+      },
+      weak_state);
+    // 还在队列中时才发布定时器，出队后Wake才读取，两者由锁排定先后；已经出队的由这里取消
+    {
+      MutexType::Lock relock(state->mutex);
+      if (w->queued) {
+        w->timer = timer;
+        timer.reset();
+      }
+    }
+    if (timer) {
+      timer->cancel();
+    }
+  }
+
+  if (before_yield) {
+    before_yield();
+  }
+  // 唤醒方可能在yield之前就把协程加入了调度，调度器会跳过还未yield的协程，等yield之后再调度
+  fiber->yield();
+
+  // 定时器回调持有等待者，这里断开引用
+  w->fiber.reset();
+  w->timer.reset();
+  return !w->timeout;
+}
+
+FiberWaitQueue::Waiter::ptr FiberWaitQueue::dequeue() {
+  auto& waiters = m_state->waiters;
+  if (waiters.empty()) {
+    return nullptr;
+  }
+  Waiter::ptr w = waiters.front();
+  waiters.pop_front();
+  w->queued = false;
+  return w;
+}
+
+void FiberWaitQueue::Wake(const Waiter::ptr& waiter) {
+  if (waiter->timer) {
+    waiter->timer->cancel();
+  }
+  waiter->scheduler->schedule(waiter->fiber);
+}
+
+FiberSemaphore::FiberSemaphore(size_t count)
+  : m_count(count) {
+}
+
+bool FiberSemaphore::tryWait() {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  if (m_count > 0) {
+    --m_count;
+    return true;
+  }
+  return false;
+}
+
+void FiberSemaphore::wait() {
+  waitFor(~0ull);
+}
+
+bool FiberSemaphore::waitFor(uint64_t timeout_ms) {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  if (m_count > 0) {
+    --m_count;
+    return true;
+  }
+  if (timeout_ms == 0) {
+    return false;
+  }
+  // 被唤醒时信号量已经由notify直接交给了本协程
+  return m_queue.wait(lock, timeout_ms);
+}
+
+void FiberSemaphore::notify() {
+  FiberWaitQueue::Waiter::ptr w;
+  {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    w = m_queue.dequeue();
+    if (!w) {
+      ++m_count;
+      return;
+    }
+  }
+  FiberWaitQueue::Wake(w);
+}
+
+size_t FiberSemaphore::getCount() {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  return m_count;
+}
+
+bool FiberMutex::tryLock() {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  if (m_locked) {
+    return false;
+  }
+  m_locked = true;
+  return true;
+}
+
+void FiberMutex::lock() {
+  lockFor(~0ull);
+}
+
+bool FiberMutex::lockFor(uint64_t timeout_ms) {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  if (!m_locked) {
+    m_locked = true;
+    return true;
+  }
+  if (timeout_ms == 0) {
+    return false;
+  }
+  // 被唤醒时锁已经由unlock直接交给了本协程
+  return m_queue.wait(lock, timeout_ms);
+}
+
+void FiberMutex::unlock() {
+  FiberWaitQueue::Waiter::ptr w;
+  {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    SYLAR_ASSERT(m_locked);
+    w = m_queue.dequeue();
+    if (!w) {
+      m_locked = false;
+      return;
+    }
+  }
+  FiberWaitQueue::Wake(w);
+}
+
+void FiberCondVar::wait(FiberMutex::Lock& lock) {
+  waitFor(lock, ~0ull);
+}
+
+bool FiberCondVar::waitFor(FiberMutex::Lock& lock, uint64_t timeout_ms) {
+  bool rt = true;
+  {
+    FiberWaitQueue::MutexType::Lock qlock(m_queue.mutex());
+    // 先入队再释放外部锁，notify只要在持有外部锁时调用就不会丢失唤醒
+    rt = m_queue.wait(qlock, timeout_ms, [&lock]() { lock.unlock(); });
+  }
+  lock.lock();
+  return rt;
+}
+
+void FiberCondVar::notifyOne() {
+  FiberWaitQueue::Waiter::ptr w;
+  {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    w = m_queue.dequeue();
+  }
+  if (w) {
+    FiberWaitQueue::Wake(w);
+  }
+}
+
+void FiberCondVar::notifyAll() {
+  std::vector<FiberWaitQueue::Waiter::ptr> ws;
+  {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    while (auto w = m_queue.dequeue()) {
+      ws.push_back(w);
+    }
+  }
+  for (auto& i : ws) {
+    FiberWaitQueue::Wake(i);
+  }
+}
+
+FiberWaitGroup::FiberWaitGroup(size_t count)
+  : m_count(count) {
+}
+
+void FiberWaitGroup::add(size_t n) {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  m_count += n;
+}
+
+void FiberWaitGroup::done() {
+  std::vector<FiberWaitQueue::Waiter::ptr> ws;
+  std::vector<Semaphore*> threads;
+  {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    SYLAR_ASSERT2(m_count > 0, "FiberWaitGroup::done without add");
+    if (--m_count > 0) {
+      return;
+    }
+    while (auto w = m_queue.dequeue()) {
+      ws.push_back(w);
+    }
+    threads.swap(m_threadWaiters);
+  }
+  // 唤醒之后等待组可能已经被等待者析构，不能再访问成员
+  for (auto& i : ws) {
+    FiberWaitQueue::Wake(i);
+  }
+  for (auto i : threads) {
+    i->notify();
+  }
+}
+
+void FiberWaitGroup::wait() {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  if (m_count == 0) {
+    return;
+  }
+  Scheduler* sc = Scheduler::GetThis();
+  if (sc && Fiber::GetThis().get() != Scheduler::GetMainFiber()) {
+    m_queue.wait(lock);
+    return;
+  }
+  // 不在调度器的协程中，阻塞线程
+  Semaphore sem;
+  m_threadWaiters.push_back(&sem);
+  lock.unlock();
+  sem.wait();
+}
+
+bool FiberWaitGroup::waitFor(uint64_t timeout_ms) {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  if (m_count == 0) {
+    return true;
+  }
+  if (timeout_ms == 0) {
+    return false;
+  }
+  return m_queue.wait(lock, timeout_ms);
+}
+
+size_t FiberWaitGroup::getCount() {
+  FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+  return m_count;
+}
+
+}   // namespace sylar
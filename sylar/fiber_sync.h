@@ -0,0 +1,268 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 18:10:26
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 18:10:26
+ * @FilePath: /sylar_from_nanasaki/sylar/fiber_sync.h
+ */
+#ifndef __SYLAR_FIBER_SYNC_H__
+#define __SYLAR_FIBER_SYNC_H__
+
+#include "fiber.h"
+#include "mutex.h"
+#include "timer.h"
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace sylar {
+
+class Scheduler;
+
+/**
+ * @brief 协程等待队列
+ * @details 协程同步原语的公共部分。等待时把当前协程挂到队列上并yield，不阻塞线程；
+ *          唤醒时通过协程所属调度器的schedule重新调度，可以跨同一个调度器的不同线程唤醒。
+ *          队列和原语自身的状态共用mutex()保护
+ */
+class FiberWaitQueue : Noncopyable {
+public:
+  using MutexType = Spinlock;
+
+  /**
+   * @brief 等待者
+   */
+  struct Waiter {
+    using ptr = std::shared_ptr<Waiter>;
+    /// 等待协程所属的调度器
+    Scheduler* scheduler = nullptr;
+    /// 等待的协程
+    Fiber::ptr fiber;
+    /// 超时定时器
+    Timer::ptr timer;
+    /// 在队列中的位置
+    std::list<ptr>::iterator it;
+    /// 是否还在队列中
+    bool queued = false;
+    /// 是否因为超时被唤醒
+    bool timeout = false;
+  };
+
+  FiberWaitQueue();
+
+  /**
+   * @brief 获取保护队列的锁
+   */
+  MutexType& mutex() {
+    return m_state->mutex;
+  }
+
+  /**
+   * @brief 挂起当前协程直到被唤醒或超时
+   * @param[in] lock 已经持有的mutex()，挂起前释放，返回时不再持有
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时，超时依赖当前线程的IOManager
+   * @param[in] before_yield 入队并释放lock之后、yield之前执行，用于释放外部的锁
+   * @return 被唤醒返回true，超时返回false
+   * @attention 只能在调度器调度的协程中调用
+   */
+  bool wait(MutexType::Lock& lock, uint64_t timeout_ms = ~0ull,
+            const std::function<void()>& before_yield = nullptr);
+
+  /**
+   * @brief 从队头取出一个等待者
+   * @attention 调用前必须持有mutex()
+   * @return 队列为空时返回nullptr
+   */
+  Waiter::ptr dequeue();
+
+  /**
+   * @brief 队列是否为空
+   * @attention 调用前必须持有mutex()
+   */
+  bool empty() const {
+    return m_state->waiters.empty();
+  }
+
+  /**
+   * @brief 唤醒已经出队的等待者
+   * @details 取消超时定时器，并把协程重新加入调度器，不需要持有mutex()
+   */
+  static void Wake(const Waiter::ptr& waiter);
+
+private:
+  /**
+   * @brief 队列状态
+   * @details 超时定时器通过weak_ptr引用，原语析构后到期的定时器不会再访问队列
+   */
+  struct State {
+    MutexType mutex;
+    std::list<Waiter::ptr> waiters;
+  };
+
+  std::shared_ptr<State> m_state;
+};
+
+/**
+ * @brief 协程信号量
+ * @details notify时如果有等待者，信号量直接交给队头的等待者，不会被后来者抢走
+ */
+class FiberSemaphore : Noncopyable {
+public:
+  /**
+   * @brief 构造函数
+   * @param[in] count 信号量初始值
+   */
+  FiberSemaphore(size_t count = 0);
+
+  /**
+   * @brief 尝试获取信号量，不挂起
+   */
+  bool tryWait();
+
+  /**
+   * @brief 获取信号量，获取不到时挂起当前协程
+   */
+  void wait();
+
+  /**
+   * @brief 获取信号量，最多等待timeout_ms毫秒
+   * @return 超时返回false
+   */
+  bool waitFor(uint64_t timeout_ms);
+
+  /**
+   * @brief 释放信号量
+   */
+  void notify();
+
+  /**
+   * @brief 获取信号量当前值
+   */
+  size_t getCount();
+
+private:
+  FiberWaitQueue m_queue;
+  /// 信号量值
+  size_t m_count;
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details 锁被占用时挂起当前协程而不是线程，unlock时直接把锁交给队头的等待者
+ */
+class FiberMutex : Noncopyable {
+public:
+  /// 局部锁
+  using Lock = ScopedLockImpl<FiberMutex>;
+
+  /**
+   * @brief 尝试加锁，不挂起
+   */
+  bool tryLock();
+
+  /**
+   * @brief 加锁，锁被占用时挂起当前协程
+   */
+  void lock();
+
+  /**
+   * @brief 加锁，最多等待timeout_ms毫秒
+   * @return 超时返回false
+   */
+  bool lockFor(uint64_t timeout_ms);
+
+  /**
+   * @brief 解锁
+   */
+  void unlock();
+
+private:
+  FiberWaitQueue m_queue;
+  /// 是否已被占用
+  bool m_locked = false;
+};
+
+/**
+ * @brief 协程条件变量
+ * @details 配合FiberMutex使用，等待时挂起当前协程
+ */
+class FiberCondVar : Noncopyable {
+public:
+  /**
+   * @brief 释放lock并挂起当前协程，被唤醒后重新加锁
+   * @param[in] lock 已加锁的FiberMutex局部锁
+   */
+  void wait(FiberMutex::Lock& lock);
+
+  /**
+   * @brief 同wait，最多等待timeout_ms毫秒
+   * @return 超时返回false，无论是否超时，返回时都重新持有lock
+   */
+  bool waitFor(FiberMutex::Lock& lock, uint64_t timeout_ms);
+
+  /**
+   * @brief 唤醒一个等待者
+   */
+  void notifyOne();
+
+  /**
+   * @brief 唤醒所有等待者
+   */
+  void notifyAll();
+
+private:
+  FiberWaitQueue m_queue;
+};
+
+/**
+ * @brief 协程等待组
+ * @details 用add登记未完成的任务数，每个任务完成时调用done，wait挂起当前协程直到计数归零。
+ *          不在调度器的协程中时(如main函数)wait阻塞当前线程
+ */
+class FiberWaitGroup : Noncopyable {
+public:
+  /**
+   * @brief 构造函数
+   * @param[in] count 初始的未完成任务数
+   */
+  FiberWaitGroup(size_t count = 0);
+
+  /**
+   * @brief 增加未完成的任务数
+   */
+  void add(size_t n = 1);
+
+  /**
+   * @brief 一个任务完成，计数归零时唤醒所有等待者
+   */
+  void done();
+
+  /**
+   * @brief 等待计数归零
+   */
+  void wait();
+
+  /**
+   * @brief 等待计数归零，最多等待timeout_ms毫秒
+   * @return 超时返回false
+   * @attention 只能在IOManager调度的协程中调用
+   */
+  bool waitFor(uint64_t timeout_ms);
+
+  /**
+   * @brief 获取未完成的任务数
+   */
+  size_t getCount();
+
+private:
+  FiberWaitQueue m_queue;
+  /// 未完成的任务数
+  size_t m_count;
+  /// 在线程上阻塞等待的等待者
+  std::vector<Semaphore*> m_threadWaiters;
+};
+
+}   // namespace sylar
+
+#endif
@@ -0,0 +1,434 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 05:40:52
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 05:40:52
+ * @FilePath: /sylar_from_nanasaki/sylar/fiber_watchdog.cc
+ */
+#include "fiber_watchdog.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "macro.h"
+#include "mutex.h"
+#include "thread.h"
+#include "util/util.h"
+#include <algorithm>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+// 是否统计每个协程的运行时间
+static ConfigVar<bool>::ptr g_fiber_accounting =
+  Config::Lookup<bool>("fiber.accounting", false, "fiber run time accounting");
+
+// 协程连续运行超过该时间没有yield时报告，单位毫秒，0表示关闭看门狗
+static ConfigVar<uint32_t>::ptr g_fiber_watchdog_ms =
+  Config::Lookup<uint32_t>("fiber.watchdog_ms", 0, "fiber watchdog threshold ms, 0 to disable");
+
+// 看门狗请求调用栈时发送的信号，默认SIGURG，程序自己用到该信号时可以换成其他信号
+static ConfigVar<int>::ptr g_fiber_watchdog_signal =
+  Config::Lookup<int>("fiber.watchdog_signal", SIGURG, "signal used by fiber watchdog backtrace");
+
+std::atomic<bool> FiberWatchdog::s_accounting{false};
+
+namespace {
+
+/// 最多记录的栈帧数
+static const int MAX_FRAMES = 64;
+
+enum BacktraceState {
+  /// 没有请求
+  BT_NONE,
+  /// 看门狗已请求，等待信号处理函数取调用栈
+  BT_REQUESTED,
+  /// 调用栈已取到
+  BT_DONE
+};
+
+}   // namespace
+
+/**
+ * @brief 每个线程当前正在运行的协程，以及在该线程上登记的协程
+ */
+struct FiberWatchdog::ThreadSlot {
+  /// 正在运行的协程id
+  std::atomic<uint64_t> fiberId = {0};
+  /// 本次resume的时间，0表示没有在运行统计中的协程
+  std::atomic<uint64_t> since = {0};
+  pthread_t thread;
+  int tid = 0;
+  std::string name;
+  /// 调用栈请求状态
+  std::atomic<int> btState = {BT_NONE};
+  /// 信号处理函数取到的栈帧
+  void* frames[MAX_FRAMES];
+  int frameCount = 0;
+  /// 上次报告的协程id和resume时间，只由看门狗线程访问
+  uint64_t reportedId = 0;
+  uint64_t reportedSince = 0;
+  /// 所属线程是否已经退出，在fiberMutex中修改
+  std::atomic<bool> exited = {false};
+  /// 保护fibers链表，只有本线程登记、协程析构和输出top协程时持有
+  Mutex fiberMutex;
+  /// 第一次在本线程resume的协程，通过Fiber::m_watchPrev/m_watchNext串成链表
+  Fiber* fibers = nullptr;
+};
+
+namespace {
+
+typedef FiberWatchdog::ThreadSlot ThreadSlot;
+
+struct WatchdogRegistry {
+  /// 保护slots，只在注册、注销和取快照时持有
+  Mutex mutex;
+  /// 存活线程的槽，以及线程已退出但还有协程登记的槽
+  std::vector<std::shared_ptr<ThreadSlot>> slots;
+  /// 保护看门狗线程的启停
+  Mutex threadMutex;
+  Thread::ptr thread;
+  /// 看门狗线程运行期间安装了处理函数的信号，0表示没有安装
+  int signal = 0;
+  std::atomic<bool> stop = {false};
+  std::atomic<uint32_t> thresholdMs = {0};
+  std::atomic<uint64_t> reported = {0};
+};
+
+/// 线程退出时可能晚于静态对象析构，注册表不释放
+static WatchdogRegistry& GetRegistry() {
+  static WatchdogRegistry* s_registry = new WatchdogRegistry;
+  return *s_registry;
+}
+
+/**
+ * @brief 从注册表中移除线程槽
+ */
+static void RemoveSlot(ThreadSlot* slot) {
+  WatchdogRegistry& registry = GetRegistry();
+  Mutex::Lock lock(registry.mutex);
+  registry.slots.erase(std::find_if(
+    registry.slots.begin(), registry.slots.end(),
+    [slot](const std::shared_ptr<ThreadSlot>& s) { return s.get() == slot; }));
+}
+
+/**
+ * @brief 持有当前线程的ThreadSlot，线程退出时注销
+ * @details 看门狗线程检查时持有快照里的引用，ThreadSlot在两边都释放之后才销毁。
+ *          线程退出时还有协程登记在槽上的，槽留在注册表中，由最后一个协程注销时移除
+ */
+struct SlotHolder {
+  std::shared_ptr<ThreadSlot> slot;
+  /// 与slot相同，供信号处理函数读取
+  ThreadSlot* raw = nullptr;
+
+  ~SlotHolder() {
+    if (!slot) {
+      return;
+    }
+    raw = nullptr;
+    bool empty;
+    {
+      Mutex::Lock lock(slot->fiberMutex);
+      slot->since.store(0, std::memory_order_release);
+      slot->exited.store(true, std::memory_order_release);
+      empty = !slot->fibers;
+    }
+    if (empty) {
+      RemoveSlot(slot.get());
+    }
+  }
+};
+
+static thread_local SlotHolder t_slot;
+
+/// 安装看门狗信号处理函数之前该信号的处理方式
+static struct sigaction s_old_action;
+
+static ThreadSlot* GetSlot() {
+  if (SYLAR_LIKELY(t_slot.raw)) {
+    return t_slot.raw;
+  }
+  std::shared_ptr<ThreadSlot> slot = std::make_shared<ThreadSlot>();
+  slot->thread = pthread_self();
+  slot->tid = sylar::util::GetThreadId();
+  slot->name = Thread::GetName();
+  WatchdogRegistry& registry = GetRegistry();
+  Mutex::Lock lock(registry.mutex);
+  registry.slots.push_back(slot);
+  t_slot.slot = slot;
+  t_slot.raw = slot.get();
+  return t_slot.raw;
+}
+
+/**
+ * @brief 在被检查的线程上取调用栈，只做backtrace()，格式化由看门狗线程完成
+ * @details 不是看门狗发起的信号交给之前安装的处理函数，之前是SIG_DFL或SIG_IGN时忽略
+ */
+static void OnBacktraceSignal(int sig, siginfo_t* info, void* ucontext) {
+  ThreadSlot* slot = t_slot.raw;
+  if (slot && slot->btState.load(std::memory_order_acquire) == BT_REQUESTED) {
+    int saved_errno = errno;
+    slot->frameCount = ::backtrace(slot->frames, MAX_FRAMES);
+    slot->btState.store(BT_DONE, std::memory_order_release);
+    errno = saved_errno;
+    return;
+  }
+  if (s_old_action.sa_flags & SA_SIGINFO) {
+    if (s_old_action.sa_sigaction) {
+      s_old_action.sa_sigaction(sig, info, ucontext);
+    }
+  } else if (s_old_action.sa_handler != SIG_DFL && s_old_action.sa_handler != SIG_IGN) {
+    s_old_action.sa_handler(sig);
+  }
+}
+
+/**
+ * @brief 检查所有线程，报告运行超时的协程
+ * @details 只在取快照时持有registry.mutex，发信号和等待调用栈时不持锁，
+ *          不会阻塞新线程注册(Fiber::resume)和线程退出
+ */
+static void CheckSlots(uint64_t threshold_us, int sig) {
+  WatchdogRegistry& registry = GetRegistry();
+  uint64_t now = sylar::util::GetElapsedUS();
+  std::vector<std::shared_ptr<ThreadSlot>> slots;
+  {
+    Mutex::Lock lock(registry.mutex);
+    slots = registry.slots;
+  }
+  for (auto& slot : slots) {
+    uint64_t since = slot->since.load(std::memory_order_acquire);
+    uint64_t id = slot->fiberId.load(std::memory_order_acquire);
+    // 前后两次读到的since相同，说明id和since属于同一次运行
+    if (!since || now < since + threshold_us ||
+        since != slot->since.load(std::memory_order_acquire)) {
+      continue;
+    }
+    if (slot->reportedId == id && slot->reportedSince == since) {
+      continue;
+    }
+    slot->reportedId = id;
+    slot->reportedSince = since;
+
+    std::string bt;
+    slot->btState.store(BT_REQUESTED, std::memory_order_release);
+    // 线程可能在取快照之后退出，退出后不能再对它的pthread_t发信号
+    if (!slot->exited.load(std::memory_order_acquire) && pthread_kill(slot->thread, sig) == 0) {
+      for (int i = 0; i < 100 && slot->btState.load(std::memory_order_acquire) != BT_DONE; ++i) {
+        usleep(1000);
+      }
+      // 取栈前后协程都没有切换，调用栈就是该协程的
+      if (slot->btState.load(std::memory_order_acquire) == BT_DONE &&
+          slot->fiberId.load(std::memory_order_acquire) == id &&
+          slot->since.load(std::memory_order_acquire) == since) {
+        bt = sylar::util::BacktraceToString(slot->frames, slot->frameCount, 1, "    ");
+      }
+    }
+    slot->btState.store(BT_NONE, std::memory_order_release);
+    ++registry.reported;
+    SYLAR_LOG_WARN(g_logger) << "fiber id=" << id << " running " << (now - since) / 1000
+                             << "ms without yield, thread=" << slot->tid << " " << slot->name
+                             << std::endl
+                             << (bt.empty() ? "    <backtrace unavailable>\n" : bt);
+  }
+}
+
+static void WatchdogMain() {
+  // 第一次调用backtrace()会加载libgcc，不能发生在信号处理函数中，先在这里调用一次
+  void* warm[4];
+  ::backtrace(warm, 4);
+
+  WatchdogRegistry& registry = GetRegistry();
+  while (!registry.stop.load(std::memory_order_acquire)) {
+    uint32_t threshold = registry.thresholdMs.load(std::memory_order_relaxed);
+    // 检查间隔取阈值的四分之一，报告延迟不超过阈值的1.25倍
+    usleep(std::max<uint64_t>(threshold * 1000ull / 4, 1000));
+    if (threshold) {
+      CheckSlots(threshold * 1000ull, registry.signal);
+    }
+  }
+}
+
+const char* StateToString(Fiber::State state) {
+  switch (state) {
+  case Fiber::READY:
+    return "READY";
+  case Fiber::RUNNING:
+    return "RUNNING";
+  case Fiber::TERM:
+    return "TERM";
+  }
+  return "UNKNOWN";
+}
+
+}   // namespace
+
+struct _FiberWatchdogIniter {
+  _FiberWatchdogIniter() {
+    Update(g_fiber_accounting->getValue(), g_fiber_watchdog_ms->getValue(),
+           g_fiber_watchdog_signal->getValue());
+    // 回调在新值生效前调用，需要把新值传进去
+    g_fiber_accounting->addListener([](const bool&, const bool& new_value) {
+      Update(new_value, g_fiber_watchdog_ms->getValue(), g_fiber_watchdog_signal->getValue());
+    });
+    g_fiber_watchdog_ms->addListener([](const uint32_t&, const uint32_t& new_value) {
+      Update(g_fiber_accounting->getValue(), new_value, g_fiber_watchdog_signal->getValue());
+    });
+    g_fiber_watchdog_signal->addListener([](const int&, const int& new_value) {
+      Update(g_fiber_accounting->getValue(), g_fiber_watchdog_ms->getValue(), new_value);
+    });
+  }
+
+  /**
+   * @brief 根据配置开启或关闭统计，启动或停止看门狗线程
+   * @details 看门狗线程启动时安装信号处理函数，停止时恢复原来的处理方式，运行中换信号时重启看门狗线程
+   * @param[in] accounting 是否开启统计
+   * @param[in] ms 看门狗阈值，单位毫秒
+   * @param[in] sig 取调用栈的信号
+   */
+  static void Update(bool accounting, uint32_t ms, int sig) {
+    WatchdogRegistry& registry = GetRegistry();
+    FiberWatchdog::s_accounting = accounting || ms > 0;
+    registry.thresholdMs = ms;
+
+    Mutex::Lock lock(registry.threadMutex);
+    if (registry.thread && (ms == 0 || sig != registry.signal)) {
+      registry.stop = true;
+      registry.thread->join();
+      registry.thread.reset();
+      sigaction(registry.signal, &s_old_action, nullptr);
+      registry.signal = 0;
+    }
+    if (ms > 0 && !registry.thread) {
+      struct sigaction sa;
+      memset(&sa, 0, sizeof(sa));
+      sa.sa_sigaction = &OnBacktraceSignal;
+      sa.sa_flags = SA_RESTART | SA_SIGINFO;
+      sigemptyset(&sa.sa_mask);
+      if (sigaction(sig, &sa, &s_old_action) != 0) {
+        SYLAR_LOG_ERROR(g_logger) << "fiber watchdog sigaction(" << sig
+                                  << ") fail, errno=" << errno << " errstr=" << strerror(errno);
+        return;
+      }
+      registry.signal = sig;
+      registry.stop = false;
+      registry.thread.reset(new Thread(&WatchdogMain, "fiber_watchdog"));
+    }
+  }
+};
+
+static _FiberWatchdogIniter s_fiber_watchdog_initer;
+
+FiberWatchdog::Running FiberWatchdog::OnResume(Fiber* fiber, uint64_t now) {
+  ThreadSlot* slot = GetSlot();
+  if (!fiber->m_watchSlot) {
+    Mutex::Lock lock(slot->fiberMutex);
+    fiber->m_watchSlot = slot;
+    fiber->m_watchPrev = nullptr;
+    fiber->m_watchNext = slot->fibers;
+    if (slot->fibers) {
+      slot->fibers->m_watchPrev = fiber;
+    }
+    slot->fibers = fiber;
+  }
+  Running prev;
+  prev.fiberId = slot->fiberId.load(std::memory_order_relaxed);
+  prev.since = slot->since.load(std::memory_order_relaxed);
+  // 先清掉since再改id，看门狗读到的since前后一致时id一定匹配
+  slot->since.store(0, std::memory_order_release);
+  slot->fiberId.store(fiber->getId(), std::memory_order_release);
+  slot->since.store(now, std::memory_order_release);
+  return prev;
+}
+
+void FiberWatchdog::OnYield(const Running& prev) {
+  ThreadSlot* slot = GetSlot();
+  slot->since.store(0, std::memory_order_release);
+  slot->fiberId.store(prev.fiberId, std::memory_order_release);
+  slot->since.store(prev.since, std::memory_order_release);
+}
+
+void FiberWatchdog::Unregister(Fiber* fiber) {
+  ThreadSlot* slot = fiber->m_watchSlot;
+  bool last;
+  {
+    Mutex::Lock lock(slot->fiberMutex);
+    if (fiber->m_watchPrev) {
+      fiber->m_watchPrev->m_watchNext = fiber->m_watchNext;
+    } else {
+      slot->fibers = fiber->m_watchNext;
+    }
+    if (fiber->m_watchNext) {
+      fiber->m_watchNext->m_watchPrev = fiber->m_watchPrev;
+    }
+    fiber->m_watchSlot = nullptr;
+    fiber->m_watchPrev = fiber->m_watchNext = nullptr;
+    last = !slot->fibers && slot->exited.load(std::memory_order_relaxed);
+  }
+  // 所属线程已经退出，最后一个协程负责移除槽
+  if (last) {
+    RemoveSlot(slot);
+  }
+}
+
+std::ostream& FiberWatchdog::DumpTopFibers(std::ostream& os, size_t n) {
+  struct Item {
+    uint64_t id;
+    Fiber::State state;
+    uint64_t runUs;
+    uint64_t runningUs;
+    uint64_t switches;
+  };
+  std::vector<Item> items;
+  uint64_t now = sylar::util::GetElapsedUS();
+  WatchdogRegistry& registry = GetRegistry();
+  std::vector<std::shared_ptr<ThreadSlot>> slots;
+  {
+    Mutex::Lock lock(registry.mutex);
+    slots = registry.slots;
+  }
+  for (auto& slot : slots) {
+    Mutex::Lock lock(slot->fiberMutex);
+    for (Fiber* f = slot->fibers; f; f = f->m_watchNext) {
+      uint64_t resume_at = f->getResumeTime();
+      uint64_t running = resume_at && now > resume_at ? now - resume_at : 0;
+      items.push_back({f->getId(), f->getState(), f->getRunTime() + running, running,
+                       f->getSwitches()});
+    }
+  }
+  size_t top = std::min(n, items.size());
+  std::partial_sort(items.begin(), items.begin() + top, items.end(),
+                    [](const Item& a, const Item& b) { return a.runUs > b.runUs; });
+  os << "[FiberWatchdog fibers=" << items.size() << " accounting=" << IsAccounting()
+     << " watchdog_ms=" << registry.thresholdMs << " reported=" << registry.reported << "]";
+  for (size_t i = 0; i < top; ++i) {
+    const Item& item = items[i];
+    os << std::endl
+       << "    fiber id=" << item.id << " state=" << StateToString(item.state)
+       << " run_us=" << item.runUs << " switches=" << item.switches;
+    if (item.runningUs) {
+      os << " running_us=" << item.runningUs;
+    }
+  }
+  return os;
+}
+
+std::string FiberWatchdog::TopFibersToString(size_t n) {
+  std::stringstream ss;
+  DumpTopFibers(ss, n);
+  return ss.str();
+}
+
+uint64_t FiberWatchdog::GetReported() {
+  return GetRegistry().reported;
+}
+
+}   // namespace sylar
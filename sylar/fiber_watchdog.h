@@ -0,0 +1,97 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 05:40:52
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 05:40:52
+ * @FilePath: /sylar_from_nanasaki/sylar/fiber_watchdog.h
+ */
+#ifndef __SYLAR_FIBER_WATCHDOG_H__
+#define __SYLAR_FIBER_WATCHDOG_H__
+
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+
+namespace sylar {
+
+class Fiber;
+
+/**
+ * @brief 协程运行时间统计和长时间运行协程的看门狗
+ * @details 开启配置项fiber.accounting后，每次resume记录协程本次运行的时间，累加到协程上，并记录每个线程当前正在运行的协程。
+ *          配置项fiber.watchdog_ms大于0时同时开启统计，并启动一个看门狗线程，发现有协程连续运行超过该时间没有yield，
+ *          就通过信号(配置项fiber.watchdog_signal，默认SIGURG)让该线程取一次调用栈，由看门狗线程输出协程id、
+ *          运行时间和调用栈，同一次运行只报告一次。信号原有的处理函数会被链式调用，看门狗停止后恢复。
+ *          运行时间按单调时钟(sylar::util::GetElapsedUS)计算，协程中未hook的阻塞调用也计算在内
+ */
+class FiberWatchdog {
+public:
+  /**
+   * @brief 线程当前正在运行的协程
+   */
+  struct Running {
+    /// 协程id
+    uint64_t fiberId = 0;
+    /// 本次resume的时间，取自sylar::util::GetElapsedUS()，0表示没有在运行统计中的协程
+    uint64_t since = 0;
+  };
+
+  /**
+   * @brief 线程的看门狗状态，同时记录在该线程上登记的协程
+   */
+  struct ThreadSlot;
+
+  /**
+   * @brief 是否开启了运行时间统计
+   */
+  static bool IsAccounting() {
+    return s_accounting.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 协程即将被resume，记录为当前线程正在运行的协程
+   * @param[in] fiber 协程
+   * @param[in] now 当前时间，单位微秒
+   * @return 之前正在运行的协程，yield回来后交给OnYield恢复
+   */
+  static Running OnResume(Fiber* fiber, uint64_t now);
+
+  /**
+   * @brief 协程yield回到resume的调用方，恢复之前正在运行的协程
+   */
+  static void OnYield(const Running& prev);
+
+  /**
+   * @brief 协程析构时从统计中移除
+   * @details 只锁协程登记所在线程的槽，不经过全局锁
+   */
+  static void Unregister(Fiber* fiber);
+
+  /**
+   * @brief 按累计运行时间从高到低输出协程
+   * @param[in] os 输出流
+   * @param[in] n 最多输出的协程数
+   * @details 只包含开启统计后运行过的存活协程，正在运行的协程会额外输出本次已运行的时间
+   */
+  static std::ostream& DumpTopFibers(std::ostream& os, size_t n = 10);
+
+  /**
+   * @brief 以字符串形式返回DumpTopFibers的结果
+   */
+  static std::string TopFibersToString(size_t n = 10);
+
+  /**
+   * @brief 看门狗已报告的超时次数
+   */
+  static uint64_t GetReported();
+
+private:
+  friend struct _FiberWatchdogIniter;
+  /// 是否开启运行时间统计
+  static std::atomic<bool> s_accounting;
+};
+
+}   // namespace sylar
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 08:05:12
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 08:05:12
+ * @FilePath: /sylar_from_nanasaki/sylar/future.cc
+ */
+#include "future.h"
+#include "fiber.h"
+#include "iomanager.h"
+#include "macro.h"
+
+namespace sylar {
+
+void FutureStateBase::addCallback(Callback cb) {
+  {
+    MutexType::Lock lock(m_mutex);
+    if (!m_ready.load(std::memory_order_relaxed)) {
+      m_callbacks.push_back(std::move(cb));
+      return;
+    }
+  }
+  cb();
+}
+
+bool FutureStateBase::wait(uint64_t timeout_ms) {
+  if (isReady()) {
+    return true;
+  }
+  if (timeout_ms == 0) {
+    return false;
+  }
+  Scheduler* sc = Scheduler::GetThis();
+  if (!sc || Fiber::GetThis().get() == Scheduler::GetMainFiber()) {
+    // 不在调度器的协程中，阻塞线程
+    SYLAR_ASSERT2(timeout_ms == ~0ull, "future timed wait must be called in IOManager fiber");
+    Semaphore sem;
+    addCallback([&sem]() { sem.notify(); });
+    sem.wait();
+    return true;
+  }
+
+  // 带超时时定时器回调可能晚于本函数返回，节点放在堆上共同持有
+  Fiber::ptr fiber = Fiber::GetThis();
+  Waiter local;
+  std::shared_ptr<Waiter> shared;
+  if (timeout_ms != ~0ull || fiber->isSharedStack()) {
+    shared = std::make_shared<Waiter>();
+  }
+  Waiter* w = shared ? shared.get() : &local;
+  w->scheduler = sc;
+  w->fiber = fiber;
+  if (timeout_ms != ~0ull) {
+    // 添加定时器要加定时器的读写锁、分配内存，在自旋锁外面提前添加
+    IOManager* iom = IOManager::GetThis();
+    SYLAR_ASSERT2(iom, "future timed wait must be called in IOManager");
+    w->timer = iom->addTimer(timeout_ms, [shared]() {
+      if (shared->woken.exchange(true)) {
+        return;
+      }
+      shared->timeout = true;
+      shared->scheduler->schedule(shared->fiber);
+    });
+  }
+
+  bool ready = false;
+  {
+    MutexType::Lock lock(m_mutex);
+    ready = m_ready.load(std::memory_order_relaxed);
+    if (!ready) {
+      w->next = m_waiters;
+      if (m_waiters) {
+        m_waiters->prev = w;
+      }
+      m_waiters = w;
+      w->linked = true;
+    }
+  }
+  if (ready) {
+    if (w->timer) {
+      if (w->woken.exchange(true)) {
+        // 定时器已经触发，协程已被加入调度，yield一次把这次调度消耗掉
+        fiber->yield();
+      } else {
+        w->timer->cancel();
+      }
+    }
+    w->fiber.reset();
+    w->timer.reset();
+    return true;
+  }
+
+  // 唤醒方可能在yield之前就把协程加入了调度，调度器会跳过还未yield的协程，等yield之后再调度
+  fiber->yield();
+
+  bool timeout = w->timeout;
+  if (timeout) {
+    // 超时唤醒时节点可能还在链表中
+    MutexType::Lock lock(m_mutex);
+    if (w->linked) {
+      if (w->prev) {
+        w->prev->next = w->next;
+      } else {
+        m_waiters = w->next;
+      }
+      if (w->next) {
+        w->next->prev = w->prev;
+      }
+      w->linked = false;
+    }
+  }
+  // 断开节点与定时器、协程之间的引用
+  w->fiber.reset();
+  w->timer.reset();
+  return !timeout;
+}
+
+FutureStateBase::Waiter* FutureStateBase::takeWaitersNoLock() {
+  Waiter* waiters = nullptr;
+  Waiter* w = m_waiters;
+  m_waiters = nullptr;
+  while (w) {
+    Waiter* next = w->next;
+    w->linked = false;
+    // 在锁内决定由谁唤醒，超时一方唤醒的协程在释放锁之后可能马上返回，不能再访问
+    if (!w->woken.exchange(true)) {
+      w->next = waiters;
+      waiters = w;
+    }
+    w = next;
+  }
+  return waiters;
+}
+
+void FutureStateBase::WakeWaiters(Waiter* waiters) {
+  while (waiters) {
+    Waiter* w = waiters;
+    waiters = w->next;
+    if (w->timer) {
+      w->timer->cancel();
+    }
+    w->scheduler->schedule(w->fiber);
+  }
+}
+
+void FutureStateBase::releasePromise() {
+  if (m_promises.fetch_sub(1, std::memory_order_acq_rel) == 1 && !isReady()) {
+    setException(std::make_exception_ptr(FutureError("broken promise")));
+  }
+}
+
+TimerManager* FutureStateBase::GetTimerManager() {
+  IOManager* iom = IOManager::GetThis();
+  SYLAR_ASSERT2(iom, "future timeout without TimerManager");
+  return iom;
+}
+
+}   // namespace sylar
@@ -0,0 +1,566 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 08:05:12
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 08:05:12
+ * @FilePath: /sylar_from_nanasaki/sylar/future.h
+ */
+#ifndef __SYLAR_FUTURE_H__
+#define __SYLAR_FUTURE_H__
+
+#include "mutex.h"
+#include "noncopyable.h"
+#include "scheduler.h"
+#include "timer.h"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace sylar {
+
+/**
+ * @brief Future相关的错误，如promise未设置结果就被销毁
+ */
+class FutureError : public std::logic_error {
+public:
+  using std::logic_error::logic_error;
+};
+
+/**
+ * @brief Future::timeout超时
+ */
+class FutureTimeout : public FutureError {
+public:
+  using FutureError::FutureError;
+};
+
+/**
+ * @brief Future共享状态中与值类型无关的部分
+ * @details 结果只能设置一次，设置后唤醒等待的协程并依次执行登记的回调。
+ *          等待结果的协程挂在侵入式等待链表上，不阻塞线程，不带超时的等待不分配内存
+ */
+class FutureStateBase : Noncopyable {
+public:
+  using Callback = std::function<void()>;
+
+  /**
+   * @brief 结果是否已设置
+   */
+  bool isReady() const {
+    return m_ready.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief 获取异常，未完成或成功时为空
+   */
+  std::exception_ptr getException() const {
+    return isReady() ? m_exception : nullptr;
+  }
+
+  /**
+   * @brief 登记结果设置后执行的回调
+   * @details 已经完成时立即在当前线程执行，否则在设置结果的线程上执行
+   */
+  void addCallback(Callback cb);
+
+  /**
+   * @brief 等待结果
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+   * @return 超时返回false
+   * @details 在调度器的协程中挂起当前协程，超时依赖当前线程的IOManager；否则阻塞线程，且不支持超时
+   */
+  bool wait(uint64_t timeout_ms = ~0ull);
+
+  /**
+   * @brief 以异常结束
+   * @return 结果已经设置过时返回false
+   */
+  bool setException(std::exception_ptr e) {
+    return complete([this, &e]() { m_exception = e; });
+  }
+
+  /**
+   * @brief 结果是异常时重新抛出
+   */
+  void rethrowIfFailed() const {
+    if (m_exception) {
+      std::rethrow_exception(m_exception);
+    }
+  }
+
+  /**
+   * @brief 增加一个Promise引用
+   */
+  void addPromise() {
+    m_promises.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 减少一个Promise引用，最后一个Promise销毁时还没有结果则以FutureError结束
+   */
+  void releasePromise();
+
+  /**
+   * @brief 获取timeout使用的定时器管理器，即当前线程的IOManager
+   */
+  static TimerManager* GetTimerManager();
+
+protected:
+  /**
+   * @brief 设置结果并执行回调
+   * @param[in] set 持有锁时调用，写入结果
+   */
+  template <class SetFunc>
+  bool complete(SetFunc&& set) {
+    std::vector<Callback> cbs;
+    Waiter* waiters = nullptr;
+    {
+      MutexType::Lock lock(m_mutex);
+      if (m_ready.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      set();
+      m_ready.store(true, std::memory_order_release);
+      cbs.swap(m_callbacks);
+      waiters = takeWaitersNoLock();
+    }
+    // 取消定时器和调度都要加其他锁，放在自旋锁外面
+    WakeWaiters(waiters);
+    for (auto& i : cbs) {
+      i();
+    }
+    return true;
+  }
+
+private:
+  /**
+   * @brief 挂起等待结果的协程，侵入式双向链表的节点
+   * @details 不带超时时节点放在等待协程的栈上，共享栈协程挂起后栈会被换出，节点放在堆上；
+   *          带超时时节点由等待协程和定时器回调共同持有
+   */
+  struct Waiter {
+    /// 等待协程所属的调度器
+    Scheduler* scheduler = nullptr;
+    /// 等待的协程
+    Fiber::ptr fiber;
+    /// 超时定时器
+    Timer::ptr timer;
+    Waiter* prev = nullptr;
+    Waiter* next = nullptr;
+    /// 是否还在等待链表中，持有m_mutex时访问
+    bool linked = false;
+    /// 完成和超时谁先置为true谁负责唤醒
+    std::atomic<bool> woken = {false};
+    /// 是否因为超时被唤醒
+    bool timeout = false;
+  };
+
+  /**
+   * @brief 清空等待链表，取出需要由完成方唤醒的协程
+   * @details 已经超时的协程由定时器回调唤醒，不在返回的链表中
+   * @return 通过next链接的节点，在协程被调度之前一直有效
+   * @attention 调用前必须持有m_mutex
+   */
+  Waiter* takeWaitersNoLock();
+
+  /**
+   * @brief 唤醒takeWaitersNoLock取出的协程，不需要持有m_mutex
+   * @attention 调度之后不再访问节点，节点可能随协程返回而销毁
+   */
+  static void WakeWaiters(Waiter* waiters);
+
+private:
+  using MutexType = Spinlock;
+  MutexType m_mutex;
+  /// 是否已经有结果
+  std::atomic<bool> m_ready = {false};
+  /// 存活的Promise数
+  std::atomic<uint32_t> m_promises = {0};
+  /// 异常结果
+  std::exception_ptr m_exception;
+  /// 完成时执行的回调
+  std::vector<Callback> m_callbacks;
+  /// 等待结果的协程
+  Waiter* m_waiters = nullptr;
+};
+
+/**
+ * @brief Future共享状态，值和等待队列在同一次分配中
+ */
+template <class T>
+class FutureState : public FutureStateBase {
+public:
+  using ptr = std::shared_ptr<FutureState>;
+
+  /**
+   * @brief 以值结束
+   * @return 结果已经设置过时返回false
+   */
+  template <class U>
+  bool setValue(U&& v) {
+    return complete([this, &v]() { m_value.emplace(std::forward<U>(v)); });
+  }
+
+  /**
+   * @brief 获取值，调用前结果必须已经设置且不是异常
+   */
+  const T& value() const {
+    return *m_value;
+  }
+
+private:
+  std::optional<T> m_value;
+};
+
+/**
+ * @brief 没有值的Future共享状态
+ */
+template <>
+class FutureState<void> : public FutureStateBase {
+public:
+  using ptr = std::shared_ptr<FutureState>;
+
+  bool setValue() {
+    return complete([]() {});
+  }
+
+  void value() const {
+  }
+};
+
+template <class T>
+class Future;
+
+namespace detail {
+
+/**
+ * @brief 用src的结果设置dst，f为空时直接转发值，否则用f(值)的结果设置dst，f抛出的异常也设置到dst
+ */
+template <class T, class R, class Func>
+void ChainState(const typename FutureState<T>::ptr& src, const typename FutureState<R>::ptr& dst,
+                Func& f) {
+  if (auto e = src->getException()) {
+    dst->setException(e);
+    return;
+  }
+  try {
+    if constexpr (std::is_void<T>::value && std::is_void<R>::value) {
+      f();
+      dst->setValue();
+    } else if constexpr (std::is_void<T>::value) {
+      dst->setValue(f());
+    } else if constexpr (std::is_void<R>::value) {
+      f(src->value());
+      dst->setValue();
+    } else {
+      dst->setValue(f(src->value()));
+    }
+  } catch (...) {
+    dst->setException(std::current_exception());
+  }
+}
+
+template <class T, class Func>
+struct ThenResult {
+  using type = std::decay_t<std::invoke_result_t<Func&, const T&>>;
+};
+
+template <class Func>
+struct ThenResult<void, Func> {
+  using type = std::decay_t<std::invoke_result_t<Func&>>;
+};
+
+}   // namespace detail
+
+/**
+ * @brief 异步结果的承诺方，设置结果后唤醒等待的协程
+ * @details 可以拷贝，各副本共享同一个结果，便于放入std::function中跨调度器传递。
+ *          最后一个副本销毁时还没有设置结果，Future以FutureError("broken promise")结束
+ */
+template <class T>
+class Promise {
+public:
+  Promise()
+    : m_state(std::make_shared<FutureState<T>>()) {
+    m_state->addPromise();
+  }
+
+  Promise(const Promise& rhs)
+    : m_state(rhs.m_state) {
+    if (m_state) {
+      m_state->addPromise();
+    }
+  }
+
+  Promise(Promise&& rhs) noexcept
+    : m_state(std::move(rhs.m_state)) {
+  }
+
+  Promise& operator=(Promise rhs) noexcept {
+    std::swap(m_state, rhs.m_state);
+    return *this;
+  }
+
+  ~Promise() {
+    if (m_state) {
+      m_state->releasePromise();
+    }
+  }
+
+  /**
+   * @brief 获取对应的Future
+   */
+  Future<T> getFuture() const {
+    return Future<T>(m_state);
+  }
+
+  /**
+   * @brief 设置值，T为void时不带参数
+   * @return 结果已经设置过时返回false
+   */
+  template <class... Args>
+  bool setValue(Args&&... args) {
+    return m_state->setValue(std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief 设置异常
+   * @return 结果已经设置过时返回false
+   */
+  bool setException(std::exception_ptr e) {
+    return m_state->setException(e);
+  }
+
+private:
+  typename FutureState<T>::ptr m_state;
+};
+
+/**
+ * @brief 异步结果
+ * @details 可以拷贝，各副本共享同一个结果。get在结果就绪前挂起当前协程而不是线程，
+ *          结果就绪后协程重新加入它所属的调度器
+ */
+template <class T>
+class Future {
+public:
+  using State = FutureState<T>;
+
+  Future() = default;
+
+  explicit Future(typename State::ptr state)
+    : m_state(std::move(state)) {
+  }
+
+  /**
+   * @brief 是否关联了共享状态
+   */
+  bool valid() const {
+    return m_state != nullptr;
+  }
+
+  /**
+   * @brief 结果是否已经就绪
+   */
+  bool isReady() const {
+    return m_state->isReady();
+  }
+
+  /**
+   * @brief 结果是否是异常，未就绪时返回false
+   */
+  bool hasException() const {
+    return m_state->getException() != nullptr;
+  }
+
+  /**
+   * @brief 等待结果就绪
+   */
+  void wait() const {
+    m_state->wait();
+  }
+
+  /**
+   * @brief 等待结果就绪，最多等待timeout_ms毫秒
+   * @return 超时返回false
+   * @attention 只能在IOManager调度的协程中调用
+   */
+  bool waitFor(uint64_t timeout_ms) const {
+    return m_state->wait(timeout_ms);
+  }
+
+  /**
+   * @brief 等待并获取结果，结果是异常时抛出该异常
+   */
+  decltype(auto) get() const {
+    m_state->wait();
+    m_state->rethrowIfFailed();
+    return m_state->value();
+  }
+
+  /**
+   * @brief 结果就绪后用f(值)的结果设置新的Future
+   * @param[in] f 回调，T为void时不带参数。本Future是异常时f不执行，异常直接传给新的Future
+   * @param[in] sc 执行f的调度器，nullptr表示在设置结果的线程上直接执行，此时f中不能做阻塞或会挂起协程的操作
+   */
+  template <class Func>
+  auto then(Func f, Scheduler* sc = nullptr) const
+    -> Future<typename detail::ThenResult<T, Func>::type> {
+    using R = typename detail::ThenResult<T, Func>::type;
+    typename FutureState<R>::ptr next = std::make_shared<FutureState<R>>();
+    typename State::ptr state = m_state;
+    if (sc) {
+      m_state->addCallback([state, next, f, sc]() {
+        sc->schedule([state, next, f]() mutable { detail::ChainState<T, R>(state, next, f); });
+      });
+    } else {
+      m_state->addCallback(
+        [state, next, f]() mutable { detail::ChainState<T, R>(state, next, f); });
+    }
+    return Future<R>(next);
+  }
+
+  /**
+   * @brief 返回一个最多等待timeout_ms毫秒的Future，超时后以FutureTimeout结束
+   * @param[in] timeout_ms 超时时间(毫秒)
+   * @param[in] tm 定时器管理器，nullptr表示当前线程的IOManager
+   */
+  Future<T> timeout(uint64_t timeout_ms, TimerManager* tm = nullptr) const {
+    if (!tm) {
+      tm = FutureStateBase::GetTimerManager();
+    }
+    typename State::ptr next = std::make_shared<State>();
+    typename State::ptr state = m_state;
+    Timer::ptr timer = tm->addTimer(timeout_ms, [next]() {
+      next->setException(std::make_exception_ptr(FutureTimeout("future timeout")));
+    });
+    m_state->addCallback([state, next, timer]() {
+      timer->cancel();
+      if constexpr (std::is_void<T>::value) {
+        auto forward = []() {};
+        detail::ChainState<T, T>(state, next, forward);
+      } else {
+        auto forward = [](const T& v) -> const T& { return v; };
+        detail::ChainState<T, T>(state, next, forward);
+      }
+    });
+    return Future<T>(next);
+  }
+
+  /**
+   * @brief 获取共享状态
+   */
+  const typename State::ptr& getState() const {
+    return m_state;
+  }
+
+private:
+  typename State::ptr m_state;
+};
+
+/**
+ * @brief 在调度器上执行f，返回其结果的Future
+ * @param[in] sc 执行f的调度器，如把CPU密集的计算从IO线程转到计算调度器
+ * @param[in] f 函数，抛出的异常设置到Future
+ */
+template <class Func>
+auto Async(Scheduler* sc, Func f) -> Future<std::decay_t<std::invoke_result_t<Func&>>> {
+  using R = std::decay_t<std::invoke_result_t<Func&>>;
+  typename FutureState<R>::ptr state = std::make_shared<FutureState<R>>();
+  sc->schedule([state, f]() mutable {
+    try {
+      if constexpr (std::is_void<R>::value) {
+        f();
+        state->setValue();
+      } else {
+        state->setValue(f());
+      }
+    } catch (...) {
+      state->setException(std::current_exception());
+    }
+  });
+  return Future<R>(state);
+}
+
+/**
+ * @brief WhenAll的结果类型，void的Future合并为Future<void>
+ */
+template <class T>
+using WhenAllResult = std::conditional_t<std::is_void<T>::value, void, std::vector<T>>;
+
+/**
+ * @brief 所有Future都成功后按原顺序得到所有的值，任意一个异常时以第一个异常结束
+ */
+template <class T>
+Future<WhenAllResult<T>> WhenAll(const std::vector<Future<T>>& futures) {
+  using R = WhenAllResult<T>;
+  struct Context {
+    std::vector<Future<T>> futures;
+    std::atomic<size_t> remaining;
+    typename FutureState<R>::ptr next;
+  };
+  auto ctx = std::make_shared<Context>();
+  ctx->futures = futures;
+  ctx->remaining = futures.size();
+  ctx->next = std::make_shared<FutureState<R>>();
+  Future<R> rt(ctx->next);
+  if (futures.empty()) {
+    if constexpr (std::is_void<T>::value) {
+      ctx->next->setValue();
+    } else {
+      ctx->next->setValue(R());
+    }
+    return rt;
+  }
+  for (auto& i : futures) {
+    typename FutureState<T>::ptr state = i.getState();
+    state->addCallback([ctx, state]() {
+      if (auto e = state->getException()) {
+        ctx->next->setException(e);
+      }
+      if (ctx->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+      }
+      // 最后一个完成，有异常时上面已经设置过结果，这里不会生效
+      if constexpr (std::is_void<T>::value) {
+        ctx->next->setValue();
+      } else {
+        R values;
+        values.reserve(ctx->futures.size());
+        for (auto& f : ctx->futures) {
+          if (f.hasException()) {
+            return;
+          }
+          values.push_back(f.getState()->value());
+        }
+        ctx->next->setValue(std::move(values));
+      }
+      ctx->futures.clear();
+    });
+  }
+  return rt;
+}
+
+/**
+ * @brief 任意一个Future就绪(成功或异常)后得到它的下标
+ * @details 通过futures[下标]获取结果，futures为空时以FutureError结束
+ */
+template <class T>
+Future<size_t> WhenAny(const std::vector<Future<T>>& futures) {
+  FutureState<size_t>::ptr next = std::make_shared<FutureState<size_t>>();
+  if (futures.empty()) {
+    next->setException(std::make_exception_ptr(FutureError("WhenAny without future")));
+  }
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].getState()->addCallback([next, i]() { next->setValue(i); });
+  }
+  return Future<size_t>(next);
+}
+
+}   // namespace sylar
+
+#endif
@@ -9,10 +9,12 @@
 #include "config.h"
 #include "fd_manager.h"
 #include "fiber.h"
+#include "io_uring.h"
 #include "iomanager.h"
 #include "log.h"
 #include "macro.h"
 #include <dlfcn.h>
+#include <string.h>
 
 namespace sylar {
 
@@ -94,18 +96,19 @@ struct timer_info {
  * @param hook_fun_name hook函数名称（用于日志）
  * @param event 等待的IO事件类型（READ/WRITE）
  * @param timeout_so 套接字超时选项（SO_RCVTIMEO/SO_SNDTIMEO）
+ * @param req io_uring后端下等价的IO请求，操作码为IORING_OP_NOP时只使用epoll
  * @param args 原始IO函数参数
  * @return ssize_t 操作结果，与原始系统调用一致
  * @note 核心逻辑：
  * 1. 检查hook启用状态和fd有效性
  * 2. 非阻塞重试操作
- * 3. EAGAIN时添加定时器和IO事件监听
+ * 3. EAGAIN时添加定时器和IO事件监听，io_uring后端下改为把IO提交给内核
  * 4. 协程让出等待事件就绪
  * 5. 处理超时和错误情况
  */
 template <typename OriginFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event,
-                     int timeout_so, Args&&... args) {
+                     int timeout_so, const sylar::UringRequest& req, Args&&... args) {
   if (!sylar::t_hook_enable) {
     return fun(fd, std::forward<Args>(args)...);
   }
@@ -135,6 +138,29 @@ retry:
   }
   if (n == -1 && errno == EAGAIN) {
     sylar::IOManager* iom = sylar::IOManager::GetThis();
+    // 共享栈协程挂起后栈所在的内存由其他协程使用，内核不能在挂起期间写入栈上的缓冲区，只能使用epoll方式
+    if (iom->isUring() && req.opcode != IORING_OP_NOP
+        && !sylar::Fiber::GetThis()->isSharedStack()) {
+      // 由内核在数据就绪后完成IO，协程恢复时直接拿到结果，不用再执行一次系统调用
+      int res = iom->uringIo(req, to);
+      if (res >= 0) {
+        return res;
+      }
+      if (res == -ECANCELED) {
+        // 被cancelAll取消，和epoll方式一样重新执行一次
+        if (ctx->isClose()) {
+          errno = EBADF;
+          return -1;
+        }
+        goto retry;
+      }
+      if (res != -EAGAIN) {
+        errno = -res;
+        return -1;
+      }
+      // 内核同样返回EAGAIN时退回epoll方式等待
+    }
+
     sylar::Timer::ptr timer;
     std::weak_ptr<timer_info> winfo(tinfo);
 
@@ -175,6 +201,48 @@ retry:
   return n;
 }
 
+/**
+ * @brief io_uring后端下通过multishot accept接受连接
+ * @param[out] fd 新连接的fd，失败时为-1并设置errno
+ * @return 是否已处理，返回false时按普通方式accept
+ */
+static bool do_uring_accept(int s, sockaddr* addr, socklen_t* addrlen, int& fd) {
+  if (!sylar::t_hook_enable) {
+    return false;
+  }
+  sylar::IOManager* iom = sylar::IOManager::GetThis();
+  if (!iom || !iom->isUring() || sylar::Fiber::GetThis()->isSharedStack()) {
+    return false;
+  }
+  sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(s);
+  if (!ctx || ctx->isClose() || !ctx->isSocket() || ctx->getUserNonblock()) {
+    return false;
+  }
+
+  uint64_t to = ctx->getTimeout(SO_RCVTIMEO);
+  int res = 0;
+  do {
+    res = iom->uringAccept(s, to);
+    // 被cancelAll取消后重新等待，socket已关闭则返回EBADF
+  } while (res == -ECANCELED && !ctx->isClose());
+  if (res == -EAGAIN) {
+    return false;
+  }
+  if (res == -ECANCELED) {
+    res = -EBADF;
+  }
+  if (res < 0) {
+    errno = -res;
+    fd = -1;
+    return true;
+  }
+  // multishot accept不返回对端地址
+  if (addr && addrlen) {
+    getpeername(res, addr, addrlen);
+  }
+  fd = res;
+  return true;
+}
 
 extern "C" {
 
@@ -189,12 +257,7 @@ unsigned int sleep(unsigned int seconds) {
 
   sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
   sylar::IOManager* iom = sylar::IOManager::GetThis();
-  iom->addTimer(seconds * 1000,
-                std::bind((void(sylar::Scheduler::*)(sylar::Fiber::ptr, int thread)) &
-                            sylar::IOManager::schedule,
-                          iom,
-                          fiber,
-                          -1));
+  iom->addTimer(seconds * 1000, [iom, fiber]() { iom->schedule(fiber); });
   sylar::Fiber::GetThis()->yield();
   return 0;
 }
@@ -205,12 +268,7 @@ int usleep(useconds_t usec) {
   }
   sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
   sylar::IOManager* iom = sylar::IOManager::GetThis();
-  iom->addTimer(usec / 1000,
-                std::bind((void(sylar::Scheduler::*)(sylar::Fiber::ptr, int thread)) &
-                            sylar::IOManager::schedule,
-                          iom,
-                          fiber,
-                          -1));
+  iom->addTimerUs(usec, [iom, fiber]() { iom->schedule(fiber); });
   sylar::Fiber::GetThis()->yield();
   return 0;
 }
@@ -220,15 +278,11 @@ int nanosleep(const struct timespec* req, struct timespec* rem) {
     return nanosleep_f(req, rem);
   }
 
-  int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
+  // 不足1微秒的部分向上取整，至少睡够请求的时间
+  uint64_t timeout_us = req->tv_sec * 1000 * 1000ull + (req->tv_nsec + 999) / 1000;
   sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
   sylar::IOManager* iom = sylar::IOManager::GetThis();
-  iom->addTimer(timeout_ms,
-                std::bind((void(sylar::Scheduler::*)(sylar::Fiber::ptr, int thread)) &
-                            sylar::IOManager::schedule,
-                          iom,
-                          fiber,
-                          -1));
+  iom->addTimerUs(timeout_us, [iom, fiber]() { iom->schedule(fiber); });
   sylar::Fiber::GetThis()->yield();
   return 0;
 }
@@ -241,7 +295,7 @@ int socket(int domain, int type, int protocol) {
   if (fd == -1) {
     return fd;
   }
-  sylar::FdMgr::GetInstance()->get(fd, true);
+  sylar::FdMgr::GetInstance()->create(fd);
   return fd;
 }
 
@@ -264,14 +318,28 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     return connect_f(fd, addr, addrlen);
   }
 
-  int n = connect_f(fd, addr, addrlen);
+  sylar::IOManager* iom = sylar::IOManager::GetThis();
+  int n = 0;
+  if (iom->isUring() && !sylar::Fiber::GetThis()->isSharedStack()) {
+    // 连接和超时都交给内核，返回EINPROGRESS时连接已经发起，按epoll方式等待
+    int res = iom->uringIo(sylar::UringRequest::Connect(fd, addr, addrlen), timeout_ms);
+    if (res == 0) {
+      return 0;
+    } else if (res != -EINPROGRESS) {
+      errno = -res;
+      return -1;
+    }
+    n = -1;
+    errno = EINPROGRESS;
+  } else {
+    n = connect_f(fd, addr, addrlen);
+  }
   if (n == 0) {
     return 0;
   } else if (n != -1 || errno != EINPROGRESS) {
     return n;
   }
 
-  sylar::IOManager* iom = sylar::IOManager::GetThis();
   sylar::Timer::ptr timer;
   std::shared_ptr<timer_info> tinfo(new timer_info);
   std::weak_ptr<timer_info> winfo(tinfo);
@@ -325,32 +393,66 @@ int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
 }
 
 int accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
-  int fd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+  int fd = -1;
+  if (!sylar::do_uring_accept(s, addr, addrlen, fd)) {
+    fd = do_io(s,
+               accept_f,
+               "accept",
+               sylar::IOManager::READ,
+               SO_RCVTIMEO,
+               sylar::UringRequest::Accept(s, addr, addrlen),
+               addr,
+               addrlen);
+  }
   if (fd >= 0) {
-    sylar::FdMgr::GetInstance()->get(fd, true);
+    sylar::FdMgr::GetInstance()->create(fd);
   }
   return fd;
 }
 
 ssize_t read(int fd, void* buf, size_t count) {
-  return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
+  return do_io(fd,
+               read_f,
+               "read",
+               sylar::IOManager::READ,
+               SO_RCVTIMEO,
+               sylar::UringRequest::Read(fd, buf, count),
+               buf,
+               count);
 }
 
 ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
-  return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+  return do_io(fd,
+               readv_f,
+               "readv",
+               sylar::IOManager::READ,
+               SO_RCVTIMEO,
+               sylar::UringRequest::Readv(fd, iov, iovcnt),
+               iov,
+               iovcnt);
 }
 
 ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
-  return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+  return do_io(sockfd,
+               recv_f,
+               "recv",
+               sylar::IOManager::READ,
+               SO_RCVTIMEO,
+               sylar::UringRequest::Recv(sockfd, buf, len, flags),
+               buf,
+               len,
+               flags);
 }
 
 ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr,
                  socklen_t* addrlen) {
+  // 需要对端地址时只使用epoll，由recvfrom填写地址长度
   return do_io(sockfd,
                recvfrom_f,
                "recvfrom",
                sylar::IOManager::READ,
                SO_RCVTIMEO,
+               src_addr ? sylar::UringRequest() : sylar::UringRequest::Recv(sockfd, buf, len, flags),
                buf,
                len,
                flags,
@@ -359,29 +461,83 @@ ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr*
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
-  return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
+  return do_io(sockfd,
+               recvmsg_f,
+               "recvmsg",
+               sylar::IOManager::READ,
+               SO_RCVTIMEO,
+               sylar::UringRequest::Recvmsg(sockfd, msg, flags),
+               msg,
+               flags);
 }
 
 ssize_t write(int fd, const void* buf, size_t count) {
-  return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+  return do_io(fd,
+               write_f,
+               "write",
+               sylar::IOManager::WRITE,
+               SO_SNDTIMEO,
+               sylar::UringRequest::Write(fd, buf, count),
+               buf,
+               count);
 }
 
 ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
-  return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+  return do_io(fd,
+               writev_f,
+               "writev",
+               sylar::IOManager::WRITE,
+               SO_SNDTIMEO,
+               sylar::UringRequest::Writev(fd, iov, iovcnt),
+               iov,
+               iovcnt);
 }
 
 ssize_t send(int s, const void* msg, size_t len, int flags) {
-  return do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+  return do_io(s,
+               send_f,
+               "send",
+               sylar::IOManager::WRITE,
+               SO_SNDTIMEO,
+               sylar::UringRequest::Send(s, msg, len, flags),
+               msg,
+               len,
+               flags);
 }
 
 ssize_t sendto(int s, const void* msg, size_t len, int flags, const struct sockaddr* to,
                socklen_t tolen) {
-  return do_io(
-    s, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+  // 指定了目的地址时以sendmsg提交
+  iovec iov = {(void*)msg, len};
+  msghdr mh;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_name = (void*)to;
+  mh.msg_namelen = tolen;
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  return do_io(s,
+               sendto_f,
+               "sendto",
+               sylar::IOManager::WRITE,
+               SO_SNDTIMEO,
+               to ? sylar::UringRequest::Sendmsg(s, &mh, flags)
+                  : sylar::UringRequest::Send(s, msg, len, flags),
+               msg,
+               len,
+               flags,
+               to,
+               tolen);
 }
 
 ssize_t sendmsg(int s, const struct msghdr* msg, int flags) {
-  return do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+  return do_io(s,
+               sendmsg_f,
+               "sendmsg",
+               sylar::IOManager::WRITE,
+               SO_SNDTIMEO,
+               sylar::UringRequest::Sendmsg(s, msg, flags),
+               msg,
+               flags);
 }
 
 int close(int fd) {
@@ -391,9 +547,12 @@ int close(int fd) {
 
   sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
   if (ctx) {
+    // 先标记关闭，被cancelAll唤醒的IO不会再重新提交
+    ctx->setClose();
     auto iom = sylar::IOManager::GetThis();
     if (iom) {
       iom->cancelAll(fd);
+      iom->uringClose(fd);
     }
     sylar::FdMgr::GetInstance()->del(fd);
   }
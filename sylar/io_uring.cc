@@ -0,0 +1,315 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 13:05:27
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 13:05:27
+ * @FilePath: /sylar_from_nanasaki/sylar/io_uring.cc
+ */
+#include "io_uring.h"
+#include "log.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+void UringRequest::prepare(io_uring_sqe* sqe) const {
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->msg_flags = opFlags;
+}
+
+UringRequest UringRequest::Read(int fd, void* buf, size_t len) {
+  UringRequest req;
+  req.opcode = IORING_OP_READ;
+  req.fd = fd;
+  req.addr = (uint64_t)buf;
+  req.len = len;
+  // -1表示使用文件当前的偏移，同read
+  req.off = (uint64_t)-1;
+  return req;
+}
+
+UringRequest UringRequest::Readv(int fd, const iovec* iov, int iovcnt) {
+  UringRequest req;
+  req.opcode = IORING_OP_READV;
+  req.fd = fd;
+  req.addr = (uint64_t)iov;
+  req.len = iovcnt;
+  req.off = (uint64_t)-1;
+  return req;
+}
+
+UringRequest UringRequest::Recv(int fd, void* buf, size_t len, int flags) {
+  UringRequest req;
+  req.opcode = IORING_OP_RECV;
+  req.fd = fd;
+  req.addr = (uint64_t)buf;
+  req.len = len;
+  req.opFlags = flags;
+  return req;
+}
+
+UringRequest UringRequest::Recvmsg(int fd, msghdr* msg, int flags) {
+  UringRequest req;
+  req.opcode = IORING_OP_RECVMSG;
+  req.fd = fd;
+  req.addr = (uint64_t)msg;
+  req.len = 1;
+  req.opFlags = flags;
+  return req;
+}
+
+UringRequest UringRequest::Write(int fd, const void* buf, size_t len) {
+  UringRequest req;
+  req.opcode = IORING_OP_WRITE;
+  req.fd = fd;
+  req.addr = (uint64_t)buf;
+  req.len = len;
+  req.off = (uint64_t)-1;
+  return req;
+}
+
+UringRequest UringRequest::Writev(int fd, const iovec* iov, int iovcnt) {
+  UringRequest req;
+  req.opcode = IORING_OP_WRITEV;
+  req.fd = fd;
+  req.addr = (uint64_t)iov;
+  req.len = iovcnt;
+  req.off = (uint64_t)-1;
+  return req;
+}
+
+UringRequest UringRequest::Send(int fd, const void* buf, size_t len, int flags) {
+  UringRequest req;
+  req.opcode = IORING_OP_SEND;
+  req.fd = fd;
+  req.addr = (uint64_t)buf;
+  req.len = len;
+  req.opFlags = flags;
+  return req;
+}
+
+UringRequest UringRequest::Sendmsg(int fd, const msghdr* msg, int flags) {
+  UringRequest req;
+  req.opcode = IORING_OP_SENDMSG;
+  req.fd = fd;
+  req.addr = (uint64_t)msg;
+  req.len = 1;
+  req.opFlags = flags;
+  return req;
+}
+
+UringRequest UringRequest::Accept(int fd, sockaddr* addr, socklen_t* addrlen) {
+  UringRequest req;
+  req.opcode = IORING_OP_ACCEPT;
+  req.fd = fd;
+  req.addr = (uint64_t)addr;
+  req.off = (uint64_t)addrlen;
+  return req;
+}
+
+UringRequest UringRequest::Connect(int fd, const sockaddr* addr, socklen_t addrlen) {
+  UringRequest req;
+  req.opcode = IORING_OP_CONNECT;
+  req.fd = fd;
+  req.addr = (uint64_t)addr;
+  // connect的地址长度放在off中
+  req.off = addrlen;
+  return req;
+}
+
+IoUring::ptr IoUring::Create(uint32_t entries) {
+  ptr uring(new IoUring);
+  if (!uring->init(entries)) {
+    return nullptr;
+  }
+  return uring;
+}
+
+IoUring::~IoUring() {
+  if (m_sqes) {
+    munmap(m_sqes, m_sqesSize);
+  }
+  if (m_cqRing && m_cqRing != m_sqRing) {
+    munmap(m_cqRing, m_cqRingSize);
+  }
+  if (m_sqRing) {
+    munmap(m_sqRing, m_sqRingSize);
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+bool IoUring::init(uint32_t entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = entries * 2;
+  m_fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (m_fd < 0) {
+    SYLAR_LOG_WARN(g_logger) << "io_uring_setup(" << entries << ") errno=" << errno
+                             << " errstr=" << strerror(errno);
+    return false;
+  }
+  // 数据未就绪时由内核内部poll等待(5.7+)；完成队列满时不丢弃CQE
+  uint32_t required = IORING_FEAT_FAST_POLL | IORING_FEAT_NODROP;
+  if ((params.features & required) != required) {
+    SYLAR_LOG_WARN(g_logger) << "io_uring features=" << params.features << " missing required";
+    return false;
+  }
+
+  m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+  }
+  m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                  IORING_OFF_SQ_RING);
+  if (m_sqRing == MAP_FAILED) {
+    m_sqRing = nullptr;
+    return false;
+  }
+  if (single_mmap) {
+    m_cqRing = m_sqRing;
+  } else {
+    m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_fd, IORING_OFF_CQ_RING);
+    if (m_cqRing == MAP_FAILED) {
+      m_cqRing = nullptr;
+      return false;
+    }
+  }
+  m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                    IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  m_sqes = (io_uring_sqe*)sqes;
+
+  char* sq = (char*)m_sqRing;
+  m_sqHead = (unsigned*)(sq + params.sq_off.head);
+  m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+  m_sqFlags = (unsigned*)(sq + params.sq_off.flags);
+  m_sqArray = (unsigned*)(sq + params.sq_off.array);
+  m_sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+  m_sqEntries = params.sq_entries;
+  m_sqeTail = *m_sqTail;
+
+  char* cq = (char*)m_cqRing;
+  m_cqHead = (unsigned*)(cq + params.cq_off.head);
+  m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+  m_cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+  m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+  return probe();
+}
+
+bool IoUring::probe() {
+  static const uint8_t s_ops[] = {IORING_OP_READ, IORING_OP_READV, IORING_OP_RECV,
+                                  IORING_OP_RECVMSG, IORING_OP_WRITE, IORING_OP_WRITEV,
+                                  IORING_OP_SEND, IORING_OP_SENDMSG, IORING_OP_ACCEPT,
+                                  IORING_OP_CONNECT, IORING_OP_LINK_TIMEOUT,
+                                  IORING_OP_ASYNC_CANCEL};
+  size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  std::unique_ptr<char[]> buf(new char[len]());
+  io_uring_probe* p = (io_uring_probe*)buf.get();
+  if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, p, 256) < 0) {
+    SYLAR_LOG_WARN(g_logger) << "io_uring probe errno=" << errno << " errstr=" << strerror(errno);
+    return false;
+  }
+  for (uint8_t op : s_ops) {
+    if (op > p->last_op || !(p->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      SYLAR_LOG_WARN(g_logger) << "io_uring op " << (int)op << " not supported";
+      return false;
+    }
+  }
+
+  // close时要按fd取消进行中的操作，较老的内核不支持这些标志，会返回EINVAL
+  io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = m_fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  sqe->user_data = 0;
+  if (submit() != 1 || enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+    return false;
+  }
+  io_uring_cqe cqe;
+  if (reap(&cqe, 1) != 1 || cqe.res == -EINVAL) {
+    SYLAR_LOG_WARN(g_logger) << "io_uring cancel by fd not supported";
+    return false;
+  }
+  return true;
+}
+
+int IoUring::enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+  int rt;
+  do {
+    rt = syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, nullptr, 0);
+  } while (rt < 0 && errno == EINTR);
+  return rt < 0 ? -errno : rt;
+}
+
+io_uring_sqe* IoUring::getSqe() {
+  unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  if (m_sqeTail - head >= m_sqEntries) {
+    return nullptr;
+  }
+  io_uring_sqe* sqe = &m_sqes[m_sqeTail & m_sqMask];
+  ++m_sqeTail;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int IoUring::submit() {
+  return submitPublished(publish());
+}
+
+unsigned IoUring::publish() {
+  unsigned tail = *m_sqTail;
+  for (; tail != m_sqeTail; ++tail) {
+    m_sqArray[tail & m_sqMask] = tail & m_sqMask;
+  }
+  __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+  // 包括之前因出错没有被内核取走的SQE
+  return tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+}
+
+int IoUring::submitPublished(unsigned to_submit) {
+  if (!to_submit) {
+    return 0;
+  }
+  // 多个线程同时提交时，内核按提交队列中实际剩余的个数取走，先进入的取走全部，后进入的返回0
+  int rt = enter(to_submit, 0, 0);
+  // 完成队列溢出时内核暂不接受新的提交，先把溢出的CQE刷回完成队列
+  while (rt == -EBUSY || rt == -EAGAIN) {
+    rt = enter(to_submit, 0, IORING_ENTER_GETEVENTS);
+  }
+  return rt;
+}
+
+size_t IoUring::reap(io_uring_cqe* cqes, size_t max) {
+  if (__atomic_load_n(m_sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) {
+    enter(0, 0, IORING_ENTER_GETEVENTS);
+  }
+  unsigned head = *m_cqHead;
+  unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+  size_t n = 0;
+  for (; head != tail && n < max; ++head, ++n) {
+    cqes[n] = m_cqes[head & m_cqMask];
+  }
+  __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+}   // namespace sylar
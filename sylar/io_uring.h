@@ -0,0 +1,162 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 13:05:27
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 13:05:27
+ * @FilePath: /sylar_from_nanasaki/sylar/io_uring.h
+ */
+#ifndef __SYLAR_IO_URING_H__
+#define __SYLAR_IO_URING_H__
+
+#include "noncopyable.h"
+#include <linux/io_uring.h>
+#include <memory>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace sylar {
+
+/**
+ * @brief 一次提交给io_uring的IO请求
+ * @details 只记录hook中用到的字段，由IOManager填写到SQE中
+ */
+struct UringRequest {
+  /// 操作码IORING_OP_XXX
+  uint8_t opcode = IORING_OP_NOP;
+  /// 文件句柄
+  int fd = -1;
+  /// 缓冲区、iovec数组、msghdr或地址
+  uint64_t addr = 0;
+  /// 缓冲区长度、iovec个数或地址长度
+  uint32_t len = 0;
+  /// 文件偏移，accept时为地址长度的指针
+  uint64_t off = 0;
+  /// msg_flags或accept_flags
+  uint32_t opFlags = 0;
+
+  /**
+   * @brief 填写SQE，不包括user_data
+   */
+  void prepare(io_uring_sqe* sqe) const;
+
+  static UringRequest Read(int fd, void* buf, size_t len);
+  static UringRequest Readv(int fd, const iovec* iov, int iovcnt);
+  static UringRequest Recv(int fd, void* buf, size_t len, int flags);
+  static UringRequest Recvmsg(int fd, msghdr* msg, int flags);
+  static UringRequest Write(int fd, const void* buf, size_t len);
+  static UringRequest Writev(int fd, const iovec* iov, int iovcnt);
+  static UringRequest Send(int fd, const void* buf, size_t len, int flags);
+  static UringRequest Sendmsg(int fd, const msghdr* msg, int flags);
+  static UringRequest Accept(int fd, sockaddr* addr, socklen_t* addrlen);
+  static UringRequest Connect(int fd, const sockaddr* addr, socklen_t addrlen);
+};
+
+/**
+ * @brief 直接通过系统调用使用的io_uring实例
+ * @details 管理mmap出来的提交队列(SQ)和完成队列(CQ)，不依赖liburing。
+ *          SQ只能有一个生产者，CQ只能有一个消费者，由调用方加锁
+ */
+class IoUring : Noncopyable {
+public:
+  using ptr = std::unique_ptr<IoUring>;
+
+  /**
+   * @brief 创建io_uring实例
+   * @details 内核需要支持FAST_POLL和NODROP特性、hook用到的全部操作以及按fd取消(5.19+)
+   * @param[in] entries 提交队列长度，完成队列长度为它的两倍
+   * @return 内核不支持或创建失败时返回nullptr
+   */
+  static ptr Create(uint32_t entries);
+
+  ~IoUring();
+
+  /**
+   * @brief io_uring的文件句柄，有新的完成事件时可读，可以加入epoll
+   */
+  int getFd() const {
+    return m_fd;
+  }
+
+  /**
+   * @brief 取一个空闲的SQE，已清零
+   * @return 提交队列已满时返回nullptr
+   */
+  io_uring_sqe* getSqe();
+
+  /**
+   * @brief 提交所有已填写的SQE
+   * @return 提交的个数，失败返回-errno
+   */
+  int submit();
+
+  /**
+   * @brief 把已填写的SQE放入提交队列，内核在下一次io_uring_enter时取走
+   * @return 提交队列中还未被内核取走的SQE个数
+   */
+  unsigned publish();
+
+  /**
+   * @brief 通知内核取走提交队列中的SQE，只读取已经publish的部分，可以不持有锁
+   * @param[in] to_submit publish返回的个数
+   * @return 内核取走的个数，失败返回-errno
+   */
+  int submitPublished(unsigned to_submit);
+
+  /**
+   * @brief 取出已完成的CQE
+   * @param[out] cqes 输出数组
+   * @param[in] max 最多取出的个数
+   * @return 取出的个数
+   */
+  size_t reap(io_uring_cqe* cqes, size_t max);
+
+private:
+  IoUring() = default;
+
+  /**
+   * @brief 创建并映射队列，检查内核特性
+   */
+  bool init(uint32_t entries);
+
+  /**
+   * @brief 检查内核是否支持需要的操作
+   */
+  bool probe();
+
+  /**
+   * @brief io_uring_enter系统调用
+   */
+  int enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+
+private:
+  /// io_uring文件句柄
+  int m_fd = -1;
+  /// 提交队列映射
+  void* m_sqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  /// 完成队列映射，内核支持SINGLE_MMAP时与提交队列相同
+  void* m_cqRing = nullptr;
+  size_t m_cqRingSize = 0;
+  /// SQE数组映射
+  io_uring_sqe* m_sqes = nullptr;
+  size_t m_sqesSize = 0;
+
+  unsigned* m_sqHead = nullptr;
+  unsigned* m_sqTail = nullptr;
+  unsigned* m_sqFlags = nullptr;
+  unsigned* m_sqArray = nullptr;
+  unsigned m_sqMask = 0;
+  unsigned m_sqEntries = 0;
+  /// 已取出的SQE的尾部，提交时写入m_sqTail
+  unsigned m_sqeTail = 0;
+
+  unsigned* m_cqHead = nullptr;
+  unsigned* m_cqTail = nullptr;
+  unsigned m_cqMask = 0;
+  io_uring_cqe* m_cqes = nullptr;
+};
+
+}   // namespace sylar
+
+#endif
@@ -6,18 +6,111 @@
  */
 
 #include "iomanager.h"
+#include "config.h"
+#include "fd_manager.h"
+#include "io_uring.h"
 #include "log.h"
 #include "macro.h"
-#include <fcntl.h>       // for fcntl()
+#include "util/util.h"
+#include <sched.h>       // for sched_yield()
 #include <sys/epoll.h>   // for epoll_xxx()
-#include <unistd.h>      // for pipe()
+#include <sys/eventfd.h> // for eventfd()
+#include <sys/syscall.h> // for __NR_epoll_pwait2
+#include <unistd.h>      // for read()/write()
 #include <cstring>
+#include <deque>
+#include <list>
 #include <string>
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static ConfigVar<std::map<std::string, uint32_t>>::ptr g_iomanager_spin_us =
+  Config::Lookup("iomanager.spin_us", std::map<std::string, uint32_t>(),
+                 "iomanager max spin microseconds before idle blocks, iomanager name -> us");
+
+static ConfigVar<std::map<std::string, std::string>>::ptr g_iomanager_backend =
+  Config::Lookup("iomanager.backend", std::map<std::string, std::string>(),
+                 "iomanager io backend, iomanager name -> epoll|io_uring");
+
+static ConfigVar<std::map<std::string, bool>>::ptr g_iomanager_persistent_events =
+  Config::Lookup("iomanager.persistent_events", std::map<std::string, bool>(),
+                 "iomanager register fds once edge-triggered, iomanager name -> bool");
+
+static ConfigVar<uint32_t>::ptr g_iomanager_uring_entries =
+  Config::Lookup("iomanager.uring_entries", (uint32_t)1024, "io_uring submission queue entries");
+
+static ConfigVar<uint32_t>::ptr g_iomanager_uring_batch =
+  Config::Lookup("iomanager.uring_batch", (uint32_t)32,
+                 "io_uring queued sqes submitted without waiting for idle, 1 submits every io");
+
+/**
+ * @brief 提交给io_uring的操作，CQE的user_data指向它
+ */
+struct UringOp {
+  enum Type {
+    /// 一次IO，完成后恢复协程
+    IO,
+    /// multishot accept，每个新连接产生一个CQE
+    ACCEPT,
+  };
+  Type type;
+};
+
+/**
+ * @brief 一次IO操作
+ * @details 收割的线程在协程挂起期间写入结果，不能放在协程栈上，共享栈协程挂起后栈属于其他协程。 链接了超时SQE时会产生两个CQE，超时SQE的user_data为本对象地址加1，两个CQE都收到后才恢复协程
+ */
+struct UringIoOp : public UringOp {
+  /// 等待的协程
+  Fiber::ptr fiber;
+  /// 协程所在的调度器
+  Scheduler* scheduler = nullptr;
+  /// IO的结果
+  int res = 0;
+  /// 是否是超时取消的
+  bool timedOut = false;
+  /// IO的fd上未完成的操作数，完成后减1
+  std::atomic<uint32_t>* uringOps = nullptr;
+  /// 链接的超时SQE的超时时间，内核在提交时读取，提交可能晚于uringIo返回到idle
+  __kernel_timespec ts;
+  /// 还未收到的CQE个数
+  std::atomic<int> cqes = {1};
+};
+
+/**
+ * @brief 等待multishot accept的协程
+ */
+struct UringAcceptWaiter {
+  /// 超时定时器通过id找到等待者
+  uint64_t id = 0;
+  Fiber::ptr fiber;
+  Scheduler* scheduler = nullptr;
+  /// 新连接的fd或-errno
+  int res = 0;
+};
+
+/**
+ * @brief 监听socket上multishot accept的连接队列
+ */
+struct IOManager::UringAcceptQueue : public UringOp {
+  Mutex mutex;
+  /// 是否已提交multishot accept
+  bool armed = false;
+  /// 监听socket已关闭，之后收到的连接直接关闭
+  bool closed = false;
+  /// 已接受还没有被取走的连接
+  std::deque<int> fds;
+  /// 等待新连接的协程，先到先得
+  std::list<UringAcceptWaiter*> waiters;
+  uint64_t nextId = 0;
+  /// 提交期间保持自身存活，最后一个CQE到达后释放
+  std::shared_ptr<UringAcceptQueue> self;
+  /// 监听socket上未完成的操作数，multishot accept结束后减1
+  std::atomic<uint32_t>* uringOps = nullptr;
+};
+
 enum EpollCtlOp {};
 
 static std::ostream& operator<<(std::ostream& os, const EpollCtlOp& op) {
@@ -82,18 +175,17 @@ void IOManager::FdContext::resetEventContext(EventContext& ctx) {
   ctx.cb = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(IOManager::Event event) {
-  // 待触发的事件必须已被注册过
-  SYLAR_ASSERT(events & event);
-  /**
-   *  清除该事件，表示不再关注该事件了
-   * 也就是说，注册的IO事件是一次性的，如果想持续关注某个socket
-   * fd的读写事件，那么每次触发事件之后都要重新添加
-   */
-  events = (Event)(events & ~event);
+void IOManager::FdContext::triggerEvent(IOManager::Event event, PendingTasks* pending) {
   // 调度对应的协程
   EventContext& ctx = getEventContext(event);
-  if (ctx.cb) {
+  SYLAR_ASSERT(ctx.scheduler && (ctx.cb || ctx.fiber));
+  if (pending && ctx.scheduler == pending->scheduler) {
+    if (ctx.cb) {
+      pending->cbs.push_back(std::move(ctx.cb));
+    } else {
+      pending->fibers.push_back(std::move(ctx.fiber));
+    }
+  } else if (ctx.cb) {
     ctx.scheduler->schedule(ctx.cb);
   } else {
     ctx.scheduler->schedule(ctx.fiber);
@@ -102,90 +194,161 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
   return;
 }
 
-IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
+uint32_t IOManager::FdContext::acquireBits(uint32_t bits) {
+  uint32_t s = state.load(std::memory_order_relaxed);
+  for (uint32_t spins = 0;; ++spins) {
+    if (!(s & bits)) {
+      if (state.compare_exchange_weak(s, s | bits, std::memory_order_acquire,
+                                      std::memory_order_relaxed)) {
+        return s | bits;
+      }
+      continue;
+    }
+    // 持有者只做几次赋值或一次epoll_ctl，自旋一会后让出CPU，避免持有者被抢占时空转
+    if (spins >= 64) {
+      sched_yield();
+    }
+    s = state.load(std::memory_order_relaxed);
+  }
+}
+
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name, bool auto_start)
   : Scheduler(threads, use_caller, name) {
   m_epfd = epoll_create(5000);
   SYLAR_ASSERT(m_epfd > 0);
 
-  int rt = pipe(m_tickleFds);
-  SYLAR_ASSERT(!rt);
+  // 非阻塞方式，配合边缘触发
+  m_tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  SYLAR_ASSERT(m_tickleFd >= 0);
 
-  // 关注pipe读句柄的可读事件，用于tickle协程
+  // 关注eventfd的可读事件，用于tickle协程，所有idle线程阻塞在同一个epoll上，一次写入只唤醒其中一个
   epoll_event event;
   memset(&event, 0, sizeof(epoll_event));
   event.events = EPOLLIN | EPOLLET;
-  event.data.fd = m_tickleFds[0];
+  event.data.fd = m_tickleFd;
 
-  // 非阻塞方式，配合边缘触发
-  rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
+  int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd, &event);
   SYLAR_ASSERT(!rt);
 
-  rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
-  SYLAR_ASSERT(!rt);
+  auto spin = g_iomanager_spin_us->getValue();
+  auto it = spin.find(name);
+  if (it == spin.end()) {
+    it = spin.find("*");
+  }
+  if (it != spin.end()) {
+    m_spinUs = it->second;
+  }
 
-  contextResize(32);
+  auto persistent = g_iomanager_persistent_events->getValue();
+  auto pit = persistent.find(name);
+  if (pit == persistent.end()) {
+    pit = persistent.find("*");
+  }
+  if (pit != persistent.end()) {
+    m_persistentEvents = pit->second;
+  }
 
-  start();
+  auto backend = g_iomanager_backend->getValue();
+  auto bit = backend.find(name);
+  if (bit == backend.end()) {
+    bit = backend.find("*");
+  }
+  if (bit != backend.end() && bit->second == "io_uring") {
+    m_uring = IoUring::Create(g_iomanager_uring_entries->getValue());
+    m_uringBatch = std::max<uint32_t>(g_iomanager_uring_batch->getValue(), 1);
+    if (m_uring) {
+      // 有新的CQE时io_uring的fd可读，和eventfd一样由idle线程在epoll_wait中等待
+      memset(&event, 0, sizeof(epoll_event));
+      event.events = EPOLLIN | EPOLLET;
+      event.data.fd = m_uring->getFd();
+      rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_uring->getFd(), &event);
+      SYLAR_ASSERT(!rt);
+    } else {
+      SYLAR_LOG_WARN(g_logger) << "IOManager " << name << " io_uring unavailable, use epoll";
+    }
+  } else if (bit != backend.end() && bit->second != "epoll") {
+    SYLAR_LOG_WARN(g_logger) << "IOManager " << name << " unknown backend " << bit->second
+                             << ", use epoll";
+  }
+
+  if (auto_start) {
+    start();
+  }
 }
 
 IOManager::~IOManager() {
   stop();
+  m_uring.reset();
   close(m_epfd);
-  close(m_tickleFds[0]);
-  close(m_tickleFds[1]);
+  close(m_tickleFd);
 
-  for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-    if (m_fdContexts[i]) {
-      delete m_fdContexts[i];
-    }
+  for (size_t i = 0; i < FD_SEGMENTS; ++i) {
+    delete[] m_fdSegments[i].load(std::memory_order_relaxed);
   }
 }
 
-void IOManager::contextResize(size_t size) {
-  m_fdContexts.resize(size);
-
-  for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-    if (!m_fdContexts[i]) {
-      m_fdContexts[i] = new FdContext;
-      m_fdContexts[i]->fd = i;
+IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
+  if (SYLAR_UNLIKELY(fd < 0)) {
+    return nullptr;
+  }
+  // 第k段保存[32 * (2^k - 1), 32 * (2^(k+1) - 1))范围内的fd
+  uint32_t v = (uint32_t)fd / 32 + 1;
+  size_t k = 31 - __builtin_clz(v);
+  size_t base = 32 * (((size_t)1 << k) - 1);
+  FdContext* seg = m_fdSegments[k].load(std::memory_order_acquire);
+  if (SYLAR_UNLIKELY(!seg)) {
+    if (!auto_create) {
+      return nullptr;
+    }
+    // 多个线程同时分配时只有一个能发布，其余的释放自己分配的段
+    size_t size = (size_t)32 << k;
+    FdContext* new_seg = new FdContext[size];
+    for (size_t i = 0; i < size; ++i) {
+      new_seg[i].fd = base + i;
+    }
+    if (m_fdSegments[k].compare_exchange_strong(seg, new_seg, std::memory_order_acq_rel,
+                                                std::memory_order_acquire)) {
+      seg = new_seg;
+    } else {
+      delete[] new_seg;
     }
   }
+  return &seg[fd - base];
 }
 
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
   // 找到fd对应的FdContext，如果不存在，那就分配一个
-  FdContext* fd_ctx = nullptr;
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() > fd) {
-    fd_ctx = m_fdContexts[fd];
-    lock.unlock();
-  } else {
-    lock.unlock();
-    RWMutexType::WriteLock lock2(m_mutex);
-    contextResize(fd * 1.5);
-    fd_ctx = m_fdContexts[fd];
+  FdContext* fd_ctx = getFdContext(fd, true);
+  if (SYLAR_UNLIKELY(!fd_ctx)) {
+    SYLAR_LOG_ERROR(g_logger) << "addEvent invalid fd=" << fd;
+    return -1;
+  }
+  if (m_persistentEvents) {
+    return addPersistentEvent(fd_ctx, event, std::move(cb));
   }
 
   // 同一个fd不允许重复添加相同的事件
-  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-  if (SYLAR_UNLIKELY(fd_ctx->events & event)) {
+  FdContext::Lock lock(*fd_ctx);
+  Event events = fd_ctx->getEvents();
+  if (SYLAR_UNLIKELY(events & event)) {
     SYLAR_LOG_ERROR(g_logger) << "addEvent assert fd=" << fd << " event=" << (EPOLL_EVENTS)event
-                              << " fd_ctx.event=" << (EPOLL_EVENTS)fd_ctx->events;
-    SYLAR_ASSERT(!(fd_ctx->events & event));
+                              << " fd_ctx.event=" << (EPOLL_EVENTS)events;
+    SYLAR_ASSERT(!(events & event));
   }
 
   // 将新的事件加入epoll_wait，使用epoll_event的私有指针存储FdContext的位置
-  int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  int op = events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
   epoll_event epevent;
-  epevent.events = EPOLLET | fd_ctx->events | event;
+  epevent.events = EPOLLET | events | event;
   epevent.data.ptr = fd_ctx;
 
+  m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
   int rt = epoll_ctl(m_epfd, op, fd, &epevent);
   if (rt) {
     SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << (EpollCtlOp)op << ", " << fd
                               << ", " << (EPOLL_EVENTS)epevent.events << "):" << rt << " (" << errno
                               << ") (" << strerror(errno)
-                              << ") fd_ctx->events=" << (EPOLL_EVENTS)fd_ctx->events;
+                              << ") fd_ctx->events=" << (EPOLL_EVENTS)events;
     return -1;
   }
 
@@ -193,7 +356,6 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
   ++m_pendingEventCount;
 
   // 找到这个fd的event事件对应的EventContext，对其中的scheduler, cb, fiber进行赋值
-  fd_ctx->events = (Event)(fd_ctx->events | event);
   FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
   SYLAR_ASSERT(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
 
@@ -206,30 +368,132 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     SYLAR_ASSERT2(event_ctx.fiber->getState() == Fiber::RUNNING,
                   "state=" << event_ctx.fiber->getState());
   }
+  fd_ctx->state.fetch_or(event, std::memory_order_release);
+  return 0;
+}
+
+int IOManager::addPersistentEvent(FdContext* fd_ctx, Event event, std::function<void()> cb) {
+  int fd = fd_ctx->fd;
+  // fd号会被复用。旧fd没有经过本IOManager上hook的close关闭时(未开启hook的线程、其他IOManager)，
+  // 注册状态不会清除，而内核已经把旧fd移出了epoll。hook创建fd时会建立新的FdCtx，代数不同说明需要重新注册
+  FdCtx::ptr ctx = FdMgr::GetInstance()->get(fd);
+  uint32_t gen = ctx ? ctx->getGeneration() : 0;
+  auto registered = [fd_ctx, gen](std::memory_order order) {
+    return (fd_ctx->state.load(order) & FdContext::REGISTERED)
+           && fd_ctx->generation.load(std::memory_order_relaxed) == gen;
+  };
+  // 第一次等待时以读写事件一起注册，之后不再修改，只有这里需要加锁
+  if (!registered(std::memory_order_acquire)) {
+    FdContext::Lock lock(*fd_ctx);
+    if (!registered(std::memory_order_relaxed)) {
+      // cancelAll之后没有关闭的fd仍在epoll中，期间记录的就绪可能已经过时，重新注册时epoll会报告当前的就绪
+      fd_ctx->state.fetch_and(~FdContext::READY_MASK, std::memory_order_relaxed);
+      int op = EPOLL_CTL_ADD;
+      epoll_event epevent;
+      epevent.events = EPOLLET | EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+      epevent.data.ptr = fd_ctx;
+
+      m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
+      int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+      if (rt && errno == EEXIST) {
+        op = EPOLL_CTL_MOD;
+        m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
+        rt = epoll_ctl(m_epfd, op, fd, &epevent);
+      }
+      if (rt) {
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << (EpollCtlOp)op << ", " << fd
+                                  << ", " << (EPOLL_EVENTS)epevent.events << "):" << rt << " ("
+                                  << errno << ") (" << strerror(errno) << ")";
+        return -1;
+      }
+      fd_ctx->generation.store(gen, std::memory_order_relaxed);
+      fd_ctx->state.fetch_or(FdContext::REGISTERED, std::memory_order_release);
+    }
+  }
+
+  // 占用事件上下文，同一个fd不允许重复添加相同的事件
+  uint32_t busy = (uint32_t)event << FdContext::BUSY_SHIFT;
+  uint32_t ready = (uint32_t)event << FdContext::READY_SHIFT;
+  uint32_t state = fd_ctx->acquireBits(busy);
+  if (SYLAR_UNLIKELY(state & event)) {
+    SYLAR_LOG_ERROR(g_logger) << "addEvent assert fd=" << fd << " event=" << (EPOLL_EVENTS)event
+                              << " fd_ctx.event=" << (EPOLL_EVENTS)(state & FdContext::EVENT_MASK);
+    SYLAR_ASSERT(!(state & event));
+  }
+
+  Scheduler* sc = Scheduler::GetThis();
+  if (!(state & ready)) {
+    // 先填好事件上下文，再在释放占用的同时设置等待标志；
+    // 占用期间到达的就绪被idle记录下来，设置标志前要再检查一次
+    ++m_pendingEventCount;
+    FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+    event_ctx.scheduler = sc;
+    if (cb) {
+      event_ctx.cb.swap(cb);
+    } else {
+      event_ctx.fiber = Fiber::GetThis();
+      SYLAR_ASSERT2(event_ctx.fiber->getState() == Fiber::RUNNING,
+                    "state=" << event_ctx.fiber->getState());
+    }
+    while (!(state & ready)) {
+      if (fd_ctx->state.compare_exchange_weak(state, (state | event) & ~busy,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+        return 0;
+      }
+    }
+    // 填写期间已经就绪，收回事件上下文
+    --m_pendingEventCount;
+    cb.swap(event_ctx.cb);
+    fd_ctx->resetEventContext(event_ctx);
+  }
+
+  // 等待之前事件已经就绪，直接唤醒，不用经过epoll
+  fd_ctx->state.fetch_and(~(ready | busy), std::memory_order_acq_rel);
+  sc = sc ? sc : this;
+  if (cb) {
+    sc->schedule(std::move(cb));
+  } else {
+    sc->schedule(Fiber::GetThis());
+  }
   return 0;
 }
 
 bool IOManager::delEvent(int fd, Event event) {
   // 找到fd对应的FdContext
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = getFdContext(fd, false);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
-  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-  if (SYLAR_UNLIKELY(!(fd_ctx->events & event))) {
+  if (m_persistentEvents) {
+    // 持久注册模式下只清除等待
+    uint32_t busy = (uint32_t)event << FdContext::BUSY_SHIFT;
+    if (SYLAR_UNLIKELY(!(fd_ctx->acquireBits(busy) & event))) {
+      fd_ctx->releaseBits(busy);
+      return false;
+    }
+    fd_ctx->state.fetch_and(~(uint32_t)event, std::memory_order_relaxed);
+    --m_pendingEventCount;
+    fd_ctx->resetEventContext(fd_ctx->getEventContext(event));
+    fd_ctx->releaseBits(busy);
+    return true;
+  }
+
+  FdContext::Lock lock(*fd_ctx);
+  Event events = fd_ctx->getEvents();
+  if (SYLAR_UNLIKELY(!(events & event))) {
     return false;
   }
 
   // 清除指定的事件，表示不关心这个事件了，如果清除之后结果为0，则从epoll_wait中删除该文件描述符
-  Event new_events = (Event)(fd_ctx->events & ~event);
+  Event new_events = (Event)(events & ~event);
   int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
   epoll_event epevent;
   epevent.events = EPOLLET | new_events;
   epevent.data.ptr = fd_ctx;
 
+  m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
   int rt = epoll_ctl(m_epfd, op, fd, &epevent);
   if (rt) {
     SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << (EpollCtlOp)op << ", " << fd
@@ -241,7 +505,7 @@ bool IOManager::delEvent(int fd, Event event) {
   // 待执行事件数减1
   --m_pendingEventCount;
   // 重置该fd对应的event事件上下文
-  fd_ctx->events = new_events;
+  fd_ctx->state.fetch_and(~(uint32_t)event, std::memory_order_relaxed);
   FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
   fd_ctx->resetEventContext(event_ctx);
   return true;
@@ -249,25 +513,39 @@ bool IOManager::delEvent(int fd, Event event) {
 
 bool IOManager::cancelEvent(int fd, Event event) {
   // 找到fd对应的FdContext
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = getFdContext(fd, false);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
-  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-  if (SYLAR_UNLIKELY(!(fd_ctx->events & event))) {
+  if (m_persistentEvents) {
+    // 持久注册模式下只清除等待，占用上下文期间idle把到达的事件记录为就绪
+    uint32_t busy = (uint32_t)event << FdContext::BUSY_SHIFT;
+    if (SYLAR_UNLIKELY(!(fd_ctx->acquireBits(busy) & event))) {
+      fd_ctx->releaseBits(busy);
+      return false;
+    }
+    fd_ctx->state.fetch_and(~(uint32_t)event, std::memory_order_relaxed);
+    fd_ctx->triggerEvent(event);
+    fd_ctx->releaseBits(busy);
+    --m_pendingEventCount;
+    return true;
+  }
+
+  FdContext::Lock lock(*fd_ctx);
+  Event events = fd_ctx->getEvents();
+  if (SYLAR_UNLIKELY(!(events & event))) {
     return false;
   }
 
   // 删除事件
-  Event new_events = (Event)(fd_ctx->events & ~event);
+  Event new_events = (Event)(events & ~event);
   int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
   epoll_event epevent;
   epevent.events = EPOLLET | new_events;
   epevent.data.ptr = fd_ctx;
 
+  m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
   int rt = epoll_ctl(m_epfd, op, fd, &epevent);
   if (rt) {
     SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << (EpollCtlOp)op << ", " << fd
@@ -277,6 +555,7 @@ bool IOManager::cancelEvent(int fd, Event event) {
   }
 
   // 删除之前触发一次事件
+  fd_ctx->state.fetch_and(~(uint32_t)event, std::memory_order_relaxed);
   fd_ctx->triggerEvent(event);
   // 活跃事件数减1
   --m_pendingEventCount;
@@ -285,44 +564,73 @@ bool IOManager::cancelEvent(int fd, Event event) {
 
 bool IOManager::cancelAll(int fd) {
   // 找到fd对应的FdContext
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = getFdContext(fd, false);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
-  FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-  if (!fd_ctx->events) {
-    return false;
+  bool uring_cancelled = false;
+  if (m_uring && fd_ctx->uringOps.load(std::memory_order_acquire) > 0) {
+    // 取消fd上所有提交给io_uring的操作，等待的协程收到-ECANCELED。
+    // 没有进行中操作的fd(普通文件、管道、只走epoll的socket)不需要取消。
+    // 排在fd上还未提交的IO之后，一起提交
+    {
+      Spinlock::Lock lock(m_uringMutex);
+      io_uring_sqe* sqe = getUringSqe();
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->fd = fd;
+      sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+      sqe->user_data = 0;
+    }
+    submitUring();
+    uring_cancelled = true;
   }
 
-  // 删除全部事件
-  int op = EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events = 0;
-  epevent.data.ptr = fd_ctx;
+  FdContext::Lock lock(*fd_ctx);
+  Event events = NONE;
+  if (m_persistentEvents) {
+    // fd关闭时内核自动将它移出epoll，这里只清除注册状态，没有关闭的fd下次addEvent时重新注册
+    fd_ctx->acquireBits(FdContext::BUSY_MASK);
+    uint32_t state = fd_ctx->state.fetch_and(
+      ~(FdContext::REGISTERED | FdContext::READY_MASK | FdContext::EVENT_MASK),
+      std::memory_order_acq_rel);
+    events = (Event)(state & FdContext::EVENT_MASK);
+  } else {
+    events = fd_ctx->getEvents();
+    if (!events) {
+      return uring_cancelled;
+    }
 
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if (rt) {
-    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << (EpollCtlOp)op << ", " << fd
-                              << ", " << (EPOLL_EVENTS)epevent.events << "):" << rt << " (" << errno
-                              << ") (" << strerror(errno) << ")";
-    return false;
+    // 删除全部事件
+    int op = EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events = 0;
+    epevent.data.ptr = fd_ctx;
+
+    m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
+    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+    if (rt) {
+      SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << (EpollCtlOp)op << ", " << fd
+                                << ", " << (EPOLL_EVENTS)epevent.events << "):" << rt << " ("
+                                << errno << ") (" << strerror(errno) << ")";
+      return false;
+    }
+    fd_ctx->state.fetch_and(~FdContext::EVENT_MASK, std::memory_order_relaxed);
   }
 
   // 触发全部已注册的事件
-  if (fd_ctx->events & READ) {
+  if (events & READ) {
     fd_ctx->triggerEvent(READ);
     --m_pendingEventCount;
   }
-  if (fd_ctx->events & WRITE) {
+  if (events & WRITE) {
     fd_ctx->triggerEvent(WRITE);
     --m_pendingEventCount;
   }
-
-  SYLAR_ASSERT(fd_ctx->events == 0);
-  return true;
+  if (m_persistentEvents) {
+    fd_ctx->releaseBits(FdContext::BUSY_MASK);
+  }
+  return events || uring_cancelled;
 }
 
 IOManager* IOManager::GetThis() {
@@ -337,10 +645,18 @@ IOManager* IOManager::GetThis() {
 void IOManager::tickle() {
   SYLAR_LOG_DEBUG(g_logger) << "tickle";
   if (!hasIdleThreads()) {
+    m_tickleSuppressed.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // 已经有一个唤醒在途，被唤醒的线程会检查任务队列，这次tickle可以合并掉
+  if (m_tickled.load(std::memory_order_relaxed) || m_tickled.exchange(true)) {
+    m_tickleSuppressed.fetch_add(1, std::memory_order_relaxed);
     return;
   }
-  int rt = write(m_tickleFds[1], "T", 1);
-  SYLAR_ASSERT(rt == 1);
+  m_tickleIssued.fetch_add(1, std::memory_order_relaxed);
+  uint64_t one = 1;
+  int rt = write(m_tickleFd, &one, sizeof(one));
+  SYLAR_ASSERT(rt == sizeof(one));
 }
 
 bool IOManager::stopping() {
@@ -348,11 +664,11 @@ bool IOManager::stopping() {
   return stopping(timeout);
 }
 
-bool IOManager::stopping(uint64_t& timeout) {
+bool IOManager::stopping(uint64_t& timeout_us) {
   // 对于IOManager而言，必须等所有待调度的IO事件都执行完了才可以退出
   // 增加定时器功能后，还应该保证没有剩余的定时器待触发
-  timeout = getNextTimer();
-  return timeout == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
+  timeout_us = getNextTimerUs();
+  return timeout_us == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
 }
 
 /**
@@ -367,6 +683,10 @@ void IOManager::idle() {
   const uint64_t MAX_EVNETS = 256;
   epoll_event* events = new epoll_event[MAX_EVNETS]();
   std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr) { delete[] ptr; });
+  PendingTasks pending;
+  pending.scheduler = this;
+  // 本线程的自旋时间，随负载在[0, m_spinUs]内调整
+  uint64_t spin_budget = m_spinUs;
 
   while (true) {
     // 获取下一个定时器的超时时间，顺便判断调度器是否停止
@@ -376,72 +696,141 @@ void IOManager::idle() {
       break;
     }
 
-    // 阻塞在epoll_wait上，等待事件发生或定时器超时
+    // 本线程和其他线程切出协程时积压的SQE在自旋和阻塞之前一次提交
+    if (m_uring && m_uringQueued.load(std::memory_order_relaxed)) {
+      submitUring();
+    }
+
     int rt = 0;
-    do {
-      // 默认超时时间5秒，如果下一个定时器的超时时间大于5秒，仍以5秒来计算超时，避免定时器超时时间太大时，epoll_wait一直阻塞
-      static const int MAX_TIMEOUT = 5000;
-      if (next_timeout != ~0ull) {
-        next_timeout = std::min((int)next_timeout, MAX_TIMEOUT);
+    bool spin_hit = false;
+    uint64_t spin_max = m_spinUs;
+    spin_budget = std::min(spin_budget, spin_max);
+    if (spin_budget && next_timeout) {
+      // 阻塞之前先自旋一小段时间，刚空闲就来的任务和IO事件可以省掉一次阻塞和唤醒，
+      // 命中说明负载较高，下次多自旋一会，未命中说明比较空闲，下次少自旋一会
+      spin_hit = spinPoll(events, MAX_EVNETS, spin_budget, rt);
+      if (spin_hit) {
+        ++m_spinHits;
+        spin_budget = std::min(spin_budget * 2, spin_max);
       } else {
-        next_timeout = MAX_TIMEOUT;
+        ++m_spinMisses;
+        spin_budget /= 2;
+        // 自旋期间定时器可能已经超时，重新获取超时时间
+        if (SYLAR_UNLIKELY(stopping(next_timeout))) {
+          SYLAR_LOG_DEBUG(g_logger) << "name=" << getName() << "idle stopping exit";
+          break;
+        }
       }
-      rt = epoll_wait(m_epfd, events, MAX_EVNETS, (int)next_timeout);
-      if (rt < 0 && errno == EINTR) {
-        continue;
-      } else {
-        break;
-      }
-    } while (true);
-
-    // 收集所有已超时的定时器，执行回调函数
-    std::vector<std::function<void()>> cbs;
-    listExpiredCb(cbs);
-    if (!cbs.empty()) {
-      for (const auto& cb : cbs) {
-        schedule(cb);
+    }
+
+    if (!spin_hit) {
+      uint64_t begin = spin_max ? sylar::util::GetCurrentUS() : 0;
+      // 阻塞在epoll_wait上，等待事件发生或定时器超时
+      do {
+        // 默认超时时间5秒，如果下一个定时器的超时时间大于5秒，仍以5秒来计算超时，避免定时器超时时间太大时，epoll_wait一直阻塞
+        static const uint64_t MAX_TIMEOUT_US = 5000 * 1000;
+        next_timeout = std::min(next_timeout, MAX_TIMEOUT_US);
+        rt = waitEvents(events, MAX_EVNETS, next_timeout);
+        if (rt < 0 && errno == EINTR) {
+          continue;
+        } else {
+          break;
+        }
+      } while (true);
+      // 阻塞后很快就被唤醒，说明多自旋一会本可以等到，自旋时间衰减到0之后也靠这里恢复
+      if (spin_max && rt > 0 && sylar::util::GetCurrentUS() - begin < spin_max) {
+        spin_budget = std::min(std::max(spin_budget * 2, (spin_max + 7) / 8), spin_max);
       }
-      cbs.clear();
     }
 
+    // 被uringIo通知唤醒时马上提交，之后本线程可能一直在执行任务，不会很快回到idle
+    if (m_uring && m_uringQueued.load(std::memory_order_relaxed)) {
+      submitUring();
+    }
+
+    // 收集所有已超时的定时器的回调函数，和就绪的IO事件一起批量调度
+    // 回调从定时器中取出到加入调度之前，其他线程在定时器和任务队列里都看不到它，计入待处理事件数，
+    // 避免其他线程在此期间判断可以停止而退出，导致之后指定到该线程的任务无法执行
+    ++m_pendingEventCount;
+    listExpiredCb(pending.cbs);
+    size_t triggered = 0;
+
     // 遍历所有发生的事件，根据epoll_event的私有指针找到对应的FdContext，进行事件处理
     for (int i = 0; i < rt; ++i) {
       epoll_event& event = events[i];
-      if (event.data.fd == m_tickleFds[0]) {
-        // ticklefd[0]用于通知协程调度，这时只需要把管道里的内容读完即可
-        uint8_t dummy[256];
-        while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0)
+      if (event.data.fd == m_tickleFd) {
+        // eventfd用于通知协程调度，先读走计数再清除在途标记，之后的tickle会重新写入；
+        // 如果先清除标记，清除之后写入的计数被这次读走，它的就绪事件也随之失效，标记却一直保持为true，
+        // 之后的tickle都会被合并掉。读走到清除之间的tickle被合并，但本线程马上就会去检查任务队列，不会丢失通知
+        uint64_t dummy;
+        while (read(m_tickleFd, &dummy, sizeof(dummy)) > 0)
           ;
+        m_tickled.store(false);
+        continue;
+      }
+      if (m_uring && event.data.fd == m_uring->getFd()) {
+        triggered += reapUring(pending);
         continue;
       }
 
       FdContext* fd_ctx = (FdContext*)event.data.ptr;
-      FdContext::MutexType::Lock lock(fd_ctx->mutex);
       /**
        * EPOLLERR: 出错，比如写读端已经关闭的pipe
        * EPOLLHUP: 套接字对端关闭
        * 出现这两种事件，应该同时触发fd的读和写事件，否则有可能出现注册的事件永远执行不到的情况
        */
       if (event.events & (EPOLLERR | EPOLLHUP)) {
-        event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+        event.events |= EPOLLIN | EPOLLOUT;
       }
-      int real_events = NONE;
-      if (event.events & EPOLLIN) {
+      uint32_t real_events = NONE;
+      if (event.events & (EPOLLIN | EPOLLRDHUP)) {
         real_events |= READ;
       }
       if (event.events & EPOLLOUT) {
         real_events |= WRITE;
       }
 
-      if ((fd_ctx->events & real_events) == NONE) {
+      if (m_persistentEvents) {
+        // 持久注册的fd不修改epoll，一次CAS占用有协程等待的事件上下文并清除等待标志，
+        // 没有协程等待或上下文正被占用的事件记录为就绪，由下一次addEvent消费
+        uint32_t state = fd_ctx->state.load(std::memory_order_relaxed);
+        uint32_t taken;
+        uint32_t new_state;
+        do {
+          taken = real_events & state & ~(state >> FdContext::BUSY_SHIFT);
+          uint32_t ready = real_events & ~taken;
+          new_state = (state & ~taken) | (taken << FdContext::BUSY_SHIFT)
+                      | (ready << FdContext::READY_SHIFT);
+        } while (new_state != state
+                 && !fd_ctx->state.compare_exchange_weak(state, new_state,
+                                                         std::memory_order_acq_rel,
+                                                         std::memory_order_relaxed));
+        if (taken & READ) {
+          fd_ctx->triggerEvent(READ, &pending);
+          fd_ctx->releaseBits(READ << FdContext::BUSY_SHIFT);
+          ++triggered;
+        }
+        if (taken & WRITE) {
+          fd_ctx->triggerEvent(WRITE, &pending);
+          fd_ctx->releaseBits(WRITE << FdContext::BUSY_SHIFT);
+          ++triggered;
+        }
+        continue;
+      }
+
+      FdContext::Lock lock(*fd_ctx);
+      uint32_t events = fd_ctx->getEvents();
+      real_events &= events;
+      if (real_events == NONE) {
         continue;
       }
 
       // 剔除已经发生的事件，将剩下的事件重新加入epoll_wait
-      int left_events = (fd_ctx->events & ~real_events);
+      uint32_t left_events = events & ~real_events;
       int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
       event.events = EPOLLET | left_events;
 
+      m_epollCtlCount.fetch_add(1, std::memory_order_relaxed);
       int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
       if (rt2) {
         SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", " << (EpollCtlOp)op << ", "
@@ -450,17 +839,25 @@ void IOManager::idle() {
         continue;
       }
 
-      // 处理已经发生的事件，也就是让调度器调度指定的函数或协程
+      // 处理已经发生的事件，也就是让调度器调度指定的函数或协程，这里先收集起来
+      fd_ctx->state.fetch_and(~real_events, std::memory_order_relaxed);
       if (real_events & READ) {
-        fd_ctx->triggerEvent(READ);
-        --m_pendingEventCount;
+        fd_ctx->triggerEvent(READ, &pending);
+        ++triggered;
       }
       if (real_events & WRITE) {
-        fd_ctx->triggerEvent(WRITE);
-        --m_pendingEventCount;
+        fd_ctx->triggerEvent(WRITE, &pending);
+        ++triggered;
       }
     }   // end for
 
+    // 整批加入调度，加入之后才减少待处理事件数
+    schedule(pending.fibers.begin(), pending.fibers.end());
+    schedule(pending.cbs.begin(), pending.cbs.end());
+    pending.fibers.clear();
+    pending.cbs.clear();
+    m_pendingEventCount -= triggered + 1;
+
     /**
      * 一旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)重新检查是否有新任务要调度
      * 上面triggerEvent实际也只是把对应的fiber重新加入调度，要执行的话还要等idle协程退出
@@ -473,8 +870,323 @@ void IOManager::idle() {
   }   // end while(true)
 }
 
+bool IOManager::spinPoll(epoll_event* events, int max_events, uint64_t budget_us, int& rt) {
+  uint64_t begin = sylar::util::GetCurrentUS();
+  do {
+    if (hasPendingTasks()) {
+      rt = 0;
+      return true;
+    }
+    m_epollWaitCount.fetch_add(1, std::memory_order_relaxed);
+    rt = epoll_wait(m_epfd, events, max_events, 0);
+    if (rt > 0) {
+      return true;
+    }
+  } while (sylar::util::GetCurrentUS() - begin < budget_us);
+  rt = 0;
+  return false;
+}
+
+int IOManager::waitEvents(epoll_event* events, int max_events, uint64_t timeout_us) {
+  m_epollWaitCount.fetch_add(1, std::memory_order_relaxed);
+#ifdef __NR_epoll_pwait2
+  // 内核不支持(ENOSYS)时记下来，之后都走epoll_wait
+  static std::atomic<bool> s_pwait2 = {true};
+  if (s_pwait2.load(std::memory_order_relaxed)) {
+    struct timespec ts;
+    ts.tv_sec = timeout_us / 1000000;
+    ts.tv_nsec = timeout_us % 1000000 * 1000;
+    int rt = syscall(__NR_epoll_pwait2, m_epfd, events, max_events, &ts, nullptr, 0);
+    if (rt >= 0 || errno != ENOSYS) {
+      return rt;
+    }
+    s_pwait2.store(false, std::memory_order_relaxed);
+  }
+#endif
+  // 向上取整，避免不足1毫秒的定时器变成epoll_wait(0)的忙等
+  return epoll_wait(m_epfd, events, max_events, (int)((timeout_us + 999) / 1000));
+}
+
 void IOManager::onTimerInsertedAtFront() {
   tickle();
 }
 
+io_uring_sqe* IOManager::getUringSqe() {
+  io_uring_sqe* sqe = m_uring->getSqe();
+  while (SYLAR_UNLIKELY(!sqe)) {
+    ++m_uringSubmitCount;
+    m_uring->submit();
+    sqe = m_uring->getSqe();
+  }
+  ++m_uringQueued;
+  return sqe;
+}
+
+int IOManager::submitUring() {
+  unsigned to_submit = 0;
+  {
+    Spinlock::Lock lock(m_uringMutex);
+    m_uringQueued.store(0, std::memory_order_relaxed);
+    to_submit = m_uring->publish();
+  }
+  if (!to_submit) {
+    return 0;
+  }
+  ++m_uringSubmitCount;
+  return m_uring->submitPublished(to_submit);
+}
+
+int IOManager::uringIo(const UringRequest& req, uint64_t timeout_ms) {
+  SYLAR_ASSERT(m_uring);
+  std::unique_ptr<UringIoOp> op(new UringIoOp);
+  op->type = UringOp::IO;
+  op->fiber = Fiber::GetThis();
+  op->scheduler = Scheduler::GetThis();
+  if (req.fd >= 0) {
+    op->uringOps = &getFdContext(req.fd, true)->uringOps;
+    ++*op->uringOps;
+  }
+  ++m_pendingEventCount;
+  if (timeout_ms != ~0ull) {
+    op->ts.tv_sec = timeout_ms / 1000;
+    op->ts.tv_nsec = timeout_ms % 1000 * 1000 * 1000;
+    op->cqes = 2;
+  }
+  bool first = false;
+  {
+    Spinlock::Lock lock(m_uringMutex);
+    first = m_uringQueued.load(std::memory_order_relaxed) == 0;
+    io_uring_sqe* sqe = getUringSqe();
+    req.prepare(sqe);
+    sqe->user_data = (uint64_t)op.get();
+    if (timeout_ms != ~0ull) {
+      // 超时SQE链接在IO之后
+      sqe->flags |= IOSQE_IO_LINK;
+      io_uring_sqe* tsqe = getUringSqe();
+      tsqe->opcode = IORING_OP_LINK_TIMEOUT;
+      tsqe->fd = -1;
+      tsqe->addr = (uint64_t)&op->ts;
+      tsqe->len = 1;
+      tsqe->user_data = (uint64_t)op.get() | 1;
+    }
+  }
+  // 一般不在这里提交，由空闲线程把积压的SQE一次提交。本线程切出协程后可能一直有任务可执行，
+  // 所以一批中的第一个SQE入队时通知一个空闲线程；没有空闲线程或积压太多时立即提交，避免等待太久
+  int rt = 0;
+  if (m_uringQueued.load(std::memory_order_relaxed) >= m_uringBatch) {
+    rt = submitUring();
+  } else if (first) {
+    if (hasIdleThreads()) {
+      tickle();
+    } else {
+      rt = submitUring();
+    }
+  }
+  if (SYLAR_UNLIKELY(rt < 0)) {
+    SYLAR_LOG_ERROR(g_logger) << "io_uring submit error " << rt << " opcode=" << (int)req.opcode
+                              << " fd=" << req.fd;
+    SYLAR_ASSERT2(false, "io_uring submit");
+  }
+
+  // 所有CQE都收到后由收割的线程调度回来
+  Fiber::GetThis()->yield();
+  if (op->timedOut) {
+    return -ETIMEDOUT;
+  }
+  return op->res;
+}
+
+int IOManager::uringAccept(int fd, uint64_t timeout_ms) {
+  SYLAR_ASSERT(m_uring);
+  if (!m_multishotAccept) {
+    return -EAGAIN;
+  }
+  std::shared_ptr<UringAcceptQueue> queue;
+  {
+    MutexType::Lock lock(m_acceptMutex);
+    auto& q = m_acceptQueues[fd];
+    if (!q) {
+      q = std::make_shared<UringAcceptQueue>();
+      q->type = UringOp::ACCEPT;
+    }
+    queue = q;
+  }
+
+  // 和UringIoOp一样不能放在协程栈上
+  std::unique_ptr<UringAcceptWaiter> waiter(new UringAcceptWaiter);
+  Timer::ptr timer;
+  {
+    MutexType::Lock lock(queue->mutex);
+    if (!queue->fds.empty()) {
+      int client = queue->fds.front();
+      queue->fds.pop_front();
+      return client;
+    }
+    if (!queue->armed) {
+      {
+        Spinlock::Lock lock2(m_uringMutex);
+        io_uring_sqe* sqe = getUringSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->user_data = (uint64_t)queue.get();
+      }
+      int rt = submitUring();
+      if (rt < 0) {
+        return rt;
+      }
+      queue->uringOps = &getFdContext(fd, true)->uringOps;
+      ++*queue->uringOps;
+      queue->armed = true;
+      queue->self = queue;
+      ++m_pendingEventCount;
+    }
+    waiter->id = ++queue->nextId;
+    waiter->fiber = Fiber::GetThis();
+    waiter->scheduler = Scheduler::GetThis();
+    queue->waiters.push_back(waiter.get());
+
+    if (timeout_ms != ~0ull) {
+      std::weak_ptr<UringAcceptQueue> wqueue(queue);
+      uint64_t id = waiter->id;
+      timer = addTimer(timeout_ms, [wqueue, id]() {
+        auto q = wqueue.lock();
+        if (!q) {
+          return;
+        }
+        MutexType::Lock lock(q->mutex);
+        for (auto it = q->waiters.begin(); it != q->waiters.end(); ++it) {
+          if ((*it)->id == id) {
+            UringAcceptWaiter* w = *it;
+            q->waiters.erase(it);
+            w->res = -ETIMEDOUT;
+            w->scheduler->schedule(std::move(w->fiber));
+            break;
+          }
+        }
+      });
+    }
+  }
+
+  Fiber::GetThis()->yield();
+  if (timer) {
+    timer->cancel();
+  }
+  return waiter->res;
+}
+
+void IOManager::uringClose(int fd) {
+  if (!m_uring) {
+    return;
+  }
+  std::shared_ptr<UringAcceptQueue> queue;
+  {
+    MutexType::Lock lock(m_acceptMutex);
+    auto it = m_acceptQueues.find(fd);
+    if (it == m_acceptQueues.end()) {
+      return;
+    }
+    queue = it->second;
+    m_acceptQueues.erase(it);
+  }
+  // 进行中的multishot accept已经被cancelAll取消，之后到达的连接在收割时关闭
+  MutexType::Lock lock(queue->mutex);
+  queue->closed = true;
+  for (int client : queue->fds) {
+    close(client);
+  }
+  queue->fds.clear();
+}
+
+size_t IOManager::reapUring(PendingTasks& pending) {
+  static const size_t MAX_CQES = 64;
+  io_uring_cqe cqes[MAX_CQES];
+  size_t completed = 0;
+  size_t n = 0;
+  do {
+    {
+      Spinlock::Lock lock(m_uringReapMutex);
+      n = m_uring->reap(cqes, MAX_CQES);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      completed += onUringComplete(cqes[i], pending);
+    }
+  } while (n == MAX_CQES);
+  return completed;
+}
+
+size_t IOManager::onUringComplete(const io_uring_cqe& cqe, PendingTasks& pending) {
+  // 取消请求没有关联的操作
+  if (!cqe.user_data) {
+    return 0;
+  }
+  UringOp* uop = (UringOp*)(cqe.user_data & ~1ull);
+  // 调度器与pending相同时放入pending批量调度
+  auto wake = [&pending](Scheduler* sc, Fiber::ptr&& fiber) {
+    if (sc == pending.scheduler) {
+      pending.fibers.push_back(std::move(fiber));
+    } else {
+      sc->schedule(std::move(fiber));
+    }
+  };
+
+  if (uop->type == UringOp::IO) {
+    UringIoOp* op = (UringIoOp*)uop;
+    if (cqe.user_data & 1) {
+      // 超时SQE触发时返回-ETIME，IO先完成时被取消
+      if (cqe.res == -ETIME) {
+        op->timedOut = true;
+      }
+    } else {
+      op->res = cqe.res;
+    }
+    if (--op->cqes > 0) {
+      return 0;
+    }
+    if (op->uringOps) {
+      --*op->uringOps;
+    }
+    wake(op->scheduler, std::move(op->fiber));
+    return 1;
+  }
+
+  UringAcceptQueue* queue = (UringAcceptQueue*)uop;
+  // 最后一个CQE到达时释放自身，在解锁之后析构
+  std::shared_ptr<UringAcceptQueue> self;
+  MutexType::Lock lock(queue->mutex);
+  if (cqe.res >= 0) {
+    if (queue->closed) {
+      close(cqe.res);
+    } else if (!queue->waiters.empty()) {
+      UringAcceptWaiter* w = queue->waiters.front();
+      queue->waiters.pop_front();
+      w->res = cqe.res;
+      wake(w->scheduler, std::move(w->fiber));
+    } else {
+      queue->fds.push_back(cqe.res);
+    }
+  } else if (cqe.res == -EINVAL) {
+    SYLAR_LOG_INFO(g_logger) << "io_uring multishot accept not supported";
+    m_multishotAccept = false;
+  }
+  if (cqe.flags & IORING_CQE_F_MORE) {
+    return 0;
+  }
+
+  // multishot accept结束，出错时把错误交给所有等待的协程，被取消的协程会重新提交
+  queue->armed = false;
+  if (queue->uringOps) {
+    --*queue->uringOps;
+  }
+  self.swap(queue->self);
+  int res = cqe.res == -EINVAL ? -EAGAIN : (cqe.res < 0 ? cqe.res : -ECANCELED);
+  for (auto w : queue->waiters) {
+    w->res = res;
+    wake(w->scheduler, std::move(w->fiber));
+  }
+  queue->waiters.clear();
+  lock.unlock();
+  return 1;
+}
+
 }   // namespace sylar
\ No newline at end of file
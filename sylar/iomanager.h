@@ -10,9 +10,17 @@
 
 #include "scheduler.h"
 #include "timer.h"
+#include <unordered_map>
+
+struct epoll_event;
+struct io_uring_sqe;
+struct io_uring_cqe;
 
 namespace sylar {
 
+class IoUring;
+struct UringRequest;
+
 class IOManager : public Scheduler, public TimerManager {
 public:
   using ptr = std::shared_ptr<IOManager>;
@@ -32,12 +40,28 @@ public:
   };
 
 private:
+  /**
+   * @brief 一轮epoll_wait中待调度的任务
+   * @details idle处理完所有就绪事件和超时定时器后整批加入调度，只加一次锁，最多唤醒一次
+   */
+  struct PendingTasks {
+    /// 批量调度使用的调度器，回调指定了其他调度器的事件直接调度
+    Scheduler* scheduler = nullptr;
+    /// 待调度的协程
+    std::vector<Fiber::ptr> fibers;
+    /// 待调度的回调函数
+    std::vector<std::function<void()>> cbs;
+  };
+
   /**
    * @brief socket fd上下文类
-   * @details 每个socket fd都对应一个FdContext，包括fd的值，fd上的事件，以及fd的读写事件上下文
+   * @details 每个socket fd都对应一个FdContext，包括fd的值，fd上的事件，以及fd的读写事件上下文。
+   *          fd的事件状态保存在一个原子状态字中：修改epoll注册时持有状态字中的锁位，串行化epoll_ctl；
+   *          持久注册模式下注册之后不再调用epoll_ctl，等待、触发和取消事件都只对状态字做CAS，
+   *          事件上下文由状态字中该事件的占用位保护
    */
   struct FdContext {
-    typedef Mutex MutexType;
+    using Lock = ScopedLockImpl<FdContext>;
     /**
      * @brief 事件上下文类
      * @details fd的每个事件都有一个事件上下文，保存这个事件的回调函数以及执行回调函数的调度器
@@ -52,6 +76,19 @@ private:
       std::function<void()> cb;
     };
 
+    /// 状态字中READ/WRITE所在的位表示有协程在等待该事件
+    static constexpr uint32_t EVENT_MASK = READ | WRITE;
+    /// 持久注册模式下，事件已经就绪但没有协程等待，READ/WRITE左移READY_SHIFT位
+    static constexpr uint32_t READY_SHIFT = 4;
+    static constexpr uint32_t READY_MASK = EVENT_MASK << READY_SHIFT;
+    /// 事件上下文正在被读写，READ/WRITE左移BUSY_SHIFT位
+    static constexpr uint32_t BUSY_SHIFT = 8;
+    static constexpr uint32_t BUSY_MASK = EVENT_MASK << BUSY_SHIFT;
+    /// 持久注册模式下，已经以IN|OUT|RDHUP边缘触发加入了epoll
+    static constexpr uint32_t REGISTERED = 0x10000;
+    /// 修改epoll注册的锁
+    static constexpr uint32_t LOCKED = 0x80000000;
+
     /**
      * @brief 获取事件上下文类
      * @param[in] event 事件类型
@@ -67,10 +104,46 @@ private:
 
     /**
      * @brief 触发事件
-     * @details 根据事件类型调用对应上下文结构中的调度器去调度回调协程或回调函数
+     * @details 根据事件类型调用对应上下文结构中的调度器去调度回调协程或回调函数。
+     *          调用方已经清除了该事件的等待标志，并持有锁或占用了该事件的上下文
      * @param[in] event 事件类型
+     * @param[out] pending 不为空且事件的调度器与pending相同时，回调先放入pending，由调用方批量调度
+     */
+    void triggerEvent(Event event, PendingTasks* pending = nullptr);
+
+    /**
+     * @brief 有协程等待的事件
      */
-    void triggerEvent(Event event);
+    Event getEvents() const {
+      return (Event)(state.load(std::memory_order_acquire) & EVENT_MASK);
+    }
+
+    /**
+     * @brief 等到状态字中的bits全部为0后将它们置1
+     * @return 置位后的状态字
+     */
+    uint32_t acquireBits(uint32_t bits);
+
+    /**
+     * @brief 将状态字中的bits清0
+     */
+    void releaseBits(uint32_t bits) {
+      state.fetch_and(~bits, std::memory_order_release);
+    }
+
+    /**
+     * @brief 加锁，串行化epoll_ctl
+     */
+    void lock() {
+      acquireBits(LOCKED);
+    }
+
+    /**
+     * @brief 解锁
+     */
+    void unlock() {
+      releaseBits(LOCKED);
+    }
 
     /// 读事件上下文
     EventContext read;
@@ -78,10 +151,12 @@ private:
     EventContext write;
     /// 事件关联的句柄
     int fd = 0;
-    /// 该fd添加了哪些事件的回调函数，或者说该fd关心哪些事件
-    Event events = NONE;
-    /// 事件的Mutex
-    MutexType mutex;
+    /// 原子状态字
+    std::atomic<uint32_t> state = {0};
+    /// 持久注册模式下，注册时fd对应的FdCtx的代数，没有FdCtx时为0
+    std::atomic<uint32_t> generation = {0};
+    /// 提交给io_uring还未完成的操作数，为0时cancelAll不需要向io_uring提交取消请求
+    std::atomic<uint32_t> uringOps = {0};
   };
 
 public:
@@ -90,8 +165,11 @@ public:
    * @param[in] threads 线程数量
    * @param[in] use_caller 是否将调用线程包含进去
    * @param[in] name 调度器的名称
+   * @param[in] auto_start 是否在构造时启动。为false时可以先调用setInjectQueue等只能在启动前修改的设置，
+   *            再手动调用start
    */
-  IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "IOManager");
+  IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "IOManager",
+            bool auto_start = true);
 
   /**
    * @brief 析构函数
@@ -139,10 +217,137 @@ public:
    */
   static IOManager* GetThis();
 
+  /**
+   * @brief 是否持久注册fd
+   * @details 由配置项iomanager.persistent_events中本IOManager名称对应的值决定，没有则取"*"对应的值。
+   *          开启后fd第一次等待事件时以IN|OUT|RDHUP边缘触发加入epoll，直到关闭都不再修改，
+   *          事件触发时没有协程等待就记录为就绪，之后的addEvent直接唤醒，不用再调用epoll_ctl。
+   *          记录的就绪可能已经被非阻塞IO消费掉，被唤醒的一方需要重试IO，hook的IO会自动重试。
+   *          fd必须通过hook的close关闭，否则同一个fd值的新文件会被当成已经注册
+   */
+  bool isPersistentEvents() const {
+    return m_persistentEvents;
+  }
+
+  /**
+   * @brief 调用epoll_ctl修改IO事件的次数
+   */
+  uint64_t getEpollCtlCount() const {
+    return m_epollCtlCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 调用epoll_wait的次数，包括自旋时的非阻塞轮询
+   */
+  uint64_t getEpollWaitCount() const {
+    return m_epollWaitCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 为提交SQE调用io_uring_enter的次数
+   */
+  uint64_t getUringSubmitCount() const {
+    return m_uringSubmitCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 是否使用io_uring后端
+   * @details 由配置项iomanager.backend中本IOManager名称对应的值决定，没有则取"*"对应的值，
+   *          值为io_uring且内核支持时使用io_uring，否则使用epoll。
+   *          io_uring后端下hook的IO在数据未就绪时提交给内核完成，完成后再恢复协程，
+   *          省掉epoll方式中注册事件、等待和重新执行系统调用的开销；协程调度和定时器仍然使用epoll
+   */
+  bool isUring() const {
+    return m_uring != nullptr;
+  }
+
+  /**
+   * @brief 后端名称，epoll或io_uring
+   */
+  const char* getBackend() const {
+    return m_uring ? "io_uring" : "epoll";
+  }
+
+  /**
+   * @brief 通过io_uring执行一次IO，当前协程挂起直到完成
+   * @details 只能在io_uring后端的协程中调用。超时通过链接的超时SQE实现，超时后内核取消该IO。
+   *          SQE先放入提交队列，一批中的第一个SQE通知一个空闲线程，由它批量提交；
+   *          没有空闲线程或积压的SQE达到配置项iomanager.uring_batch时立即提交。
+   *          req中的缓冲区在挂起期间由内核写入，不能位于共享栈协程的栈上
+   * @param[in] req IO请求
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+   * @return 成功返回对应系统调用的返回值，失败返回-errno，超时返回-ETIMEDOUT，
+   *         被cancelAll取消返回-ECANCELED
+   */
+  int uringIo(const UringRequest& req, uint64_t timeout_ms = ~0ull);
+
+  /**
+   * @brief 通过multishot accept接受连接，当前协程挂起直到有新连接
+   * @details 第一次调用时在监听socket上提交一个multishot accept，之后每个新连接产生一个CQE，
+   *          没有协程在等待时先缓存起来，直到fd关闭或出错才需要重新提交
+   * @param[in] fd 监听socket
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+   * @return 成功返回新连接的fd，失败返回-errno，超时返回-ETIMEDOUT，被cancelAll取消返回-ECANCELED，
+   *         返回-EAGAIN表示内核不支持multishot accept，应改用普通的accept
+   */
+  int uringAccept(int fd, uint64_t timeout_ms = ~0ull);
+
+  /**
+   * @brief fd关闭前调用，关闭multishot accept已经接受但还没有取走的连接
+   */
+  void uringClose(int fd);
+
+  /**
+   * @brief 实际写eventfd唤醒idle线程的次数
+   */
+  uint64_t getTickleIssued() const {
+    return m_tickleIssued.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 被合并或因没有idle线程而省掉的tickle次数
+   */
+  uint64_t getTickleSuppressed() const {
+    return m_tickleSuppressed.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 设置idle协程阻塞前的最长自旋时间，单位微秒，0表示不自旋
+   * @details 任务队列为空时，idle协程先在任务队列和epoll_wait(0)上自旋，期间有任务或IO事件就不用阻塞和唤醒。
+   *          每个线程的实际自旋时间在[0, us]内自适应：自旋命中时加倍，未命中时减半，
+   *          阻塞后很快就被唤醒时也加倍。默认值取自配置项iomanager.spin_us中本IOManager名称对应的值，
+   *          没有则取"*"对应的值，可以随时修改
+   */
+  void setSpinUs(uint32_t us) {
+    m_spinUs = us;
+  }
+
+  /**
+   * @brief 获取idle协程阻塞前的最长自旋时间，单位微秒
+   */
+  uint32_t getSpinUs() const {
+    return m_spinUs;
+  }
+
+  /**
+   * @brief 自旋期间等到了任务或IO事件的次数
+   */
+  uint64_t getSpinHits() const {
+    return m_spinHits.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 自旋超时后进入阻塞等待的次数
+   */
+  uint64_t getSpinMisses() const {
+    return m_spinMisses.load(std::memory_order_relaxed);
+  }
+
 protected:
   /**
    * @brief 通知调度器有任务要调度
-   * @details 写pipe让idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他任务
+   * @details 写eventfd让一个idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他任务。
+   *          已经有一个唤醒在途时，后续的tickle被合并，被唤醒的线程取到任务后发现还有剩余任务会再tickle下一个线程
    */
   void tickle() override;
 
@@ -162,10 +367,10 @@ protected:
 
   /**
    * @brief 判断是否可以停止，同时获取最近一个定时器的超时时间
-   * @param[out] timeout 最近一个定时器的超时时间，用于idle协程的epoll_wait
+   * @param[out] timeout_us 最近一个定时器的超时时间(微秒)，用于idle协程的epoll_wait
    * @return 返回是否可以停止
    */
-  bool stopping(uint64_t& timeout);
+  bool stopping(uint64_t& timeout_us);
 
   /**
    * @brief
@@ -174,22 +379,111 @@ protected:
   void onTimerInsertedAtFront() override;
 
   /**
-   * @brief 重置socket句柄上下文的容器大小
-   * @param[in] size 容量大小
+   * @brief 在任务队列和epoll_wait(0)上自旋
+   * @param[out] events 就绪事件
+   * @param[in] max_events 最多返回的事件数
+   * @param[in] budget_us 自旋时间，单位微秒
+   * @param[out] rt 就绪事件数
+   * @return 自旋期间是否等到了任务或IO事件
    */
-  void contextResize(size_t size);
+  bool spinPoll(epoll_event* events, int max_events, uint64_t budget_us, int& rt);
+
+  /**
+   * @brief 等待IO事件，超时精确到微秒
+   * @details 内核支持时使用epoll_pwait2，否则退回epoll_wait，超时向上取整到毫秒
+   * @param[out] events 就绪事件
+   * @param[in] max_events 最多返回的事件数
+   * @param[in] timeout_us 超时时间(微秒)
+   * @return 同epoll_wait
+   */
+  int waitEvents(epoll_event* events, int max_events, uint64_t timeout_us);
+
+  /**
+   * @brief 取出io_uring所有已完成的CQE，恢复对应的协程
+   * @param[out] pending 待批量调度的任务
+   * @return 完成的待处理事件数
+   */
+  size_t reapUring(PendingTasks& pending);
+
+  /**
+   * @brief 处理一个CQE
+   * @return 完成的待处理事件数
+   */
+  size_t onUringComplete(const io_uring_cqe& cqe, PendingTasks& pending);
+
+  /**
+   * @brief 获取一个SQE，提交队列满时先提交，需持有m_uringMutex
+   */
+  io_uring_sqe* getUringSqe();
+
+  /**
+   * @brief 提交所有已放入提交队列的SQE，一次io_uring_enter
+   * @return 内核取走的个数，失败返回-errno
+   */
+  int submitUring();
+
+  /**
+   * @brief 获取fd对应的FdContext，不加锁
+   * @param[in] fd socket句柄
+   * @param[in] auto_create 所在的段不存在时是否分配
+   * @return fd无效或所在的段不存在且不分配时返回nullptr
+   */
+  FdContext* getFdContext(int fd, bool auto_create);
+
+  /**
+   * @brief 持久注册模式下添加事件，只有第一次注册fd时加锁
+   */
+  int addPersistentEvent(FdContext* fd_ctx, Event event, std::function<void()> cb);
 
 private:
   /// epoll 文件句柄
   int m_epfd = 0;
-  /// pipe 文件句柄，fd[0]读端，fd[1]写端
-  int m_tickleFds[2];
+  /// eventfd 文件句柄，用于tickle
+  int m_tickleFd = -1;
+  /// 是否有已写入eventfd但还未被idle线程读走的唤醒
+  alignas(64) std::atomic<bool> m_tickled = {false};
+  /// 实际写eventfd的次数
+  std::atomic<uint64_t> m_tickleIssued = {0};
+  /// 省掉的tickle次数
+  std::atomic<uint64_t> m_tickleSuppressed = {0};
+  /// idle阻塞前的最长自旋时间，单位微秒
+  std::atomic<uint32_t> m_spinUs = {0};
+  /// 自旋命中次数
+  std::atomic<uint64_t> m_spinHits = {0};
+  /// 自旋未命中次数
+  std::atomic<uint64_t> m_spinMisses = {0};
   /// 当前等待执行的IO事件数量
   std::atomic<size_t> m_pendingEventCount = {0};
-  /// IOManager的Mutex
-  RWMutexType m_mutex;
-  /// socket事件上下文的容器
-  std::vector<FdContext*> m_fdContexts;
+  /// 是否持久注册fd
+  bool m_persistentEvents = false;
+  /// 调用epoll_ctl修改IO事件的次数
+  std::atomic<uint64_t> m_epollCtlCount = {0};
+  /// 调用epoll_wait的次数
+  std::atomic<uint64_t> m_epollWaitCount = {0};
+  /// fd上下文表的段数，第k段有32<<k个FdContext，足够容纳所有非负的int
+  static constexpr size_t FD_SEGMENTS = 27;
+  /// 分段的fd上下文表，段只增不减，分配后地址不变，读取不用加锁
+  std::atomic<FdContext*> m_fdSegments[FD_SEGMENTS] = {};
+
+  struct UringAcceptQueue;
+  /// io_uring实例，使用epoll后端时为空
+  std::unique_ptr<IoUring> m_uring;
+  /// 填写SQE的锁，持有期间不执行系统调用
+  Spinlock m_uringMutex;
+  /// 已填写还未提交的SQE个数
+  std::atomic<uint32_t> m_uringQueued = {0};
+  /// 积压多少个SQE时不等idle立即提交
+  uint32_t m_uringBatch = 32;
+  /// 为提交SQE调用io_uring_enter的次数
+  std::atomic<uint64_t> m_uringSubmitCount = {0};
+  /// 收割CQE的锁
+  Spinlock m_uringReapMutex;
+  /// 内核是否支持multishot accept
+  std::atomic<bool> m_multishotAccept = {true};
+  /// 监听socket -> multishot accept的连接队列
+  std::unordered_map<int, std::shared_ptr<UringAcceptQueue>> m_acceptQueues;
+  /// m_acceptQueues的锁
+  Mutex m_acceptMutex;
 };
 
 }   // end namespace sylar
@@ -0,0 +1,118 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 13:20:05
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 13:20:05
+ * @FilePath: /sylar_from_nanasaki/sylar/mpsc_queue.h
+ */
+#ifndef __SYLAR_MPSC_QUEUE_H__
+#define __SYLAR_MPSC_QUEUE_H__
+
+#include "noncopyable.h"
+#include <atomic>
+#include <type_traits>
+
+namespace sylar {
+
+/**
+ * @brief 侵入式MPSC队列的节点
+ * @details 需要放入MpscQueue的类型继承该类即可，拷贝时不会拷贝next指针
+ */
+struct MpscNode {
+  MpscNode() = default;
+  MpscNode(const MpscNode&) {
+  }
+  MpscNode& operator=(const MpscNode&) {
+    return *this;
+  }
+
+  /// 队列中的下一个节点
+  std::atomic<MpscNode*> next = {nullptr};
+};
+
+/**
+ * @brief 侵入式无锁多生产者单消费者队列
+ * @details Dmitry Vyukov的intrusive MPSC队列，入队只需要一次原子交换，不分配内存。
+ *          生产者交换完head但还未链接next的短暂窗口内，pop()可能返回nullptr，
+ *          调用方需要结合额外的计数判断队列是否真正为空
+ * @attention pop()同一时间只能有一个线程调用，由调用方保证互斥
+ * @tparam T 节点类型，必须继承自MpscNode
+ */
+template <class T>
+class MpscQueue : Noncopyable {
+  static_assert(std::is_base_of<MpscNode, T>::value, "T must derive from MpscNode");
+
+public:
+  MpscQueue()
+    : m_head(&m_stub)
+    , m_tail(&m_stub) {
+  }
+
+  /**
+   * @brief 入队一个节点，多线程安全
+   */
+  void push(T* node) {
+    push(node, node);
+  }
+
+  /**
+   * @brief 入队一串已经通过next链接好的节点，多线程安全
+   * @param[in] first 第一个节点
+   * @param[in] last 最后一个节点
+   */
+  void push(T* first, T* last) {
+    pushNode(first, last);
+  }
+
+  /**
+   * @brief 出队一个节点，只能由一个消费者调用
+   * @return 队列为空(或生产者还未完成链接)时返回nullptr
+   */
+  T* pop() {
+    MpscNode* tail = m_tail;
+    MpscNode* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &m_stub) {
+      if (!next) {
+        return nullptr;
+      }
+      m_tail = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+      m_tail = next;
+      return static_cast<T*>(tail);
+    }
+    if (tail != m_head.load(std::memory_order_acquire)) {
+      // 有生产者正在入队，还未链接完成
+      return nullptr;
+    }
+    // 队列中只剩最后一个节点，重新放入stub才能把它取出来
+    pushNode(&m_stub, &m_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+      m_tail = next;
+      return static_cast<T*>(tail);
+    }
+    return nullptr;
+  }
+
+private:
+  void pushNode(MpscNode* first, MpscNode* last) {
+    last->next.store(nullptr, std::memory_order_relaxed);
+    MpscNode* prev = m_head.exchange(last, std::memory_order_acq_rel);
+    prev->next.store(first, std::memory_order_release);
+  }
+
+private:
+  /// 最后入队的节点，生产者之间竞争
+  alignas(64) std::atomic<MpscNode*> m_head;
+  /// 下一个出队的节点，只有消费者访问
+  alignas(64) MpscNode* m_tail;
+  /// 哨兵节点
+  MpscNode m_stub;
+};
+
+}   // namespace sylar
+
+#endif
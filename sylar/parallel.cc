@@ -0,0 +1,37 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 07:02:36
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 07:02:36
+ * @FilePath: /sylar_from_nanasaki/sylar/parallel.cc
+ */
+#include "parallel.h"
+
+namespace sylar {
+
+void ParallelGroup::setError(int error) {
+  Spinlock::Lock lock(m_mutex);
+  if (!m_failed) {
+    m_error = error;
+    m_failed.store(true, std::memory_order_release);
+  }
+}
+
+void ParallelGroup::setException(std::exception_ptr e) {
+  Spinlock::Lock lock(m_mutex);
+  if (!m_failed) {
+    m_exception = e;
+    m_failed.store(true, std::memory_order_release);
+  }
+}
+
+int ParallelGroup::wait() {
+  m_waitGroup.wait();
+  // 所有分片都已完成，不会再有写入
+  if (m_exception) {
+    std::rethrow_exception(m_exception);
+  }
+  return m_error;
+}
+
+}   // namespace sylar
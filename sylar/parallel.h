@@ -0,0 +1,167 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 07:02:36
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 07:02:36
+ * @FilePath: /sylar_from_nanasaki/sylar/parallel.h
+ */
+#ifndef __SYLAR_PARALLEL_H__
+#define __SYLAR_PARALLEL_H__
+
+#include "fiber_sync.h"
+#include "macro.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace sylar {
+
+/**
+ * @brief 一组并行分片的共享状态
+ * @details 分片通过shared_ptr持有，调用方返回后仍在收尾的分片不会访问已释放的状态。
+ *          只记录第一个失败分片的异常或错误码，出错后各分片中还没有开始的元素不再执行
+ */
+class ParallelGroup : Noncopyable {
+public:
+  using ptr = std::shared_ptr<ParallelGroup>;
+
+  /**
+   * @brief 构造函数
+   * @param[in] parts 分片数
+   */
+  ParallelGroup(size_t parts)
+    : m_waitGroup(parts) {
+  }
+
+  /**
+   * @brief 是否已有分片失败
+   */
+  bool isFailed() const {
+    return m_failed.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief 记录分片返回的错误码
+   */
+  void setError(int error);
+
+  /**
+   * @brief 记录分片抛出的异常
+   */
+  void setException(std::exception_ptr e);
+
+  /**
+   * @brief 一个分片完成
+   */
+  void done() {
+    m_waitGroup.done();
+  }
+
+  /**
+   * @brief 等待所有分片完成
+   * @details 在调度器的协程中调用时挂起当前协程，不阻塞线程
+   * @return 第一个失败分片的错误码，全部成功返回0。第一个失败的分片抛出了异常时在这里重新抛出
+   */
+  int wait();
+
+private:
+  FiberWaitGroup m_waitGroup;
+  Spinlock m_mutex;
+  std::atomic<bool> m_failed = {false};
+  /// 第一个错误码
+  int m_error = 0;
+  /// 第一个异常
+  std::exception_ptr m_exception;
+};
+
+/**
+ * @brief 把区间[begin, end)分片到调度器的线程上并行执行f(i)，等待全部完成后返回
+ * @param[in] sc 执行分片的调度器，nullptr表示当前线程的调度器
+ * @param[in] begin 起始下标
+ * @param[in] end 结束下标
+ * @param[in] f 对每个下标执行的函数，返回void或int，返回非0表示出错
+ * @param[in] grain 每个分片的元素数，0表示按调度器线程数平均分片。
+ *                  f中有IO等会挂起协程的操作(如扇出请求后端)时传1，每个元素一个协程，互不等待
+ * @return 第一个出错的错误码，全部成功返回0
+ * @details 在调度器的协程中调用时只挂起调用协程，其所在的线程继续执行其他任务(包括这里的分片)。
+ *          f抛出的异常在调用方重新抛出，出错后还没开始的元素不再执行
+ * @attention 调用方是sc的use_caller主线程时，sc必须已经在stop中执行调度，否则分片得不到执行
+ */
+template <class Func>
+int ParallelFor(Scheduler* sc, size_t begin, size_t end, Func&& f, size_t grain = 0) {
+  using Result = std::invoke_result_t<Func&, size_t>;
+  static_assert(std::is_void<Result>::value || std::is_convertible<Result, int>::value,
+                "ParallelFor function must return void or int error code");
+  if (begin >= end) {
+    return 0;
+  }
+  if (!sc) {
+    sc = Scheduler::GetThis();
+  }
+  SYLAR_ASSERT2(sc, "ParallelFor without scheduler");
+
+  size_t n = end - begin;
+  if (grain == 0) {
+    size_t threads = std::max<size_t>(sc->getThreadCount(), 1);
+    grain = (n + threads - 1) / threads;
+  }
+  size_t parts = (n + grain - 1) / grain;
+  ParallelGroup::ptr group = std::make_shared<ParallelGroup>(parts);
+
+  std::vector<std::function<void()>> cbs;
+  cbs.reserve(parts);
+  for (size_t i = 0; i < parts; ++i) {
+    size_t part_begin = begin + i * grain;
+    size_t part_end = part_begin + std::min(grain, end - part_begin);
+    // 调用方等到所有分片完成才返回，可以引用f
+    cbs.push_back([group, &f, part_begin, part_end]() {
+      try {
+        for (size_t j = part_begin; j < part_end && !group->isFailed(); ++j) {
+          if constexpr (std::is_void<Result>::value) {
+            f(j);
+          } else {
+            int rt = f(j);
+            if (rt) {
+              group->setError(rt);
+            }
+          }
+        }
+      } catch (...) {
+        group->setException(std::current_exception());
+      }
+      group->done();
+    });
+  }
+  sc->schedule(cbs.begin(), cbs.end());
+  return group->wait();
+}
+
+/**
+ * @brief 在调度器的线程上并行计算f(in[i])，按原顺序返回结果
+ * @param[in] sc 执行分片的调度器，nullptr表示当前线程的调度器
+ * @param[in] in 输入
+ * @param[in] f 对每个元素执行的函数，返回值类型需要可以默认构造
+ * @param[in] grain 每个分片的元素数，同ParallelFor
+ * @details f抛出的异常在调用方重新抛出
+ */
+template <class T, class Func>
+auto ParallelMap(Scheduler* sc, const std::vector<T>& in, Func&& f, size_t grain = 0)
+  -> std::vector<std::decay_t<std::invoke_result_t<Func&, const T&>>> {
+  using Result = std::decay_t<std::invoke_result_t<Func&, const T&>>;
+  // vector<bool>的相邻元素共用一个字节，不能在多个线程中同时写
+  static_assert(!std::is_same<Result, bool>::value, "ParallelMap can not return bool");
+  std::vector<Result> out(in.size());
+  ParallelFor(
+    sc, 0, in.size(), [&out, &in, &f](size_t i) { out[i] = f(in[i]); }, grain);
+  return out;
+}
+
+}   // namespace sylar
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 16:48:31
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 16:48:31
+ * @FilePath: /sylar_from_nanasaki/sylar/reactor_group.cc
+ */
+#include "reactor_group.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include <map>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static ConfigVar<std::map<std::string, std::string>>::ptr g_reactor_balance =
+  Config::Lookup("reactor.balance", std::map<std::string, std::string>(),
+                 "reactor group connection balance, group name -> round_robin|least_loaded");
+
+ReactorGroup::ReactorGroup(size_t threads, const std::string& name)
+  : m_name(name)
+  , m_loads(new Load[threads]) {
+  SYLAR_ASSERT(threads > 0);
+  auto balance = g_reactor_balance->getValue();
+  auto it = balance.find(name);
+  if (it == balance.end()) {
+    it = balance.find("*");
+  }
+  if (it != balance.end()) {
+    m_balance = FromString(it->second);
+  }
+
+  // 其他线程向reactor投递连接和任务都经过注入队列，不受全局配置scheduler.inject_queue影响，启动前打开
+  for (size_t i = 0; i < threads; ++i) {
+    IOManager* iom = new IOManager(1, false, name + "_" + std::to_string(i), false);
+    m_reactors.emplace_back(iom);
+    iom->setInjectQueue(true);
+    iom->start();
+  }
+}
+
+ReactorGroup::~ReactorGroup() {
+  stop();
+}
+
+size_t ReactorGroup::acquire() {
+  size_t n = m_reactors.size();
+  size_t start = m_next.fetch_add(1, std::memory_order_relaxed) % n;
+  size_t index = start;
+  if (m_balance == LEAST_LOADED) {
+    // reactor数量不多，直接扫描一遍，连接数相同时从游标处开始取，保持轮流
+    size_t min = getLoad(start);
+    for (size_t i = 1; i < n && min; ++i) {
+      size_t k = (start + i) % n;
+      size_t load = getLoad(k);
+      if (load < min) {
+        min = load;
+        index = k;
+      }
+    }
+  }
+  m_loads[index].count.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+void ReactorGroup::acquire(size_t index) {
+  SYLAR_ASSERT(index < m_reactors.size());
+  m_loads[index].count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ReactorGroup::release(size_t index) {
+  SYLAR_ASSERT(index < m_reactors.size());
+  m_loads[index].count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int ReactorGroup::indexOf(const IOManager* iom) const {
+  for (size_t i = 0; i < m_reactors.size(); ++i) {
+    if (m_reactors[i].get() == iom) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void ReactorGroup::stop() {
+  for (auto& i : m_reactors) {
+    i->stop();
+  }
+}
+
+const char* ReactorGroup::ToString(Balance v) {
+  switch (v) {
+  case LEAST_LOADED:
+    return "least_loaded";
+  default:
+    return "round_robin";
+  }
+}
+
+ReactorGroup::Balance ReactorGroup::FromString(const std::string& v) {
+  if (v == "least_loaded") {
+    return LEAST_LOADED;
+  }
+  if (v != "round_robin") {
+    SYLAR_LOG_WARN(g_logger) << "unknown reactor balance " << v << ", use round_robin";
+  }
+  return ROUND_ROBIN;
+}
+
+}   // namespace sylar
@@ -0,0 +1,147 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 16:48:31
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 16:48:31
+ * @FilePath: /sylar_from_nanasaki/sylar/reactor_group.h
+ */
+#ifndef __SYLAR_REACTOR_GROUP_H__
+#define __SYLAR_REACTOR_GROUP_H__
+
+#include "iomanager.h"
+#include "noncopyable.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sylar {
+
+/**
+ * @brief 每个线程一个reactor的IO调度器组
+ * @details 由threads个单线程的IOManager组成，每个reactor有自己的epoll、fd上下文表和定时器，
+ *          连接在accept时分配给一个reactor，之后它的所有IO事件和协程都在该reactor的线程上处理，
+ *          不会像多线程共用一个epoll那样在线程之间来回迁移。
+ *          其他线程向reactor添加任务时经过reactor的无锁注入队列，相当于邮箱。
+ *          不论配置项scheduler.inject_queue如何设置，reactor总是在启动前打开注入队列
+ */
+class ReactorGroup : Noncopyable {
+public:
+  using ptr = std::shared_ptr<ReactorGroup>;
+
+  /**
+   * @brief 为新连接选择reactor的策略
+   */
+  enum Balance {
+    /// 轮流分配
+    ROUND_ROBIN,
+    /// 分配给当前连接数最少的reactor
+    LEAST_LOADED,
+  };
+
+  /**
+   * @brief 构造函数，创建并启动所有reactor
+   * @param[in] threads reactor个数
+   * @param[in] name 名称，第i个reactor名为name_i。
+   *            分配策略由配置项reactor.balance中该名称对应的值决定，没有则取"*"对应的值，默认轮流分配
+   */
+  ReactorGroup(size_t threads, const std::string& name = "reactor");
+
+  /**
+   * @brief 析构函数，停止所有reactor
+   */
+  ~ReactorGroup();
+
+  const std::string& getName() const {
+    return m_name;
+  }
+
+  /**
+   * @brief reactor个数
+   */
+  size_t size() const {
+    return m_reactors.size();
+  }
+
+  /**
+   * @brief 获取第index个reactor
+   */
+  IOManager* getReactor(size_t index) const {
+    return m_reactors[index].get();
+  }
+
+  Balance getBalance() const {
+    return m_balance;
+  }
+
+  void setBalance(Balance v) {
+    m_balance = v;
+  }
+
+  /**
+   * @brief 为一个新连接选择reactor，该reactor的连接数加1
+   * @return reactor的下标，连接结束后需要调用release
+   */
+  size_t acquire();
+
+  /**
+   * @brief 新连接已经确定由第index个reactor处理，如由该reactor上的accept循环接受，连接数加1
+   */
+  void acquire(size_t index);
+
+  /**
+   * @brief 连接结束，对应reactor的连接数减1
+   */
+  void release(size_t index);
+
+  /**
+   * @brief iom在组中的下标
+   * @return 不属于本组时返回-1
+   */
+  int indexOf(const IOManager* iom) const;
+
+  /**
+   * @brief 第index个reactor当前的连接数
+   */
+  size_t getLoad(size_t index) const {
+    return m_loads[index].count.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 停止所有reactor，等待其中的任务和IO事件处理完
+   */
+  void stop();
+
+  /**
+   * @brief 策略的名称
+   */
+  static const char* ToString(Balance v);
+
+  /**
+   * @brief 从名称解析策略，无法识别时返回ROUND_ROBIN
+   */
+  static Balance FromString(const std::string& v);
+
+private:
+  /**
+   * @brief 每个reactor的连接数，各占一个缓存行
+   */
+  struct alignas(64) Load {
+    std::atomic<size_t> count = {0};
+  };
+
+  /// 名称
+  std::string m_name;
+  /// reactor
+  std::vector<std::unique_ptr<IOManager>> m_reactors;
+  /// 各reactor的连接数
+  std::unique_ptr<Load[]> m_loads;
+  /// 分配策略
+  std::atomic<Balance> m_balance = {ROUND_ROBIN};
+  /// 轮流分配的游标，最少连接时作为查找的起点，连接数相同时轮流分配
+  std::atomic<size_t> m_next = {0};
+};
+
+}   // namespace sylar
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 04:30:18
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 04:30:18
+ * @FilePath: /sylar_from_nanasaki/sylar/runtime_stats.cc
+ */
+#include "runtime_stats.h"
+#include "config.h"
+#include "macro.h"
+#include "mutex.h"
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+namespace sylar {
+
+// 是否统计调度器和协程的运行时计数
+static ConfigVar<bool>::ptr g_runtime_stats =
+  Config::Lookup<bool>("runtime.stats", false, "collect scheduler and fiber runtime stats");
+
+std::atomic<bool> RuntimeStats::s_enabled{false};
+
+struct _RuntimeStatsIniter {
+  _RuntimeStatsIniter() {
+    RuntimeStats::s_enabled = g_runtime_stats->getValue();
+    g_runtime_stats->addListener([](const bool&, const bool& new_value) {
+      RuntimeStats::s_enabled = new_value;
+    });
+  }
+};
+
+static _RuntimeStatsIniter s_runtime_stats_initer;
+
+namespace {
+
+/**
+ * @brief 所有线程计数器的注册表，线程退出时把计数并入retired
+ */
+struct StatsRegistry {
+  Mutex mutex;
+  std::vector<RuntimeStats::ThreadStats::ptr> threads;
+  RuntimeStats::Snapshot retired;
+};
+
+/// 线程退出时可能晚于静态对象析构，注册表不释放
+static StatsRegistry& GetRegistry() {
+  static StatsRegistry* s_registry = new StatsRegistry;
+  return *s_registry;
+}
+
+/// 当前线程的计数器是否已经注销，之后析构的线程局部变量(如线程主协程)不能再注册
+static thread_local bool t_stats_exited = false;
+
+/**
+ * @brief 持有当前线程的计数器，线程退出时注销
+ */
+struct ThreadStatsHolder {
+  RuntimeStats::ThreadStats::ptr stats;
+
+  ~ThreadStatsHolder() {
+    t_stats_exited = true;
+    if (!stats) {
+      return;
+    }
+    StatsRegistry& registry = GetRegistry();
+    Mutex::Lock lock(registry.mutex);
+    // 退出的线程只保留计数，不计入线程数
+    stats->fill(registry.retired);
+    --registry.retired.threads;
+    for (auto it = registry.threads.begin(); it != registry.threads.end(); ++it) {
+      if (*it == stats) {
+        registry.threads.erase(it);
+        break;
+      }
+    }
+  }
+};
+
+static thread_local ThreadStatsHolder t_stats;
+
+}   // namespace
+
+RuntimeStats::Snapshot& RuntimeStats::Snapshot::operator+=(const Snapshot& rhs) {
+  threads += rhs.threads;
+  tasksRun += rhs.tasksRun;
+  idleUs += rhs.idleUs;
+  wakeups += rhs.wakeups;
+  fibersCreated += rhs.fibersCreated;
+  fibersDestroyed += rhs.fibersDestroyed;
+  runQueueDepth += rhs.runQueueDepth;
+  for (size_t i = 0; i < STACK_BUCKETS; ++i) {
+    stackHistogram[i] += rhs.stackHistogram[i];
+  }
+  return *this;
+}
+
+std::ostream& RuntimeStats::Snapshot::dump(std::ostream& os) const {
+  os << "threads=" << threads << " tasks_run=" << tasksRun << " idle_us=" << idleUs
+     << " wakeups=" << wakeups << " fibers_created=" << fibersCreated
+     << " fibers_destroyed=" << fibersDestroyed << " run_queue_depth=" << runQueueDepth
+     << " stack_histogram=";
+  for (size_t i = 0; i < STACK_BUCKETS; ++i) {
+    os << (i ? "," : "") << stackHistogram[i];
+  }
+  return os;
+}
+
+std::string RuntimeStats::Snapshot::toString() const {
+  std::stringstream ss;
+  dump(ss);
+  return ss.str();
+}
+
+RuntimeStats::ThreadStats::ThreadStats() {
+  for (auto& i : stackHistogram) {
+    i.store(0, std::memory_order_relaxed);
+  }
+}
+
+void RuntimeStats::ThreadStats::addStackUsage(size_t bytes) {
+  // 桶号即KB数的二进制位数
+  uint64_t kb = bytes >> 10;
+  size_t bucket = kb ? 64 - __builtin_clzll(kb) : 0;
+  Add(stackHistogram[std::min(bucket, STACK_BUCKETS - 1)]);
+}
+
+void RuntimeStats::ThreadStats::fill(Snapshot& snapshot) const {
+  ++snapshot.threads;
+  snapshot.tasksRun += tasksRun.load(std::memory_order_relaxed);
+  snapshot.idleUs += idleUs.load(std::memory_order_relaxed);
+  snapshot.wakeups += wakeups.load(std::memory_order_relaxed);
+  snapshot.fibersCreated += fibersCreated.load(std::memory_order_relaxed);
+  snapshot.fibersDestroyed += fibersDestroyed.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < STACK_BUCKETS; ++i) {
+    snapshot.stackHistogram[i] += stackHistogram[i].load(std::memory_order_relaxed);
+  }
+}
+
+RuntimeStats::ThreadStats* RuntimeStats::GetThis() {
+  if (SYLAR_LIKELY(!t_stats_exited && t_stats.stats)) {
+    return t_stats.stats.get();
+  }
+  return GetThisPtr().get();
+}
+
+RuntimeStats::ThreadStats::ptr RuntimeStats::GetThisPtr() {
+  if (SYLAR_UNLIKELY(t_stats_exited)) {
+    // 线程退出阶段的计数不再统计
+    static ThreadStats::ptr* s_discard = new ThreadStats::ptr(std::make_shared<ThreadStats>());
+    return *s_discard;
+  }
+  if (!t_stats.stats) {
+    ThreadStats::ptr stats = std::make_shared<ThreadStats>();
+    StatsRegistry& registry = GetRegistry();
+    Mutex::Lock lock(registry.mutex);
+    registry.threads.push_back(stats);
+    t_stats.stats = stats;
+  }
+  return t_stats.stats;
+}
+
+RuntimeStats::Snapshot RuntimeStats::GetSnapshot() {
+  StatsRegistry& registry = GetRegistry();
+  Mutex::Lock lock(registry.mutex);
+  Snapshot snapshot = registry.retired;
+  for (auto& i : registry.threads) {
+    i->fill(snapshot);
+  }
+  return snapshot;
+}
+
+}   // namespace sylar
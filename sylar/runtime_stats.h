@@ -0,0 +1,126 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 04:30:18
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 04:30:18
+ * @FilePath: /sylar_from_nanasaki/sylar/runtime_stats.h
+ */
+#ifndef __SYLAR_RUNTIME_STATS_H__
+#define __SYLAR_RUNTIME_STATS_H__
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+
+namespace sylar {
+
+/**
+ * @brief 协程运行时统计
+ * @details 计数器按线程分开，只由所属线程写入，读取方在快照时汇总，写入不需要原子读改写也不会伪共享。
+ *          调度线程的任务数先在本地累加，进入idle前或每TASK_FLUSH个任务写入一次。
+ *          是否统计取自配置项runtime.stats，默认关闭，关闭后只剩一次判断
+ */
+class RuntimeStats {
+public:
+  /// 协程栈使用量直方图的桶数，第i个桶统计[1K << (i - 1), 1K << i)字节，第0个桶统计1K以下，最后一个桶统计之后所有
+  static const size_t STACK_BUCKETS = 12;
+  /// 调度线程本地累加的任务数达到该值时写入计数器
+  static const uint64_t TASK_FLUSH = 256;
+
+  /**
+   * @brief 统计快照
+   */
+  struct Snapshot {
+    /// 汇总的线程数
+    uint64_t threads = 0;
+    /// 执行的任务数
+    uint64_t tasksRun = 0;
+    /// 调度线程在idle协程中的总时间，单位微秒
+    uint64_t idleUs = 0;
+    /// 调度线程从idle协程中返回的次数
+    uint64_t wakeups = 0;
+    /// 创建的协程数
+    uint64_t fibersCreated = 0;
+    /// 析构的协程数
+    uint64_t fibersDestroyed = 0;
+    /// 快照时任务队列中等待执行的任务数，只有调度器快照有效
+    uint64_t runQueueDepth = 0;
+    /// 协程yield时栈使用量的直方图
+    uint64_t stackHistogram[STACK_BUCKETS] = {0};
+
+    Snapshot& operator+=(const Snapshot& rhs);
+
+    /**
+     * @brief 输出为一行key=value，便于日志采集
+     */
+    std::ostream& dump(std::ostream& os) const;
+
+    std::string toString() const;
+  };
+
+  /**
+   * @brief 每个线程的计数器，按缓存行对齐
+   */
+  struct alignas(64) ThreadStats {
+    using ptr = std::shared_ptr<ThreadStats>;
+
+    std::atomic<uint64_t> tasksRun = {0};
+    std::atomic<uint64_t> idleUs = {0};
+    std::atomic<uint64_t> wakeups = {0};
+    std::atomic<uint64_t> fibersCreated = {0};
+    std::atomic<uint64_t> fibersDestroyed = {0};
+    std::atomic<uint64_t> stackHistogram[STACK_BUCKETS];
+
+    ThreadStats();
+
+    /**
+     * @brief 由所属线程增加计数，只有一个写入者，不需要原子读改写
+     */
+    static void Add(std::atomic<uint64_t>& counter, uint64_t v = 1) {
+      counter.store(counter.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 记录一次栈使用量
+     */
+    void addStackUsage(size_t bytes);
+
+    /**
+     * @brief 累加到快照
+     */
+    void fill(Snapshot& snapshot) const;
+  };
+
+  /**
+   * @brief 是否启用统计
+   */
+  static bool IsEnabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 获取当前线程的计数器，第一次调用时创建并注册
+   */
+  static ThreadStats* GetThis();
+
+  /**
+   * @brief 获取当前线程的计数器的智能指针，线程退出后仍可读取
+   */
+  static ThreadStats::ptr GetThisPtr();
+
+  /**
+   * @brief 汇总所有线程的计数，包括已经退出的线程
+   */
+  static Snapshot GetSnapshot();
+
+private:
+  friend struct _RuntimeStatsIniter;
+  /// 是否启用统计，缓存配置项runtime.stats
+  static std::atomic<bool> s_enabled;
+};
+
+}   // namespace sylar
+
+#endif
@@ -6,8 +6,11 @@
  * @FilePath: /sylar_from_nanasaki/sylar/scheduler.cc
  */
 #include "scheduler.h"
+#include "config.h"
 #include "hook.h"
 #include "macro.h"
+#include "util/cpu_util.h"
+#include <algorithm>
 
 namespace sylar {
 
@@ -17,12 +20,94 @@ static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 static thread_local Scheduler* t_scheduler = nullptr;
 /// 当前线程的调度协程，每个线程都独有一份
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+/// 当前调度线程的id，在run()中设置，避免反复调用gettid
+static thread_local int t_scheduler_thread = -1;
+
+thread_local Scheduler::LocalQueue* Scheduler::t_localQueue = nullptr;
+thread_local Scheduler::PinnedCount* Scheduler::t_pinnedCount = nullptr;
+
+// 是否默认启用工作窃取调度模式
+static ConfigVar<bool>::ptr g_scheduler_work_stealing =
+  Config::Lookup<bool>("scheduler.work_stealing", false, "scheduler work stealing mode");
+
+// 是否默认通过无锁注入队列添加任务
+static ConfigVar<bool>::ptr g_scheduler_inject_queue =
+  Config::Lookup<bool>("scheduler.inject_queue", false, "scheduler lock-free inject queue");
+
+// 是否默认让回调任务的协程运行在共享栈上
+static ConfigVar<bool>::ptr g_scheduler_shared_stack =
+  Config::Lookup<bool>("scheduler.shared_stack", false, "scheduler callback fibers on shared stack");
+
+// 调度线程绑核配置，key为调度器名称，"*"对所有未单独配置的调度器生效，
+// value为空或none表示不绑定，physical表示每个物理核一个线程，all表示所有CPU，其他按CPU列表解析，如"0-3,8"
+static ConfigVar<std::map<std::string, std::string>>::ptr g_scheduler_cpu_affinity =
+  Config::Lookup("scheduler.cpu_affinity", std::map<std::string, std::string>(),
+                 "scheduler worker cpu affinity, scheduler name -> none/all/physical/cpu list");
+
+// 全局任务队列中HIGH、NORMAL、BACKGROUND三个调度类别的权重
+static ConfigVar<std::vector<uint32_t>>::ptr g_scheduler_priority_weights =
+  Config::Lookup("scheduler.priority_weights", std::vector<uint32_t>{16, 4, 1},
+                 "scheduler weights of high, normal and background tasks");
+
+/// 每次从注入队列中最多取出的任务数
+static const size_t INJECT_BATCH = 256;
+/// 每个线程最多缓存的空闲任务节点数
+static const size_t TASK_CACHE_SIZE = 1024;
+
+thread_local Scheduler::TaskCacheHolder Scheduler::t_taskCache;
+
+Scheduler::ScheduleTask* const Scheduler::TaskCache::CLOSED =
+  reinterpret_cast<Scheduler::ScheduleTask*>(1);
+
+void Scheduler::TaskCache::unref() {
+  if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+Scheduler::TaskCacheHolder::~TaskCacheHolder() {
+  for (auto i : cache->nodes) {
+    delete i;
+  }
+  size_t freed = cache->nodes.size();
+  cache->nodes.clear();
+  // 关闭之后其他线程归还的节点由归还方直接释放
+  ScheduleTask* t = cache->returned.exchange(TaskCache::CLOSED, std::memory_order_acq_rel);
+  while (t) {
+    ScheduleTask* next = static_cast<ScheduleTask*>(t->next.load(std::memory_order_relaxed));
+    delete t;
+    ++freed;
+    t = next;
+  }
+  // 连同本线程持有的一份引用一起释放
+  if (cache->refs.fetch_sub(freed + 1, std::memory_order_acq_rel) == freed + 1) {
+    delete cache;
+  }
+}
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
   : m_name(name)
   , m_threadCount(threads)
-  , m_useCaller(use_caller) {
+  , m_useCaller(use_caller)
+  , m_workStealing(g_scheduler_work_stealing->getValue())
+  , m_injectQueue(g_scheduler_inject_queue->getValue())
+  , m_sharedStack(g_scheduler_shared_stack->getValue()) {
   SYLAR_ASSERT(m_threadCount > 0);
+  m_pinnedSize = threads;
+  m_pinned.reset(new PinnedCount[m_pinnedSize]);
+
+  auto affinity = g_scheduler_cpu_affinity->getValue();
+  auto it = affinity.find(name);
+  if (it == affinity.end()) {
+    it = affinity.find("*");
+  }
+  if (it != affinity.end()) {
+    m_cpuAffinity = it->second;
+  }
+
+  auto weights = g_scheduler_priority_weights->getValue();
+  weights.resize(Fiber::PRIORITY_COUNT, 1);
+  setPriorityWeights(weights[Fiber::HIGH], weights[Fiber::NORMAL], weights[Fiber::BACKGROUND]);
 
   if (use_caller) {
     --threads;
@@ -36,10 +121,13 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
      * 在user_caller情况下，把caller线程的主协程暂时保存起来，等调度协程结束时，再resume回caller协程
      */
     m_rootFiber.reset(new Fiber(std::bind(&Scheduler::run, this), 0, false));
+    // 调度协程在调度器停止之前一直运行，不参与运行时间统计
+    m_rootFiber->setAccounting(false);
 
     sylar::Thread::SetName(m_name);
     t_scheduler_fiber = m_rootFiber.get();
     m_rootThread = sylar::util::GetThreadId();
+    m_pinned[0].threadId.store(m_rootThread, std::memory_order_release);
     m_threadIds.push_back(m_rootThread);
   } else {
     m_rootThread = -1;
@@ -67,6 +155,38 @@ void Scheduler::setThis() {
   t_scheduler = this;
 }
 
+void Scheduler::setWorkStealing(bool v) {
+  MutexType::Lock lock(m_mutex);
+  if (m_localsReady || !m_threads.empty()) {
+    SYLAR_LOG_ERROR(g_logger) << "setWorkStealing must be called before start, name=" << m_name;
+    return;
+  }
+  m_workStealing = v;
+}
+
+void Scheduler::setInjectQueue(bool v) {
+  MutexType::Lock lock(m_mutex);
+  if (m_localsReady || !m_threads.empty()) {
+    SYLAR_LOG_ERROR(g_logger) << "setInjectQueue must be called before start, name=" << m_name;
+    return;
+  }
+  m_injectQueue = v;
+}
+
+void Scheduler::setPriorityWeights(uint32_t high, uint32_t normal, uint32_t background) {
+  MutexType::Lock lock(m_mutex);
+  m_lanes[Fiber::HIGH].weight = std::max(high, 1u);
+  m_lanes[Fiber::NORMAL].weight = std::max(normal, 1u);
+  m_lanes[Fiber::BACKGROUND].weight = std::max(background, 1u);
+}
+
+void Scheduler::ScheduleTask::setPriority(int prio, uint64_t deadline_ms) {
+  if (prio >= 0 && prio < Fiber::PRIORITY_COUNT) {
+    priority = (Fiber::Priority)prio;
+  }
+  deadline = deadline_ms ? sylar::util::GetElapsedMS() + deadline_ms : 0;
+}
+
 void Scheduler::start() {
   SYLAR_LOG_DEBUG(g_logger) << "start";
   MutexType::Lock lock(m_mutex);
@@ -75,17 +195,117 @@ void Scheduler::start() {
     return;
   }
   SYLAR_ASSERT(m_threads.empty());
+  // 本地队列由各个调度线程在绑核之后自己创建，内存按首次访问分配在线程所在的NUMA节点上，
+  // use_caller时调用线程的本地队列放在最后，由调用线程创建
+  bool init_locals = m_workStealing && !m_localsReady;
+  if (init_locals) {
+    m_locals.resize(m_threadCount + (m_useCaller ? 1 : 0));
+    if (m_useCaller) {
+      m_locals.back().reset(new LocalQueue);
+      m_locals.back()->index = m_threadCount;
+    }
+  }
+
+  // 工作线程按顺序轮流绑定到配置的CPU上，use_caller的调用线程不改变绑定
+  std::vector<int> cpus = CpuUtil::ResolveCpuSpec(m_cpuAffinity);
+  if (!m_cpuAffinity.empty() && m_cpuAffinity != "none" && cpus.empty()) {
+    SYLAR_LOG_ERROR(g_logger) << "invalid cpu affinity " << m_cpuAffinity << ", name=" << m_name;
+  }
+  m_threadCpus.assign(m_threadCount, -1);
+  for (size_t i = 0; i < m_threadCount && !cpus.empty(); ++i) {
+    m_threadCpus[i] = cpus[i % cpus.size()];
+  }
+
   m_threads.resize(m_threadCount);
   for (size_t i = 0; i < m_threadCount; i++) {
     m_threads[i].reset(
-      new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i)));
+      new Thread(std::bind(&Scheduler::threadMain, this, i), m_name + "_" + std::to_string(i)));
+    // 线程自己在threadMain中也会登记，先登记的一方生效，两边都早于指定给该线程的任务入队
+    m_pinned[m_threadIds.size()].threadId.store(m_threads[i]->getId(), std::memory_order_release);
     m_threadIds.push_back(m_threads[i]->getId());
   }
+
+  if (init_locals) {
+    // 等所有调度线程创建好本地队列之后再放行，此后其他线程才能访问m_locals
+    for (size_t i = 0; i < m_threadCount; ++i) {
+      m_localsCreated.wait();
+    }
+    m_localsReady.store(true, std::memory_order_release);
+    for (size_t i = 0; i < m_threadCount; ++i) {
+      m_localsStart.notify();
+    }
+  }
+}
+
+void Scheduler::threadMain(size_t index) {
+  m_pinned[index + (m_useCaller ? 1 : 0)].threadId.store(sylar::util::GetThreadId(),
+                                                         std::memory_order_release);
+  int cpu = m_threadCpus[index];
+  if (cpu >= 0 && !CpuUtil::BindCurrentThread(cpu)) {
+    SYLAR_LOG_ERROR(g_logger) << "bind thread to cpu " << cpu << " fail, name=" << m_name;
+  }
+  if (m_workStealing) {
+    LocalQueue* local = new LocalQueue;
+    local->index = index;
+    local->threadId.store(sylar::util::GetThreadId(), std::memory_order_release);
+    m_locals[index].reset(local);
+    t_localQueue = local;
+    m_localsCreated.notify();
+    m_localsStart.wait();
+  }
+  run();
+}
+
+std::ostream& Scheduler::dump(std::ostream& os) {
+  os << "[Scheduler name=" << m_name << " size=" << m_threadCount
+     << " active_count=" << m_activeThreadCount << " idle_count=" << m_idleThreadCount
+     << " stopping=" << m_stopping << " work_stealing=" << m_workStealing
+     << " inject_queue=" << m_injectQueue << " cpu_affinity="
+     << (m_cpuAffinity.empty() ? "none" : m_cpuAffinity);
+  MutexType::Lock lock(m_mutex);
+  os << " tasks=" << m_taskCount << " weights=" << m_lanes[Fiber::HIGH].weight << "/"
+     << m_lanes[Fiber::NORMAL].weight << "/" << m_lanes[Fiber::BACKGROUND].weight << " ]";
+  if (m_useCaller) {
+    os << std::endl << "    thread " << m_rootThread << " (caller) cpu=-1";
+  }
+  for (size_t i = 0; i < m_threads.size() && i < m_threadCpus.size(); ++i) {
+    int cpu = m_threadCpus[i];
+    os << std::endl << "    thread " << m_threads[i]->getId() << " " << m_threads[i]->getName()
+       << " cpu=" << cpu;
+    if (cpu >= 0) {
+      os << " node=" << CpuUtil::GetCpuNode(cpu);
+    }
+  }
+  return os;
+}
+
+RuntimeStats::Snapshot Scheduler::getStats() {
+  RuntimeStats::Snapshot snapshot;
+  MutexType::Lock lock(m_mutex);
+  for (auto& i : m_threadStats) {
+    i->fill(snapshot);
+  }
+  snapshot.runQueueDepth = m_taskCount + m_injectCount.load(std::memory_order_relaxed) +
+                           m_localTaskCount.load(std::memory_order_relaxed) +
+                           m_affinityTaskCount.load(std::memory_order_relaxed);
+  return snapshot;
 }
 
 bool Scheduler::stopping() {
   MutexType::Lock lock(m_mutex);
-  return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+  return m_stopping && m_taskCount == 0 && m_injectCount == 0 && m_localTaskCount == 0 &&
+         m_affinityTaskCount == 0 && m_activeThreadCount == 0;
+}
+
+bool Scheduler::hasPendingTasks() {
+  if (m_pendingAny.load(std::memory_order_relaxed) > 0 ||
+      (t_pinnedCount && t_pinnedCount->pending.load(std::memory_order_relaxed) > 0)) {
+    return true;
+  }
+  // 亲和队列只有本线程能执行，本地队列中的任务都可以窃取
+  LocalQueue* local = t_localQueue;
+  return (local && local->affinityCount.load(std::memory_order_relaxed) > 0) ||
+         m_localTaskCount.load(std::memory_order_relaxed) > 0;
 }
 
 void Scheduler::tickle() {
@@ -137,92 +357,571 @@ void Scheduler::stop() {
   }
 }
 
+Scheduler::ScheduleTask* Scheduler::AllocTask() {
+  TaskCache* cache = t_taskCache.cache;
+  auto& nodes = cache->nodes;
+  if (nodes.empty() && cache->returned.load(std::memory_order_relaxed)) {
+    // 一次取回其他线程归还的全部节点，超出缓存上限的部分释放掉
+    ScheduleTask* t = cache->returned.exchange(nullptr, std::memory_order_acquire);
+    size_t freed = 0;
+    while (t) {
+      ScheduleTask* next = static_cast<ScheduleTask*>(t->next.load(std::memory_order_relaxed));
+      if (nodes.size() < TASK_CACHE_SIZE) {
+        nodes.push_back(t);
+      } else {
+        delete t;
+        ++freed;
+      }
+      t = next;
+    }
+    if (freed) {
+      cache->refs.fetch_sub(freed, std::memory_order_relaxed);
+    }
+  }
+  if (nodes.empty()) {
+    cache->refs.fetch_add(1, std::memory_order_relaxed);
+    ScheduleTask* t = new ScheduleTask;
+    t->owner.cache = cache;
+    return t;
+  }
+  ScheduleTask* t = nodes.back();
+  nodes.pop_back();
+  return t;
+}
+
+void Scheduler::FreeTask(ScheduleTask* task) {
+  TaskCache* cache = task->owner.cache;
+  task->reset();
+  if (cache == t_taskCache.cache) {
+    auto& nodes = cache->nodes;
+    if (nodes.size() >= TASK_CACHE_SIZE) {
+      delete task;
+      // 本线程还持有一份引用，不会降到0
+      cache->refs.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+    nodes.push_back(task);
+    return;
+  }
+
+  // 其他线程分配的节点压回所属线程的returned栈
+  ScheduleTask* head = cache->returned.load(std::memory_order_relaxed);
+  do {
+    if (head == TaskCache::CLOSED) {
+      delete task;
+      cache->unref();
+      return;
+    }
+    task->next.store(head, std::memory_order_relaxed);
+  } while (!cache->returned.compare_exchange_weak(head, task, std::memory_order_release,
+                                                  std::memory_order_relaxed));
+}
+
+void Scheduler::scheduleInline(std::function<void()> cb, int thread) {
+  ScheduleTask task(std::move(cb), thread);
+  if (!task.cb) {
+    return;
+  }
+  task.inlined = true;
+  if (m_workStealing || m_injectQueue) {
+    scheduleTask(task);
+    return;
+  }
+
+  bool need_tickle = false;
+  pendingCount(task.thread).fetch_add(1, std::memory_order_relaxed);
+  {
+    MutexType::Lock lock(m_mutex);
+    need_tickle = m_taskCount == 0;
+    pushGlobalNoLock(task);
+  }
+  if (need_tickle) {
+    tickle();
+  }
+}
+
+bool Scheduler::pushAffinity(ScheduleTask& task) {
+  for (auto& i : m_locals) {
+    if (i->threadId.load(std::memory_order_acquire) != task.thread) {
+      continue;
+    }
+    ++m_affinityTaskCount;
+    {
+      MutexType::Lock lock(i->mutex);
+      i->affinity.push_back(std::move(task));
+      ++i->affinityCount;
+    }
+    return true;
+  }
+  return false;
+}
+
+void Scheduler::scheduleBatch(ScheduleTask* first, ScheduleTask* last, size_t count) {
+  bool need_tickle = false;
+  if (m_workStealing && m_localsReady.load(std::memory_order_acquire)) {
+    // 能放入亲和队列或本地队列的任务先摘出来，剩下的重新链接后走全局队列
+    ScheduleTask* rest = nullptr;
+    last = nullptr;
+    count = 0;
+    for (ScheduleTask* t = first; t;) {
+      // 放入本地队列后节点可能马上被其他线程窃取并释放，先取出next
+      ScheduleTask* next = static_cast<ScheduleTask*>(t->next.load(std::memory_order_relaxed));
+      if (t->thread != -1) {
+        if (pushAffinity(*t)) {
+          FreeTask(t);
+          need_tickle = true;
+          t = next;
+          continue;
+        }
+      } else if (t_scheduler == this && t_localQueue && !t->isUrgent() &&
+                 t->priority == Fiber::NORMAL) {
+        ++m_localTaskCount;
+        if (t_localQueue->runq.push(t)) {
+          need_tickle = need_tickle || hasIdleThreads();
+          t = next;
+          continue;
+        }
+        --m_localTaskCount;
+      }
+      t->next.store(nullptr, std::memory_order_relaxed);
+      if (last) {
+        last->next.store(t, std::memory_order_relaxed);
+      } else {
+        rest = t;
+      }
+      last = t;
+      ++count;
+      t = next;
+    }
+    first = rest;
+  }
+
+  if (first) {
+    for (ScheduleTask* t = first; t;
+         t = static_cast<ScheduleTask*>(t->next.load(std::memory_order_relaxed))) {
+      if (t->isUrgent()) {
+        urgentCount(t->thread).fetch_add(1, std::memory_order_relaxed);
+      }
+      pendingCount(t->thread).fetch_add(1, std::memory_order_relaxed);
+    }
+    if (m_injectQueue) {
+      // 先增加计数再入队，保证stopping()不会漏掉正在入队的任务
+      need_tickle = m_injectCount.fetch_add(count, std::memory_order_acq_rel) == 0 || need_tickle;
+      m_inject.push(first, last);
+    } else {
+      MutexType::Lock lock(m_mutex);
+      need_tickle = m_taskCount == 0 || need_tickle;
+      for (ScheduleTask* t = first; t;) {
+        ScheduleTask* next = static_cast<ScheduleTask*>(t->next.load(std::memory_order_relaxed));
+        pushGlobalNoLock(*t);
+        FreeTask(t);
+        t = next;
+      }
+    }
+  }
+
+  if (need_tickle) {
+    tickle();
+  }
+}
+
+void Scheduler::scheduleTask(ScheduleTask& task) {
+  if (m_workStealing && m_localsReady.load(std::memory_order_acquire)) {
+    if (task.thread != -1) {
+      // 指定了线程的任务放入目标线程的亲和队列，目标线程还未进入run()时走全局队列
+      if (pushAffinity(task)) {
+        tickle();
+        return;
+      }
+    } else if (t_scheduler == this && t_localQueue && !task.isUrgent() &&
+               task.priority == Fiber::NORMAL) {
+      // 调度线程自己添加的NORMAL任务直接放入本地队列，不需要加锁，其他类别的任务要在全局队列里按权重排队
+      ScheduleTask* t = AllocTask();
+      *t = std::move(task);
+      ++m_localTaskCount;
+      if (t_localQueue->runq.push(t)) {
+        if (hasIdleThreads()) {
+          tickle();
+        }
+        return;
+      }
+      // 本地队列已满，放入全局队列
+      --m_localTaskCount;
+      task = std::move(*t);
+      FreeTask(t);
+    }
+  }
+
+  if (task.isUrgent()) {
+    urgentCount(task.thread).fetch_add(1, std::memory_order_relaxed);
+  }
+  pendingCount(task.thread).fetch_add(1, std::memory_order_relaxed);
+  if (m_injectQueue) {
+    injectTask(task);
+    return;
+  }
+
+  bool need_tickle = false;
+  {
+    MutexType::Lock lock(m_mutex);
+    need_tickle = m_taskCount == 0;
+    pushGlobalNoLock(task);
+  }
+  if (need_tickle) {
+    tickle();
+  }
+}
+
+void Scheduler::injectTask(ScheduleTask& task) {
+  ScheduleTask* t = AllocTask();
+  *t = std::move(task);
+  // 先增加计数再入队，保证stopping()不会漏掉正在入队的任务
+  bool need_tickle = m_injectCount.fetch_add(1, std::memory_order_acq_rel) == 0;
+  m_inject.push(t);
+  if (need_tickle) {
+    tickle();
+  }
+}
+
+void Scheduler::drainInjectNoLock() {
+  for (size_t i = 0; i < INJECT_BATCH && m_injectCount.load(std::memory_order_acquire); ++i) {
+    ScheduleTask* t = m_inject.pop();
+    if (!t) {
+      // 生产者还未完成链接，下一轮再取
+      break;
+    }
+    pushGlobalNoLock(*t);
+    FreeTask(t);
+    m_injectCount.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+void Scheduler::pushGlobalNoLock(ScheduleTask& task) {
+  TaskLane& lane = m_lanes[task.priority];
+  std::list<ScheduleTask>& tasks = task.deadline ? lane.deadline : lane.fifo;
+  auto pos = tasks.end();
+  if (task.deadline) {
+    // 截止时间大多是递增的，从后往前找插入位置
+    while (pos != tasks.begin() && std::prev(pos)->deadline > task.deadline) {
+      --pos;
+    }
+  }
+  ++m_taskCount;
+  if (m_spareTasks.empty()) {
+    tasks.insert(pos, std::move(task));
+    return;
+  }
+  auto node = m_spareTasks.begin();
+  tasks.splice(pos, m_spareTasks, node);
+  *node = std::move(task);
+}
+
+bool Scheduler::takeTaskNoLock(std::list<ScheduleTask>& tasks, uint64_t deadline,
+                               ScheduleTask& task) {
+  int thread = t_scheduler_thread;
+  for (auto it = tasks.begin(); it != tasks.end() && it->deadline <= deadline; ++it) {
+    if (it->thread != -1 && it->thread != thread) {
+      // 指定了调度线程，但不是在当前线程上调度，跳过这个任务，继续下一个
+      continue;
+    }
+
+    // 找到一个未指定线程，或是指定了当前线程的任务
+    SYLAR_ASSERT(it->fiber || it->cb);
+
+    // [BUG FIX]: hook
+    // IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
+    // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
+    // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
+    /// @todo 这里需要优化，否则协程框架的性能会下降
+    if (it->fiber && it->fiber->getState() == Fiber::RUNNING) {
+      continue;
+    }
+
+    // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除
+    task = std::move(*it);
+    if (m_injectQueue && m_spareTasks.size() < TASK_CACHE_SIZE) {
+      // 链表节点留给下一次入队复用
+      it->reset();
+      m_spareTasks.splice(m_spareTasks.end(), tasks, it);
+    } else {
+      tasks.erase(it);
+    }
+    --m_taskCount;
+    pendingCount(task.thread).fetch_sub(1, std::memory_order_relaxed);
+    if (task.isUrgent()) {
+      urgentCount(task.thread).fetch_sub(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool Scheduler::nextGlobalTask(ScheduleTask& task) {
+  MutexType::Lock lock(m_mutex);
+  if (m_injectQueue) {
+    drainInjectNoLock();
+  }
+
+  bool found = false;
+  if (m_taskCount > 0) {
+    // 1. 已经超过截止时间的任务，不论类别最先执行
+    uint64_t now = 0;
+    for (auto& lane : m_lanes) {
+      if (lane.deadline.empty()) {
+        continue;
+      }
+      now = now ? now : sylar::util::GetElapsedMS();
+      if (lane.deadline.front().deadline <= now && takeTaskNoLock(lane.deadline, now, task)) {
+        found = true;
+        break;
+      }
+    }
+  }
+
+  if (!found && m_taskCount > 0) {
+    // 2. 平滑加权轮询：每个非空的道当前值加上自己的权重，从当前值最大的道取任务，取到的道减去总权重，
+    // 这样每个类别分到的执行机会与权重成正比，且不会连续很长时间轮不到
+    int order[Fiber::PRIORITY_COUNT];
+    size_t n = 0;
+    int64_t total = 0;
+    for (int i = 0; i < Fiber::PRIORITY_COUNT; ++i) {
+      TaskLane& lane = m_lanes[i];
+      if (lane.deadline.empty() && lane.fifo.empty()) {
+        continue;
+      }
+      lane.current += lane.weight;
+      total += lane.weight;
+      order[n++] = i;
+    }
+    // 道的数量很少，插入排序保持稳定且不像std::stable_sort那样申请临时缓冲区
+    for (size_t i = 1; i < n; ++i) {
+      int v = order[i];
+      size_t j = i;
+      for (; j > 0 && m_lanes[order[j - 1]].current < m_lanes[v].current; --j) {
+        order[j] = order[j - 1];
+      }
+      order[j] = v;
+    }
+    // 当前值最大的道里可能只有指定给其他线程的任务，依次尝试下一个道
+    for (size_t i = 0; i < n && !found; ++i) {
+      TaskLane& lane = m_lanes[order[i]];
+      // 同一道里有截止时间的任务按截止时间先执行
+      if (takeTaskNoLock(lane.deadline, ~0ull, task) || takeTaskNoLock(lane.fifo, ~0ull, task)) {
+        lane.current -= total;
+        found = true;
+      }
+    }
+    if (!found) {
+      // 没有取到任务，撤销本轮加上的权重
+      for (size_t i = 0; i < n; ++i) {
+        m_lanes[order[i]].current -= m_lanes[order[i]].weight;
+      }
+    }
+  }
+
+  if (found) {
+    ++m_activeThreadCount;
+  }
+  // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
+  return m_taskCount > 0 || m_injectCount.load(std::memory_order_relaxed) > 0;
+}
+
+bool Scheduler::nextLocalTask(LocalQueue* local, ScheduleTask& task) {
+  bool tickle_me = false;
+
+  // 0. 全局队列里有本线程能执行的HIGH类别或有截止时间的任务，先于本地任务调度，指定给其他线程的不用管
+  if (m_urgentAny.load(std::memory_order_relaxed) > 0 ||
+      (t_pinnedCount && t_pinnedCount->urgent.load(std::memory_order_relaxed) > 0)) {
+    tickle_me = nextGlobalTask(task);
+    if (task.fiber || task.cb) {
+      return tickle_me;
+    }
+  }
+
+  // 1. 亲和队列，只有本线程能执行，优先调度
+  if (local->affinityCount.load(std::memory_order_acquire) > 0) {
+    MutexType::Lock lock(local->mutex);
+    for (auto it = local->affinity.begin(); it != local->affinity.end(); ++it) {
+      // 同全局队列，跳过还未来得及yield的协程
+      if (it->fiber && it->fiber->getState() == Fiber::RUNNING) {
+        continue;
+      }
+      task = std::move(*it);
+      local->affinity.erase(it);
+      --local->affinityCount;
+      ++m_activeThreadCount;
+      --m_affinityTaskCount;
+      return false;
+    }
+  }
+
+  // 2. 本地队列
+  while (ScheduleTask* t = local->runq.pop()) {
+    if (t->fiber && t->fiber->getState() == Fiber::RUNNING) {
+      // 协程还没来得及yield，挪到全局队列稍后再调度，避免在本地队列里反复弹出
+      pendingCount(t->thread).fetch_add(1, std::memory_order_relaxed);
+      {
+        MutexType::Lock lock(m_mutex);
+        pushGlobalNoLock(*t);
+      }
+      --m_localTaskCount;
+      FreeTask(t);
+      tickle_me = true;
+      continue;
+    }
+    task = std::move(*t);
+    FreeTask(t);
+    ++m_activeThreadCount;
+    --m_localTaskCount;
+    return tickle_me || (!local->runq.empty() && hasIdleThreads());
+  }
+
+  // 3. 全局队列，非调度线程添加的任务以及本地队列溢出的任务都在这里
+  tickle_me |= nextGlobalTask(task);
+  if (task.fiber || task.cb) {
+    return tickle_me;
+  }
+
+  // 4. 从其他线程的本地队列窃取一半任务
+  size_t n = m_locals.size();
+  for (size_t i = 1; i < n; ++i) {
+    LocalQueue* victim = m_locals[(local->index + i) % n].get();
+    ScheduleTask* t = victim->runq.stealInto(local->runq);
+    if (!t) {
+      continue;
+    }
+    if (t->fiber && t->fiber->getState() == Fiber::RUNNING) {
+      pendingCount(t->thread).fetch_add(1, std::memory_order_relaxed);
+      {
+        MutexType::Lock lock(m_mutex);
+        pushGlobalNoLock(*t);
+      }
+      --m_localTaskCount;
+      FreeTask(t);
+      return true;
+    }
+    task = std::move(*t);
+    FreeTask(t);
+    ++m_activeThreadCount;
+    --m_localTaskCount;
+    return tickle_me || !local->runq.empty();
+  }
+
+  // 5. 其他线程的亲和队列里还有任务，通知其他线程进行调度
+  for (auto& i : m_locals) {
+    if (i.get() != local && i->affinityCount.load(std::memory_order_relaxed) > 0) {
+      tickle_me = true;
+      break;
+    }
+  }
+  return tickle_me;
+}
+
 void Scheduler::run() {
   SYLAR_LOG_DEBUG(g_logger) << "run";
   set_hook_enable(true);
   setThis();
+  t_scheduler_thread = sylar::util::GetThreadId();
+  t_pinnedCount = pinnedCount(t_scheduler_thread);
   if (sylar::util::GetThreadId() != m_rootThread) {
     t_scheduler_fiber = sylar::Fiber::GetThis().get();
   }
 
+  // 工作窃取模式下工作线程在threadMain中已经创建了本地队列，use_caller的调用线程使用最后一个
+  LocalQueue* local = t_localQueue;
+  if (!local && m_workStealing && m_localsReady.load(std::memory_order_acquire) && m_useCaller &&
+      sylar::util::GetThreadId() == m_rootThread) {
+    local = m_locals.back().get();
+    local->threadId.store(sylar::util::GetThreadId(), std::memory_order_release);
+    t_localQueue = local;
+  }
+
+  // 计数器只由本线程写入，取一次指针，之后不用再访问线程局部变量
+  RuntimeStats::ThreadStats* stats = nullptr;
+  {
+    RuntimeStats::ThreadStats::ptr ptr = RuntimeStats::GetThisPtr();
+    stats = ptr.get();
+    MutexType::Lock lock(m_mutex);
+    m_threadStats.push_back(ptr);
+  }
+
   Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+  // idle协程会阻塞在epoll_wait等调用上，不参与运行时间统计，避免被看门狗误报
+  idle_fiber->setAccounting(false);
   Fiber::ptr cb_fiber;
+  bool hook_enable = is_hook_enable();
 
+  // 本线程执行的任务数先在这里累加，批量写入计数器
+  uint64_t tasks_run = 0;
   ScheduleTask task;
   while (true) {
     task.reset();
-    bool tickle_me = false;   // 是否tickle其他线程进行任务调度
-    {
-      MutexType::Lock lock(m_mutex);
-      auto it = m_tasks.begin();
-      // 遍历所有调度任务
-      while (it != m_tasks.end()) {
-        if (it->thread != -1 && it->thread != sylar::util::GetThreadId()) {
-          // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
-          ++it;
-          tickle_me = true;
-          continue;
-        }
-
-        // 找到一个未指定线程，或是指定了当前线程的任务
-        SYLAR_ASSERT(it->fiber || it->cb);
-
-        // if (it->fiber) {
-        //     // 任务队列时的协程一定是READY状态，谁会把RUNNING或TERM状态的协程加入调度呢？
-        //     SYLAR_ASSERT(it->fiber->getState() == Fiber::READY);
-        // }
-
-        // [BUG FIX]: hook
-        // IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
-        // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
-        // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
-        /// @todo 这里需要优化，否则协程框架的性能会下降
-        if (it->fiber && it->fiber->getState() == Fiber::RUNNING) {
-          ++it;
-          continue;
-        }
-
-        // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
-        task = *it;
-        m_tasks.erase(it++);
-        ++m_activeThreadCount;
-        break;
-      }
-      // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
-      tickle_me |= (it != m_tasks.end());
-    }
+    bool tickle_me = local ? nextLocalTask(local, task) : nextGlobalTask(task);
 
     if (tickle_me) {
       tickle();
     }
 
+    bool stats_enabled = RuntimeStats::IsEnabled();
+    if (stats_enabled && (task.fiber || task.cb) &&
+        ++tasks_run == RuntimeStats::TASK_FLUSH) {
+      RuntimeStats::ThreadStats::Add(stats->tasksRun, tasks_run);
+      tasks_run = 0;
+    }
+
     if (task.fiber) {
       // resume协程，resume返回时，协程要么执行完了，要么半路yield了，总之这个任务就算完成了，活跃线程数减一
       task.fiber->resume();
       --m_activeThreadCount;
       task.reset();
+    } else if (task.cb && task.inlined) {
+      // 直接在调度协程上执行，关闭hook，避免回调中的阻塞调用去yield调度协程
+      set_hook_enable(false);
+      task.cb();
+      set_hook_enable(hook_enable);
+      --m_activeThreadCount;
+      task.reset();
     } else if (task.cb) {
-      if (cb_fiber) {
-        cb_fiber->reset(task.cb);
-      } else {
-        cb_fiber.reset(new Fiber(task.cb));
-      }
+      // 优先复用本线程缓存的已结束协程，不用每个回调任务都分配一次栈
+      cb_fiber = Fiber::Acquire(std::move(task.cb), m_sharedStack);
+      // 协程沿用任务的调度类别，之后yield再被唤醒时按同样的类别排队
+      cb_fiber->setPriority(task.priority);
       task.reset();
       cb_fiber->resume();
       --m_activeThreadCount;
-      cb_fiber.reset();
+      // 执行完的协程放回缓存，中途yield的协程被其他地方持有，只释放引用
+      Fiber::Recycle(cb_fiber);
+    } else if (m_injectCount.load(std::memory_order_acquire) > 0) {
+      // 注入队列里还有生产者未完成链接的任务，不能进入idle，马上重新获取
+      continue;
     } else {
       // 进到这个分支情况一定是任务队列空了，调度idle协程即可
+      // 空闲之前把累加的任务数写入计数器，快照最多落后一批
+      if (tasks_run) {
+        RuntimeStats::ThreadStats::Add(stats->tasksRun, tasks_run);
+        tasks_run = 0;
+      }
       if (idle_fiber->getState() == Fiber::TERM) {
         // 如果调度器没有调度任务，那么idle协程会不停地resume/yield，不会结束，如果idle协程结束了，那一定是调度器停止了
         SYLAR_LOG_DEBUG(g_logger) << "idle fiber term";
+        // 其他线程可能在判断stopping之后才进入idle，通知它们重新检查是否可以退出
+        tickle();
         break;
       }
+      // 空闲时释放多余的缓存协程
+      Fiber::TrimPool();
       ++m_idleThreadCount;
+      uint64_t idle_begin = stats_enabled ? sylar::util::GetCurrentUS() : 0;
       idle_fiber->resume();
+      if (stats_enabled) {
+        RuntimeStats::ThreadStats::Add(stats->idleUs, sylar::util::GetCurrentUS() - idle_begin);
+        RuntimeStats::ThreadStats::Add(stats->wakeups);
+      }
       --m_idleThreadCount;
     }
   }
+  t_localQueue = nullptr;
+  Fiber::ClearPool();
   SYLAR_LOG_DEBUG(g_logger) << "Scheduler::run() exit";
 }
 
@@ -9,9 +9,13 @@
 #define __SYLAR_SCHEDULER_H__
 
 #include "fiber.h"
+#include "mpsc_queue.h"
+#include "runtime_stats.h"
 #include "thread.h"
+#include "work_stealing_queue.h"
 #include <list>
 #include <memory>
+#include <ostream>
 #include <vector>
 
 namespace sylar {
@@ -46,6 +50,22 @@ public:
     return m_name;
   }
 
+  /**
+   * @brief 获取参与调度的线程数，包含use_caller的主线程
+   */
+  size_t getThreadCount() const {
+    return m_threadCount + (m_useCaller ? 1 : 0);
+  }
+
+  /**
+   * @brief 获取参与调度的线程id，start()之后才完整
+   * @details use_caller时第一个是主线程，之后按顺序是各个工作线程，可以作为schedule()的thread参数
+   */
+  std::vector<int> getThreadIds() {
+    MutexType::Lock lock(m_mutex);
+    return m_threadIds;
+  }
+
   /**
    * @brief 获取当前线程调度器指针
    */
@@ -61,13 +81,25 @@ public:
    * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
    * @param[] fc 协程对象或指针
    * @param[] thread 指定运行该任务的线程号，-1表示任意线程
+   * @param[] priority 调度类别Fiber::Priority，-1表示协程任务沿用协程自己的类别，回调任务为NORMAL
+   * @param[] deadline_ms 截止时间，相对当前时间的毫秒数，0表示没有截止时间
+   * @details 同一类别中有截止时间的任务按截止时间先后排在前面，超过截止时间还未执行的任务不论类别优先执行
    */
   template <class FiberOrCb>
-  void schedule(FiberOrCb fc, int thread = -1) {
+  void schedule(FiberOrCb fc, int thread = -1, int priority = -1, uint64_t deadline_ms = 0) {
+    if (m_workStealing || m_injectQueue) {
+      ScheduleTask task(fc, thread);
+      if (task.fiber || task.cb) {
+        task.setPriority(priority, deadline_ms);
+        scheduleTask(task);
+      }
+      return;
+    }
+
     bool need_tickle = false;
     {
       MutexType::Lock lock(m_mutex);
-      need_tickle = scheduleNoLock(fc, thread);
+      need_tickle = scheduleNoLock(fc, thread, priority, deadline_ms);
     }
 
     if (need_tickle) {
@@ -75,6 +107,143 @@ public:
     }
   }
 
+  /**
+   * @brief 批量添加调度任务
+   * @details 整批任务只加一次锁(注入队列模式下只做一次原子交换)，最多tickle一次
+   * @tparam InputIterator 协程对象或函数的迭代器
+   * @param[] begin 起始迭代器
+   * @param[] end 结束迭代器
+   * @param[] thread 指定运行这些任务的线程号，-1表示任意线程
+   * @param[] priority 调度类别，同schedule(fc, thread, priority, deadline_ms)
+   * @param[] deadline_ms 截止时间，相对当前时间的毫秒数，0表示没有截止时间
+   * @attention 元素通过swap取出，调用之后区间内的元素为空
+   */
+  template <class InputIterator>
+  void schedule(InputIterator begin, InputIterator end, int thread = -1, int priority = -1,
+                uint64_t deadline_ms = 0) {
+    ScheduleTask* first = nullptr;
+    ScheduleTask* last = nullptr;
+    size_t count = 0;
+    for (; begin != end; ++begin) {
+      ScheduleTask* t = AllocTask();
+      *t = ScheduleTask(&*begin, thread);
+      if (!t->fiber && !t->cb) {
+        FreeTask(t);
+        continue;
+      }
+      t->setPriority(priority, deadline_ms);
+      t->next.store(nullptr, std::memory_order_relaxed);
+      if (last) {
+        last->next.store(t, std::memory_order_relaxed);
+      } else {
+        first = t;
+      }
+      last = t;
+      ++count;
+    }
+    if (first) {
+      scheduleBatch(first, last, count);
+    }
+  }
+
+  /**
+   * @brief 添加直接在调度协程上执行的回调任务
+   * @details 不创建协程，也不切换上下文，适合执行时间很短且不会yield的小任务，如计数、唤醒、转发等。
+   *          执行期间关闭hook，其中的阻塞调用会直接阻塞调度线程
+   * @param[] cb 回调函数
+   * @param[] thread 指定运行该任务的线程号，-1表示任意线程
+   * @attention 回调中不能yield，也不能调用会挂起协程的接口，如FiberMutex::lock、Channel的阻塞收发
+   */
+  void scheduleInline(std::function<void()> cb, int thread = -1);
+
+  /**
+   * @brief 设置是否启用工作窃取调度模式
+   * @details 启用后每个调度线程拥有一个本地无锁运行队列和一个亲和任务队列，
+   *          调度线程内添加的任务优先进入本地队列，空闲线程从其他线程的本地队列窃取任务。
+   *          默认值取自配置项scheduler.work_stealing
+   * @attention 只能在start()之前设置
+   */
+  void setWorkStealing(bool v);
+
+  /**
+   * @brief 是否启用了工作窃取调度模式
+   */
+  bool isWorkStealing() const {
+    return m_workStealing;
+  }
+
+  /**
+   * @brief 设置是否通过无锁注入队列添加任务
+   * @details 启用后schedule()不再加锁和分配链表节点，任务节点取自线程局部缓存并通过MPSC队列注入，
+   *          由调度线程在run()中加锁批量取出。默认值取自配置项scheduler.inject_queue
+   * @attention 只能在start()之前设置
+   */
+  void setInjectQueue(bool v);
+
+  /**
+   * @brief 是否启用了无锁注入队列
+   */
+  bool isInjectQueue() const {
+    return m_injectQueue;
+  }
+
+  /**
+   * @brief 设置回调任务的协程是否运行在共享栈上
+   * @details 启用后schedule(cb)创建的协程运行在调度线程的共享栈上，协程第一次运行后固定在该线程调度，
+   *          适合大量长时间空闲的连接协程。默认值取自配置项scheduler.shared_stack，修改只影响之后创建的协程
+   */
+  void setSharedStack(bool v) {
+    m_sharedStack = v;
+  }
+
+  /**
+   * @brief 回调任务的协程是否运行在共享栈上
+   */
+  bool isSharedStack() const {
+    return m_sharedStack;
+  }
+
+  /**
+   * @brief 设置调度线程的CPU绑定
+   * @details 工作线程按顺序轮流绑定到解析出的CPU上，use_caller的调用线程不改变绑定。
+   *          默认值取自配置项scheduler.cpu_affinity中本调度器名称对应的值，没有则取"*"对应的值
+   * @param[in] spec 空字符串或"none"表示不绑定，"physical"表示每个物理核一个线程，"all"表示所有CPU，
+   *                 其他按CPU列表解析，如"0-3,8"
+   * @attention 只能在start()之前设置
+   */
+  void setCpuAffinity(const std::string& spec) {
+    m_cpuAffinity = spec;
+  }
+
+  /**
+   * @brief 获取调度线程的CPU绑定配置
+   */
+  const std::string& getCpuAffinity() const {
+    return m_cpuAffinity;
+  }
+
+  /**
+   * @brief 设置全局任务队列中各调度类别的权重
+   * @details 各类别都有任务时，按平滑加权轮询轮流取任务，每个类别至少分到权重占比的执行机会，
+   *          后台任务不会被饿死。权重为0时按1处理。默认值取自配置项scheduler.priority_weights
+   * @param[in] high HIGH类别的权重
+   * @param[in] normal NORMAL类别的权重
+   * @param[in] background BACKGROUND类别的权重
+   */
+  void setPriorityWeights(uint32_t high, uint32_t normal, uint32_t background);
+
+  /**
+   * @brief 获取调度器的运行时统计
+   * @details 汇总本调度器所有调度线程的计数器，包括已经退出的线程，run_queue_depth为全局队列、注入队列和本地队列中的任务数。
+   *          线程级的协程创建和析构次数包含调度线程上所有协程，use_caller时也包含调用线程在调度器之外的协程
+   */
+  RuntimeStats::Snapshot getStats();
+
+  /**
+   * @brief 输出调度器状态，包括每个调度线程绑定的CPU和NUMA节点
+   */
+  std::ostream& dump(std::ostream& os);
+
   /**
    * @brief 启动调度器
    */
@@ -96,6 +265,12 @@ protected:
    */
   void run();
 
+  /**
+   * @brief 工作线程入口，先绑核并创建本线程的本地队列，再进入run()
+   * @param[in] index 工作线程序号
+   */
+  void threadMain(size_t index);
+
   /**
    * @brief 无任务调度时执行idle协程
    */
@@ -119,44 +294,196 @@ protected:
     return m_idleThreadCount > 0;
   }
 
+  /**
+   * @brief 返回任务队列中是否可能有当前线程能执行的任务
+   * @details 供idle协程自旋时检查，只读原子计数，不加锁。
+   *          指定给其他线程的任务不算在内，被重新加入调度但还未yield完的协程会在yield完成之前短暂地算在内
+   */
+  bool hasPendingTasks();
+
 private:
+  struct ScheduleTask;
+  struct LocalQueue;
+  struct PinnedCount;
+
+  /**
+   * @brief 工作窃取模式或注入队列模式下添加调度任务
+   * @details 工作窃取模式下，指定了线程的任务放入对应线程的亲和队列，未指定线程的NORMAL任务放入当前调度线程的本地队列，
+   *          非调度线程添加的任务、其他类别或有截止时间的任务、本地队列已满时放入全局队列；
+   *          启用注入队列时，放入全局队列的任务先进入注入队列
+   */
+  void scheduleTask(ScheduleTask& task);
+
+  /**
+   * @brief 批量添加一串通过next链接的任务节点，节点取自AllocTask()
+   * @details 工作窃取模式下调度线程自己添加的任务放入本地队列，其余任务整串注入或一次加锁放入全局队列
+   */
+  void scheduleBatch(ScheduleTask* first, ScheduleTask* last, size_t count);
+
+  /**
+   * @brief 工作窃取模式下把指定了线程的任务放入目标线程的亲和队列
+   * @return 目标线程还未进入run()时返回false，任务需要放入全局队列
+   */
+  bool pushAffinity(ScheduleTask& task);
+
+  /**
+   * @brief 将任务放入注入队列，不加锁
+   */
+  void injectTask(ScheduleTask& task);
+
+  /**
+   * @brief 把注入队列中的任务批量转移到全局任务队列
+   * @attention 调用前必须持有m_mutex，m_mutex同时保证了注入队列只有一个消费者
+   */
+  void drainInjectNoLock();
+
+  /**
+   * @brief 将任务放入全局任务队列，优先复用空闲链表节点，避免分配内存
+   * @details 按调度类别放入对应的道，有截止时间的任务按截止时间插入
+   * @attention 调用前必须持有m_mutex
+   */
+  void pushGlobalNoLock(ScheduleTask& task);
+
+  /**
+   * @brief 从全局任务队列的一个链表中取出第一个可以在当前线程执行的任务
+   * @param[in] tasks 任务链表
+   * @param[in] deadline 只查看截止时间不晚于该值的任务
+   * @param[out] task 取到的任务
+   * @attention 调用前必须持有m_mutex
+   */
+  bool takeTaskNoLock(std::list<ScheduleTask>& tasks, uint64_t deadline, ScheduleTask& task);
+
+  /**
+   * @brief 从线程局部缓存中获取一个任务节点，本地缓存用完时先取回其他线程归还的节点
+   */
+  static ScheduleTask* AllocTask();
+
+  /**
+   * @brief 归还任务节点到分配它的线程的缓存
+   */
+  static void FreeTask(ScheduleTask* task);
+
+  /**
+   * @brief 工作窃取模式下获取一个可执行的任务
+   * @details 依次从亲和队列、本地队列、全局队列获取，最后尝试从其他线程窃取
+   * @param[in] local 当前线程的本地队列
+   * @param[out] task 获取到的任务
+   * @return 是否需要tickle其他线程
+   */
+  bool nextLocalTask(LocalQueue* local, ScheduleTask& task);
+
+  /**
+   * @brief 从全局任务队列中获取一个可以在当前线程执行的任务
+   * @param[out] task 获取到的任务
+   * @return 是否需要tickle其他线程
+   */
+  bool nextGlobalTask(ScheduleTask& task);
+
   /**
    * @brief 添加调度任务，无锁
    * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
    * @param[] fc 协程对象或指针
    * @param[] thread 指定运行该任务的线程号，-1表示任意线程
+   * @param[] priority 调度类别，-1表示默认类别
+   * @param[] deadline_ms 截止时间，相对当前时间的毫秒数，0表示没有截止时间
    */
   template <class FiberOrCb>
-  bool scheduleNoLock(FiberOrCb fc, int thread) {
-    bool need_tickle = m_tasks.empty();
+  bool scheduleNoLock(FiberOrCb fc, int thread, int priority, uint64_t deadline_ms) {
+    bool need_tickle = m_taskCount == 0;
     ScheduleTask task(fc, thread);
     if (task.fiber || task.cb) {
-      m_tasks.push_back(task);
+      task.setPriority(priority, deadline_ms);
+      if (task.isUrgent()) {
+        urgentCount(task.thread).fetch_add(1, std::memory_order_relaxed);
+      }
+      pendingCount(task.thread).fetch_add(1, std::memory_order_relaxed);
+      pushGlobalNoLock(task);
     }
     return need_tickle;
   }
 
+  /**
+   * @brief 注入队列和全局任务队列中能在线程thread上执行的任务计数
+   * @details 未指定线程的任务共用一个计数，指定了线程的任务计在该线程在m_threadIds中的位置上，
+   *          任务入队之前加一，取出之后减一
+   */
+  std::atomic<size_t>& pendingCount(int thread) {
+    return thread == -1 ? m_pendingAny : pinnedCount(thread)->pending;
+  }
+
+  /**
+   * @brief 注入队列和全局任务队列中能在线程thread上执行的HIGH类别或有截止时间的任务计数
+   * @details 分槽方式同pendingCount，工作窃取模式下调度线程只在有自己能执行的紧急任务时才先查看全局队列
+   */
+  std::atomic<size_t>& urgentCount(int thread) {
+    return thread == -1 ? m_urgentAny : pinnedCount(thread)->urgent;
+  }
+
+  /**
+   * @brief 指定在线程thread上执行的任务计数
+   * @details 调度线程不多，依次比较。thread不是本调度器的线程时返回m_pinnedOther，这样的任务不会被执行
+   */
+  PinnedCount* pinnedCount(int thread) {
+    for (size_t i = 0; i < m_pinnedSize; ++i) {
+      if (m_pinned[i].threadId.load(std::memory_order_acquire) == thread) {
+        return &m_pinned[i];
+      }
+    }
+    return &m_pinnedOther;
+  }
+
 private:
   /**
    * @brief 调度任务，协程/函数二选一，可指定在哪个线程上调度
+   * @details 继承MpscNode以便直接放入注入队列，运行过的共享栈协程未指定线程时固定在共享栈所属的线程上调度
    */
-  struct ScheduleTask {
+  struct TaskCache;
+
+  /**
+   * @brief 任务节点所属的TaskCache，赋值时保持不变
+   */
+  struct TaskOwner {
+    TaskOwner() = default;
+    TaskOwner(const TaskOwner&) {
+    }
+    TaskOwner& operator=(const TaskOwner&) {
+      return *this;
+    }
+
+    TaskCache* cache = nullptr;
+  };
+
+  struct ScheduleTask : public MpscNode {
     Fiber::ptr fiber;
     std::function<void()> cb;
     int thread;
+    /// cb是否直接在调度协程上执行
+    bool inlined = false;
+    /// 调度类别
+    Fiber::Priority priority = Fiber::NORMAL;
+    /// 截止时间，取自sylar::util::GetElapsedMS()，0表示没有截止时间
+    uint64_t deadline = 0;
+    /// 由AllocTask()分配的节点所属的缓存
+    TaskOwner owner;
 
     ScheduleTask(Fiber::ptr f, int thr) {
       fiber = f;
-      thread = thr;
+      thread = (thr == -1 && fiber) ? fiber->getStackThread() : thr;
+      priority = fiber ? fiber->getPriority() : Fiber::NORMAL;
     }
     ScheduleTask(Fiber::ptr* f, int thr) {
       fiber.swap(*f);
-      thread = thr;
+      thread = (thr == -1 && fiber) ? fiber->getStackThread() : thr;
+      priority = fiber ? fiber->getPriority() : Fiber::NORMAL;
     }
     ScheduleTask(std::function<void()> f, int thr) {
       cb = f;
       thread = thr;
     }
+    ScheduleTask(std::function<void()>* f, int thr) {
+      cb.swap(*f);
+      thread = thr;
+    }
     ScheduleTask() {
       thread = -1;
     }
@@ -165,9 +492,109 @@ private:
       fiber = nullptr;
       cb = nullptr;
       thread = -1;
+      inlined = false;
+      priority = Fiber::NORMAL;
+      deadline = 0;
+    }
+
+    /**
+     * @brief 设置调度类别和截止时间
+     * @param[in] prio 调度类别，-1或非法值表示保持默认类别
+     * @param[in] deadline_ms 截止时间，相对当前时间的毫秒数，0表示没有截止时间
+     */
+    void setPriority(int prio, uint64_t deadline_ms);
+
+    /**
+     * @brief 是否需要优先于工作窃取模式的本地队列执行
+     */
+    bool isUrgent() const {
+      return priority == Fiber::HIGH || deadline;
     }
   };
 
+  /**
+   * @brief 全局任务队列中一个调度类别的道
+   */
+  struct TaskLane {
+    /// 有截止时间的任务，按截止时间从早到晚排列
+    std::list<ScheduleTask> deadline;
+    /// 没有截止时间的任务，先进先出
+    std::list<ScheduleTask> fifo;
+    /// 平滑加权轮询的当前值
+    int64_t current = 0;
+    /// 权重
+    uint32_t weight = 1;
+  };
+
+  /**
+   * @brief 工作窃取模式下每个调度线程的本地队列
+   */
+  struct LocalQueue {
+    /// 本地运行队列，无锁，保存未指定线程的任务
+    WorkStealingQueue<ScheduleTask> runq;
+    /// 亲和队列的互斥锁，每个线程一把，不与其他线程竞争全局锁
+    MutexType mutex;
+    /// 亲和队列，保存指定在本线程执行的任务
+    std::list<ScheduleTask> affinity;
+    /// 亲和队列中的任务数
+    std::atomic<size_t> affinityCount = {0};
+    /// 队列所属线程的id，线程进入run()之前为-1
+    std::atomic<int> threadId = {-1};
+    /// 队列在m_locals中的下标
+    size_t index = 0;
+  };
+
+  /**
+   * @brief 注入队列和全局任务队列中指定在某个调度线程上执行的任务计数
+   */
+  struct PinnedCount {
+    /// 调度线程的id，登记之前为-1
+    std::atomic<int> threadId = {-1};
+    /// 任务数
+    std::atomic<size_t> pending = {0};
+    /// HIGH类别或有截止时间的任务数
+    std::atomic<size_t> urgent = {0};
+  };
+
+  /**
+   * @brief 线程局部的空闲任务节点缓存
+   * @details 节点在哪个线程分配就归还到哪个线程的缓存。其他线程释放的节点压入returned无锁栈，
+   *          由所属线程在缓存用完时一次取回，这样跨线程添加任务的生产者也能复用节点，不必每次new。
+   *          所属线程退出后returned置为CLOSED，之后归还的节点直接释放；
+   *          缓存本身在线程退出且分配出去的节点全部释放后才销毁
+   */
+  struct TaskCache {
+    /// 线程退出后returned的取值
+    static ScheduleTask* const CLOSED;
+
+    /**
+     * @brief 减少一次引用，最后一次引用时销毁缓存
+     */
+    void unref();
+
+    /// 本线程的空闲节点，只有本线程访问
+    std::vector<ScheduleTask*> nodes;
+    /// 其他线程归还的节点，通过next链接
+    std::atomic<ScheduleTask*> returned = {nullptr};
+    /// 引用计数，所属线程一份，加上分配出去还未销毁的每个节点各一份
+    std::atomic<size_t> refs = {1};
+  };
+
+  /**
+   * @brief 线程退出时关闭并释放当前线程的TaskCache
+   */
+  struct TaskCacheHolder {
+    ~TaskCacheHolder();
+    TaskCache* cache = new TaskCache;
+  };
+
+  /// 工作窃取模式下当前线程的本地队列
+  static thread_local LocalQueue* t_localQueue;
+  /// 当前调度线程的指定任务计数，在run()中设置
+  static thread_local PinnedCount* t_pinnedCount;
+  /// 当前线程的空闲任务节点缓存
+  static thread_local TaskCacheHolder t_taskCache;
+
 private:
   /// 协程调度器名称
   std::string m_name;
@@ -175,8 +602,20 @@ private:
   MutexType m_mutex;
   /// 线程池
   std::vector<Thread::ptr> m_threads;
-  /// 任务队列
-  std::list<ScheduleTask> m_tasks;
+  /// 全局任务队列，每个调度类别一道
+  TaskLane m_lanes[Fiber::PRIORITY_COUNT];
+  /// 全局任务队列中的任务数
+  size_t m_taskCount = 0;
+  /// 注入队列和全局任务队列中未指定线程的HIGH类别或有截止时间的任务数
+  std::atomic<size_t> m_urgentAny = {0};
+  /// 注入队列和全局任务队列中未指定线程的任务数
+  std::atomic<size_t> m_pendingAny = {0};
+  /// 各调度线程的指定任务计数，下标与m_threadIds相同
+  std::unique_ptr<PinnedCount[]> m_pinned;
+  /// m_pinned的大小，即调度线程数，包含use_caller的主线程
+  size_t m_pinnedSize = 0;
+  /// 指定给不属于本调度器的线程的任务计数
+  PinnedCount m_pinnedOther;
   /// 线程池的线程ID数组
   std::vector<int> m_threadIds;
   /// 工作线程数量，不包含use_caller的主线程
@@ -195,6 +634,41 @@ private:
 
   /// 是否正在停止
   bool m_stopping = false;
+
+  /// 是否启用工作窃取模式
+  bool m_workStealing = false;
+  /// 工作窃取模式下每个调度线程的本地队列，由各个调度线程在start()时创建
+  std::vector<std::unique_ptr<LocalQueue>> m_locals;
+  /// m_locals是否已创建完成
+  std::atomic<bool> m_localsReady = {false};
+  /// 工作线程创建好本地队列后通知start()
+  Semaphore m_localsCreated;
+  /// 所有本地队列创建好之后放行工作线程
+  Semaphore m_localsStart;
+  /// 本地队列中的任务总数，可以被任意调度线程窃取
+  std::atomic<size_t> m_localTaskCount = {0};
+  /// 亲和队列中的任务总数
+  std::atomic<size_t> m_affinityTaskCount = {0};
+
+  /// 是否启用无锁注入队列
+  bool m_injectQueue = false;
+  /// 注入队列，多个线程添加任务，持有m_mutex的调度线程取出
+  MpscQueue<ScheduleTask> m_inject;
+  /// 注入队列中的任务数
+  std::atomic<size_t> m_injectCount = {0};
+  /// 全局任务队列的空闲链表节点，避免反复分配
+  std::list<ScheduleTask> m_spareTasks;
+
+  /// 回调任务的协程是否运行在共享栈上
+  std::atomic<bool> m_sharedStack = {false};
+
+  /// 调度线程的CPU绑定配置
+  std::string m_cpuAffinity;
+  /// 每个工作线程绑定的CPU，-1表示未绑定
+  std::vector<int> m_threadCpus;
+
+  /// 各调度线程的计数器，线程退出后仍保留
+  std::vector<RuntimeStats::ThreadStats::ptr> m_threadStats;
 };
 
 }   // namespace sylar
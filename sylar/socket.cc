@@ -179,10 +179,28 @@ bool Socket::bind(const Address::ptr addr) {
     SYLAR_LOG_ERROR(g_logger) << "bind error errrno=" << errno << " errstr=" << strerror(errno);
     return false;
   }
+  // 绑定端口0时由内核分配端口，重新获取实际的地址
+  m_localAddress.reset();
   getLocalAddress();
   return true;
 }
 
+bool Socket::setReusePort(bool v) {
+  if (!isValid()) {
+    newSock();
+    if (SYLAR_UNLIKELY(!isValid())) {
+      return false;
+    }
+  }
+  int val = v ? 1 : 0;
+  if (!setOption(SOL_SOCKET, SO_REUSEPORT, val)) {
+    SYLAR_LOG_ERROR(g_logger) << "setReusePort sock=" << m_sock << " errno=" << errno
+                              << " errstr=" << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
 bool Socket::reconnect(uint64_t timeout_ms) {
   if (!m_remoteAddress) {
     SYLAR_LOG_ERROR(g_logger) << "reconnect m_remoteAddress is null";
@@ -143,6 +143,12 @@ public:
     return setOption(level, option, &value, sizeof(T));
   }
 
+  /**
+   * @brief 设置SO_REUSEPORT，多个设置了该选项的socket可以绑定同一个地址，由内核在它们之间分配新连接
+   * @details 需要在bind之前调用，socket句柄还未创建时先创建
+   */
+  bool setReusePort(bool v = true);
+
   /**
    * @brief 接收connect链接
    * @return 成功返回新连接的socket,失败返回nullptr
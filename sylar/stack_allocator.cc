@@ -0,0 +1,187 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 15:11:52
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 15:11:52
+ * @FilePath: /sylar_from_nanasaki/sylar/stack_allocator.cc
+ */
+#include "stack_allocator.h"
+#include "log.h"
+#include "singleton.h"
+#include "util/cpu_util.h"
+#include <deque>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+StackAllocator* StackAllocator::GetByName(const std::string& name) {
+  if (name == "malloc") {
+    return Singleton<MallocStackAllocator>::GetInstance();
+  }
+  if (name == "mmap") {
+    return Singleton<MmapStackAllocator>::GetInstance();
+  }
+  if (name == "pooled") {
+    return Singleton<PooledStackAllocator>::GetInstance();
+  }
+  return nullptr;
+}
+
+void* MallocStackAllocator::alloc(size_t size) {
+  return malloc(size);
+}
+
+void MallocStackAllocator::dealloc(void* vp, size_t size) {
+  free(vp);
+}
+
+size_t MmapStackAllocator::PageSize() {
+  static size_t s_page_size = sysconf(_SC_PAGESIZE);
+  return s_page_size;
+}
+
+size_t MmapStackAllocator::RoundToPage(size_t size) {
+  size_t page = PageSize();
+  return (size + page - 1) / page * page;
+}
+
+void* MmapStackAllocator::alloc(size_t size) {
+  size_t page = PageSize();
+  size_t len = RoundToPage(size) + page;
+  void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    SYLAR_LOG_ERROR(g_logger) << "mmap stack fail, size=" << len << " errno=" << errno
+                              << " errstr=" << strerror(errno);
+    return nullptr;
+  }
+  // 栈从高地址向低地址增长，保护页放在最低的一页
+  if (mprotect(base, page, PROT_NONE)) {
+    SYLAR_LOG_ERROR(g_logger) << "mprotect guard page fail, errno=" << errno
+                              << " errstr=" << strerror(errno);
+    munmap(base, len);
+    return nullptr;
+  }
+  void* stack = (char*)base + page;
+  if (m_numaLocal && !CpuUtil::BindMemoryToNode(stack, len - page, CpuUtil::GetCurrentNode())) {
+    // 非NUMA内核不支持mbind，退化为默认的首次访问分配
+    SYLAR_LOG_DEBUG(g_logger) << "mbind stack fail, errno=" << errno << " errstr=" << strerror(errno);
+  }
+  return stack;
+}
+
+void MmapStackAllocator::dealloc(void* vp, size_t size) {
+  if (!vp) {
+    return;
+  }
+  size_t page = PageSize();
+  if (munmap((char*)vp - page, RoundToPage(size) + page)) {
+    SYLAR_LOG_ERROR(g_logger) << "munmap stack fail, errno=" << errno
+                              << " errstr=" << strerror(errno);
+  }
+}
+
+namespace {
+
+/**
+ * @brief 线程局部的空闲栈缓存
+ * @details 按栈大小分组，每组是一个双端队列，队尾是最近释放的栈(常驻内存)，
+ *          队头的trimmed个栈已经通过madvise释放了物理内存
+ */
+struct StackCache {
+  struct SizeClass {
+    size_t size = 0;
+    std::deque<void*> stacks;
+    size_t trimmed = 0;
+  };
+
+  ~StackCache() {
+    MmapStackAllocator alloc;
+    for (auto& i : classes) {
+      for (auto sp : i.stacks) {
+        alloc.dealloc(sp, i.size);
+      }
+    }
+  }
+
+  SizeClass& get(size_t size) {
+    for (auto& i : classes) {
+      if (i.size == size) {
+        return i;
+      }
+    }
+    classes.emplace_back();
+    classes.back().size = size;
+    return classes.back();
+  }
+
+  std::vector<SizeClass> classes;
+};
+
+static thread_local StackCache t_stack_cache;
+
+}   // namespace
+
+void* PooledStackAllocator::alloc(size_t size) {
+  auto& sc = t_stack_cache.get(RoundToPage(size));
+  if (sc.stacks.empty()) {
+    return MmapStackAllocator::alloc(size);
+  }
+  void* sp = sc.stacks.back();
+  sc.stacks.pop_back();
+  if (sc.trimmed > sc.stacks.size()) {
+    sc.trimmed = sc.stacks.size();
+  }
+  return sp;
+}
+
+void PooledStackAllocator::dealloc(void* vp, size_t size) {
+  if (!vp) {
+    return;
+  }
+  auto& sc = t_stack_cache.get(RoundToPage(size));
+  if (sc.stacks.size() >= m_maxCached) {
+    // 缓存已满，优先淘汰最久没用过的栈
+    if (sc.stacks.empty()) {
+      MmapStackAllocator::dealloc(vp, size);
+      return;
+    }
+    MmapStackAllocator::dealloc(sc.stacks.front(), size);
+    sc.stacks.pop_front();
+    if (sc.trimmed) {
+      --sc.trimmed;
+    }
+  }
+  sc.stacks.push_back(vp);
+
+  // 超过hot个常驻的栈，把最早的一个常驻栈的物理内存还给系统
+  size_t hot = m_hotCached;
+  if (sc.stacks.size() - sc.trimmed > hot) {
+    madvise(sc.stacks[sc.trimmed], sc.size, MADV_DONTNEED);
+    ++sc.trimmed;
+  }
+}
+
+void PooledStackAllocator::trim() {
+  for (auto& sc : t_stack_cache.classes) {
+    for (size_t i = sc.trimmed; i < sc.stacks.size(); ++i) {
+      madvise(sc.stacks[i], sc.size, MADV_DONTNEED);
+    }
+    sc.trimmed = sc.stacks.size();
+  }
+}
+
+size_t PooledStackAllocator::cachedCount() const {
+  size_t n = 0;
+  for (auto& sc : t_stack_cache.classes) {
+    n += sc.stacks.size();
+  }
+  return n;
+}
+
+}   // namespace sylar
@@ -0,0 +1,150 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 15:11:47
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 15:11:47
+ * @FilePath: /sylar_from_nanasaki/sylar/stack_allocator.h
+ */
+#ifndef __SYLAR_STACK_ALLOCATOR_H__
+#define __SYLAR_STACK_ALLOCATOR_H__
+
+#include "noncopyable.h"
+#include <atomic>
+#include <stddef.h>
+#include <string>
+
+namespace sylar {
+
+/**
+ * @brief 协程栈内存分配器接口
+ * @details 协程创建时通过分配器申请栈内存，协程析构时归还给同一个分配器
+ */
+class StackAllocator : Noncopyable {
+public:
+  virtual ~StackAllocator() = default;
+
+  /**
+   * @brief 分配栈内存
+   * @param[in] size 栈大小
+   * @return 栈的低地址，失败返回nullptr
+   */
+  virtual void* alloc(size_t size) = 0;
+
+  /**
+   * @brief 释放栈内存
+   * @param[in] vp alloc返回的地址
+   * @param[in] size 栈大小，必须与alloc时一致
+   */
+  virtual void dealloc(void* vp, size_t size) = 0;
+
+  /**
+   * @brief 分配器名称
+   */
+  virtual const char* getName() const = 0;
+
+  /**
+   * @brief 根据名称获取分配器
+   * @param[in] name malloc/mmap/pooled
+   * @return 名称无效时返回nullptr
+   */
+  static StackAllocator* GetByName(const std::string& name);
+};
+
+/**
+ * @brief malloc栈内存分配器
+ * @details 没有保护页，栈溢出会直接破坏堆内存
+ */
+class MallocStackAllocator : public StackAllocator {
+public:
+  void* alloc(size_t size) override;
+  void dealloc(void* vp, size_t size) override;
+  const char* getName() const override {
+    return "malloc";
+  }
+};
+
+/**
+ * @brief mmap栈内存分配器
+ * @details 每个栈单独mmap，栈底(低地址)额外映射一个PROT_NONE保护页，栈溢出时立即触发SIGSEGV
+ * @attention 每个栈占用两个VMA，大量协程时需要注意vm.max_map_count的限制
+ */
+class MmapStackAllocator : public StackAllocator {
+public:
+  void* alloc(size_t size) override;
+  void dealloc(void* vp, size_t size) override;
+  const char* getName() const override {
+    return "mmap";
+  }
+
+  /**
+   * @brief 系统页大小
+   */
+  static size_t PageSize();
+
+  /**
+   * @brief 向上取整到页大小
+   */
+  static size_t RoundToPage(size_t size);
+
+  /**
+   * @brief 设置新分配的栈是否优先使用分配线程所在NUMA节点的物理内存
+   * @details 调度线程绑核之后，回调协程的栈由运行它的调度线程分配，物理页会落在该线程所在的节点上
+   */
+  void setNumaLocal(bool v) {
+    m_numaLocal = v;
+  }
+
+private:
+  /// 是否按分配线程所在的NUMA节点分配物理内存
+  std::atomic<bool> m_numaLocal = {false};
+};
+
+/**
+ * @brief 带缓存的mmap栈内存分配器
+ * @details 在MmapStackAllocator的基础上，每个线程维护一个空闲栈链表，释放的栈优先放回当前线程的链表，
+ *          分配时优先复用。链表中只保留最近使用的hot个栈常驻内存，更早的栈通过madvise(MADV_DONTNEED)
+ *          把物理内存还给系统，但保留虚拟地址映射，再次使用时无需重新mmap
+ */
+class PooledStackAllocator : public MmapStackAllocator {
+public:
+  void* alloc(size_t size) override;
+  void dealloc(void* vp, size_t size) override;
+  const char* getName() const override {
+    return "pooled";
+  }
+
+  /**
+   * @brief 设置每个线程最多缓存的栈数量，超过后直接munmap
+   */
+  void setMaxCached(size_t v) {
+    m_maxCached = v;
+  }
+
+  /**
+   * @brief 设置每个线程缓存中常驻物理内存的栈数量，超过的部分会被madvise释放
+   */
+  void setHotCached(size_t v) {
+    m_hotCached = v;
+  }
+
+  /**
+   * @brief 释放当前线程缓存中所有栈的物理内存
+   * @details 适合在线程长时间空闲前调用
+   */
+  void trim();
+
+  /**
+   * @brief 当前线程缓存的栈数量
+   */
+  size_t cachedCount() const;
+
+private:
+  /// 每个线程最多缓存的栈数量
+  std::atomic<size_t> m_maxCached = {64};
+  /// 每个线程缓存中常驻物理内存的栈数量
+  std::atomic<size_t> m_hotCached = {8};
+};
+
+}   // namespace sylar
+
+#endif
@@ -11,8 +11,10 @@
 #include "sylar/address.h"
 #include "sylar/iomanager.h"
 #include "sylar/socket.h"
+#include "sylar/util/util.h"
 #include <cerrno>
 #include <cstring>
+#include <linux/filter.h>
 #include <sys/socket.h>
 #include <vector>
 
@@ -23,9 +25,30 @@ static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout = sylar::Config::Lookup(
   "tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2), "tcp server read timeout");
 
+static sylar::ConfigVar<bool>::ptr g_tcp_server_reuseport =
+  sylar::Config::Lookup("tcp_server.reuseport", false,
+                        "tcp server SO_REUSEPORT sharded accept, one listen socket per io thread");
+
+static sylar::ConfigVar<bool>::ptr g_tcp_server_reuseport_bpf = sylar::Config::Lookup(
+  "tcp_server.reuseport_bpf", false, "tcp server steer SO_REUSEPORT connections by cpu");
+
+/**
+ * @brief 连接占用的reactor负载，析构时释放，handleClient抛出异常时也不会漏掉
+ */
+struct ReactorLoadGuard {
+  ReactorGroup::ptr reactors;
+  size_t index;
+
+  ~ReactorLoadGuard() {
+    reactors->release(index);
+  }
+};
+
 TcpServer::TcpServer(IOManager* io_worker, IOManager* accept_worker)
   : m_ioWorker(io_worker)
   , m_acceptWorker(accept_worker)
+  , m_reusePort(g_tcp_server_reuseport->getValue())
+  , m_reusePortBpf(g_tcp_server_reuseport_bpf->getValue())
   , m_recvTimeout(g_tcp_server_read_timeout->getValue())
   , m_name("tcp_server")
   , m_type("tcp")
@@ -37,6 +60,7 @@ TcpServer::~TcpServer() {
     i->close();
   }
   m_socks.clear();
+  m_sockShards.clear();
 }
 
 bool TcpServer::bind(Address::ptr addr) {
@@ -47,25 +71,48 @@ bool TcpServer::bind(Address::ptr addr) {
 }
 
 bool TcpServer::bind(const std::vector<Address::ptr>& addrs, std::vector<Address::ptr>& fails) {
+  size_t shards = getAcceptShards();
   for (const auto& addr : addrs) {
-    Socket::ptr sock = Socket::CreateTCP(addr);
-    if (!sock->bind(addr)) {
-      SYLAR_LOG_ERROR(g_logger) << "bind fail, errno = " << errno << " errstr = " << strerror(errno)
-                                << " addr = [" << addr->toString() << "]";
-      fails.push_back(addr);
-      continue;
+    // Unix域socket不支持SO_REUSEPORT，且bind时会删除已有的路径
+    size_t n = addr->getFamily() == AF_UNIX ? 1 : shards;
+    std::vector<Socket::ptr> socks;
+    Address::ptr bind_addr = addr;
+    for (size_t i = 0; i < n; ++i) {
+      Socket::ptr sock = Socket::CreateTCP(addr);
+      if (m_reusePort && !sock->setReusePort()) {
+        break;
+      }
+      if (!sock->bind(bind_addr)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind fail, errno = " << errno
+                                  << " errstr = " << strerror(errno) << " addr = ["
+                                  << addr->toString() << "]";
+        break;
+      }
+      if (!sock->listen()) {
+        SYLAR_LOG_ERROR(g_logger) << "listen fail, errno = " << errno
+                                  << " errstr = " << strerror(errno) << " addr = ["
+                                  << addr->toString() << "]";
+        break;
+      }
+      // 端口为0时其余分片绑定第一个分片分配到的端口
+      bind_addr = sock->getLocalAddress();
+      socks.push_back(sock);
     }
-    if (!sock->listen()) {
-      SYLAR_LOG_ERROR(g_logger) << "listen fail, errno = " << errno
-                                << " errstr = " << strerror(errno) << " addr = ["
-                                << addr->toString() << "]";
+    if (socks.size() != n) {
       fails.push_back(addr);
       continue;
     }
-    m_socks.push_back(sock);
+    if (n > 1 && m_reusePortBpf) {
+      attachReusePortBpf(socks[0], n);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      m_socks.push_back(socks[i]);
+      m_sockShards.push_back(m_reusePort && addr->getFamily() != AF_UNIX ? (int)i : -1);
+    }
   }
   if (!fails.empty()) {
     m_socks.clear();
+    m_sockShards.clear();
     return false;
   }
 
@@ -76,12 +123,83 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs, std::vector<Address
   return true;
 }
 
+size_t TcpServer::getAcceptShards() const {
+  if (!m_reusePort) {
+    return 1;
+  }
+  size_t n = m_reactors ? m_reactors->size() : m_ioWorker->getThreadCount();
+  return n ? n : 1;
+}
+
+IOManager* TcpServer::getAcceptWorker(size_t index) const {
+  int shard = m_sockShards[index];
+  if (shard < 0) {
+    return m_acceptWorker;
+  }
+  return m_reactors ? m_reactors->getReactor(shard) : m_ioWorker;
+}
+
+int TcpServer::getAcceptThread(size_t index) const {
+  int shard = m_sockShards[index];
+  if (shard < 0 || m_reactors) {
+    return -1;
+  }
+  std::vector<int> ids = m_ioWorker->getThreadIds();
+  return (size_t)shard < ids.size() ? ids[shard] : -1;
+}
+
+bool TcpServer::attachReusePortBpf(Socket::ptr sock, size_t shards) {
+  // 分片按bind的顺序编号，返回值 = 当前CPU % 分片数
+  sock_filter code[] = {
+    {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+    {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)shards},
+    {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  sock_fprog prog = {(unsigned short)(sizeof(code) / sizeof(code[0])), code};
+  if (!sock->setOption(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, prog)) {
+    SYLAR_LOG_WARN(g_logger) << "attach reuseport bpf fail, errno = " << errno
+                             << " errstr = " << strerror(errno) << " sock = " << *sock;
+    return false;
+  }
+  return true;
+}
+
 void TcpServer::startAccept(Socket::ptr sock) {
+  // 分片accept的循环被调度到固定的线程上，记下该线程
+  int home = m_reusePort && IOManager::GetThis() == m_ioWorker ? util::GetThreadId() : -1;
   while (!m_isStop) {
     Socket::ptr client = sock->accept();
+    if (home != -1 && util::GetThreadId() != home) {
+      // accept等待结束后协程可能在其他线程上被唤醒，回到原来的线程
+      m_ioWorker->schedule(Fiber::GetThis(), home);
+      Fiber::GetThis()->yield();
+    }
     if (client) {
       client->setRecvTimeout(m_recvTimeout);
-      m_ioWorker->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client));
+      if (m_reactors) {
+        // 连接固定在选中的reactor上，handleClient结束后释放。
+        // 分片accept时accept循环本身就在某个reactor上，直接交给本reactor
+        ReactorGroup::ptr reactors = m_reactors;
+        int local = m_reusePort ? reactors->indexOf(IOManager::GetThis()) : -1;
+        size_t index = 0;
+        if (local >= 0) {
+          index = local;
+          reactors->acquire(index);
+        } else {
+          index = reactors->acquire();
+        }
+        auto self = shared_from_this();
+        reactors->getReactor(index)->schedule([self, client, reactors, index]() {
+          ReactorLoadGuard guard{reactors, index};
+          self->handleClient(client);
+        });
+      } else if (home != -1) {
+        // 分片accept时交给执行accept的线程
+        m_ioWorker->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client),
+                             home);
+      } else {
+        m_ioWorker->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client));
+      }
     } else {
       SYLAR_LOG_ERROR(g_logger) << "accept errno = " << errno << " errstr = " << strerror(errno);
     }
@@ -93,8 +211,9 @@ bool TcpServer::start() {
     return true;
   }
   m_isStop = false;
-  for (auto& sock : m_socks) {
-    m_acceptWorker->schedule(std::bind(&TcpServer::startAccept, shared_from_this(), sock));
+  for (size_t i = 0; i < m_socks.size(); ++i) {
+    getAcceptWorker(i)->schedule(
+      std::bind(&TcpServer::startAccept, shared_from_this(), m_socks[i]), getAcceptThread(i));
   }
   return true;
 }
@@ -103,11 +222,22 @@ void TcpServer::stop() {
   m_isStop = true;
   auto self = shared_from_this();
   m_acceptWorker->schedule([this, self]() {
-    for (auto& sock : m_socks) {
-      sock->cancelAll();
-      sock->close();
+    // 等待accept的协程挂在执行accept循环的调度器上，要在那里取消和关闭
+    for (size_t i = 0; i < m_socks.size(); ++i) {
+      Socket::ptr sock = m_socks[i];
+      IOManager* worker = getAcceptWorker(i);
+      if (worker == IOManager::GetThis()) {
+        sock->cancelAll();
+        sock->close();
+      } else {
+        worker->schedule([self, sock]() {
+          sock->cancelAll();
+          sock->close();
+        });
+      }
     }
     m_socks.clear();
+    m_sockShards.clear();
   });
 }
 
@@ -119,7 +249,12 @@ std::string TcpServer::toString(const std::string& prefix) {
   std::stringstream ss;
   ss << prefix << "[type = " << m_type << " name = " << m_name
      << " io_worker = " << (m_ioWorker ? m_ioWorker->getName() : "")
+     << " reactors = "
+     << (m_reactors ? m_reactors->getName() + "x" + std::to_string(m_reactors->size()) + "("
+                        + ReactorGroup::ToString(m_reactors->getBalance()) + ")"
+                    : "")
      << " accept = " << (m_acceptWorker ? m_acceptWorker->getName() : "")
+     << " reuseport = " << m_reusePort << (m_reusePort && m_reusePortBpf ? "(bpf)" : "")
      << " recv_timeout = " << m_recvTimeout << "]" << std::endl;
   std::string pfx = prefix.empty() ? "    " : prefix;
   for (auto& i : m_socks) {
@@ -10,6 +10,7 @@
 
 #include "sylar/iomanager.h"
 #include "sylar/noncopyable.h"
+#include "sylar/reactor_group.h"
 #include "sylar/socket.h"
 #include <memory>
 #include <vector>
@@ -89,6 +90,53 @@ public:
     m_name = v;
   }
 
+  /**
+   * @brief 设置处理新连接的reactor组
+   * @details 设置后新连接不再交给io_worker，而是按reactor组的分配策略交给其中一个reactor，
+   *          连接的整个生命周期都在该reactor的线程上处理，handleClient返回时视为连接结束。
+   *          需要在start()之前设置，传入nullptr恢复使用io_worker
+   */
+  void setReactors(ReactorGroup::ptr v) {
+    m_reactors = v;
+  }
+
+  /**
+   * @brief 返回处理新连接的reactor组
+   */
+  ReactorGroup::ptr getReactors() const {
+    return m_reactors;
+  }
+
+  /**
+   * @brief 设置是否使用SO_REUSEPORT分片accept
+   * @details 开启后每个地址绑定多个设置了SO_REUSEPORT的监听socket，
+   *          设置了reactor组时每个reactor一个，否则io_worker的每个线程一个，由内核在它们之间分配新连接。
+   *          每个监听socket有自己的accept循环，设置了reactor组时运行在对应的reactor上，
+   *          新连接直接交给本reactor处理；否则第i个accept循环固定在io_worker的第i个线程上，新连接交给该线程处理。
+   *          Unix域地址不支持，仍然只有一个监听socket。需要在bind()之前设置，默认取配置项tcp_server.reuseport
+   */
+  void setReusePort(bool v) {
+    m_reusePort = v;
+  }
+
+  bool isReusePort() const {
+    return m_reusePort;
+  }
+
+  /**
+   * @brief 设置是否在SO_REUSEPORT分片上挂载按CPU分配连接的BPF程序
+   * @details 新连接交给第(处理该连接的CPU % 分片数)个分片，而不是按四元组哈希，
+   *          配合scheduler.cpu_affinity把第i个reactor绑定到第i个CPU，连接的协议栈处理和accept在同一个CPU上。
+   *          需要在bind()之前设置，默认取配置项tcp_server.reuseport_bpf，挂载失败时退回内核的哈希分配
+   */
+  void setReusePortBpf(bool v) {
+    m_reusePortBpf = v;
+  }
+
+  bool isReusePortBpf() const {
+    return m_reusePortBpf;
+  }
+
   /**
    * @brief 是否停止
    */
@@ -112,6 +160,27 @@ protected:
    */
   virtual void startAccept(Socket::ptr sock);
 
+private:
+  /**
+   * @brief SO_REUSEPORT模式下每个地址的监听socket个数
+   */
+  size_t getAcceptShards() const;
+
+  /**
+   * @brief 执行第index个监听socket的accept循环的调度器
+   */
+  IOManager* getAcceptWorker(size_t index) const;
+
+  /**
+   * @brief 执行第index个监听socket的accept循环的线程，-1表示不指定
+   * @details 没有reactor组的分片accept时，第i个分片固定在io_worker的第i个线程上
+   */
+  int getAcceptThread(size_t index) const;
+
+  /**
+   * @brief 在同一地址的一组SO_REUSEPORT监听socket上挂载按CPU分配连接的BPF程序
+   */
+  bool attachReusePortBpf(Socket::ptr sock, size_t shards);
 
 protected:
   /// 监听Socket数组
@@ -120,6 +189,14 @@ protected:
   IOManager* m_ioWorker;
   /// 服务器Socket接收连接的调度器
   IOManager* m_acceptWorker;
+  /// 处理新连接的reactor组，为空时使用m_ioWorker
+  ReactorGroup::ptr m_reactors;
+  /// 是否使用SO_REUSEPORT分片accept
+  bool m_reusePort;
+  /// 是否挂载按CPU分配连接的BPF程序
+  bool m_reusePortBpf;
+  /// m_socks中每个监听socket所属的分片，-1表示不分片，在m_acceptWorker上accept
+  std::vector<int> m_sockShards;
   /// 接收超时时间(毫秒)
   uint64_t m_recvTimeout;
   /// 服务器名称
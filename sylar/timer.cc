@@ -31,12 +31,12 @@ bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs)
 }
 
 
-Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager)
+Timer::Timer(uint64_t us, std::function<void()> cb, bool recurring, TimerManager* manager)
   : m_recurring(recurring)
-  , m_ms(ms)
+  , m_us(us)
   , m_cb(cb)
   , m_manager(manager) {
-  m_next = sylar::util::GetElapsedMS() + m_ms;
+  m_next = sylar::util::GetElapsedUS() + m_us;
 }
 
 Timer::Timer(uint64_t next)
@@ -64,13 +64,17 @@ bool Timer::refresh() {
     return false;
   }
   m_manager->m_timers.erase(it);
-  m_next = sylar::util::GetElapsedMS() + m_ms;
+  m_next = sylar::util::GetElapsedUS() + m_us;
   m_manager->m_timers.insert(shared_from_this());
   return true;
 }
 
 bool Timer::reset(uint64_t ms, bool from_now) {
-  if (ms == m_ms && !from_now) {
+  return resetUs(ms * 1000, from_now);
+}
+
+bool Timer::resetUs(uint64_t us, bool from_now) {
+  if (us == m_us && !from_now) {
     return true;
   }
   TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
@@ -84,25 +88,25 @@ bool Timer::reset(uint64_t ms, bool from_now) {
   m_manager->m_timers.erase(it);
   uint64_t start = 0;
   if (from_now) {
-    start = sylar::util::GetElapsedMS();
+    start = sylar::util::GetElapsedUS();
   } else {
-    start = m_next - m_ms;
+    start = m_next - m_us;
   }
-  m_ms = ms;
-  m_next = start + m_ms;
+  m_us = us;
+  m_next = start + m_us;
   m_manager->addTimer(shared_from_this(), lock);
   return true;
 }
 
 TimerManager::TimerManager() {
-  m_previouseTime = sylar::util::GetElapsedMS();
+  m_previouseTime = sylar::util::GetElapsedUS();
 }
 
 TimerManager::~TimerManager() {
 }
 
-Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
-  Timer::ptr timer(new Timer(ms, cb, recurring, this));
+Timer::ptr TimerManager::addTimerUs(uint64_t us, std::function<void()> cb, bool recurring) {
+  Timer::ptr timer(new Timer(us, cb, recurring, this));
   RWMutexType::WriteLock lock(m_mutex);
   addTimer(timer, lock);
   return timer;
@@ -115,12 +119,21 @@ static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
   }
 }
 
-Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb,
-                                           std::weak_ptr<void> weak_cond, bool recurring) {
-  return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+Timer::ptr TimerManager::addConditionTimerUs(uint64_t us, std::function<void()> cb,
+                                             std::weak_ptr<void> weak_cond, bool recurring) {
+  return addTimerUs(us, std::bind(&OnTimer, weak_cond, cb), recurring);
 }
 
 uint64_t TimerManager::getNextTimer() {
+  uint64_t us = getNextTimerUs();
+  if (us == ~0ull) {
+    return ~0ull;
+  }
+  // 向上取整，还没有超时的定时器不会返回0
+  return (us + 999) / 1000;
+}
+
+uint64_t TimerManager::getNextTimerUs() {
   RWMutexType::ReadLock lock(m_mutex);
   m_tickled = false;
   if (m_timers.empty()) {
@@ -128,16 +141,16 @@ uint64_t TimerManager::getNextTimer() {
   }
 
   const Timer::ptr& next = *m_timers.begin();
-  uint64_t now_ms = sylar::util::GetElapsedMS();
-  if (now_ms >= next->m_next) {
+  uint64_t now_us = sylar::util::GetElapsedUS();
+  if (now_us >= next->m_next) {
     return 0;
   } else {
-    return next->m_next - now_ms;
+    return next->m_next - now_us;
   }
 }
 
 void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
-  uint64_t now_ms = sylar::util::GetElapsedMS();
+  uint64_t now_us = sylar::util::GetElapsedUS();
   std::vector<Timer::ptr> expired;
   {
     RWMutexType::ReadLock lock(m_mutex);
@@ -150,17 +163,17 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
     return;
   }
   bool rollover = false;
-  if (SYLAR_UNLIKELY(detectClockRollover(now_ms))) {
+  if (SYLAR_UNLIKELY(detectClockRollover(now_us))) {
     // 使用clock_gettime(CLOCK_MONOTONIC_RAW)，应该不可能出现时间回退的问题
     rollover = true;
   }
-  if (!rollover && ((*m_timers.begin())->m_next > now_ms)) {
+  if (!rollover && ((*m_timers.begin())->m_next > now_us)) {
     return;
   }
 
-  Timer::ptr now_timer(new Timer(now_ms));
+  Timer::ptr now_timer(new Timer(now_us));
   auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-  while (it != m_timers.end() && (*it)->m_next == now_ms) {
+  while (it != m_timers.end() && (*it)->m_next == now_us) {
     ++it;
   }
   expired.insert(expired.begin(), m_timers.begin(), it);
@@ -170,7 +183,7 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
   for (auto& timer : expired) {
     cbs.push_back(timer->m_cb);
     if (timer->m_recurring) {
-      timer->m_next = now_ms + timer->m_ms;
+      timer->m_next = now_us + timer->m_us;
       m_timers.insert(timer);
     } else {
       timer->m_cb = nullptr;
@@ -191,12 +204,12 @@ void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
   }
 }
 
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
+bool TimerManager::detectClockRollover(uint64_t now_us) {
   bool rollover = false;
-  if (now_ms < m_previouseTime && now_ms < (m_previouseTime - 60 * 60 * 1000)) {
+  if (now_us < m_previouseTime && now_us < (m_previouseTime - 60 * 60 * 1000 * 1000ull)) {
     rollover = true;
   }
-  m_previouseTime = now_ms;
+  m_previouseTime = now_us;
   return rollover;
 }
 
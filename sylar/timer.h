@@ -44,27 +44,34 @@ public:
    */
   bool reset(uint64_t ms, bool from_now);
 
+  /**
+   * @brief 重置定时器时间
+   * @param[in] us 定时器执行间隔时间(微秒)
+   * @param[in] from_now 是否从当前时间开始计算
+   */
+  bool resetUs(uint64_t us, bool from_now);
+
 private:
   /**
    * @brief 构造函数
-   * @param[in] ms 定时器执行间隔时间
+   * @param[in] us 定时器执行间隔时间(微秒)
    * @param[in] cb 回调函数
    * @param[in] recurring 是否循环
    * @param[in] manager 定时器管理器
    */
-  Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager);
+  Timer(uint64_t us, std::function<void()> cb, bool recurring, TimerManager* manager);
   /**
    * @brief 构造函数
-   * @param[in] next 执行的时间戳(毫秒)
+   * @param[in] next 执行的时间戳(微秒)
    */
   Timer(uint64_t next);
 
 private:
   /// 是否循环定时器
   bool m_recurring = false;
-  /// 执行周期
-  uint64_t m_ms = 0;
-  /// 精确的执行时间
+  /// 执行周期(微秒)
+  uint64_t m_us = 0;
+  /// 精确的执行时间(GetElapsedUS)
   uint64_t m_next = 0;
   /// 回调函数
   std::function<void()> m_cb;
@@ -111,7 +118,17 @@ public:
    * @param[in] cb 定时器回调函数
    * @param[in] recurring 是否循环定时器
    */
-  Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+  Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false) {
+    return addTimerUs(ms * 1000, std::move(cb), recurring);
+  }
+
+  /**
+   * @brief 添加微秒精度的定时器
+   * @param[in] us 定时器执行间隔时间(微秒)
+   * @param[in] cb 定时器回调函数
+   * @param[in] recurring 是否循环定时器
+   */
+  Timer::ptr addTimerUs(uint64_t us, std::function<void()> cb, bool recurring = false);
 
   /**
    * @brief 添加条件定时器
@@ -121,13 +138,30 @@ public:
    * @param[in] recurring 是否循环
    */
   Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond,
-                               bool recurring = false);
+                               bool recurring = false) {
+    return addConditionTimerUs(ms * 1000, std::move(cb), std::move(weak_cond), recurring);
+  }
+
+  /**
+   * @brief 添加微秒精度的条件定时器
+   * @param[in] us 定时器执行间隔时间(微秒)
+   * @param[in] cb 定时器回调函数
+   * @param[in] weak_cond 条件
+   * @param[in] recurring 是否循环
+   */
+  Timer::ptr addConditionTimerUs(uint64_t us, std::function<void()> cb,
+                                 std::weak_ptr<void> weak_cond, bool recurring = false);
 
   /**
-   * @brief 到最近一个定时器执行的时间间隔(毫秒)
+   * @brief 到最近一个定时器执行的时间间隔(毫秒)，不足1毫秒按1毫秒计算，已超时返回0
    */
   uint64_t getNextTimer();
 
+  /**
+   * @brief 到最近一个定时器执行的时间间隔(微秒)，已超时返回0，没有定时器返回~0ull
+   */
+  uint64_t getNextTimerUs();
+
   /**
    * @brief 获取需要执行的定时器的回调函数列表
    * @param[out] cbs 回调函数数组
@@ -154,7 +188,7 @@ private:
   /**
    * @brief 检测服务器时间是否被调后了
    */
-  bool detectClockRollover(uint64_t now_ms);
+  bool detectClockRollover(uint64_t now_us);
 
 private:
   /// Mutex
@@ -163,7 +197,7 @@ private:
   std::set<Timer::ptr, Timer::Comparator> m_timers;
   /// 是否触发onTimerInsertedAtFront
   bool m_tickled = false;
-  /// 上次执行时间
+  /// 上次执行时间(微秒)
   uint64_t m_previouseTime = 0;
 };
 
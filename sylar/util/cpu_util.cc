@@ -0,0 +1,183 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 00:40:18
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 00:40:18
+ * @FilePath: /sylar_from_nanasaki/sylar/util/cpu_util.cc
+ */
+#include "cpu_util.h"
+#include <algorithm>
+#include <ctype.h>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <tuple>
+#include <unistd.h>
+
+namespace sylar {
+namespace CpuUtil {
+
+/// mbind(2)的内存策略，不依赖libnuma的头文件
+static const int SYLAR_MPOL_PREFERRED = 1;
+
+static std::string ReadLine(const std::string& path) {
+  std::ifstream ifs(path);
+  std::string line;
+  std::getline(ifs, line);
+  return line;
+}
+
+static int ReadInt(const std::string& path, int def) {
+  std::string line = ReadLine(path);
+  if (line.empty()) {
+    return def;
+  }
+  return atoi(line.c_str());
+}
+
+std::vector<int> ParseCpuList(const std::string& str) {
+  std::vector<int> cpus;
+  size_t pos = 0;
+  while (pos < str.size()) {
+    size_t end = str.find(',', pos);
+    if (end == std::string::npos) {
+      end = str.size();
+    }
+    std::string item = str.substr(pos, end - pos);
+    pos = end + 1;
+
+    size_t dash = item.find('-');
+    char* p = nullptr;
+    long first = strtol(item.c_str(), &p, 10);
+    if (p == item.c_str() || first < 0) {
+      continue;
+    }
+    long last = first;
+    if (dash != std::string::npos) {
+      const char* s = item.c_str() + dash + 1;
+      last = strtol(s, &p, 10);
+      if (p == s || last < first) {
+        continue;
+      }
+    }
+    for (long i = first; i <= last && i < CPU_SETSIZE; ++i) {
+      cpus.push_back((int)i);
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::vector<int> GetAllowedCpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int i = 0; i < CPU_SETSIZE; ++i) {
+      if (CPU_ISSET(i, &set)) {
+        cpus.push_back(i);
+      }
+    }
+  }
+  if (cpus.empty()) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long i = 0; i < n; ++i) {
+      cpus.push_back((int)i);
+    }
+  }
+  return cpus;
+}
+
+/**
+ * @brief CPU到NUMA节点的映射，第一次使用时从/sys/devices/system/node读取
+ */
+static const std::map<int, int>& CpuNodeMap() {
+  static std::map<int, int> s_map;
+  static std::once_flag s_once;
+  std::call_once(s_once, []() {
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (!dir) {
+      return;
+    }
+    while (struct dirent* dp = readdir(dir)) {
+      std::string name = dp->d_name;
+      if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+          !isdigit((unsigned char)name[4])) {
+        continue;
+      }
+      int node = atoi(name.c_str() + 4);
+      for (int cpu : ParseCpuList(ReadLine("/sys/devices/system/node/" + name + "/cpulist"))) {
+        s_map[cpu] = node;
+      }
+    }
+    closedir(dir);
+  });
+  return s_map;
+}
+
+int GetCpuNode(int cpu) {
+  auto& m = CpuNodeMap();
+  auto it = m.find(cpu);
+  return it == m.end() ? 0 : it->second;
+}
+
+int GetCurrentNode() {
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : GetCpuNode(cpu);
+}
+
+std::vector<int> GetPhysicalCores() {
+  // (节点, 封装, 核心) -> 该核心上编号最小的逻辑CPU
+  std::map<std::tuple<int, int, int>, int> cores;
+  for (int cpu : GetAllowedCpus()) {
+    std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+    int package = ReadInt(base + "physical_package_id", 0);
+    int core = ReadInt(base + "core_id", cpu);
+    cores.emplace(std::make_tuple(GetCpuNode(cpu), package, core), cpu);
+  }
+  std::vector<int> cpus;
+  for (auto& i : cores) {
+    cpus.push_back(i.second);
+  }
+  return cpus;
+}
+
+std::vector<int> ResolveCpuSpec(const std::string& spec) {
+  if (spec.empty() || spec == "none") {
+    return {};
+  }
+  if (spec == "all") {
+    return GetAllowedCpus();
+  }
+  if (spec == "physical") {
+    return GetPhysicalCores();
+  }
+  return ParseCpuList(spec);
+}
+
+bool BindCurrentThread(int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool BindMemoryToNode(void* addr, size_t len, int node) {
+  if (node < 0 || node >= (int)(sizeof(unsigned long) * 8)) {
+    return false;
+  }
+  unsigned long mask = 1UL << node;
+  return syscall(SYS_mbind, addr, len, SYLAR_MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0) == 0;
+}
+
+}   // namespace CpuUtil
+}   // namespace sylar
@@ -0,0 +1,64 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 00:40:18
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 00:40:18
+ * @FilePath: /sylar_from_nanasaki/sylar/util/cpu_util.h
+ */
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace sylar {
+namespace CpuUtil {
+
+/**
+ * @brief 解析CPU列表，格式同/sys/devices/system/cpu/online，如"0,2,4-7"
+ * @return 去重排序后的CPU编号，格式错误的部分被忽略
+ */
+std::vector<int> ParseCpuList(const std::string& str);
+
+/**
+ * @brief 当前进程允许使用的CPU，参考sched_getaffinity(2)
+ */
+std::vector<int> GetAllowedCpus();
+
+/**
+ * @brief 每个物理核取一个逻辑CPU，超线程的兄弟CPU被跳过
+ * @details 按NUMA节点、物理封装、核心编号排序，只包含当前进程允许使用的CPU
+ */
+std::vector<int> GetPhysicalCores();
+
+/**
+ * @brief 获取CPU所在的NUMA节点
+ * @return 没有NUMA信息时返回0
+ */
+int GetCpuNode(int cpu);
+
+/**
+ * @brief 获取当前线程正在运行的CPU所在的NUMA节点
+ */
+int GetCurrentNode();
+
+/**
+ * @brief 把CPU配置解析成CPU列表
+ * @param[in] spec 空字符串或"none"表示不绑定，"all"表示所有允许使用的CPU，
+ *                 "physical"表示每个物理核一个，其他按CPU列表解析
+ */
+std::vector<int> ResolveCpuSpec(const std::string& spec);
+
+/**
+ * @brief 把当前线程绑定到指定的CPU上
+ */
+bool BindCurrentThread(int cpu);
+
+/**
+ * @brief 设置一段内存优先从指定NUMA节点分配物理页，参考mbind(2)的MPOL_PREFERRED
+ * @details 只影响之后才发生缺页的页，addr必须按页对齐
+ */
+bool BindMemoryToNode(void* addr, size_t len, int node);
+
+}   // namespace CpuUtil
+}   // namespace sylar
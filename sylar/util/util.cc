@@ -43,6 +43,12 @@ uint64_t GetElapsedMS() {
   return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+uint64_t GetElapsedUS() {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
 std::string GetThreadName() {
   char thread_name[16] = {0};
   pthread_getname_np(pthread_self(), thread_name, 16);
@@ -72,12 +78,10 @@ static std::string demangle(const char* str) {
   return str;
 }
 
-void Backtrace(std::vector<std::string>& bt, int size, int skip) {
-  void** array = (void**)malloc((sizeof(void*) * size));
-  // backtrace()函数，获取函数调用堆栈帧数据，即回溯函数调用列表。
-  // 数据将放在buffer中。参数size用来指定buffer中可以保存多少个void*元素（表示相应栈帧的地址，一个返回地址）
-  // 如果回溯的函数调用大于size，则size个函数调用地址被返回。为了取得全部的函数调用列表，应保证buffer和size足够大
-  size_t s = ::backtrace(array, size);
+/**
+ * @brief 把栈帧地址转成函数名等描述信息
+ */
+static void SymbolizeFrames(void* const* array, int s, int skip, std::vector<std::string>& bt) {
   // 将从backtrace()函数获取的地址转为描述这些地址的字符串数组
   // 每个地址的字符串信息包含对应函数的名字、在函数内的十六进制偏移地址、以及实际的返回地址（十六进制）
   char** strings = backtrace_symbols(array, s);
@@ -86,11 +90,20 @@ void Backtrace(std::vector<std::string>& bt, int size, int skip) {
     return;
   }
 
-  for (size_t i = skip; i < s; ++i) {
+  for (int i = skip; i < s; ++i) {
     bt.push_back(demangle(strings[i]));
   }
 
   free(strings);
+}
+
+void Backtrace(std::vector<std::string>& bt, int size, int skip) {
+  void** array = (void**)malloc((sizeof(void*) * size));
+  // backtrace()函数，获取函数调用堆栈帧数据，即回溯函数调用列表。
+  // 数据将放在buffer中。参数size用来指定buffer中可以保存多少个void*元素（表示相应栈帧的地址，一个返回地址）
+  // 如果回溯的函数调用大于size，则size个函数调用地址被返回。为了取得全部的函数调用列表，应保证buffer和size足够大
+  size_t s = ::backtrace(array, size);
+  SymbolizeFrames(array, s, skip, bt);
   free(array);
 }
 
@@ -104,6 +117,16 @@ std::string BacktraceToString(int size, int skip, const std::string& prefix) {
   return ss.str();
 }
 
+std::string BacktraceToString(void* const* frames, int size, int skip, const std::string& prefix) {
+  std::vector<std::string> bt;
+  SymbolizeFrames(frames, size, skip, bt);
+  std::stringstream ss;
+  for (size_t i = 0; i < bt.size(); ++i) {
+    ss << prefix << bt[i] << std::endl;
+  }
+  return ss.str();
+}
+
 uint64_t GetCurrentMS() {
   struct timeval tv;
   gettimeofday(&tv, NULL);
@@ -35,6 +35,11 @@ uint64_t GetFiberId();
  */
 uint64_t GetElapsedMS();
 
+/**
+ * @brief 获取当前启动的微秒数，与GetElapsedMS使用同一个时钟
+ */
+uint64_t GetElapsedUS();
+
 /**
  * @brief 获取线程名称，参考pthread_getname_np(3)
  */
@@ -62,6 +67,17 @@ void Backtrace(std::vector<std::string>& bt, int size = 64, int skip = 1);
  */
 std::string BacktraceToString(int size = 64, int skip = 2, const std::string& prefix = "");
 
+/**
+ * @brief 把已经取到的调用栈地址转成字符串
+ * @details 用于格式化在其他线程或信号处理函数中通过backtrace()取到的调用栈
+ * @param[in] frames 栈帧地址
+ * @param[in] size 栈帧数
+ * @param[in] skip 跳过栈顶的层数
+ * @param[in] prefix 栈信息前输出的内容
+ */
+std::string BacktraceToString(void* const* frames, int size, int skip = 0,
+                              const std::string& prefix = "");
+
 /**
  * @brief 获取当前时间的毫秒
  */
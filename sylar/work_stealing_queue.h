@@ -0,0 +1,125 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 10:12:40
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 10:12:40
+ * @FilePath: /sylar_from_nanasaki/sylar/work_stealing_queue.h
+ */
+#ifndef __SYLAR_WORK_STEALING_QUEUE_H__
+#define __SYLAR_WORK_STEALING_QUEUE_H__
+
+#include "noncopyable.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sylar {
+
+/**
+ * @brief 工作窃取队列(每线程本地运行队列)
+ * @details 固定容量的环形队列，参考Go runtime的runq实现：
+ *          只有队列所属线程可以push(只写tail)，所属线程和窃取线程都通过CAS head出队，
+ *          整个过程不需要任何锁。队列只保存元素指针，元素的生命周期由使用者管理
+ * @tparam T 元素类型
+ * @tparam N 队列容量，必须是2的幂
+ */
+template <class T, uint32_t N = 256>
+class WorkStealingQueue : Noncopyable {
+  static_assert((N & (N - 1)) == 0, "WorkStealingQueue capacity must be power of 2");
+
+public:
+  WorkStealingQueue() {
+    for (uint32_t i = 0; i < N; ++i) {
+      m_slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief 入队，只能由队列所属线程调用
+   * @return 队列已满时返回false
+   */
+  bool push(T* v) {
+    uint32_t h = m_head.load(std::memory_order_acquire);
+    uint32_t t = m_tail.load(std::memory_order_relaxed);
+    if (t - h >= N) {
+      return false;
+    }
+    m_slots[t & (N - 1)].store(v, std::memory_order_relaxed);
+    m_tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief 出队(FIFO)，只能由队列所属线程调用
+   * @return 队列为空时返回nullptr
+   */
+  T* pop() {
+    while (true) {
+      uint32_t h = m_head.load(std::memory_order_acquire);
+      uint32_t t = m_tail.load(std::memory_order_relaxed);
+      if (h == t) {
+        return nullptr;
+      }
+      T* v = m_slots[h & (N - 1)].load(std::memory_order_relaxed);
+      if (m_head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel)) {
+        return v;
+      }
+    }
+  }
+
+  /**
+   * @brief 从本队列窃取一半元素到dst
+   * @details 由窃取线程调用，dst必须是窃取线程自己的队列且为空
+   * @return 返回窃取到的第一个元素，剩余的元素放入dst；没有可窃取的元素时返回nullptr
+   */
+  T* stealInto(WorkStealingQueue& dst) {
+    T* buf[N / 2];
+    while (true) {
+      uint32_t h = m_head.load(std::memory_order_acquire);
+      uint32_t t = m_tail.load(std::memory_order_acquire);
+      uint32_t n = t - h;
+      if (n == 0 || n > N) {
+        // n > N 说明读到了不一致的head/tail，队列所属线程正在操作，直接放弃
+        return nullptr;
+      }
+      n = n - n / 2;
+      for (uint32_t i = 0; i < n; ++i) {
+        buf[i] = m_slots[(h + i) & (N - 1)].load(std::memory_order_relaxed);
+      }
+      if (m_head.compare_exchange_weak(h, h + n, std::memory_order_acq_rel)) {
+        for (uint32_t i = 1; i < n; ++i) {
+          dst.push(buf[i]);
+        }
+        return buf[0];
+      }
+    }
+  }
+
+  /**
+   * @brief 队列中的元素个数(近似值)
+   */
+  size_t size() const {
+    uint32_t h = m_head.load(std::memory_order_acquire);
+    uint32_t t = m_tail.load(std::memory_order_acquire);
+    return t - h > N ? 0 : t - h;
+  }
+
+  /**
+   * @brief 队列是否为空(近似值)
+   */
+  bool empty() const {
+    return size() == 0;
+  }
+
+private:
+  /// 队头，所属线程和窃取线程通过CAS修改，单独占一个cache line避免伪共享
+  alignas(64) std::atomic<uint32_t> m_head{0};
+  /// 队尾，只有所属线程修改
+  alignas(64) std::atomic<uint32_t> m_tail{0};
+  /// 元素槽位
+  alignas(64) std::atomic<T*> m_slots[N];
+};
+
+}   // namespace sylar
+
+#endif
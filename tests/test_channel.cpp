@@ -0,0 +1,253 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 19:40:08
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 19:40:08
+ * @FilePath: /sylar_from_nanasaki/tests/test_channel.cpp
+ */
+#include "sylar/channel.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 当前线程调用operator new的次数
+static thread_local uint64_t t_allocs = 0;
+
+void* operator new(size_t size) {
+  ++t_allocs;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+/**
+ * @brief 非阻塞接口和关闭语义，不需要调度器
+ */
+void test_try() {
+  sylar::Channel<std::string> ch(2);
+  SYLAR_ASSERT(ch.trySend("a"));
+  std::string b = "b";
+  SYLAR_ASSERT(ch.trySend(std::move(b)));
+  std::string c = "c";
+  SYLAR_ASSERT(!ch.trySend(std::move(c)));
+  // 发送失败时不会移走元素
+  SYLAR_ASSERT(c == "c");
+  SYLAR_ASSERT(ch.size() == 2);
+
+  std::string v;
+  SYLAR_ASSERT(ch.tryRecv(v) && v == "a");
+  ch.close();
+  SYLAR_ASSERT(!ch.trySend("d"));
+  SYLAR_ASSERT(ch.tryRecv(v) && v == "b");
+  SYLAR_ASSERT(!ch.tryRecv(v));
+  SYLAR_LOG_INFO(g_logger) << "test_try ok";
+}
+
+/**
+ * @brief 不需要挂起的send和recv走无锁快速路径，不分配内存
+ */
+void test_fast_path_no_alloc() {
+  sylar::Channel<int> ch(4);
+  uint64_t before = t_allocs;
+  int sum = 0;
+  for (int i = 0; i < 1000; ++i) {
+    SYLAR_ASSERT(ch.send(i));
+    int v = 0;
+    SYLAR_ASSERT(ch.recv(v));
+    sum += v;
+  }
+  uint64_t allocs = t_allocs - before;
+  SYLAR_ASSERT(sum == 999 * 1000 / 2);
+  SYLAR_LOG_INFO(g_logger) << "test_fast_path_no_alloc allocs=" << allocs;
+  SYLAR_ASSERT(allocs == 0);
+}
+
+/**
+ * @brief 多生产者、中间处理、多消费者的流水线
+ */
+void test_pipeline() {
+  const int PRODUCERS = 8;
+  const int COUNT = 10000;
+  sylar::Channel<int> in(16);
+  sylar::Channel<int> out(16);
+  std::atomic<int> producers{PRODUCERS};
+  std::atomic<int> workers{4};
+  std::atomic<uint64_t> sum{0};
+  uint64_t begin = sylar::util::GetCurrentMS();
+  {
+    sylar::IOManager iom(4, false, "channel");
+    for (int i = 0; i < PRODUCERS; ++i) {
+      iom.schedule([&, i]() {
+        for (int j = 0; j < COUNT; ++j) {
+          SYLAR_ASSERT(in.send(i * COUNT + j));
+        }
+        if (--producers == 0) {
+          in.close();
+        }
+      });
+    }
+    for (int i = 0; i < 4; ++i) {
+      iom.schedule([&]() {
+        int v;
+        while (in.recv(v)) {
+          SYLAR_ASSERT(out.send(v * 2));
+        }
+        if (--workers == 0) {
+          out.close();
+        }
+      });
+    }
+    for (int i = 0; i < 4; ++i) {
+      iom.schedule([&]() {
+        int v;
+        while (out.recv(v)) {
+          sum += v;
+        }
+        SYLAR_ASSERT(out.isClosed());
+      });
+    }
+  }
+  uint64_t n = PRODUCERS * COUNT;
+  SYLAR_ASSERT(sum == n * (n - 1));
+  SYLAR_LOG_INFO(g_logger) << "test_pipeline ok, items=" << n
+                           << " used=" << sylar::util::GetCurrentMS() - begin << "ms";
+}
+
+/**
+ * @brief 超时收发
+ */
+void test_timeout() {
+  sylar::Channel<int> ch(1);
+  bool ok = false;
+  {
+    sylar::IOManager iom(2, false, "channel_timeout");
+    iom.schedule([&]() {
+      int v;
+      uint64_t begin = sylar::util::GetElapsedMS();
+      SYLAR_ASSERT(!ch.recv(v, 30));
+      SYLAR_ASSERT(sylar::util::GetElapsedMS() - begin >= 25);
+      SYLAR_ASSERT(!ch.isClosed());
+
+      SYLAR_ASSERT(ch.send(1, 30));
+      begin = sylar::util::GetElapsedMS();
+      SYLAR_ASSERT(!ch.send(2, 30));
+      SYLAR_ASSERT(sylar::util::GetElapsedMS() - begin >= 25);
+      SYLAR_ASSERT(ch.recv(v, 30) && v == 1);
+      ok = true;
+    });
+  }
+  SYLAR_ASSERT(ok);
+  SYLAR_LOG_INFO(g_logger) << "test_timeout ok";
+}
+
+/**
+ * @brief 在两个通道上select，直到两个通道都关闭
+ */
+void test_select() {
+  sylar::Channel<int> a(4);
+  sylar::Channel<std::string> b(4);
+  sylar::Channel<int> done(1);
+  int sum_a = 0;
+  int count_b = 0;
+  int timeouts = 0;
+  {
+    sylar::IOManager iom(4, false, "channel_select");
+    iom.schedule([&]() {
+      bool a_open = true;
+      bool b_open = true;
+      while (a_open || b_open) {
+        int va = 0;
+        std::string vb;
+        bool ok_a = true;
+        bool ok_b = true;
+        // 已关闭的通道总是就绪，不能再参与select
+        sylar::ChannelSelect sel;
+        int ia = -1;
+        int ib = -1;
+        int n = 0;
+        if (a_open) {
+          sel.recv(a, va, &ok_a);
+          ia = n++;
+        }
+        if (b_open) {
+          sel.recv(b, vb, &ok_b);
+          ib = n++;
+        }
+        int idx = sel.wait(50);
+        if (idx == -1) {
+          ++timeouts;
+        } else if (idx == ia) {
+          if (ok_a) {
+            sum_a += va;
+          } else {
+            a_open = false;
+          }
+        } else if (idx == ib) {
+          if (ok_b) {
+            ++count_b;
+          } else {
+            b_open = false;
+          }
+        }
+      }
+      done.send(1);
+    });
+    iom.schedule([&]() {
+      for (int i = 1; i <= 1000; ++i) {
+        a.send(i);
+      }
+      a.close();
+    });
+    iom.schedule([&]() {
+      for (int i = 0; i < 500; ++i) {
+        b.send(std::to_string(i));
+        if (i == 250) {
+          // 让select超时一次
+          usleep(100 * 1000);
+        }
+      }
+      b.close();
+    });
+    iom.schedule([&]() {
+      // select发送分支
+      sylar::Channel<int> c(1);
+      bool ok = false;
+      sylar::ChannelSelect sel;
+      sel.send(c, 42, &ok);
+      SYLAR_ASSERT(sel.trySelect() == 0 && ok);
+      SYLAR_ASSERT(sel.trySelect() == -1);
+      int v;
+      SYLAR_ASSERT(done.recv(v));
+    });
+  }
+  SYLAR_ASSERT(sum_a == 1000 * 1001 / 2);
+  SYLAR_ASSERT(count_b == 500);
+  SYLAR_ASSERT(timeouts >= 1);
+  SYLAR_LOG_INFO(g_logger) << "test_select ok, timeouts=" << timeouts;
+}
+
+int main(int argc, char** argv) {
+  test_try();
+  test_fast_path_no_alloc();
+  test_pipeline();
+  test_timeout();
+  test_select();
+  return 0;
+}
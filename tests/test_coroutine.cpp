@@ -0,0 +1,169 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 09:58:03
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 09:58:03
+ * @FilePath: /sylar_from_nanasaki/tests/test_coroutine.cpp
+ */
+#include "sylar/log.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+#ifdef SYLAR_COROUTINE
+
+#include "sylar/coroutine.h"
+#include "sylar/future.h"
+#include "sylar/iomanager.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::co::Task<int> add(int a, int b) {
+  co_await sylar::co::Sleep(1);
+  co_return a + b;
+}
+
+static sylar::co::Task<int> fail() {
+  co_await sylar::co::Sleep(1);
+  throw std::runtime_error("task failed");
+}
+
+/**
+ * @brief 任务嵌套、返回值和异常通过Future传回
+ */
+void test_task() {
+  sylar::IOManager iom(2, false, "co_task");
+  sylar::Future<int> sum = sylar::co::Spawn(&iom, []() -> sylar::co::Task<int> {
+    int total = 0;
+    for (int i = 0; i < 10; ++i) {
+      total += co_await add(i, i);
+    }
+    // 等待交给其他调度器的计算
+    total += co_await sylar::co::Await(sylar::Async(sylar::IOManager::GetThis(), []() { return 10; }));
+    co_return total;
+  }());
+  SYLAR_ASSERT(sum.get() == 100);
+
+  sylar::Future<int> failed = sylar::co::Spawn(&iom, fail());
+  failed.wait();
+  SYLAR_ASSERT(failed.hasException());
+
+  uint64_t begin = sylar::util::GetElapsedMS();
+  sylar::co::Spawn(&iom, []() -> sylar::co::Task<> { co_await sylar::co::Sleep(20); }()).get();
+  SYLAR_ASSERT(sylar::util::GetElapsedMS() - begin >= 20);
+  SYLAR_LOG_INFO(g_logger) << "test_task ok";
+}
+
+static sylar::co::Task<> echo(int fd) {
+  char buf[128];
+  while (true) {
+    ssize_t n = co_await sylar::co::Read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    if (co_await sylar::co::Write(fd, buf, n) != n) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+static sylar::co::Task<> serve(sylar::IOManager* iom, int listen_fd, int count) {
+  for (int i = 0; i < count; ++i) {
+    int fd = co_await sylar::co::Accept(listen_fd);
+    SYLAR_ASSERT(fd >= 0);
+    sylar::co::Spawn(iom, echo(fd));
+  }
+  // 在hook开启的线程上关闭，同时清理FdManager中的记录
+  close(listen_fd);
+}
+
+static sylar::co::Task<bool> request(sockaddr_in addr, int i) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (co_await sylar::co::Connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+    close(fd);
+    co_return false;
+  }
+  std::string msg = "hello " + std::to_string(i);
+  bool ok = co_await sylar::co::Write(fd, msg.c_str(), msg.size()) == (ssize_t)msg.size();
+  char buf[128] = {0};
+  size_t got = 0;
+  while (ok && got < msg.size()) {
+    ssize_t n = co_await sylar::co::Read(fd, buf + got, sizeof(buf) - got);
+    ok = n > 0;
+    got += ok ? n : 0;
+  }
+  close(fd);
+  co_return ok && msg == std::string(buf, got);
+}
+
+/**
+ * @brief 无栈协程实现的echo服务器和并发客户端
+ */
+void test_echo() {
+  const int N = 200;
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  SYLAR_ASSERT(bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd, (sockaddr*)&addr, &len);
+  SYLAR_ASSERT(listen(listen_fd, N) == 0);
+
+  sylar::IOManager iom(2, false, "co_echo");
+  sylar::Future<void> server = sylar::co::Spawn(&iom, serve(&iom, listen_fd, N));
+  std::vector<sylar::Future<bool>> clients;
+  for (int i = 0; i < N; ++i) {
+    clients.push_back(sylar::co::Spawn(&iom, request(addr, i)));
+  }
+  std::vector<bool> rts = sylar::WhenAll(clients).get();
+  server.get();
+  for (auto i : rts) {
+    SYLAR_ASSERT(i);
+  }
+  SYLAR_LOG_INFO(g_logger) << "test_echo ok, clients=" << N;
+}
+
+/**
+ * @brief 读超时
+ */
+void test_timeout() {
+  int fds[2];
+  SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  sylar::IOManager iom(1, false, "co_timeout");
+  uint64_t begin = sylar::util::GetElapsedMS();
+  int err = sylar::co::Spawn(&iom, [](int fd) -> sylar::co::Task<int> {
+              char c;
+              ssize_t n = co_await sylar::co::Read(fd, &c, 1, 20);
+              int rt = n == -1 ? errno : 0;
+              close(fd);
+              co_return rt;
+            }(fds[0])).get();
+  SYLAR_ASSERT(err == ETIMEDOUT);
+  SYLAR_ASSERT(sylar::util::GetElapsedMS() - begin >= 20);
+  close(fds[1]);
+  SYLAR_LOG_INFO(g_logger) << "test_timeout ok";
+}
+
+int main(int argc, char** argv) {
+  test_task();
+  test_echo();
+  test_timeout();
+  return 0;
+}
+
+#else
+
+int main(int argc, char** argv) {
+  SYLAR_LOG_INFO(g_logger) << "built without SYLAR_COROUTINE, skip";
+  return 0;
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 01:05:27
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 01:05:27
+ * @FilePath: /sylar_from_nanasaki/tests/test_cpu_affinity.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/scheduler.h"
+#include "sylar/stack_allocator.h"
+#include "sylar/util/cpu_util.h"
+#include <atomic>
+#include <sched.h>
+#include <sstream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_parse() {
+  SYLAR_ASSERT(sylar::CpuUtil::ParseCpuList("0,2,4-6") == std::vector<int>({0, 2, 4, 5, 6}));
+  SYLAR_ASSERT(sylar::CpuUtil::ParseCpuList("3,1-2,3") == std::vector<int>({1, 2, 3}));
+  SYLAR_ASSERT(sylar::CpuUtil::ParseCpuList("x,7-5,9") == std::vector<int>({9}));
+  SYLAR_ASSERT(sylar::CpuUtil::ParseCpuList("").empty());
+  SYLAR_ASSERT(sylar::CpuUtil::ResolveCpuSpec("none").empty());
+
+  auto allowed = sylar::CpuUtil::GetAllowedCpus();
+  auto physical = sylar::CpuUtil::GetPhysicalCores();
+  SYLAR_ASSERT(!allowed.empty());
+  SYLAR_ASSERT(!physical.empty() && physical.size() <= allowed.size());
+  SYLAR_LOG_INFO(g_logger) << "test_parse ok, allowed=" << allowed.size()
+                           << " physical=" << physical.size()
+                           << " current_node=" << sylar::CpuUtil::GetCurrentNode();
+}
+
+/**
+ * @brief 绑核之后任务只在绑定的CPU上执行
+ */
+void test_pin(bool work_stealing) {
+  int cpu = sylar::CpuUtil::GetAllowedCpus().back();
+  std::atomic<int> wrong{0};
+  std::atomic<int> done{0};
+  std::stringstream ss;
+  {
+    sylar::Scheduler sc(2, false, "affinity");
+    sc.setWorkStealing(work_stealing);
+    sc.setCpuAffinity(std::to_string(cpu));
+    sc.start();
+    for (int i = 0; i < 1000; ++i) {
+      sc.schedule([&]() {
+        if (sched_getcpu() != cpu) {
+          ++wrong;
+        }
+        ++done;
+      });
+    }
+    sc.dump(ss);
+    sc.stop();
+  }
+  SYLAR_ASSERT(done == 1000);
+  SYLAR_ASSERT(wrong == 0);
+  SYLAR_LOG_INFO(g_logger) << "test_pin ok, work_stealing=" << work_stealing << "\n" << ss.str();
+}
+
+/**
+ * @brief 通过配置项给IOManager绑核，并开启NUMA本地栈
+ */
+void test_config() {
+  sylar::Config::Lookup<std::map<std::string, std::string>>("scheduler.cpu_affinity")
+    ->setValue({{"*", "physical"}});
+  sylar::Config::Lookup<bool>("fiber.stack_numa_local")->setValue(true);
+  sylar::Config::Lookup<std::string>("fiber.stack_allocator")->setValue("pooled");
+  std::atomic<int> done{0};
+  std::stringstream ss;
+  {
+    sylar::IOManager iom(2, false, "affinity_iom");
+    SYLAR_ASSERT(iom.getCpuAffinity() == "physical");
+    for (int i = 0; i < 100; ++i) {
+      iom.schedule([&]() { ++done; });
+    }
+    iom.dump(ss);
+  }
+  sylar::Config::Lookup<std::string>("fiber.stack_allocator")->setValue("malloc");
+  sylar::Config::Lookup<bool>("fiber.stack_numa_local")->setValue(false);
+  sylar::Config::Lookup<std::map<std::string, std::string>>("scheduler.cpu_affinity")
+    ->setValue({});
+  SYLAR_ASSERT(done == 100);
+  SYLAR_LOG_INFO(g_logger) << "test_config ok\n" << ss.str();
+}
+
+int main(int argc, char** argv) {
+  test_parse();
+  test_pin(false);
+  test_pin(true);
+  test_config();
+  return 0;
+}
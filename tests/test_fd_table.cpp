@@ -0,0 +1,188 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 16:10:08
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 16:10:08
+ * @FilePath: /sylar_from_nanasaki/tests/test_fd_table.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static void set_nonblock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * @brief 让出执行直到flag为true
+ */
+static void wait_flag(const std::atomic<bool>& flag) {
+  while (!flag) {
+    sylar::IOManager::GetThis()->schedule(sylar::Fiber::GetThis());
+    sylar::Fiber::GetThis()->yield();
+  }
+}
+
+static void drain(int fd) {
+  char buf[256];
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+}
+
+/**
+ * @brief 一对socket上的读写等待
+ * @details 读协程每轮等待可读，由写数据、cancelEvent或定时器中的cancelEvent唤醒；
+ *          写协程每轮等待可写，由cancelEvent唤醒，持久注册模式下只有EAGAIN之后才会有新的可写边缘。
+ *          每轮的唤醒动作完成后才进入下一轮，保证不会丢失唤醒
+ */
+struct Pair {
+  int fds[2];
+  std::atomic<bool> readActed{false};
+  std::atomic<bool> writeActed{false};
+};
+
+static void reader(sylar::IOManager* iom, Pair* p, int rounds, std::atomic<int>* done) {
+  int fd = p->fds[0];
+  for (int i = 0; i < rounds; ++i) {
+    p->readActed = false;
+    SYLAR_ASSERT(iom->addEvent(fd, sylar::IOManager::READ) == 0);
+    int action = (fd + i) % 3;
+    if (action == 0) {
+      iom->schedule([p]() {
+        SYLAR_ASSERT(write(p->fds[1], "x", 1) == 1);
+        p->readActed = true;
+      });
+    } else if (action == 1) {
+      iom->schedule([iom, p]() {
+        iom->cancelEvent(p->fds[0], sylar::IOManager::READ);
+        p->readActed = true;
+      });
+    } else {
+      iom->addTimerUs((i % 5) * 100, [iom, p]() {
+        iom->cancelEvent(p->fds[0], sylar::IOManager::READ);
+        p->readActed = true;
+      });
+    }
+    sylar::Fiber::GetThis()->yield();
+    drain(fd);
+    wait_flag(p->readActed);
+  }
+
+  // 最后一轮由cancelAll唤醒，之后关闭，写协程结束后才关闭
+  wait_flag(p->writeActed);
+  SYLAR_ASSERT(iom->addEvent(fd, sylar::IOManager::READ) == 0);
+  iom->schedule([iom, p]() {
+    iom->cancelAll(p->fds[0]);
+    close(p->fds[0]);
+    close(p->fds[1]);
+  });
+  sylar::Fiber::GetThis()->yield();
+  ++*done;
+}
+
+static void writer(sylar::IOManager* iom, Pair* p, int rounds, std::atomic<int>* done) {
+  int fd = p->fds[0];
+  for (int i = 0; i < rounds; ++i) {
+    std::atomic<bool> acted{false};
+    SYLAR_ASSERT(iom->addEvent(fd, sylar::IOManager::WRITE) == 0);
+    iom->schedule([iom, fd, &acted]() {
+      iom->cancelEvent(fd, sylar::IOManager::WRITE);
+      acted = true;
+    });
+    sylar::Fiber::GetThis()->yield();
+    wait_flag(acted);
+  }
+  p->writeActed = true;
+  ++*done;
+}
+
+/**
+ * @brief 多个线程上同时添加、取消、触发和关闭
+ */
+static void test_stress(bool persistent, int pairs, int rounds) {
+  auto events = sylar::Config::Lookup<std::map<std::string, bool>>("iomanager.persistent_events");
+  events->setValue({{"*", persistent}});
+  std::vector<Pair> ps(pairs);
+  std::atomic<int> readers{0};
+  std::atomic<int> writers{0};
+  uint64_t begin = sylar::util::GetCurrentMS();
+  {
+    sylar::IOManager iom(4, false, persistent ? "stress_persistent" : "stress_oneshot");
+    for (auto& p : ps) {
+      SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, p.fds) == 0);
+      set_nonblock(p.fds[0]);
+      set_nonblock(p.fds[1]);
+    }
+    for (auto& p : ps) {
+      Pair* pp = &p;
+      iom.schedule([&iom, pp, rounds, &writers]() { writer(&iom, pp, rounds, &writers); });
+      iom.schedule([&iom, pp, rounds, &readers]() { reader(&iom, pp, rounds, &readers); });
+    }
+  }
+  SYLAR_ASSERT(readers == pairs);
+  SYLAR_ASSERT(writers == pairs);
+  SYLAR_LOG_INFO(g_logger) << "test_stress persistent=" << persistent << " pairs=" << pairs
+                           << " rounds=" << rounds
+                           << " used=" << sylar::util::GetCurrentMS() - begin << "ms";
+}
+
+/**
+ * @brief 多个线程同时访问不存在的段，以及在很大的fd上等待
+ */
+static void test_grow(bool persistent) {
+  auto events = sylar::Config::Lookup<std::map<std::string, bool>>("iomanager.persistent_events");
+  events->setValue({{"*", persistent}});
+  std::atomic<int> done{0};
+  {
+    sylar::IOManager iom(4, false, "grow");
+    for (int t = 0; t < 8; ++t) {
+      iom.schedule([&iom, &done]() {
+        // 已关闭的fd上epoll_ctl失败，但对应的段仍然会分配
+        for (int fd = 12000; fd < 20000; fd += 997) {
+          SYLAR_ASSERT(iom.addEvent(fd, sylar::IOManager::READ) == -1);
+          SYLAR_ASSERT(!iom.cancelEvent(fd, sylar::IOManager::READ));
+        }
+        ++done;
+      });
+    }
+    iom.schedule([&done]() {
+      int fds[2];
+      SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+      int big = dup2(fds[0], 19000);
+      SYLAR_ASSERT(big == 19000);
+      close(fds[0]);
+      set_nonblock(big);
+      sylar::IOManager* iom = sylar::IOManager::GetThis();
+      SYLAR_ASSERT(iom->addEvent(big, sylar::IOManager::READ) == 0);
+      iom->schedule([fds]() { SYLAR_ASSERT(write(fds[1], "x", 1) == 1); });
+      sylar::Fiber::GetThis()->yield();
+      char c;
+      SYLAR_ASSERT(read(big, &c, 1) == 1);
+      iom->cancelAll(big);
+      close(big);
+      close(fds[1]);
+      ++done;
+    });
+  }
+  SYLAR_ASSERT(done == 9);
+  SYLAR_LOG_INFO(g_logger) << "test_grow persistent=" << persistent << " ok";
+}
+
+int main(int argc, char** argv) {
+  // 关闭fd上的epoll_ctl失败会打印错误日志
+  sylar::LoggerMgr::GetInstance()->getLogger("system")->setLevel(sylar::LogLevel::FATAL);
+  int rounds = argc > 1 ? atoi(argv[1]) : 200;
+  test_grow(false);
+  test_grow(true);
+  test_stress(false, 64, rounds);
+  test_stress(true, 64, rounds);
+  return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 04:02:33
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 04:02:33
+ * @FilePath: /sylar_from_nanasaki/tests/test_fiber_local.cpp
+ */
+#include "sylar/fiber.h"
+#include "sylar/fiber_local.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/scheduler.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <string>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<int> s_created{0};
+static std::atomic<int> s_destroyed{0};
+
+struct Context {
+  Context() {
+    ++s_created;
+  }
+  ~Context() {
+    ++s_destroyed;
+  }
+  uint64_t request_id = 0;
+  std::string trace;
+};
+
+static sylar::FiberLocal<Context> s_context;
+static sylar::FiberLocal<int> s_counter;
+
+/**
+ * @brief 协程在线程间迁移后仍然看到自己的数据
+ */
+void test_migrate() {
+  const int N = 200;
+  std::atomic<int> ok{0};
+  std::atomic<int> moved{0};
+  s_created = s_destroyed = 0;
+  {
+    sylar::IOManager iom(3, false, "fiber_local");
+    for (int i = 0; i < N; ++i) {
+      iom.schedule([&, i]() {
+        SYLAR_ASSERT(!s_context.has());
+        s_context->request_id = i;
+        s_context->trace = "req-" + std::to_string(i);
+        int tid = sylar::util::GetThreadId();
+        for (int j = 0; j < 5; ++j) {
+          // hook后的usleep会yield，恢复时可能在其他线程上
+          usleep(1000);
+          if (sylar::util::GetThreadId() != tid) {
+            ++moved;
+          }
+          SYLAR_ASSERT(s_context->request_id == (uint64_t)i);
+          SYLAR_ASSERT(s_context->trace == "req-" + std::to_string(i));
+        }
+        ++ok;
+      });
+    }
+  }
+  SYLAR_ASSERT(ok == N);
+  SYLAR_ASSERT(s_created == N);
+  SYLAR_ASSERT(s_destroyed == N);
+  SYLAR_LOG_INFO(g_logger) << "test_migrate ok, moved=" << moved;
+}
+
+/**
+ * @brief 协程结束时析构，reset后重新开始
+ */
+void test_term_reset() {
+  s_created = s_destroyed = 0;
+  sylar::Fiber::GetThis();
+  sylar::Fiber::ptr fiber(new sylar::Fiber(
+    []() {
+      s_context->request_id = 1;
+      *s_counter = 10;
+      sylar::Fiber::GetThis()->yield();
+      SYLAR_ASSERT(s_context->request_id == 1);
+      SYLAR_ASSERT(*s_counter == 10);
+    },
+    0, false));
+  fiber->resume();
+  SYLAR_ASSERT(s_created == 1 && s_destroyed == 0);
+  // 主协程的数据与子协程互不影响
+  SYLAR_ASSERT(!s_context.has());
+  fiber->resume();
+  SYLAR_ASSERT(fiber->getState() == sylar::Fiber::TERM);
+  SYLAR_ASSERT(s_destroyed == 1);
+
+  fiber->reset([]() {
+    SYLAR_ASSERT(!s_context.has());
+    SYLAR_ASSERT(!s_counter.has());
+    s_counter.set(5);
+    SYLAR_ASSERT(*s_counter == 5);
+    s_counter.reset();
+    SYLAR_ASSERT(!s_counter.has());
+  });
+  fiber->resume();
+  SYLAR_ASSERT(s_created == s_destroyed);
+  SYLAR_LOG_INFO(g_logger) << "test_term_reset ok";
+}
+
+/**
+ * @brief 从协程缓存中复用的协程看不到上一个任务的数据
+ */
+void test_pool_reuse() {
+  const int N = 1000;
+  std::atomic<int> dirty{0};
+  s_created = s_destroyed = 0;
+  {
+    sylar::Scheduler sc(1, false, "fiber_local_pool");
+    sc.start();
+    for (int i = 0; i < N; ++i) {
+      sc.schedule([&]() {
+        if (s_counter.has()) {
+          ++dirty;
+        }
+        *s_counter = 1;
+        s_context->request_id = sylar::Fiber::GetFiberId();
+      });
+    }
+    sc.stop();
+  }
+  SYLAR_ASSERT(dirty == 0);
+  SYLAR_ASSERT(s_created == N && s_destroyed == N);
+  SYLAR_LOG_INFO(g_logger) << "test_pool_reuse ok";
+}
+
+int main(int argc, char** argv) {
+  test_migrate();
+  test_term_reset();
+  test_pool_reuse();
+  return 0;
+}
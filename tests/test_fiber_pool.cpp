@@ -0,0 +1,137 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 23:20:41
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 23:20:41
+ * @FilePath: /sylar_from_nanasaki/tests/test_fiber_pool.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/fiber.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/scheduler.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 回调任务复用已结束的协程，协程id只会有少数几个
+ */
+void test_reuse() {
+  const int N = 10000;
+  std::mutex mutex;
+  std::set<uint64_t> ids;
+  std::atomic<int> count{0};
+  {
+    sylar::Scheduler sc(2, false, "fiber_pool");
+    sc.start();
+    for (int i = 0; i < N; ++i) {
+      sc.schedule([&]() {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          ids.insert(sylar::Fiber::GetFiberId());
+        }
+        ++count;
+      });
+    }
+    sc.stop();
+  }
+  SYLAR_ASSERT(count == N);
+  SYLAR_ASSERT(ids.size() < 100);
+  SYLAR_LOG_INFO(g_logger) << "test_reuse ok, tasks=" << N << " fibers=" << ids.size();
+}
+
+/**
+ * @brief 中途yield的协程不能被回收，恢复后能正常执行完
+ */
+void test_yield() {
+  std::atomic<int> done{0};
+  {
+    sylar::IOManager iom(2, false, "fiber_pool_yield");
+    for (int i = 0; i < 100; ++i) {
+      iom.schedule([&, i]() {
+        uint64_t id = sylar::Fiber::GetFiberId();
+        // hook后的usleep会yield，期间其他回调任务可能复用已结束的协程
+        usleep(1000 + i * 10);
+        SYLAR_ASSERT(sylar::Fiber::GetFiberId() == id);
+        ++done;
+      });
+      iom.schedule([&]() { ++done; });
+    }
+  }
+  SYLAR_ASSERT(done == 200);
+  SYLAR_LOG_INFO(g_logger) << "test_yield ok";
+}
+
+/**
+ * @brief 内联任务直接在调度协程上执行，阻塞调用不会yield
+ */
+void test_inline() {
+  std::atomic<int> on_main{0};
+  std::atomic<int> count{0};
+  {
+    sylar::IOManager iom(2, false, "fiber_inline");
+    for (int i = 0; i < 100; ++i) {
+      iom.scheduleInline([&]() {
+        if (sylar::Fiber::GetThis().get() == sylar::Scheduler::GetMainFiber()) {
+          ++on_main;
+        }
+        ++count;
+      });
+    }
+    iom.scheduleInline([&]() {
+      usleep(1000);
+      ++count;
+    });
+  }
+  SYLAR_ASSERT(count == 101);
+  SYLAR_ASSERT(on_main == 100);
+  SYLAR_LOG_INFO(g_logger) << "test_inline ok";
+}
+
+/**
+ * @brief 对比每个回调新建协程、复用协程和内联执行的耗时
+ */
+void bench(const std::string& name, bool inlined) {
+  const int N = 200000;
+  std::atomic<int> count{0};
+  uint64_t begin = sylar::util::GetCurrentUS();
+  {
+    sylar::Scheduler sc(1, false, "fiber_pool_bench");
+    sc.start();
+    for (int i = 0; i < N; ++i) {
+      if (inlined) {
+        sc.scheduleInline([&]() { ++count; });
+      } else {
+        sc.schedule([&]() { ++count; });
+      }
+    }
+    sc.stop();
+  }
+  SYLAR_ASSERT(count == N);
+  uint64_t used = sylar::util::GetCurrentUS() - begin;
+  SYLAR_LOG_INFO(g_logger) << name << ": tasks=" << N << " used=" << used / 1000 << "ms "
+                           << (uint64_t)N * 1000000 / (used ? used : 1) << " tasks/s";
+}
+
+int main(int argc, char** argv) {
+  test_reuse();
+  test_yield();
+  test_inline();
+
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+  auto pool_max = sylar::Config::Lookup<uint32_t>("fiber.pool_max");
+  uint32_t old = pool_max->getValue();
+  pool_max->setValue(0);
+  bench("no pool", false);
+  pool_max->setValue(old);
+  bench("pooled", false);
+  bench("inline", true);
+  return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 22:40:12
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 22:40:12
+ * @FilePath: /sylar_from_nanasaki/tests/test_fiber_state.cpp
+ */
+#include "sylar/fiber.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/scheduler.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 状态转换：运行中为RUNNING，yield回到resume的调用方之后为READY，结束后为TERM
+ */
+static void test_state() {
+  sylar::Fiber::GetThis();
+  sylar::Fiber::ptr fiber(new sylar::Fiber(
+    []() {
+      SYLAR_ASSERT(sylar::Fiber::GetThis()->getState() == sylar::Fiber::RUNNING);
+      sylar::Fiber::GetThis()->yield();
+      SYLAR_ASSERT(sylar::Fiber::GetThis()->getState() == sylar::Fiber::RUNNING);
+    },
+    0, false));
+  SYLAR_ASSERT(fiber->getState() == sylar::Fiber::READY);
+  fiber->resume();
+  SYLAR_ASSERT(fiber->getState() == sylar::Fiber::READY);
+  fiber->resume();
+  SYLAR_ASSERT(fiber->getState() == sylar::Fiber::TERM);
+  SYLAR_LOG_INFO(g_logger) << "test_state ok";
+}
+
+/**
+ * @brief 协程先把自己加入调度再yield，其他线程可能在yield完成之前就取到它
+ * @details 调度器遇到RUNNING状态的协程会放回队列，只有上下文保存完、状态变为READY之后才resume。
+ *          如果在yield里切换之前就置为READY，其他线程会在未保存完的上下文上运行，栈上的计数会错乱
+ */
+static void test_self_reschedule(int fibers, int rounds) {
+  std::atomic<int> done{0};
+  {
+    sylar::Scheduler sc(4, false, "self_reschedule");
+    sc.start();
+    for (int i = 0; i < fibers; ++i) {
+      sc.schedule([rounds, &done]() {
+        int count = 0;
+        uint64_t sum = 0;
+        for (int j = 0; j < rounds; ++j) {
+          SYLAR_ASSERT(sylar::Fiber::GetThis()->getState() == sylar::Fiber::RUNNING);
+          sylar::Scheduler::GetThis()->schedule(sylar::Fiber::GetThis());
+          sylar::Fiber::GetThis()->yield();
+          ++count;
+          sum += j;
+        }
+        SYLAR_ASSERT(count == rounds);
+        SYLAR_ASSERT(sum == (uint64_t)rounds * (rounds - 1) / 2);
+        ++done;
+      });
+    }
+    sc.stop();
+  }
+  SYLAR_ASSERT(done == fibers);
+  SYLAR_LOG_INFO(g_logger) << "test_self_reschedule fibers=" << fibers << " rounds=" << rounds
+                           << " ok";
+}
+
+int main(int argc, char** argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  test_state();
+  test_self_reschedule(16, rounds);
+  return 0;
+}
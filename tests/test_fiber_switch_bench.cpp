@@ -0,0 +1,124 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 16:48:02
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 16:48:02
+ * @FilePath: /sylar_from_nanasaki/tests/test_fiber_switch_bench.cpp
+ */
+/**
+ * @brief 协程切换性能测试
+ * @details 分别测试裸的swapcontext、裸的汇编切换以及Fiber::resume/yield(当前编译选择的后端)每秒的切换次数，
+ *          resume一次加yield一次算两次切换
+ */
+#include "sylar/config.h"
+#include "sylar/env.h"
+#include "sylar/fcontext.h"
+#include "sylar/fiber.h"
+#include "sylar/log.h"
+#include "sylar/util/util.h"
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <ucontext.h>
+
+static const size_t STACK_SIZE = 128 * 1024;
+
+static uint64_t s_rounds = 1000000;
+
+static void print_result(const std::string& name, uint64_t used_us) {
+  uint64_t switches = s_rounds * 2;
+  std::cout << std::left << std::setw(24) << name << std::setw(16) << switches << std::setw(16)
+            << used_us << std::fixed << std::setprecision(3)
+            << (double)switches / (used_us ? used_us : 1) << std::endl;
+}
+
+static ucontext_t s_uc_main;
+static ucontext_t s_uc_fiber;
+
+static void uc_func() {
+  while (true) {
+    swapcontext(&s_uc_fiber, &s_uc_main);
+  }
+}
+
+static void bench_ucontext() {
+  void* stack = malloc(STACK_SIZE);
+  getcontext(&s_uc_fiber);
+  s_uc_fiber.uc_link = nullptr;
+  s_uc_fiber.uc_stack.ss_sp = stack;
+  s_uc_fiber.uc_stack.ss_size = STACK_SIZE;
+  makecontext(&s_uc_fiber, &uc_func, 0);
+
+  uint64_t begin = sylar::util::GetCurrentUS();
+  for (uint64_t i = 0; i < s_rounds; ++i) {
+    swapcontext(&s_uc_main, &s_uc_fiber);
+  }
+  print_result("ucontext", sylar::util::GetCurrentUS() - begin);
+  free(stack);
+}
+
+#ifdef SYLAR_HAVE_FCONTEXT
+static sylar::fcontext_t s_fc_main;
+static sylar::fcontext_t s_fc_fiber;
+
+static void fc_func() {
+  while (true) {
+    sylar_jump_fcontext(&s_fc_fiber, s_fc_main);
+  }
+}
+
+static void bench_fcontext() {
+  void* stack = malloc(STACK_SIZE);
+  s_fc_fiber = sylar::make_fcontext(stack, STACK_SIZE, &fc_func);
+
+  uint64_t begin = sylar::util::GetCurrentUS();
+  for (uint64_t i = 0; i < s_rounds; ++i) {
+    sylar_jump_fcontext(&s_fc_main, s_fc_fiber);
+  }
+  print_result("fcontext", sylar::util::GetCurrentUS() - begin);
+  free(stack);
+}
+#endif
+
+static void bench_fiber() {
+  sylar::Fiber::GetThis();
+  sylar::Fiber::ptr fiber(new sylar::Fiber(
+    []() {
+      for (uint64_t i = 0; i < s_rounds; ++i) {
+        sylar::Fiber::GetThis()->yield();
+      }
+    },
+    0, false));
+
+  uint64_t begin = sylar::util::GetCurrentUS();
+  for (uint64_t i = 0; i < s_rounds; ++i) {
+    fiber->resume();
+  }
+  uint64_t used = sylar::util::GetCurrentUS() - begin;
+  fiber->resume();
+#ifdef SYLAR_FIBER_UCONTEXT
+  print_result("Fiber(ucontext)", used);
+#else
+  print_result("Fiber(fcontext)", used);
+#endif
+}
+
+int main(int argc, char* argv[]) {
+  sylar::EnvMgr::GetInstance()->init(argc, argv);
+  sylar::Config::LoadFromConfDir(sylar::EnvMgr::GetInstance()->getConfigPath());
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+  if (argc > 1) {
+    s_rounds = atoll(argv[1]);
+  }
+
+  std::cout << std::left << std::setw(24) << "backend" << std::setw(16) << "switches"
+            << std::setw(16) << "used(us)"
+            << "Mswitches/s" << std::endl;
+  bench_ucontext();
+#ifdef SYLAR_HAVE_FCONTEXT
+  bench_fcontext();
+#endif
+  bench_fiber();
+  return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 18:42:13
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 18:42:13
+ * @FilePath: /sylar_from_nanasaki/tests/test_fiber_sync.cpp
+ */
+#include "sylar/fiber_sync.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 多个线程上的协程竞争同一把FiberMutex，临界区内yield不会导致其他协程进入
+ */
+void test_mutex() {
+  sylar::FiberMutex mutex;
+  int count = 0;
+  std::atomic<int> inside{0};
+  {
+    sylar::IOManager iom(4, false, "fiber_mutex");
+    for (int i = 0; i < 100; ++i) {
+      iom.schedule([&]() {
+        for (int j = 0; j < 100; ++j) {
+          sylar::FiberMutex::Lock lock(mutex);
+          SYLAR_ASSERT(++inside == 1);
+          int v = count;
+          if (j % 10 == 0) {
+            // 持有锁期间让出执行权
+            usleep(10);
+          }
+          count = v + 1;
+          --inside;
+        }
+      });
+    }
+  }
+  SYLAR_ASSERT(count == 100 * 100);
+  SYLAR_LOG_INFO(g_logger) << "test_mutex ok, count=" << count;
+}
+
+/**
+ * @brief 用FiberSemaphore限制并发数，并测试超时等待
+ */
+void test_semaphore() {
+  sylar::FiberSemaphore sem(3);
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+  std::atomic<int> done{0};
+  {
+    sylar::IOManager iom(4, false, "fiber_sem");
+    for (int i = 0; i < 50; ++i) {
+      iom.schedule([&]() {
+        sem.wait();
+        int r = ++running;
+        int m = max_running;
+        while (r > m && !max_running.compare_exchange_weak(m, r)) {
+        }
+        usleep(1000);
+        --running;
+        sem.notify();
+        ++done;
+      });
+    }
+  }
+  SYLAR_ASSERT(done == 50);
+  SYLAR_ASSERT(max_running <= 3);
+  SYLAR_ASSERT(sem.getCount() == 3);
+
+  sylar::FiberSemaphore empty;
+  bool timeout_ok = false;
+  {
+    sylar::IOManager iom(1, false, "fiber_sem_timeout");
+    iom.schedule([&]() {
+      uint64_t begin = sylar::util::GetElapsedMS();
+      bool rt = empty.waitFor(50);
+      uint64_t used = sylar::util::GetElapsedMS() - begin;
+      timeout_ok = !rt && used >= 40;
+    });
+  }
+  SYLAR_ASSERT(timeout_ok);
+  SYLAR_LOG_INFO(g_logger) << "test_semaphore ok, max_running=" << max_running;
+}
+
+/**
+ * @brief 带超时的等待刚挂起就被唤醒，定时器在释放锁之后才创建，被唤醒后不能留下未取消的定时器
+ */
+void test_timed_wake() {
+  sylar::FiberSemaphore sem;
+  std::atomic<int> ok{0};
+  bool timers_left = true;
+  {
+    sylar::IOManager iom(4, false, "fiber_sem_race");
+    for (int i = 0; i < 2000; ++i) {
+      iom.schedule([&]() {
+        if (sem.waitFor(10 * 1000)) {
+          ++ok;
+        }
+      });
+      iom.schedule([&]() { sem.notify(); });
+    }
+    while (ok < 2000) {
+      usleep(1000);
+    }
+    timers_left = iom.hasTimer();
+  }
+  SYLAR_ASSERT(ok == 2000);
+  SYLAR_ASSERT(!timers_left);
+  SYLAR_LOG_INFO(g_logger) << "test_timed_wake ok";
+}
+
+/**
+ * @brief FiberCondVar实现的生产者消费者
+ */
+void test_condvar() {
+  sylar::FiberMutex mutex;
+  sylar::FiberCondVar cond;
+  std::list<int> items;
+  bool closed = false;
+  std::atomic<int> sum{0};
+  std::atomic<int> timeouts{0};
+  {
+    sylar::IOManager iom(4, false, "fiber_cond");
+    for (int i = 0; i < 4; ++i) {
+      iom.schedule([&]() {
+        sylar::FiberMutex::Lock lock(mutex);
+        while (true) {
+          while (items.empty() && !closed) {
+            if (!cond.waitFor(lock, 20)) {
+              ++timeouts;
+            }
+          }
+          if (items.empty()) {
+            break;
+          }
+          sum += items.front();
+          items.pop_front();
+        }
+      });
+    }
+    iom.schedule([&]() {
+      for (int i = 1; i <= 1000; ++i) {
+        sylar::FiberMutex::Lock lock(mutex);
+        items.push_back(i);
+        cond.notifyOne();
+        if (i % 100 == 0) {
+          lock.unlock();
+          usleep(30 * 1000);
+        }
+      }
+      sylar::FiberMutex::Lock lock(mutex);
+      closed = true;
+      cond.notifyAll();
+    });
+  }
+  SYLAR_ASSERT(sum == 1000 * 1001 / 2);
+  SYLAR_LOG_INFO(g_logger) << "test_condvar ok, sum=" << sum << " timeouts=" << timeouts;
+}
+
+int main(int argc, char** argv) {
+  test_mutex();
+  test_semaphore();
+  test_timed_wake();
+  test_condvar();
+  return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 06:15:09
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 06:15:09
+ * @FilePath: /sylar_from_nanasaki/tests/test_fiber_watchdog.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/fiber.h"
+#include "sylar/fiber_watchdog.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/thread.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <signal.h>
+#include <unistd.h>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 不yield地忙等，模拟一个长时间占用线程的servlet
+ */
+static void __attribute__((noinline)) busy_servlet(uint64_t ms) {
+  uint64_t end = sylar::util::GetCurrentUS() + ms * 1000;
+  while (sylar::util::GetCurrentUS() < end) {
+  }
+}
+
+/**
+ * @brief 每次resume的运行时间累加到协程上，reset后清零
+ */
+void test_accounting() {
+  sylar::Config::Lookup<bool>("fiber.accounting")->setValue(true);
+  SYLAR_ASSERT(sylar::FiberWatchdog::IsAccounting());
+  sylar::Fiber::GetThis();
+  sylar::Fiber::ptr fiber(new sylar::Fiber(
+    []() {
+      busy_servlet(20);
+      sylar::Fiber::GetThis()->yield();
+      busy_servlet(10);
+    },
+    0, false));
+  fiber->resume();
+  SYLAR_ASSERT(fiber->getRunTime() >= 20 * 1000);
+  SYLAR_ASSERT(fiber->getResumeTime() == 0);
+  fiber->resume();
+  SYLAR_ASSERT(fiber->getRunTime() >= 30 * 1000);
+  SYLAR_ASSERT(fiber->getSwitches() == 2);
+
+  std::string top = sylar::FiberWatchdog::TopFibersToString(5);
+  SYLAR_LOG_INFO(g_logger) << top;
+  SYLAR_ASSERT(top.find("fiber id=" + std::to_string(fiber->getId())) != std::string::npos);
+
+  fiber->reset([]() {});
+  SYLAR_ASSERT(fiber->getRunTime() == 0 && fiber->getSwitches() == 0);
+  fiber->resume();
+  sylar::Config::Lookup<bool>("fiber.accounting")->setValue(false);
+  SYLAR_ASSERT(!sylar::FiberWatchdog::IsAccounting());
+  SYLAR_LOG_INFO(g_logger) << "test_accounting ok";
+}
+
+/**
+ * @brief 看门狗发现长时间不yield的协程，运行中的协程出现在top列表中
+ */
+void test_watchdog() {
+  auto watchdog_ms = sylar::Config::Lookup<uint32_t>("fiber.watchdog_ms");
+  watchdog_ms->setValue(50);
+  SYLAR_ASSERT(sylar::FiberWatchdog::IsAccounting());
+  uint64_t reported = sylar::FiberWatchdog::GetReported();
+  std::atomic<int> done{0};
+  std::atomic<uint64_t> stall_id{0};
+  {
+    sylar::IOManager iom(2, false, "watchdog");
+    iom.schedule([&]() {
+      stall_id = sylar::Fiber::GetFiberId();
+      busy_servlet(300);
+      ++done;
+    });
+    for (int i = 0; i < 20; ++i) {
+      iom.schedule([&]() {
+        usleep(1000);
+        ++done;
+      });
+    }
+    usleep(150 * 1000);
+    std::string top = sylar::FiberWatchdog::TopFibersToString(3);
+    SYLAR_LOG_INFO(g_logger) << top;
+    SYLAR_ASSERT(top.find("fiber id=" + std::to_string(stall_id) + " state=RUNNING") !=
+                 std::string::npos);
+  }
+  SYLAR_ASSERT(done == 21);
+  // 同一次运行只报告一次，idle协程不会被报告
+  SYLAR_ASSERT(sylar::FiberWatchdog::GetReported() == reported + 1);
+  watchdog_ms->setValue(0);
+  SYLAR_ASSERT(!sylar::FiberWatchdog::IsAccounting());
+  SYLAR_LOG_INFO(g_logger) << "test_watchdog ok";
+}
+
+static std::atomic<int> s_user_signals{0};
+
+static void on_user_signal(int) {
+  ++s_user_signals;
+}
+
+/**
+ * @brief 信号可以配置，程序原有的处理函数在看门狗运行期间仍会被调用，看门狗停止后恢复
+ */
+void test_signal_chain() {
+  auto watchdog_signal = sylar::Config::Lookup<int>("fiber.watchdog_signal");
+  watchdog_signal->setValue(SIGUSR2);
+  signal(SIGUSR2, &on_user_signal);
+
+  auto watchdog_ms = sylar::Config::Lookup<uint32_t>("fiber.watchdog_ms");
+  watchdog_ms->setValue(20);
+  struct sigaction sa;
+  sigaction(SIGUSR2, nullptr, &sa);
+  SYLAR_ASSERT(sa.sa_handler != &on_user_signal);
+  // 不是看门狗发起的信号交给原来的处理函数
+  raise(SIGUSR2);
+  SYLAR_ASSERT(s_user_signals == 1);
+
+  // 看门狗用SIGUSR2取调用栈，不会调用原来的处理函数
+  uint64_t reported = sylar::FiberWatchdog::GetReported();
+  sylar::Fiber::GetThis();
+  sylar::Fiber::ptr fiber(new sylar::Fiber([]() { busy_servlet(100); }, 0, false));
+  fiber->resume();
+  SYLAR_ASSERT(sylar::FiberWatchdog::GetReported() == reported + 1);
+  SYLAR_ASSERT(s_user_signals == 1);
+
+  watchdog_ms->setValue(0);
+  sigaction(SIGUSR2, nullptr, &sa);
+  SYLAR_ASSERT(sa.sa_handler == &on_user_signal);
+  signal(SIGUSR2, SIG_DFL);
+  watchdog_signal->setValue(SIGURG);
+  SYLAR_LOG_INFO(g_logger) << "test_signal_chain ok";
+}
+
+/**
+ * @brief 看门狗等待调用栈时不持有注册表的锁
+ * @details 被检查的线程屏蔽了信号，看门狗每次报告都要等满超时，期间新线程第一次resume协程时的注册不能被阻塞
+ */
+void test_check_unlocked() {
+  auto watchdog_ms = sylar::Config::Lookup<uint32_t>("fiber.watchdog_ms");
+  watchdog_ms->setValue(20);
+  std::atomic<bool> running{true};
+  sylar::Thread::ptr stall(new sylar::Thread(
+    [&running]() {
+      sigset_t set;
+      sigemptyset(&set);
+      sigaddset(&set, SIGURG);
+      pthread_sigmask(SIG_BLOCK, &set, nullptr);
+      sylar::Fiber::GetThis();
+      sylar::Fiber::ptr fiber(new sylar::Fiber([]() { busy_servlet(400); }, 0, false));
+      fiber->resume();
+      running = false;
+    },
+    "watchdog_stall"));
+
+  uint64_t max_us = 0;
+  int threads = 0;
+  while (running) {
+    std::atomic<uint64_t> used{0};
+    sylar::Thread::ptr t(new sylar::Thread(
+      [&used]() {
+        sylar::Fiber::GetThis();
+        sylar::Fiber::ptr fiber(new sylar::Fiber([]() {}, 0, false));
+        uint64_t begin = sylar::util::GetElapsedUS();
+        fiber->resume();
+        used = sylar::util::GetElapsedUS() - begin;
+      },
+      "watchdog_new"));
+    t->join();
+    max_us = std::max<uint64_t>(max_us, used);
+    ++threads;
+  }
+  stall->join();
+  watchdog_ms->setValue(0);
+  SYLAR_LOG_INFO(g_logger) << "test_check_unlocked threads=" << threads
+                           << " max first resume=" << max_us << "us";
+  SYLAR_ASSERT(max_us < 50 * 1000);
+  SYLAR_LOG_INFO(g_logger) << "test_check_unlocked ok";
+}
+
+/**
+ * @brief 协程登记在第一次resume的线程上，线程退出后协程仍在top列表中，协程析构后移除
+ */
+void test_thread_exit() {
+  sylar::Config::Lookup<bool>("fiber.accounting")->setValue(true);
+  sylar::Fiber::ptr fiber;
+  sylar::Thread::ptr t(new sylar::Thread(
+    [&fiber]() {
+      sylar::Fiber::GetThis();
+      fiber.reset(new sylar::Fiber([]() { sylar::Fiber::GetThis()->yield(); }, 0, false));
+      fiber->resume();
+    },
+    "watchdog_exit"));
+  t->join();
+  std::string id = "fiber id=" + std::to_string(fiber->getId()) + " ";
+  SYLAR_ASSERT(sylar::FiberWatchdog::TopFibersToString(1000).find(id) != std::string::npos);
+
+  // 在另一个线程上继续运行和析构
+  sylar::Fiber::GetThis();
+  fiber->resume();
+  fiber.reset();
+  SYLAR_ASSERT(sylar::FiberWatchdog::TopFibersToString(1000).find(id) == std::string::npos);
+  sylar::Config::Lookup<bool>("fiber.accounting")->setValue(false);
+  SYLAR_LOG_INFO(g_logger) << "test_thread_exit ok";
+}
+
+int main(int argc, char** argv) {
+  // 看门狗的报告输出到system日志
+  SYLAR_LOG_NAME("system")->addAppender(sylar::LogAppender::ptr(new sylar::StdoutLogAppender));
+  test_accounting();
+  test_watchdog();
+  test_signal_chain();
+  test_check_unlocked();
+  test_thread_exit();
+  return 0;
+}
@@ -0,0 +1,256 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 08:40:27
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 08:40:27
+ * @FilePath: /sylar_from_nanasaki/tests/test_future.cpp
+ */
+#include "sylar/fiber_sync.h"
+#include "sylar/future.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <new>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 当前线程调用operator new的次数
+static thread_local uint64_t t_allocs = 0;
+
+void* operator new(size_t size) {
+  ++t_allocs;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static uint64_t fib(uint64_t n) {
+  return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+/**
+ * @brief IO调度器上的协程把计算交给另一个调度器，等待结果时IO线程继续处理其他协程
+ */
+void test_offload() {
+  sylar::IOManager io(1, false, "future_io");
+  sylar::IOManager cpu(1, false, "future_cpu");
+  sylar::FiberWaitGroup finish(1);
+  std::atomic<int> ticks{0};
+  bool stop = false;
+  io.schedule([&]() {
+    while (!stop) {
+      ++ticks;
+      usleep(1000);
+    }
+  });
+  io.schedule([&]() {
+    sylar::Future<uint64_t> f = sylar::Async(&cpu, []() { return fib(27); });
+    int before = ticks;
+    SYLAR_ASSERT(f.get() == 196418);
+    SYLAR_LOG_INFO(g_logger) << "offload done, io ticks while waiting " << ticks - before;
+    SYLAR_ASSERT(f.isReady() && !f.hasException());
+    stop = true;
+    finish.done();
+  });
+  finish.wait();
+  SYLAR_LOG_INFO(g_logger) << "test_offload ok";
+}
+
+/**
+ * @brief then链式调用，异常沿链传递，promise未设置就销毁
+ */
+void test_then() {
+  sylar::IOManager iom(2, false, "future_then");
+  sylar::Promise<int> p;
+  sylar::Future<std::string> f = p.getFuture()
+                                   .then([](int v) { return v * 2; })
+                                   .then([](int v) { return std::to_string(v); }, &iom);
+  iom.schedule([p]() mutable { p.setValue(21); });
+  SYLAR_ASSERT(f.get() == "42");
+  SYLAR_ASSERT(!p.setValue(1));
+
+  sylar::Promise<void> pv;
+  bool called = false;
+  sylar::Future<int> fe = pv.getFuture()
+                            .then([]() -> int { throw std::runtime_error("backend down"); })
+                            .then([&called](int v) {
+                              called = true;
+                              return v;
+                            });
+  pv.setValue();
+  bool caught = false;
+  try {
+    fe.get();
+  } catch (const std::runtime_error& e) {
+    caught = std::string(e.what()) == "backend down";
+  }
+  SYLAR_ASSERT(caught && !called);
+
+  sylar::Future<int> broken;
+  {
+    sylar::Promise<int> p2;
+    broken = p2.getFuture();
+  }
+  SYLAR_ASSERT(broken.isReady() && broken.hasException());
+  SYLAR_LOG_INFO(g_logger) << "test_then ok";
+}
+
+/**
+ * @brief WhenAll/WhenAny组合多个后端请求
+ */
+void test_combinators() {
+  sylar::IOManager iom(2, false, "future_combinators");
+  std::vector<sylar::Future<int>> fs;
+  for (int i = 0; i < 50; ++i) {
+    fs.push_back(sylar::Async(&iom, [i]() {
+      usleep((50 - i) * 100);
+      return i;
+    }));
+  }
+  std::vector<int> all = sylar::WhenAll(fs).get();
+  SYLAR_ASSERT(all.size() == 50);
+  for (int i = 0; i < 50; ++i) {
+    SYLAR_ASSERT(all[i] == i);
+  }
+
+  std::vector<sylar::Future<int>> race;
+  race.push_back(sylar::Async(&iom, []() {
+    usleep(50 * 1000);
+    return 1;
+  }));
+  race.push_back(sylar::Async(&iom, []() { return 2; }));
+  size_t idx = sylar::WhenAny(race).get();
+  SYLAR_ASSERT(idx == 1 && race[idx].get() == 2);
+
+  std::vector<sylar::Future<void>> voids;
+  voids.push_back(sylar::Async(&iom, []() {}));
+  voids.push_back(sylar::Async(&iom, []() { throw std::logic_error("fail"); }));
+  sylar::Future<void> all_void = sylar::WhenAll(voids);
+  all_void.wait();
+  SYLAR_ASSERT(all_void.hasException());
+  SYLAR_ASSERT(sylar::WhenAll(std::vector<sylar::Future<int>>()).get().empty());
+  SYLAR_LOG_INFO(g_logger) << "test_combinators ok";
+}
+
+/**
+ * @brief waitFor和timeout基于IOManager的定时器
+ */
+void test_timeout() {
+  sylar::IOManager iom(1, false, "future_timeout");
+  sylar::FiberWaitGroup finish(1);
+  bool ok = false;
+  iom.schedule([&]() {
+    sylar::Promise<int> p;
+    sylar::Future<int> f = p.getFuture();
+    uint64_t begin = sylar::util::GetElapsedMS();
+    bool waited = f.waitFor(20);
+    SYLAR_ASSERT(!waited && sylar::util::GetElapsedMS() - begin >= 20);
+
+    sylar::Future<int> t = f.timeout(20);
+    bool timeout = false;
+    try {
+      t.get();
+    } catch (const sylar::FutureTimeout&) {
+      timeout = true;
+    }
+    SYLAR_ASSERT(timeout);
+
+    sylar::Future<int> t2 = f.timeout(1000);
+    sylar::IOManager::GetThis()->addTimer(5, [p]() mutable { p.setValue(7); });
+    SYLAR_ASSERT(t2.get() == 7 && f.get() == 7);
+    ok = true;
+    finish.done();
+  });
+  finish.wait();
+  SYLAR_ASSERT(ok);
+  SYLAR_LOG_INFO(g_logger) << "test_timeout ok";
+}
+
+/**
+ * @brief 带超时的等待与完成并发，定时器在锁外添加和取消，不能丢失唤醒或留下定时器
+ */
+void test_timed_race() {
+  std::atomic<int> ok{0};
+  std::atomic<int> timeouts{0};
+  bool timers_left = true;
+  {
+    sylar::IOManager iom(4, false, "future_race");
+    for (int i = 0; i < 2000; ++i) {
+      sylar::Promise<int> p;
+      sylar::Future<int> f = p.getFuture();
+      // 超时时间为0到2毫秒，与完成时间交错
+      uint64_t timeout = i % 2 ? 10 * 1000 : i % 3;
+      iom.schedule([f, timeout, &ok, &timeouts]() {
+        if (f.waitFor(timeout)) {
+          SYLAR_ASSERT(f.get() == 1);
+          ++ok;
+        } else {
+          ++timeouts;
+        }
+      });
+      iom.schedule([p]() mutable { p.setValue(1); });
+    }
+    while (ok + timeouts < 2000) {
+      usleep(1000);
+    }
+    timers_left = iom.hasTimer();
+  }
+  SYLAR_ASSERT(ok + timeouts == 2000 && ok >= 1000);
+  SYLAR_ASSERT(!timers_left);
+  SYLAR_LOG_INFO(g_logger) << "test_timed_race ok=" << ok << " timeouts=" << timeouts;
+}
+
+/**
+ * @brief 不带超时的get挂起时等待节点放在协程栈上，挂起过程不分配内存
+ * @details 单线程调度器上先运行的协程挂起等待，随后运行的协程检查期间的分配次数再设置结果
+ */
+void test_wait_no_alloc() {
+  sylar::IOManager iom(1, false, "future_alloc");
+  sylar::FiberWaitGroup finish(2);
+  sylar::Promise<int> p;
+  sylar::Future<int> f = p.getFuture();
+  uint64_t before = 0;
+  uint64_t allocs = ~0ull;
+  int value = 0;
+  // 预先创建协程，调度时不再为回调创建协程
+  sylar::Fiber::ptr setter(new sylar::Fiber([&]() {
+    allocs = t_allocs - before;
+    p.setValue(42);
+    finish.done();
+  }));
+  // 等待的协程自己把设置结果的协程加入调度，挂起后线程直接切到它，中间不会进入idle
+  iom.schedule([&]() {
+    sylar::IOManager::GetThis()->schedule(setter);
+    before = t_allocs;
+    value = f.get();
+    finish.done();
+  });
+  finish.wait();
+  SYLAR_LOG_INFO(g_logger) << "test_wait_no_alloc allocs=" << allocs;
+  SYLAR_ASSERT(value == 42);
+  SYLAR_ASSERT(allocs == 0);
+  SYLAR_LOG_INFO(g_logger) << "test_wait_no_alloc ok";
+}
+
+int main(int argc, char** argv) {
+  test_offload();
+  test_then();
+  test_combinators();
+  test_timeout();
+  test_timed_race();
+  test_wait_no_alloc();
+  return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 02:05:12
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 02:05:12
+ * @FilePath: /sylar_from_nanasaki/tests/test_idle_spin.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 外部线程逐个投递任务，等上一个执行完再投下一个，统计平均延迟
+ */
+static void test_ping(uint32_t spin_us) {
+  const int N = 2000;
+  std::atomic<uint64_t> total{0};
+  std::atomic<int> done{0};
+  uint64_t hits = 0, misses = 0;
+  {
+    sylar::IOManager iom(2, false, "idle_spin");
+    iom.setSpinUs(spin_us);
+    SYLAR_ASSERT(iom.getSpinUs() == spin_us);
+    for (int i = 0; i < N; ++i) {
+      uint64_t begin = sylar::util::GetCurrentUS();
+      iom.schedule([&, begin]() {
+        total += sylar::util::GetCurrentUS() - begin;
+        ++done;
+      });
+      while (done <= i) {
+        sched_yield();
+      }
+      // 间隔一小段时间，让调度线程有机会进入idle
+      if (i % 10 == 0) {
+        usleep(100);
+      }
+    }
+    hits = iom.getSpinHits();
+    misses = iom.getSpinMisses();
+  }
+  SYLAR_ASSERT(done == N);
+  if (spin_us == 0) {
+    SYLAR_ASSERT(hits == 0 && misses == 0);
+  } else {
+    SYLAR_ASSERT(hits + misses > 0);
+  }
+  SYLAR_LOG_INFO(g_logger) << "test_ping spin_us=" << spin_us << " avg latency=" << total / N
+                           << "us spin hits=" << hits << " misses=" << misses;
+}
+
+/**
+ * @brief 自旋期间到来的IO事件和定时器都能正常处理
+ */
+static void test_io_timer() {
+  int fds[2];
+  SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  std::atomic<int> reads{0};
+  std::atomic<int> timers{0};
+  {
+    sylar::IOManager iom(2, false, "idle_spin_io");
+    iom.setSpinUs(200);
+    for (int i = 0; i < 100; ++i) {
+      iom.schedule([&]() {
+        char c;
+        SYLAR_ASSERT(read(fds[0], &c, 1) == 1);
+        ++reads;
+      });
+      iom.addTimer(1, [&]() { ++timers; });
+      usleep(200);
+      SYLAR_ASSERT(write(fds[1], "x", 1) == 1);
+      while (reads <= i) {
+        usleep(10);
+      }
+    }
+  }
+  SYLAR_ASSERT(reads == 100);
+  SYLAR_ASSERT(timers == 100);
+  close(fds[0]);
+  close(fds[1]);
+  SYLAR_LOG_INFO(g_logger) << "test_io_timer ok";
+}
+
+/**
+ * @brief 指定给其他线程的任务不算作当前线程可执行的任务，空闲线程自旋后正常阻塞，不会空转
+ */
+static void test_pinned_elsewhere() {
+  std::atomic<bool> busy{false};
+  std::atomic<bool> release{false};
+  std::atomic<bool> ran{false};
+  uint64_t hits = 0;
+  {
+    sylar::IOManager iom(2, false, "idle_spin_pinned");
+    iom.setSpinUs(50);
+    std::vector<int> ids = iom.getThreadIds();
+    SYLAR_ASSERT(ids.size() == 2);
+    // 占住第0个线程，之后指定给它的任务只能排队
+    iom.schedule(
+      [&]() {
+        busy = true;
+        while (!release) {
+          sched_yield();
+        }
+      },
+      ids[0]);
+    while (!busy) {
+      usleep(100);
+    }
+    iom.schedule([&]() { ran = true; }, ids[0]);
+    uint64_t begin = iom.getSpinHits();
+    usleep(20 * 1000);
+    hits = iom.getSpinHits() - begin;
+    SYLAR_ASSERT(!ran);
+    release = true;
+  }
+  SYLAR_ASSERT(ran);
+  SYLAR_LOG_INFO(g_logger) << "test_pinned_elsewhere spin hits=" << hits;
+  SYLAR_ASSERT(hits < 20);
+}
+
+/**
+ * @brief 线程id对64取模相同的两个调度线程，指定给其中一个的任务不会让另一个空转
+ * @details 先创建一些线程消耗掉线程id，使工作线程的id与use_caller的调用线程对64取模相同。
+ *          调用线程在stop之前不参与调度，指定给它的任务一直排队
+ */
+static void test_pinned_alias() {
+  uint64_t hits = 0;
+  bool aliased = false;
+  for (int retry = 0; retry < 5 && !aliased; ++retry) {
+    std::thread caller([&]() {
+      int self = sylar::util::GetThreadId();
+      for (int i = 0; i < 64; ++i) {
+        int next = 0;
+        std::thread([&next]() { next = sylar::util::GetThreadId(); }).join();
+        if ((next + 1) % 64 == self % 64) {
+          break;
+        }
+      }
+      std::atomic<bool> ran{false};
+      sylar::IOManager iom(2, true, "idle_spin_alias");
+      iom.setSpinUs(50);
+      std::vector<int> ids = iom.getThreadIds();
+      SYLAR_ASSERT(ids.size() == 2 && ids[0] == self);
+      if (ids[1] % 64 != ids[0] % 64) {
+        return;
+      }
+      aliased = true;
+      iom.schedule([&]() { ran = true; }, self);
+      uint64_t begin = iom.getSpinHits();
+      usleep(20 * 1000);
+      hits = iom.getSpinHits() - begin;
+      SYLAR_ASSERT(!ran);
+      iom.stop();
+      SYLAR_ASSERT(ran);
+    });
+    caller.join();
+  }
+  SYLAR_LOG_INFO(g_logger) << "test_pinned_alias aliased=" << aliased << " spin hits=" << hits;
+  SYLAR_ASSERT(hits < 20);
+}
+
+/**
+ * @brief 通过配置项按IOManager名称设置自旋时间
+ */
+static void test_config() {
+  auto var = sylar::Config::Lookup<std::map<std::string, uint32_t>>("iomanager.spin_us");
+  SYLAR_ASSERT(var);
+  var->setValue({{"*", 30}, {"idle_spin_cfg", 80}});
+  {
+    sylar::IOManager iom(1, false, "idle_spin_cfg");
+    SYLAR_ASSERT(iom.getSpinUs() == 80);
+  }
+  {
+    sylar::IOManager iom(1, false, "idle_spin_other");
+    SYLAR_ASSERT(iom.getSpinUs() == 30);
+  }
+  var->setValue({});
+  SYLAR_LOG_INFO(g_logger) << "test_config ok";
+}
+
+int main(int argc, char** argv) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+  test_config();
+  test_io_timer();
+  test_pinned_elsewhere();
+  test_pinned_alias();
+  test_ping(0);
+  test_ping(50);
+  return 0;
+}
@@ -0,0 +1,353 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 14:02:16
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 14:02:16
+ * @FilePath: /sylar_from_nanasaki/tests/test_io_uring.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/fd_manager.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 未知的后端使用epoll
+ * @return 内核是否支持io_uring后端
+ */
+static bool test_backend_select() {
+  auto backend = sylar::Config::Lookup<std::map<std::string, std::string>>("iomanager.backend");
+  backend->setValue({{"*", "bogus"}});
+  {
+    sylar::IOManager iom(1, false, "bogus");
+    SYLAR_ASSERT(!iom.isUring());
+  }
+  backend->setValue({{"*", "io_uring"}});
+  bool uring = false;
+  {
+    sylar::IOManager iom(1, false, "uring");
+    uring = iom.isUring();
+  }
+  backend->setValue({{"*", "epoll"}});
+  SYLAR_LOG_INFO(g_logger) << "test_backend_select ok, io_uring available=" << uring;
+  return uring;
+}
+
+/**
+ * @brief io_uring后端下的accept、connect、读写、超时以及close唤醒等待的读
+ */
+static void test_uring_io() {
+  auto backend = sylar::Config::Lookup<std::map<std::string, std::string>>("iomanager.backend");
+  backend->setValue({{"*", "io_uring"}});
+  std::atomic<int> done{0};
+  {
+    sylar::IOManager iom(2, false, "uring_io");
+    SYLAR_ASSERT(iom.isUring());
+    iom.schedule([&done]() {
+      // 在127.0.0.1的随机端口上监听
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t len = sizeof(addr);
+      int lfd = socket(AF_INET, SOCK_STREAM, 0);
+      SYLAR_ASSERT(bind(lfd, (sockaddr*)&addr, len) == 0 && listen(lfd, 16) == 0);
+      SYLAR_ASSERT(getsockname(lfd, (sockaddr*)&addr, &len) == 0);
+
+      // 等待连接超时
+      timeval tv = {0, 50 * 1000};
+      setsockopt(lfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      uint64_t begin = sylar::util::GetCurrentMS();
+      SYLAR_ASSERT(accept(lfd, nullptr, nullptr) == -1 && errno == ETIMEDOUT);
+      SYLAR_ASSERT(sylar::util::GetCurrentMS() - begin >= 45);
+      tv.tv_sec = 5;
+      setsockopt(lfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+      // 先到的连接缓存在multishot accept的队列中
+      int c1 = socket(AF_INET, SOCK_STREAM, 0);
+      int c2 = socket(AF_INET, SOCK_STREAM, 0);
+      SYLAR_ASSERT(connect(c1, (sockaddr*)&addr, len) == 0);
+      SYLAR_ASSERT(connect(c2, (sockaddr*)&addr, len) == 0);
+      sockaddr_in peer;
+      socklen_t peer_len = sizeof(peer);
+      int s1 = accept(lfd, (sockaddr*)&peer, &peer_len);
+      int s2 = accept(lfd, nullptr, nullptr);
+      SYLAR_ASSERT(s1 >= 0 && s2 >= 0);
+      SYLAR_ASSERT(peer.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+
+      // 读在数据到达前挂起，由内核完成
+      sylar::IOManager::GetThis()->schedule([c1]() {
+        usleep(10 * 1000);
+        SYLAR_ASSERT(write(c1, "hello", 5) == 5);
+      });
+      char buf[16] = {0};
+      SYLAR_ASSERT(read(s1, buf, sizeof(buf)) == 5);
+      SYLAR_ASSERT(memcmp(buf, "hello", 5) == 0);
+
+      // 读超时由链接的超时SQE实现
+      tv = {0, 30 * 1000};
+      setsockopt(s2, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      begin = sylar::util::GetCurrentMS();
+      SYLAR_ASSERT(recv(s2, buf, sizeof(buf), 0) == -1 && errno == ETIMEDOUT);
+      SYLAR_ASSERT(sylar::util::GetCurrentMS() - begin >= 25);
+
+      // close唤醒等待读的协程
+      int s2_fd = s2;
+      std::atomic<bool> woken{false};
+      sylar::IOManager::GetThis()->schedule([s2_fd, &woken]() {
+        char c;
+        SYLAR_ASSERT(read(s2_fd, &c, 1) == -1 && errno == EBADF);
+        woken = true;
+      });
+      usleep(10 * 1000);
+      close(s2);
+      while (!woken) {
+        usleep(1000);
+      }
+
+      close(c1);
+      close(c2);
+      close(s1);
+      close(lfd);
+      ++done;
+    });
+  }
+  backend->setValue({{"*", "epoll"}});
+  SYLAR_ASSERT(done == 1);
+  SYLAR_LOG_INFO(g_logger) << "test_uring_io ok";
+}
+
+/**
+ * @brief 共享栈协程在io_uring后端下读写
+ * @details 读协程挂起后共享栈由写协程使用，如果把栈上的缓冲区交给内核，
+ *          数据到达时内核会写进写协程的栈。共享栈协程应该退回epoll方式，两个协程的栈内容都不受影响
+ */
+static void test_uring_shared_stack() {
+  auto backend = sylar::Config::Lookup<std::map<std::string, std::string>>("iomanager.backend");
+  backend->setValue({{"*", "io_uring"}});
+  // 两个协程使用同一个共享栈
+  auto count = sylar::Config::Lookup<uint32_t>("fiber.shared_stack_count");
+  uint32_t old_count = count->getValue();
+  count->setValue(1);
+  std::atomic<int> done{0};
+  std::atomic<int> conn{-1};
+  {
+    sylar::IOManager iom(1, false, "uring_shared");
+    SYLAR_ASSERT(iom.isUring());
+    iom.setSharedStack(true);
+    iom.schedule([&done, &conn]() {
+      SYLAR_ASSERT(sylar::Fiber::GetThis()->isSharedStack());
+      int fds[2];
+      SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+      // socketpair没有hook，登记后读写才会挂起协程
+      sylar::FdMgr::GetInstance()->get(fds[0], true);
+      sylar::FdMgr::GetInstance()->get(fds[1], true);
+      int s = fds[0];
+      conn = fds[1];
+
+      char buf[256];
+      memset(buf, 'a', sizeof(buf));
+      size_t got = 0;
+      while (got < sizeof(buf)) {
+        ssize_t n = recv(s, buf + got, sizeof(buf) - got, 0);
+        SYLAR_ASSERT(n > 0);
+        got += n;
+      }
+      for (size_t i = 0; i < sizeof(buf); ++i) {
+        SYLAR_ASSERT(buf[i] == 'x');
+      }
+      close(s);
+      close(fds[1]);
+      ++done;
+    });
+    iom.schedule([&done, &conn]() {
+      while (conn < 0) {
+        usleep(1000);
+      }
+      char canary[16 * 1024];
+      memset(canary, 'b', sizeof(canary));
+      char data[256];
+      memset(data, 'x', sizeof(data));
+      SYLAR_ASSERT(write(conn, data, sizeof(data)) == sizeof(data));
+      // 留出时间让内核完成读协程的IO，此时共享栈属于本协程
+      for (int i = 0; i < 100; ++i) {
+        sched_yield();
+      }
+      for (size_t i = 0; i < sizeof(canary); ++i) {
+        SYLAR_ASSERT(canary[i] == 'b');
+      }
+      ++done;
+    });
+  }
+  backend->setValue({{"*", "epoll"}});
+  count->setValue(old_count);
+  SYLAR_ASSERT(done == 2);
+  SYLAR_LOG_INFO(g_logger) << "test_uring_shared_stack ok";
+}
+
+/**
+ * @brief 没有进行中的io_uring操作的fd关闭时不提交取消请求
+ */
+static void test_uring_close_idle_fd() {
+  auto backend = sylar::Config::Lookup<std::map<std::string, std::string>>("iomanager.backend");
+  backend->setValue({{"*", "io_uring"}});
+  uint64_t submits = ~0ull;
+  bool cancelled = true;
+  {
+    sylar::IOManager iom(1, false, "uring_close");
+    SYLAR_ASSERT(iom.isUring());
+    iom.schedule([&]() {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      SYLAR_ASSERT(fd >= 0);
+      uint64_t before = sylar::IOManager::GetThis()->getUringSubmitCount();
+      cancelled = sylar::IOManager::GetThis()->cancelAll(fd);
+      close(fd);
+      submits = sylar::IOManager::GetThis()->getUringSubmitCount() - before;
+    });
+  }
+  backend->setValue({{"*", "epoll"}});
+  SYLAR_ASSERT(!cancelled);
+  SYLAR_ASSERT(submits == 0);
+  SYLAR_LOG_INFO(g_logger) << "test_uring_close_idle_fd ok";
+}
+
+/**
+ * @brief 入队SQE的线程一直在执行任务，IO由空闲线程提交，不会等到该线程进入idle
+ */
+static void test_uring_busy_submitter() {
+  auto backend = sylar::Config::Lookup<std::map<std::string, std::string>>("iomanager.backend");
+  backend->setValue({{"*", "io_uring"}});
+  std::atomic<int> conn{-1};
+  std::atomic<bool> busy_done{false};
+  uint64_t read_at = 0;
+  uint64_t busy_at = 0;
+  {
+    sylar::IOManager iom(2, false, "uring_busy");
+    SYLAR_ASSERT(iom.isUring());
+    int home = iom.getThreadIds()[0];
+    iom.schedule(
+      [&, home]() {
+        int fds[2];
+        SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        sylar::FdMgr::GetInstance()->get(fds[0], true);
+        sylar::FdMgr::GetInstance()->get(fds[1], true);
+        // 读挂起之后本线程接着执行一个不让出的任务
+        sylar::IOManager::GetThis()->schedule(
+          [&]() {
+            uint64_t begin = sylar::util::GetCurrentMS();
+            while (sylar::util::GetCurrentMS() - begin < 300) {
+            }
+            busy_at = sylar::util::GetCurrentMS();
+            busy_done = true;
+          },
+          home);
+        // 添加任务时的tickle可能唤醒另一个线程，等它重新阻塞之后再读
+        uint64_t begin = sylar::util::GetCurrentMS();
+        while (sylar::util::GetCurrentMS() - begin < 20) {
+        }
+        conn = fds[1];
+        char buf[16];
+        SYLAR_ASSERT(read(fds[0], buf, sizeof(buf)) == 5);
+        read_at = sylar::util::GetCurrentMS();
+        close(fds[0]);
+        close(fds[1]);
+      },
+      home);
+    while (conn < 0) {
+      usleep(1000);
+    }
+    usleep(20 * 1000);
+    SYLAR_ASSERT(write(conn, "hello", 5) == 5);
+    while (!busy_done || !read_at) {
+      usleep(1000);
+    }
+  }
+  backend->setValue({{"*", "epoll"}});
+  SYLAR_LOG_INFO(g_logger) << "test_uring_busy_submitter read before busy end by "
+                           << (int64_t)(busy_at - read_at) << "ms";
+  SYLAR_ASSERT(read_at < busy_at);
+}
+
+/**
+ * @brief 多个连接上的ping-pong，比较两种后端的吞吐
+ */
+static void bench(const std::string& backend, int conns, int rounds, uint32_t batch = 32) {
+  auto backends = sylar::Config::Lookup<std::map<std::string, std::string>>("iomanager.backend");
+  backends->setValue({{"*", backend}});
+  auto uring_batch = sylar::Config::Lookup<uint32_t>("iomanager.uring_batch");
+  uring_batch->setValue(batch);
+  std::atomic<int> finished{0};
+  uint64_t begin = 0;
+  uint64_t used = 0;
+  uint64_t submits = 0;
+  {
+    sylar::IOManager iom(2, false, "bench_" + backend);
+    if (backend == "io_uring" && !iom.isUring()) {
+      SYLAR_LOG_INFO(g_logger) << "io_uring not available, skip bench";
+      return;
+    }
+    begin = sylar::util::GetCurrentUS();
+    for (int i = 0; i < conns; ++i) {
+      int fds[2];
+      SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+      sylar::FdMgr::GetInstance()->get(fds[0], true);
+      sylar::FdMgr::GetInstance()->get(fds[1], true);
+      iom.schedule([fds, &finished, rounds]() {
+        char buf[64] = {0};
+        for (int j = 0; j < rounds; ++j) {
+          SYLAR_ASSERT(write(fds[0], buf, sizeof(buf)) == sizeof(buf));
+          SYLAR_ASSERT(read(fds[0], buf, sizeof(buf)) == sizeof(buf));
+        }
+        close(fds[0]);
+        ++finished;
+      });
+      iom.schedule([fds]() {
+        char buf[64];
+        ssize_t n;
+        while ((n = read(fds[1], buf, sizeof(buf))) > 0) {
+          SYLAR_ASSERT(write(fds[1], buf, n) == n);
+        }
+        close(fds[1]);
+      });
+    }
+    while (finished < conns) {
+      usleep(1000);
+    }
+    used = sylar::util::GetCurrentUS() - begin;
+    submits = iom.getUringSubmitCount();
+  }
+  backends->setValue({{"*", "epoll"}});
+  uring_batch->setValue(32);
+  uint64_t requests = (uint64_t)conns * rounds;
+  SYLAR_LOG_INFO(g_logger) << "bench backend=" << backend
+                           << (backend == "io_uring" ? " batch=" + std::to_string(batch) : "")
+                           << " conns=" << conns << " rounds=" << rounds
+                           << " used=" << used / 1000 << "ms"
+                           << " qps=" << requests * 1000000 / (used ? used : 1)
+                           << " submits/req=" << (double)submits / requests;
+}
+
+int main(int argc, char** argv) {
+  if (test_backend_select()) {
+    test_uring_io();
+    test_uring_shared_stack();
+    test_uring_close_idle_fd();
+    test_uring_busy_submitter();
+  }
+  int rounds = argc > 1 ? atoi(argv[1]) : 1000;
+  bench("epoll", 64, rounds);
+  // batch=1时每个IO立即调用一次io_uring_enter
+  bench("io_uring", 64, rounds, 1);
+  bench("io_uring", 64, rounds);
+  return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 07:31:50
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 07:31:50
+ * @FilePath: /sylar_from_nanasaki/tests/test_parallel.cpp
+ */
+#include "sylar/fiber_sync.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/parallel.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <stdexcept>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 协程中等待和线程中等待FiberWaitGroup
+ */
+void test_wait_group() {
+  sylar::FiberWaitGroup wg;
+  std::atomic<int> done{0};
+  sylar::IOManager iom(2, false, "wait_group");
+  wg.add(100);
+  for (int i = 0; i < 100; ++i) {
+    iom.schedule([&]() {
+      usleep(100);
+      ++done;
+      wg.done();
+    });
+  }
+  // main线程不在调度器中，阻塞等待
+  wg.wait();
+  SYLAR_ASSERT(done == 100 && wg.getCount() == 0);
+
+  bool timeout_ok = false;
+  sylar::FiberWaitGroup never(1);
+  sylar::FiberWaitGroup finish;
+  finish.add();
+  iom.schedule([&]() {
+    uint64_t begin = sylar::util::GetElapsedMS();
+    timeout_ok = !never.waitFor(20) && sylar::util::GetElapsedMS() - begin >= 20;
+    finish.done();
+  });
+  finish.wait();
+  SYLAR_ASSERT(timeout_ok);
+  SYLAR_LOG_INFO(g_logger) << "test_wait_group ok";
+}
+
+/**
+ * @brief 单线程调度器上，调用协程等待时线程继续执行分片，IO分片之间互不等待
+ */
+void test_parallel_for() {
+  sylar::IOManager iom(1, false, "parallel_for");
+  sylar::FiberWaitGroup finish(1);
+  iom.schedule([&]() {
+    std::vector<int> hits(1000, 0);
+    int rt = sylar::ParallelFor(nullptr, 0, hits.size(), [&hits](size_t i) { ++hits[i]; });
+    SYLAR_ASSERT(rt == 0);
+    for (auto i : hits) {
+      SYLAR_ASSERT(i == 1);
+    }
+
+    // 50个各睡10ms的后端请求，每个元素一个协程
+    uint64_t begin = sylar::util::GetElapsedMS();
+    std::atomic<int> calls{0};
+    sylar::ParallelFor(nullptr, 0, 50, [&calls](size_t) {
+      usleep(10 * 1000);
+      ++calls;
+    }, 1);
+    uint64_t used = sylar::util::GetElapsedMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "fan out 50 x 10ms used " << used << "ms";
+    SYLAR_ASSERT(calls == 50);
+    SYLAR_ASSERT(used < 250);
+    finish.done();
+  });
+  finish.wait();
+  SYLAR_LOG_INFO(g_logger) << "test_parallel_for ok";
+}
+
+/**
+ * @brief 分片的异常和错误码传回调用方
+ */
+void test_errors() {
+  sylar::IOManager iom(2, false, "parallel_errors");
+  std::atomic<int> calls{0};
+  int rt = sylar::ParallelFor(&iom, 0, 100, [&calls](size_t i) {
+    ++calls;
+    return i == 37 ? -5 : 0;
+  }, 1);
+  SYLAR_ASSERT(rt == -5);
+
+  bool caught = false;
+  try {
+    sylar::ParallelFor(&iom, 0, 100, [](size_t i) {
+      if (i == 42) {
+        throw std::runtime_error("lookup failed");
+      }
+    });
+  } catch (const std::runtime_error& e) {
+    caught = std::string(e.what()) == "lookup failed";
+  }
+  SYLAR_ASSERT(caught);
+
+  // 协程中捕获异常，不影响所在线程
+  sylar::FiberWaitGroup finish(1);
+  bool fiber_caught = false;
+  iom.schedule([&]() {
+    try {
+      sylar::ParallelMap(nullptr, std::vector<int>{1, 2, 3}, [](int v) -> int {
+        if (v == 2) {
+          throw std::invalid_argument("bad");
+        }
+        return v;
+      });
+    } catch (const std::invalid_argument&) {
+      fiber_caught = true;
+    }
+    finish.done();
+  });
+  finish.wait();
+  SYLAR_ASSERT(fiber_caught);
+  SYLAR_LOG_INFO(g_logger) << "test_errors ok";
+}
+
+/**
+ * @brief ParallelMap按原顺序返回结果
+ */
+void test_parallel_map() {
+  sylar::IOManager iom(2, false, "parallel_map");
+  std::vector<int> in;
+  for (int i = 0; i < 1000; ++i) {
+    in.push_back(i);
+  }
+  std::vector<std::string> out =
+    sylar::ParallelMap(&iom, in, [](int v) { return std::to_string(v * v); });
+  SYLAR_ASSERT(out.size() == in.size());
+  for (size_t i = 0; i < in.size(); ++i) {
+    SYLAR_ASSERT(out[i] == std::to_string(in[i] * in[i]));
+  }
+  SYLAR_LOG_INFO(g_logger) << "test_parallel_map ok";
+}
+
+int main(int argc, char** argv) {
+  test_wait_group();
+  test_parallel_for();
+  test_errors();
+  test_parallel_map();
+  return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 15:20:43
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 15:20:43
+ * @FilePath: /sylar_from_nanasaki/tests/test_persistent_events.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/fd_manager.h"
+#include "sylar/hook.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 持久注册下事件先于等待到达、超时、close唤醒以及fd复用
+ */
+static void test_semantics() {
+  auto persistent = sylar::Config::Lookup<std::map<std::string, bool>>("iomanager.persistent_events");
+  persistent->setValue({{"*", true}});
+  std::atomic<int> done{0};
+  {
+    sylar::IOManager iom(2, false, "persistent");
+    SYLAR_ASSERT(iom.isPersistentEvents());
+    iom.schedule([&done]() {
+      // 在127.0.0.1的随机端口上监听
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t len = sizeof(addr);
+      int lfd = socket(AF_INET, SOCK_STREAM, 0);
+      SYLAR_ASSERT(bind(lfd, (sockaddr*)&addr, len) == 0 && listen(lfd, 16) == 0);
+      SYLAR_ASSERT(getsockname(lfd, (sockaddr*)&addr, &len) == 0);
+      int c = socket(AF_INET, SOCK_STREAM, 0);
+      SYLAR_ASSERT(connect(c, (sockaddr*)&addr, len) == 0);
+      int s = accept(lfd, nullptr, nullptr);
+      SYLAR_ASSERT(s >= 0);
+
+      // 第一次等待时注册，数据在没有协程等待时到达
+      timeval tv = {0, 30 * 1000};
+      setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      char buf[16];
+      uint64_t begin = sylar::util::GetCurrentMS();
+      SYLAR_ASSERT(read(s, buf, sizeof(buf)) == -1 && errno == ETIMEDOUT);
+      SYLAR_ASSERT(sylar::util::GetCurrentMS() - begin >= 25);
+      SYLAR_ASSERT(write(c, "ab", 2) == 2);
+      usleep(10 * 1000);
+      SYLAR_ASSERT(read(s, buf, sizeof(buf)) == 2);
+
+      // 就绪记录被非阻塞IO消费后，等待仍然会超时而不是直接返回
+      SYLAR_ASSERT(read(s, buf, sizeof(buf)) == -1 && errno == ETIMEDOUT);
+
+      // close唤醒等待读的协程
+      std::atomic<bool> woken{false};
+      tv = {5, 0};
+      setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      sylar::IOManager::GetThis()->schedule([s, &woken]() {
+        char ch;
+        SYLAR_ASSERT(read(s, &ch, 1) == -1 && errno == EBADF);
+        woken = true;
+      });
+      usleep(10 * 1000);
+      close(s);
+      while (!woken) {
+        usleep(1000);
+      }
+
+      // 复用同一个fd值的新连接重新注册
+      int c2 = socket(AF_INET, SOCK_STREAM, 0);
+      SYLAR_ASSERT(connect(c2, (sockaddr*)&addr, len) == 0);
+      int s2 = accept(lfd, nullptr, nullptr);
+      SYLAR_ASSERT(s2 >= 0);
+      sylar::IOManager::GetThis()->schedule([c2]() {
+        usleep(10 * 1000);
+        SYLAR_ASSERT(write(c2, "x", 1) == 1);
+      });
+      setsockopt(s2, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      SYLAR_ASSERT(read(s2, buf, sizeof(buf)) == 1);
+
+      // 对端关闭
+      close(c2);
+      SYLAR_ASSERT(read(s2, buf, sizeof(buf)) == 0);
+
+      // 关闭时没有开启hook，注册状态残留，复用同一个fd值的新连接仍然要重新注册
+      int stale = s2;
+      sylar::set_hook_enable(false);
+      close(s2);
+      sylar::set_hook_enable(true);
+      int c3 = socket(AF_INET, SOCK_STREAM, 0);
+      SYLAR_ASSERT(connect(c3, (sockaddr*)&addr, len) == 0);
+      int s3 = accept(lfd, nullptr, nullptr);
+      SYLAR_ASSERT(s3 == stale);
+      sylar::IOManager::GetThis()->schedule([c3]() {
+        usleep(10 * 1000);
+        SYLAR_ASSERT(write(c3, "y", 1) == 1);
+      });
+      setsockopt(s3, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      begin = sylar::util::GetCurrentMS();
+      SYLAR_ASSERT(read(s3, buf, sizeof(buf)) == 1);
+      // 没有重新注册时收不到可读事件，要等到超时
+      SYLAR_ASSERT(sylar::util::GetCurrentMS() - begin < 1000);
+      close(c3);
+      close(s3);
+      close(c);
+      close(lfd);
+      ++done;
+    });
+  }
+  persistent->setValue({{"*", false}});
+  SYLAR_ASSERT(done == 1);
+  SYLAR_LOG_INFO(g_logger) << "test_semantics ok";
+}
+
+/**
+ * @brief 进程调用read/write类系统调用的次数，来自/proc/self/io的syscr和syscw
+ */
+static uint64_t rw_syscalls() {
+  FILE* fp = fopen("/proc/self/io", "r");
+  if (!fp) {
+    return 0;
+  }
+  char name[32];
+  unsigned long long v;
+  uint64_t total = 0;
+  while (fscanf(fp, "%31s %llu", name, &v) == 2) {
+    if (!strcmp(name, "syscr:") || !strcmp(name, "syscw:")) {
+      total += v;
+    }
+  }
+  fclose(fp);
+  return total;
+}
+
+/**
+ * @brief 长连接上的ping-pong，统计每个请求的系统调用次数
+ * @details 包括epoll_ctl、epoll_wait以及read/write(含EAGAIN的尝试和eventfd的读写)
+ */
+static void bench(bool persistent, int conns, int rounds) {
+  auto events = sylar::Config::Lookup<std::map<std::string, bool>>("iomanager.persistent_events");
+  events->setValue({{"*", persistent}});
+  std::atomic<int> finished{0};
+  uint64_t used = 0;
+  uint64_t ctl = 0;
+  uint64_t waits = 0;
+  uint64_t rw = 0;
+  {
+    sylar::IOManager iom(2, false, persistent ? "bench_persistent" : "bench_oneshot");
+    uint64_t begin = sylar::util::GetCurrentUS();
+    uint64_t rw_begin = rw_syscalls();
+    for (int i = 0; i < conns; ++i) {
+      int fds[2];
+      SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+      // socketpair没有hook，登记后读写才会挂起协程
+      sylar::FdMgr::GetInstance()->get(fds[0], true);
+      sylar::FdMgr::GetInstance()->get(fds[1], true);
+      iom.schedule([fds, &finished, rounds]() {
+        char buf[64] = {0};
+        for (int j = 0; j < rounds; ++j) {
+          SYLAR_ASSERT(write(fds[0], buf, sizeof(buf)) == sizeof(buf));
+          SYLAR_ASSERT(read(fds[0], buf, sizeof(buf)) == sizeof(buf));
+        }
+        close(fds[0]);
+        ++finished;
+      });
+      iom.schedule([fds]() {
+        char buf[64];
+        ssize_t n;
+        while ((n = read(fds[1], buf, sizeof(buf))) > 0) {
+          SYLAR_ASSERT(write(fds[1], buf, n) == n);
+        }
+        close(fds[1]);
+      });
+    }
+    while (finished < conns) {
+      usleep(1000);
+    }
+    used = sylar::util::GetCurrentUS() - begin;
+    rw = rw_syscalls() - rw_begin;
+    ctl = iom.getEpollCtlCount();
+    waits = iom.getEpollWaitCount();
+  }
+  events->setValue({{"*", false}});
+  uint64_t requests = (uint64_t)conns * rounds;
+  SYLAR_LOG_INFO(g_logger) << "bench persistent=" << persistent << " conns=" << conns
+                           << " rounds=" << rounds << " used=" << used / 1000 << "ms"
+                           << " qps=" << requests * 1000000 / (used ? used : 1)
+                           << " per request: epoll_ctl=" << (double)ctl / requests
+                           << " epoll_wait=" << (double)waits / requests
+                           << " read/write=" << (double)rw / requests
+                           << " total=" << (double)(ctl + waits + rw) / requests;
+}
+
+int main(int argc, char** argv) {
+  test_semantics();
+  int rounds = argc > 1 ? atoi(argv[1]) : 1000;
+  bench(false, 64, rounds);
+  bench(true, 64, rounds);
+  return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 03:10:25
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 03:10:25
+ * @FilePath: /sylar_from_nanasaki/tests/test_priority.cpp
+ */
+#include "sylar/fiber.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/scheduler.h"
+#include <atomic>
+#include <mutex>
+#include <sched.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::mutex s_mutex;
+static std::vector<std::string> s_order;
+static std::atomic<bool> s_go{false};
+
+static void record(const std::string& name) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_order.push_back(name);
+}
+
+/**
+ * @brief 占住唯一的调度线程，直到测试把任务都放进队列
+ */
+static void gate() {
+  while (!s_go) {
+    sched_yield();
+  }
+}
+
+static void reset() {
+  s_go = false;
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_order.clear();
+}
+
+static size_t first_of(const std::string& name) {
+  for (size_t i = 0; i < s_order.size(); ++i) {
+    if (s_order[i] == name) {
+      return i;
+    }
+  }
+  return s_order.size();
+}
+
+/**
+ * @brief 三个类别都有任务时按权重轮流执行，后台任务不会被饿死
+ */
+static void test_weights(int mode) {
+  reset();
+  {
+    sylar::Scheduler sc(1, false, "priority");
+    sc.setInjectQueue(mode >= 1);
+    sc.setWorkStealing(mode == 2);
+    sc.start();
+    sc.schedule(&gate);
+    usleep(10 * 1000);
+    for (int i = 0; i < 40; ++i) {
+      sc.schedule([]() { record("B"); }, -1, sylar::Fiber::BACKGROUND);
+    }
+    for (int i = 0; i < 40; ++i) {
+      sc.schedule([]() { record("N"); });
+    }
+    for (int i = 0; i < 40; ++i) {
+      sc.schedule([]() { record("H"); }, -1, sylar::Fiber::HIGH);
+    }
+    s_go = true;
+    sc.stop();
+  }
+  SYLAR_ASSERT(s_order.size() == 120);
+  SYLAR_ASSERT(s_order[0] == "H");
+  // 默认权重16/4/1，每21个任务里至少有一个后台任务
+  SYLAR_ASSERT(first_of("B") < 21);
+  int high = 0;
+  for (size_t i = 0; i < 21; ++i) {
+    high += s_order[i] == "H";
+  }
+  SYLAR_ASSERT(high >= 15);
+  SYLAR_LOG_INFO(g_logger) << "test_weights ok, mode=" << mode << " first background=" << first_of("B")
+                           << " high in first 21=" << high;
+}
+
+/**
+ * @brief 同一类别中有截止时间的任务先执行，超过截止时间的任务不论类别最先执行
+ */
+static void test_deadline() {
+  reset();
+  {
+    sylar::Scheduler sc(1, false, "priority_deadline");
+    sc.start();
+    sc.schedule(&gate);
+    usleep(10 * 1000);
+    for (int i = 0; i < 5; ++i) {
+      sc.schedule([]() { record("N"); });
+    }
+    sc.schedule([]() { record("D50"); }, -1, -1, 50);
+    sc.schedule([]() { record("D10"); }, -1, -1, 10);
+    sc.schedule([]() { record("late"); }, -1, sylar::Fiber::BACKGROUND, 1);
+    for (int i = 0; i < 5; ++i) {
+      sc.schedule([]() { record("H"); }, -1, sylar::Fiber::HIGH);
+    }
+    usleep(5 * 1000);
+    s_go = true;
+    sc.stop();
+  }
+  SYLAR_ASSERT(s_order.size() == 13);
+  SYLAR_ASSERT(s_order[0] == "late");
+  SYLAR_ASSERT(first_of("D10") < first_of("D50"));
+  SYLAR_ASSERT(first_of("D50") < first_of("N"));
+  SYLAR_LOG_INFO(g_logger) << "test_deadline ok";
+}
+
+/**
+ * @brief 协程可以修改自己的类别，回调任务的协程沿用任务的类别
+ */
+static void test_fiber_priority() {
+  reset();
+  std::atomic<int> prio{-1};
+  {
+    sylar::Scheduler sc(1, false, "priority_fiber");
+    sc.setPriorityWeights(1, 1, 1);
+    sc.start();
+    sc.schedule(&gate);
+    usleep(10 * 1000);
+    sc.schedule([&prio]() { prio = sylar::Fiber::GetThis()->getPriority(); }, -1,
+                sylar::Fiber::HIGH);
+    sc.schedule([]() {
+      // 降为后台类别后重新排队，等前面的NORMAL任务按轮询执行几个之后才会被恢复
+      auto self = sylar::Fiber::GetThis();
+      self->setPriority(sylar::Fiber::BACKGROUND);
+      sylar::Scheduler::GetThis()->schedule(self);
+      self->yield();
+      record("self");
+    });
+    for (int i = 0; i < 5; ++i) {
+      sc.schedule([]() { record("N"); });
+    }
+    s_go = true;
+    sc.stop();
+  }
+  SYLAR_ASSERT(prio == sylar::Fiber::HIGH);
+  SYLAR_ASSERT(s_order.size() == 6);
+  size_t pos = first_of("self");
+  SYLAR_ASSERT(pos >= 1 && pos < 5);
+  SYLAR_LOG_INFO(g_logger) << "test_fiber_priority ok, self resumed at " << pos;
+}
+
+int main(int argc, char** argv) {
+  for (int mode = 0; mode < 3; ++mode) {
+    test_weights(mode);
+  }
+  test_deadline();
+  test_fiber_priority();
+  return 0;
+}
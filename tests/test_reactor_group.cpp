@@ -0,0 +1,184 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 17:05:52
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 17:05:52
+ * @FilePath: /sylar_from_nanasaki/tests/test_reactor_group.cpp
+ */
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/reactor_group.h"
+#include "sylar/tcp_server.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <netinet/tcp.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 分配策略
+ */
+static void test_balance() {
+  sylar::ReactorGroup group(4, "balance");
+  SYLAR_ASSERT(group.getBalance() == sylar::ReactorGroup::ROUND_ROBIN);
+  // scheduler.inject_queue默认关闭，reactor仍然打开注入队列
+  for (size_t i = 0; i < group.size(); ++i) {
+    SYLAR_ASSERT(group.getReactor(i)->isInjectQueue());
+  }
+  for (int i = 0; i < 8; ++i) {
+    group.acquire();
+  }
+  for (size_t i = 0; i < group.size(); ++i) {
+    SYLAR_ASSERT(group.getLoad(i) == 2);
+  }
+
+  // 2和3上的连接结束后，新连接应该分给它们
+  group.setBalance(sylar::ReactorGroup::LEAST_LOADED);
+  for (auto i : {2, 2, 3, 3}) {
+    group.release(i);
+  }
+  for (int i = 0; i < 4; ++i) {
+    size_t idx = group.acquire();
+    SYLAR_ASSERT(idx == 2 || idx == 3);
+  }
+  for (size_t i = 0; i < group.size(); ++i) {
+    SYLAR_ASSERT(group.getLoad(i) == 2);
+    group.release(i);
+    group.release(i);
+  }
+  SYLAR_LOG_INFO(g_logger) << "test_balance ok";
+}
+
+/**
+ * @brief 回显服务器，检查连接的协程一直在同一个线程上
+ */
+class EchoServer : public sylar::TcpServer {
+public:
+  EchoServer(sylar::IOManager* io_worker, sylar::IOManager* accept_worker)
+    : TcpServer(io_worker, accept_worker) {
+  }
+
+  /**
+   * @brief 监听的地址
+   */
+  sylar::Address::ptr getAddress() {
+    return m_socks[0]->getLocalAddress();
+  }
+
+  std::atomic<int> migrated{0};
+
+protected:
+  void handleClient(sylar::Socket::ptr client) override {
+    int tid = sylar::util::GetThreadId();
+    char buf[64];
+    while (true) {
+      int n = client->recv(buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      if (sylar::util::GetThreadId() != tid) {
+        ++migrated;
+      }
+      if (client->send(buf, n) != n) {
+        break;
+      }
+    }
+    client->close();
+  }
+};
+
+/**
+ * @brief 回显服务器的ping-pong，比较共用一个epoll的多线程IOManager和reactor组
+ */
+static void bench(bool reactors, sylar::ReactorGroup::Balance balance, int conns, int rounds) {
+  const size_t threads = 4;
+  std::unique_ptr<sylar::IOManager> shared;
+  sylar::ReactorGroup::ptr group;
+  if (reactors) {
+    group.reset(new sylar::ReactorGroup(threads, "echo_reactor"));
+    group->setBalance(balance);
+  } else {
+    shared.reset(new sylar::IOManager(threads, false, "echo_shared"));
+  }
+  uint64_t used = 0;
+  int migrated = 0;
+  {
+    sylar::IOManager acceptor(1, false, "echo_accept");
+    std::shared_ptr<EchoServer> server(new EchoServer(shared.get(), &acceptor));
+    server->setReactors(group);
+    // 监听socket要在开启了hook的线程上创建，accept才会挂起协程而不是阻塞线程
+    sylar::Address::ptr addr;
+    std::atomic<bool> started{false};
+    acceptor.schedule([server, &addr, &started]() {
+      SYLAR_ASSERT(server->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+      server->start();
+      addr = server->getAddress();
+      started = true;
+    });
+    while (!started) {
+      usleep(1000);
+    }
+
+    std::atomic<int> finished{0};
+    uint64_t begin = sylar::util::GetCurrentUS();
+    {
+      sylar::IOManager clients(2, false, "echo_client");
+      for (int i = 0; i < conns; ++i) {
+        clients.schedule([addr, rounds, &finished]() {
+          sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+          SYLAR_ASSERT(sock->connect(addr));
+          int one = 1;
+          sock->setOption(IPPROTO_TCP, TCP_NODELAY, one);
+          char buf[64] = {0};
+          for (int j = 0; j < rounds; ++j) {
+            SYLAR_ASSERT(sock->send(buf, sizeof(buf)) == sizeof(buf));
+            size_t got = 0;
+            while (got < sizeof(buf)) {
+              int n = sock->recv(buf + got, sizeof(buf) - got);
+              SYLAR_ASSERT(n > 0);
+              got += n;
+            }
+          }
+          sock->close();
+          ++finished;
+        });
+      }
+    }
+    used = sylar::util::GetCurrentUS() - begin;
+    SYLAR_ASSERT(finished == conns);
+    if (group) {
+      SYLAR_LOG_INFO(g_logger) << server->toString();
+      // 连接结束后连接数都应该归零
+      for (size_t i = 0; i < group->size(); ++i) {
+        for (int k = 0; k < 1000 && group->getLoad(i); ++k) {
+          usleep(1000);
+        }
+        SYLAR_ASSERT(group->getLoad(i) == 0);
+      }
+    }
+    server->stop();
+    migrated = server->migrated;
+  }
+  group.reset();
+  shared.reset();
+
+  uint64_t requests = (uint64_t)conns * rounds;
+  SYLAR_LOG_INFO(g_logger) << "bench mode="
+                           << (reactors ? sylar::ReactorGroup::ToString(balance) : "shared")
+                           << " threads=" << threads << " conns=" << conns << " rounds=" << rounds
+                           << " used=" << used / 1000 << "ms"
+                           << " qps=" << requests * 1000000 / (used ? used : 1)
+                           << " migrated=" << migrated;
+  if (reactors) {
+    SYLAR_ASSERT(migrated == 0);
+  }
+}
+
+int main(int argc, char** argv) {
+  test_balance();
+  int rounds = argc > 1 ? atoi(argv[1]) : 1000;
+  bench(false, sylar::ReactorGroup::ROUND_ROBIN, 32, rounds);
+  bench(true, sylar::ReactorGroup::ROUND_ROBIN, 32, rounds);
+  bench(true, sylar::ReactorGroup::LEAST_LOADED, 32, rounds);
+  return 0;
+}
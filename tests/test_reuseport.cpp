@@ -0,0 +1,253 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 18:20:44
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 18:20:44
+ * @FilePath: /sylar_from_nanasaki/tests/test_reuseport.cpp
+ */
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/reactor_group.h"
+#include "sylar/tcp_server.h"
+#include "sylar/util/util.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <set>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const size_t THREADS = 4;
+
+/**
+ * @brief 接受连接后立即关闭，按处理连接的reactor计数
+ */
+class CountServer : public sylar::TcpServer {
+public:
+  CountServer(sylar::IOManager* accept_worker)
+    : TcpServer(nullptr, accept_worker) {
+  }
+
+  sylar::Address::ptr getAddress() {
+    return m_socks[0]->getLocalAddress();
+  }
+
+  size_t getListenCount() const {
+    return m_socks.size();
+  }
+
+  std::atomic<int> handled[THREADS] = {};
+
+protected:
+  void handleClient(sylar::Socket::ptr client) override {
+    int idx = getReactors()->indexOf(sylar::IOManager::GetThis());
+    SYLAR_ASSERT(idx >= 0);
+    ++handled[idx];
+    client->close();
+  }
+};
+
+/**
+ * @brief 没有reactor组，连接交给io_worker，记录accept循环和处理连接的线程
+ */
+class WorkerServer : public sylar::TcpServer {
+public:
+  WorkerServer(sylar::IOManager* io_worker, sylar::IOManager* accept_worker)
+    : TcpServer(io_worker, accept_worker) {
+  }
+
+  sylar::Address::ptr getAddress() {
+    return m_socks[0]->getLocalAddress();
+  }
+
+  size_t getListenCount() const {
+    return m_socks.size();
+  }
+
+  std::set<int> getAcceptThreads() {
+    sylar::Mutex::Lock lock(m_mutex);
+    return m_acceptThreads;
+  }
+
+  std::map<int, int> getHandled() {
+    sylar::Mutex::Lock lock(m_mutex);
+    return m_handled;
+  }
+
+protected:
+  void startAccept(sylar::Socket::ptr sock) override {
+    {
+      sylar::Mutex::Lock lock(m_mutex);
+      m_acceptThreads.insert(sylar::util::GetThreadId());
+    }
+    TcpServer::startAccept(sock);
+  }
+
+  void handleClient(sylar::Socket::ptr client) override {
+    {
+      sylar::Mutex::Lock lock(m_mutex);
+      ++m_handled[sylar::util::GetThreadId()];
+    }
+    client->close();
+  }
+
+private:
+  sylar::Mutex m_mutex;
+  std::set<int> m_acceptThreads;
+  std::map<int, int> m_handled;
+};
+
+/**
+ * @brief 在accept线程上启动服务器，监听socket要在开启了hook的线程上创建
+ */
+template <class Server>
+static sylar::Address::ptr start_server(std::shared_ptr<Server> server,
+                                        sylar::IOManager* acceptor) {
+  sylar::Address::ptr addr;
+  std::atomic<bool> started{false};
+  acceptor->schedule([server, &addr, &started]() {
+    SYLAR_ASSERT(server->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+    server->start();
+    addr = server->getAddress();
+    started = true;
+  });
+  while (!started) {
+    usleep(1000);
+  }
+  return addr;
+}
+
+/**
+ * @brief conns个连接，每个协程建立连接后等待服务器关闭
+ * @return 用时(微秒)
+ */
+static uint64_t connect_storm(sylar::Address::ptr addr, int fibers, int conns) {
+  std::atomic<int> next{0};
+  uint64_t begin = sylar::util::GetCurrentUS();
+  {
+    sylar::IOManager clients(2, false, "reuseport_client");
+    for (int i = 0; i < fibers; ++i) {
+      clients.schedule([addr, conns, &next]() {
+        while (next++ < conns) {
+          sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+          SYLAR_ASSERT(sock->connect(addr));
+          char c;
+          SYLAR_ASSERT(sock->recv(&c, 1) == 0);
+          sock->close();
+        }
+      });
+    }
+  }
+  return sylar::util::GetCurrentUS() - begin;
+}
+
+/**
+ * @brief 比较单个监听socket和SO_REUSEPORT分片的accept速率
+ * @param[in] mode 0: 单个监听socket，1: SO_REUSEPORT，2: SO_REUSEPORT + 按CPU分配的BPF
+ */
+static void bench(int mode, int conns) {
+  static const char* names[] = {"single", "reuseport", "reuseport_bpf"};
+  sylar::ReactorGroup::ptr group(new sylar::ReactorGroup(THREADS, "reuseport_reactor"));
+  uint64_t used = 0;
+  int handled[THREADS] = {0};
+  {
+    sylar::IOManager acceptor(1, false, "reuseport_accept");
+    std::shared_ptr<CountServer> server(new CountServer(&acceptor));
+    server->setReactors(group);
+    server->setReusePort(mode > 0);
+    server->setReusePortBpf(mode > 1);
+    sylar::Address::ptr addr = start_server(server, &acceptor);
+    SYLAR_ASSERT(server->getListenCount() == (mode > 0 ? THREADS : 1));
+    SYLAR_LOG_INFO(g_logger) << server->toString();
+
+    used = connect_storm(addr, 32, conns);
+    int total = 0;
+    for (int k = 0; k < 1000; ++k) {
+      total = 0;
+      for (size_t i = 0; i < THREADS; ++i) {
+        total += server->handled[i];
+      }
+      if (total == conns) {
+        break;
+      }
+      usleep(1000);
+    }
+    SYLAR_ASSERT(total == conns);
+    for (size_t i = 0; i < THREADS; ++i) {
+      handled[i] = server->handled[i];
+      SYLAR_ASSERT(group->getLoad(i) == 0);
+    }
+    // stop要唤醒各个reactor上等待accept的协程，否则reactor无法退出
+    server->stop();
+  }
+  group.reset();
+
+  std::stringstream ss;
+  for (size_t i = 0; i < THREADS; ++i) {
+    ss << (i ? "," : "") << handled[i];
+  }
+  SYLAR_LOG_INFO(g_logger) << "bench mode=" << names[mode] << " threads=" << THREADS
+                           << " conns=" << conns << " used=" << used / 1000 << "ms"
+                           << " accept/s=" << (uint64_t)conns * 1000000 / (used ? used : 1)
+                           << " per_reactor=" << ss.str();
+  if (mode == 1) {
+    // 按四元组哈希分配，每个分片都应该接受过连接
+    for (size_t i = 0; i < THREADS; ++i) {
+      SYLAR_ASSERT(handled[i] > 0);
+    }
+  }
+  if (mode == 2 && sysconf(_SC_NPROCESSORS_ONLN) == 1) {
+    // 只有一个CPU时所有连接都交给第0个分片
+    SYLAR_ASSERT(handled[0] == conns);
+  }
+}
+
+/**
+ * @brief 没有reactor组时，第i个accept循环固定在io_worker的第i个线程上，连接在accept的线程上处理
+ */
+static void test_io_worker(int conns) {
+  sylar::IOManager worker(THREADS, false, "reuseport_worker");
+  std::vector<int> ids = worker.getThreadIds();
+  SYLAR_ASSERT(ids.size() == THREADS);
+  std::set<int> accept_threads;
+  std::map<int, int> handled;
+  {
+    sylar::IOManager acceptor(1, false, "reuseport_accept");
+    std::shared_ptr<WorkerServer> server(new WorkerServer(&worker, &acceptor));
+    server->setReusePort(true);
+    sylar::Address::ptr addr = start_server(server, &acceptor);
+    SYLAR_ASSERT(server->getListenCount() == THREADS);
+
+    connect_storm(addr, 32, conns);
+    int total = 0;
+    for (int k = 0; k < 1000 && total != conns; ++k) {
+      usleep(1000);
+      total = 0;
+      handled = server->getHandled();
+      for (auto& i : handled) {
+        total += i.second;
+      }
+    }
+    SYLAR_ASSERT(total == conns);
+    accept_threads = server->getAcceptThreads();
+    server->stop();
+  }
+  SYLAR_ASSERT(accept_threads == std::set<int>(ids.begin(), ids.end()));
+  // 按四元组哈希分配，每个线程上的accept循环都接受过连接，并且只在io_worker的线程上处理
+  SYLAR_ASSERT(handled.size() == THREADS);
+  for (auto& i : handled) {
+    SYLAR_ASSERT(std::find(ids.begin(), ids.end(), i.first) != ids.end());
+    SYLAR_ASSERT(i.second > 0);
+  }
+  SYLAR_LOG_INFO(g_logger) << "test_io_worker ok";
+}
+
+int main(int argc, char** argv) {
+  int conns = argc > 1 ? atoi(argv[1]) : 5000;
+  test_io_worker(conns);
+  bench(0, conns);
+  bench(1, conns);
+  bench(2, conns);
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 05:02:47
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 05:02:47
+ * @FilePath: /sylar_from_nanasaki/tests/test_runtime_stats.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/runtime_stats.h"
+#include "sylar/scheduler.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 调度器快照汇总各调度线程的计数
+ */
+void test_scheduler_stats() {
+  sylar::Config::Lookup<bool>("runtime.stats")->setValue(true);
+  const int N = 1000;
+  std::atomic<int> done{0};
+  sylar::RuntimeStats::Snapshot before = sylar::RuntimeStats::GetSnapshot();
+  sylar::RuntimeStats::Snapshot stats;
+  {
+    sylar::IOManager iom(2, false, "runtime_stats");
+    for (int i = 0; i < N; ++i) {
+      iom.schedule([&done, i]() {
+        if (i % 10 == 0) {
+          // hook后的usleep会yield，记录一次栈使用量
+          char buf[8192];
+          memset(buf, i, sizeof(buf));
+          usleep(1000 + buf[i % sizeof(buf)]);
+        }
+        ++done;
+      });
+    }
+    while (done < N) {
+      usleep(1000);
+    }
+    usleep(10 * 1000);
+    stats = iom.getStats();
+    SYLAR_LOG_INFO(g_logger) << "running: " << stats.toString();
+  }
+  SYLAR_ASSERT(stats.threads == 2);
+  // 每个usleep的协程还要被定时器唤醒一次
+  SYLAR_ASSERT(stats.tasksRun >= (uint64_t)N + N / 10);
+  SYLAR_ASSERT(stats.wakeups > 0);
+  SYLAR_ASSERT(stats.idleUs > 0);
+  SYLAR_ASSERT(stats.runQueueDepth == 0);
+  uint64_t yields = 0;
+  uint64_t big = 0;
+  for (size_t i = 0; i < sylar::RuntimeStats::STACK_BUCKETS; ++i) {
+    yields += stats.stackHistogram[i];
+    // 8K以上
+    big += i >= 4 ? stats.stackHistogram[i] : 0;
+  }
+  SYLAR_ASSERT(yields >= (uint64_t)N / 10);
+  SYLAR_ASSERT(big >= (uint64_t)N / 10);
+
+  sylar::RuntimeStats::Snapshot after = sylar::RuntimeStats::GetSnapshot();
+  SYLAR_ASSERT(after.tasksRun - before.tasksRun >= stats.tasksRun);
+  SYLAR_ASSERT(after.fibersCreated > before.fibersCreated);
+  SYLAR_ASSERT(after.fibersCreated >= after.fibersDestroyed);
+  SYLAR_LOG_INFO(g_logger) << "test_scheduler_stats ok, global: " << after.toString();
+  sylar::Config::Lookup<bool>("runtime.stats")->setValue(false);
+}
+
+/**
+ * @brief 关闭统计时不记录任何计数
+ */
+void test_disabled() {
+  const int N = 1000;
+  std::atomic<int> count{0};
+  sylar::RuntimeStats::Snapshot before = sylar::RuntimeStats::GetSnapshot();
+  {
+    sylar::Scheduler sc(2, false, "runtime_stats_off");
+    sc.start();
+    for (int i = 0; i < N; ++i) {
+      sc.schedule([&count]() { ++count; });
+    }
+    sc.stop();
+  }
+  SYLAR_ASSERT(count == N);
+  sylar::RuntimeStats::Snapshot after = sylar::RuntimeStats::GetSnapshot();
+  SYLAR_ASSERT(after.tasksRun == before.tasksRun);
+  SYLAR_ASSERT(after.wakeups == before.wakeups);
+  SYLAR_LOG_INFO(g_logger) << "test_disabled ok";
+}
+
+int main(int argc, char** argv) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+  test_scheduler_stats();
+  test_disabled();
+  return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 05:02:47
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 05:02:47
+ * @FilePath: /sylar_from_nanasaki/tests/test_runtime_stats_bench.cpp
+ */
+/**
+ * @brief 运行时统计开销测试
+ * @details 开启或关闭runtime.stats时调度空任务的耗时对比，每种取3轮中最快的一轮。
+ *          只输出结果，不做判断，机器上的其他负载会带来几个百分点的抖动
+ */
+#include "sylar/config.h"
+#include "sylar/env.h"
+#include "sylar/log.h"
+#include "sylar/scheduler.h"
+#include "sylar/util/util.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 开启或关闭统计时调度total个空任务的耗时(微秒)
+ */
+static uint64_t run_once(bool enable, uint64_t total) {
+  sylar::Config::Lookup<bool>("runtime.stats")->setValue(enable);
+  std::atomic<uint64_t> count{0};
+  uint64_t best = ~0ull;
+  for (int round = 0; round < 3; ++round) {
+    count = 0;
+    uint64_t begin = sylar::util::GetCurrentUS();
+    {
+      sylar::Scheduler sc(1, false, "runtime_stats_bench");
+      sc.start();
+      for (uint64_t i = 0; i < total; ++i) {
+        sc.schedule([&count]() { count.fetch_add(1, std::memory_order_relaxed); });
+      }
+      sc.stop();
+    }
+    best = std::min(best, sylar::util::GetCurrentUS() - begin);
+  }
+  sylar::Config::Lookup<bool>("runtime.stats")->setValue(false);
+  return best;
+}
+
+int main(int argc, char* argv[]) {
+  sylar::EnvMgr::GetInstance()->init(argc, argv);
+  sylar::Config::LoadFromConfDir(sylar::EnvMgr::GetInstance()->getConfigPath());
+
+  uint64_t total = 300000;
+  if (argc > 1) {
+    total = atoll(argv[1]);
+  }
+
+  uint64_t off = run_once(false, total);
+  uint64_t on = run_once(true, total);
+  std::cout << std::left << std::setw(12) << "stats" << std::setw(12) << "used(ms)"
+            << std::setw(20) << "Mops/s" << std::endl;
+  for (bool enable : {false, true}) {
+    uint64_t used = enable ? on : off;
+    std::cout << std::left << std::setw(12) << (enable ? "on" : "off") << std::setw(12)
+              << used / 1000 << std::setw(20) << std::fixed << std::setprecision(3)
+              << (double)total / (used ? used : 1) << std::endl;
+  }
+  std::cout << "overhead " << std::setprecision(2) << ((double)on - off) * 100 / (off ? off : 1)
+            << "%" << std::endl;
+  return 0;
+}
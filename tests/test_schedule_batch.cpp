@@ -0,0 +1,117 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 00:12:36
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 00:12:36
+ * @FilePath: /sylar_from_nanasaki/tests/test_schedule_batch.cpp
+ */
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/scheduler.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<int> s_done{0};
+static std::atomic<int> s_pinned_err{0};
+
+static const int BATCH = 1000;
+
+/**
+ * @brief 在调度线程内批量添加回调和协程，以及指定到本线程的一批任务
+ */
+static void spawn_batch() {
+  std::vector<std::function<void()>> cbs(BATCH, []() { ++s_done; });
+  sylar::Scheduler::GetThis()->schedule(cbs.begin(), cbs.end());
+  for (auto& i : cbs) {
+    // 批量调度之后元素被取走
+    SYLAR_ASSERT(!i);
+  }
+
+  std::vector<sylar::Fiber::ptr> fibers;
+  for (int i = 0; i < BATCH; ++i) {
+    fibers.emplace_back(new sylar::Fiber([]() { ++s_done; }));
+  }
+  sylar::Scheduler::GetThis()->schedule(fibers.begin(), fibers.end());
+
+  int tid = sylar::util::GetThreadId();
+  std::vector<std::function<void()>> pinned(10, [tid]() {
+    if (sylar::util::GetThreadId() != tid) {
+      ++s_pinned_err;
+    }
+    ++s_done;
+  });
+  sylar::Scheduler::GetThis()->schedule(pinned.begin(), pinned.end(), tid);
+}
+
+/**
+ * @brief 分别在普通、注入队列、工作窃取模式下测试批量调度
+ */
+static void test_modes() {
+  for (int mode = 0; mode < 3; ++mode) {
+    s_done = 0;
+    s_pinned_err = 0;
+    {
+      sylar::Scheduler sc(4, false, "batch");
+      sc.setInjectQueue(mode >= 1);
+      sc.setWorkStealing(mode == 2);
+      sc.start();
+      // 非调度线程批量添加
+      std::vector<std::function<void()>> cbs(8, &spawn_batch);
+      sc.schedule(cbs.begin(), cbs.end());
+      sc.stop();
+    }
+    SYLAR_ASSERT(s_done == 8 * (2 * BATCH + 10));
+    SYLAR_ASSERT(s_pinned_err == 0);
+    SYLAR_LOG_INFO(g_logger) << "test_modes ok, mode=" << mode << " done=" << s_done;
+  }
+}
+
+/**
+ * @brief 一轮epoll_wait返回大量就绪事件时，批量唤醒等待读的协程
+ */
+static void test_epoll_batch() {
+  const int N = 200;
+  std::vector<int> fds(N * 2);
+  for (int i = 0; i < N; ++i) {
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i * 2]) == 0);
+  }
+  std::atomic<int> readers{0};
+  uint64_t issued = 0;
+  {
+    sylar::IOManager iom(4, false, "batch_epoll");
+    for (int i = 0; i < N; ++i) {
+      int fd = fds[i * 2];
+      iom.schedule([fd, &readers]() {
+        char c;
+        // hook后的read会注册读事件并yield
+        SYLAR_ASSERT(read(fd, &c, 1) == 1);
+        ++readers;
+      });
+    }
+    usleep(100 * 1000);
+    for (int i = 0; i < N; ++i) {
+      SYLAR_ASSERT(write(fds[i * 2 + 1], "x", 1) == 1);
+    }
+    while (readers < N) {
+      usleep(1000);
+    }
+    issued = iom.getTickleIssued();
+  }
+  for (auto fd : fds) {
+    close(fd);
+  }
+  SYLAR_LOG_INFO(g_logger) << "test_epoll_batch ok, readers=" << readers
+                           << " tickle issued=" << issued;
+}
+
+int main(int argc, char** argv) {
+  test_modes();
+  test_epoll_batch();
+  return 0;
+}
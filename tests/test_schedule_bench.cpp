@@ -0,0 +1,97 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 14:05:31
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 14:05:31
+ * @FilePath: /sylar_from_nanasaki/tests/test_schedule_bench.cpp
+ */
+/**
+ * @brief Scheduler::schedule吞吐测试
+ * @details 对比无锁注入队列与原有链表+互斥锁两种方式，在1/4/16/64个生产者线程下从外部线程添加任务的吞吐
+ */
+#include "sylar/config.h"
+#include "sylar/env.h"
+#include "sylar/log.h"
+#include "sylar/scheduler.h"
+#include "sylar/thread.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<uint64_t> s_done{0};
+
+static void empty_task() {
+  s_done.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 跑一轮测试
+ * @param[in] inject 是否启用注入队列
+ * @param[in] producers 生产者线程数
+ * @param[in] total 总任务数
+ * @param[out] schedule_us 所有生产者调用schedule的总耗时
+ * @param[out] total_us 从开始添加任务到全部执行完的耗时
+ */
+static void run_once(bool inject, int producers, uint64_t total, uint64_t& schedule_us,
+                     uint64_t& total_us) {
+  s_done = 0;
+  sylar::Scheduler sc(4, false, inject ? "inject" : "mutex");
+  sc.setInjectQueue(inject);
+  sc.start();
+
+  uint64_t per = total / producers;
+  std::atomic<uint64_t> sched_cost{0};
+  uint64_t begin = sylar::util::GetCurrentUS();
+  std::vector<sylar::Thread::ptr> thrs;
+  for (int i = 0; i < producers; ++i) {
+    thrs.push_back(std::make_shared<sylar::Thread>(
+      [&sc, per, &sched_cost]() {
+        uint64_t b = sylar::util::GetCurrentUS();
+        for (uint64_t j = 0; j < per; ++j) {
+          sc.schedule(&empty_task);
+        }
+        sched_cost += sylar::util::GetCurrentUS() - b;
+      },
+      "producer_" + std::to_string(i)));
+  }
+  for (auto& i : thrs) {
+    i->join();
+  }
+  while (s_done.load(std::memory_order_relaxed) < per * producers) {
+    sched_yield();
+  }
+  total_us = sylar::util::GetCurrentUS() - begin;
+  schedule_us = sched_cost / producers;
+  sc.stop();
+}
+
+int main(int argc, char* argv[]) {
+  sylar::EnvMgr::GetInstance()->init(argc, argv);
+  sylar::Config::LoadFromConfDir(sylar::EnvMgr::GetInstance()->getConfigPath());
+
+  uint64_t total = 400000;
+  if (argc > 1) {
+    total = atoll(argv[1]);
+  }
+
+  std::cout << std::left << std::setw(12) << "mode" << std::setw(12) << "producers"
+            << std::setw(20) << "schedule(Mops/s)" << std::setw(20) << "end2end(Mops/s)"
+            << std::endl;
+  for (int producers : {1, 4, 16, 64}) {
+    for (bool inject : {false, true}) {
+      uint64_t schedule_us = 0;
+      uint64_t total_us = 0;
+      run_once(inject, producers, total, schedule_us, total_us);
+      uint64_t n = total / producers * producers;
+      std::cout << std::left << std::setw(12) << (inject ? "inject" : "mutex+list")
+                << std::setw(12) << producers << std::setw(20) << std::fixed
+                << std::setprecision(3) << (double)n / (schedule_us ? schedule_us : 1)
+                << std::setw(20) << (double)n / (total_us ? total_us : 1) << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 17:35:40
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 17:35:40
+ * @FilePath: /sylar_from_nanasaki/tests/test_shared_stack.cpp
+ */
+/**
+ * @brief 共享栈测试
+ * @details 模拟大量空闲连接：每个协程在栈上写入一段数据后yield挂起，统计独立栈和共享栈两种模式下
+ *          每个挂起协程占用的虚拟内存和物理内存，最后恢复所有协程并校验栈上的数据没有被破坏
+ */
+#include "sylar/config.h"
+#include "sylar/env.h"
+#include "sylar/fiber.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每个协程在栈上使用的字节数，大致相当于一次阻塞读时的栈深度
+static const size_t STACK_USED = 4096;
+
+static int s_errors = 0;
+
+/**
+ * @brief 读取当前进程的虚拟内存和常驻内存，单位字节
+ */
+static void get_mem(uint64_t& vm, uint64_t& rss) {
+  FILE* fp = fopen("/proc/self/statm", "r");
+  unsigned long pages_vm = 0;
+  unsigned long pages_rss = 0;
+  if (fp) {
+    if (fscanf(fp, "%lu %lu", &pages_vm, &pages_rss) != 2) {
+      pages_vm = pages_rss = 0;
+    }
+    fclose(fp);
+  }
+  vm = pages_vm * sysconf(_SC_PAGESIZE);
+  rss = pages_rss * sysconf(_SC_PAGESIZE);
+}
+
+static void idle_conn(int id) {
+  char buf[STACK_USED];
+  memset(buf, id & 0xff, sizeof(buf));
+  sylar::Fiber::GetThis()->yield();
+  for (size_t i = 0; i < sizeof(buf); ++i) {
+    if (buf[i] != (char)(id & 0xff)) {
+      ++s_errors;
+      break;
+    }
+  }
+}
+
+/**
+ * @brief 创建n个挂起的协程并统计内存
+ */
+static void run_once(bool shared, int n) {
+  sylar::Fiber::GetThis();
+  s_errors = 0;
+  uint64_t vm0, rss0, vm1, rss1;
+  get_mem(vm0, rss0);
+
+  std::vector<sylar::Fiber::ptr> fibers;
+  fibers.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    fibers.emplace_back(new sylar::Fiber(std::bind(&idle_conn, i), 0, false, shared));
+    fibers.back()->resume();
+  }
+  get_mem(vm1, rss1);
+
+  // 倒序恢复，让共享栈上的协程尽量都经历一次换出换入
+  for (int i = n - 1; i >= 0; --i) {
+    fibers[i]->resume();
+    SYLAR_ASSERT(fibers[i]->getState() == sylar::Fiber::TERM);
+  }
+  SYLAR_ASSERT(s_errors == 0);
+
+  std::cout << std::left << std::setw(12) << (shared ? "shared" : "private") << std::setw(12)
+            << n << std::setw(20) << (vm1 - vm0) / n << std::setw(20) << (rss1 - rss0) / n
+            << std::endl;
+}
+
+/**
+ * @brief 调度器开启共享栈后，回调协程yield后被重新调度时应该回到共享栈所属的线程
+ */
+static void test_scheduler() {
+  std::atomic<int> done{0};
+  std::atomic<int> moved{0};
+  {
+    sylar::IOManager iom(4, false, "shared");
+    iom.setSharedStack(true);
+    for (int i = 0; i < 1000; ++i) {
+      iom.schedule([&done, &moved, i]() {
+        char buf[1024];
+        memset(buf, i & 0xff, sizeof(buf));
+        int tid = sylar::util::GetThreadId();
+        for (int j = 0; j < 10; ++j) {
+          // 通过hook的usleep挂起，由定时器重新调度
+          usleep(100);
+          if (tid != sylar::util::GetThreadId()) {
+            ++moved;
+          }
+        }
+        for (size_t j = 0; j < sizeof(buf); ++j) {
+          SYLAR_ASSERT(buf[j] == (char)(i & 0xff));
+        }
+        ++done;
+      });
+    }
+  }
+  SYLAR_ASSERT(done == 1000);
+  SYLAR_ASSERT(moved == 0);
+  SYLAR_LOG_INFO(g_logger) << "scheduler shared stack ok";
+}
+
+int main(int argc, char* argv[]) {
+  sylar::EnvMgr::GetInstance()->init(argc, argv);
+  sylar::Config::LoadFromConfDir(sylar::EnvMgr::GetInstance()->getConfigPath());
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+  int n = 10000;
+  if (argc > 1) {
+    n = atoi(argv[1]);
+  }
+
+  std::cout << std::left << std::setw(12) << "mode" << std::setw(12) << "fibers"
+            << std::setw(20) << "vm/fiber(B)" << std::setw(20) << "rss/fiber(B)" << std::endl;
+  run_once(false, n);
+  run_once(true, n);
+
+  test_scheduler();
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 15:40:26
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 15:40:26
+ * @FilePath: /sylar_from_nanasaki/tests/test_stack_allocator.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/env.h"
+#include "sylar/fiber.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/stack_allocator.h"
+#include "sylar/util/util.h"
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const size_t STACK_SIZE = 128 * 1024;
+
+/**
+ * @brief 分配、写满、释放，检查每种分配器都能正常工作
+ */
+void test_alloc(const std::string& name) {
+  sylar::StackAllocator* alloc = sylar::StackAllocator::GetByName(name);
+  SYLAR_ASSERT(alloc);
+  void* sp = alloc->alloc(STACK_SIZE);
+  SYLAR_ASSERT(sp);
+  memset(sp, 0xAB, STACK_SIZE);
+  alloc->dealloc(sp, STACK_SIZE);
+  SYLAR_LOG_INFO(g_logger) << "alloc " << alloc->getName() << " ok";
+}
+
+/**
+ * @brief pooled分配器释放后再分配应该复用同一块栈
+ */
+void test_pooled_reuse() {
+  auto alloc = static_cast<sylar::PooledStackAllocator*>(
+    sylar::StackAllocator::GetByName("pooled"));
+  alloc->setHotCached(2);
+  alloc->setMaxCached(4);
+
+  void* sp = alloc->alloc(STACK_SIZE);
+  alloc->dealloc(sp, STACK_SIZE);
+  SYLAR_ASSERT(alloc->cachedCount() == 1);
+  void* sp2 = alloc->alloc(STACK_SIZE);
+  SYLAR_ASSERT(sp == sp2);
+  SYLAR_ASSERT(alloc->cachedCount() == 0);
+  alloc->dealloc(sp2, STACK_SIZE);
+
+  // 超过max的部分直接munmap，超过hot的部分被madvise后依然可以正常使用
+  std::vector<void*> sps;
+  for (int i = 0; i < 8; ++i) {
+    sps.push_back(alloc->alloc(STACK_SIZE));
+  }
+  for (auto i : sps) {
+    alloc->dealloc(i, STACK_SIZE);
+  }
+  SYLAR_ASSERT(alloc->cachedCount() == 4);
+  alloc->trim();
+  for (int i = 0; i < 4; ++i) {
+    void* p = alloc->alloc(STACK_SIZE);
+    memset(p, 0xCD, STACK_SIZE);
+    alloc->dealloc(p, STACK_SIZE);
+  }
+  SYLAR_LOG_INFO(g_logger) << "pooled reuse ok, cached=" << alloc->cachedCount();
+}
+
+/**
+ * @brief 在子进程中写保护页，子进程应该被SIGSEGV杀掉
+ */
+void test_guard_page(const std::string& name) {
+  sylar::StackAllocator* alloc = sylar::StackAllocator::GetByName(name);
+  void* sp = alloc->alloc(STACK_SIZE);
+  pid_t pid = fork();
+  if (pid == 0) {
+    volatile char* p = (volatile char*)sp - 1;
+    *p = 0;
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  SYLAR_ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+  alloc->dealloc(sp, STACK_SIZE);
+  SYLAR_LOG_INFO(g_logger) << "guard page " << name << " ok";
+}
+
+/**
+ * @brief 通过配置切换分配器，反复创建销毁协程
+ */
+void test_fiber(const std::string& name) {
+  sylar::Config::Lookup<std::string>("fiber.stack_allocator")->setValue(name);
+  sylar::Fiber::GetThis();
+  uint64_t begin = sylar::util::GetCurrentUS();
+  int count = 0;
+  for (int i = 0; i < 10000; ++i) {
+    sylar::Fiber::ptr fiber(new sylar::Fiber(
+      [&count]() {
+        char buf[1024];
+        memset(buf, 0, sizeof(buf));
+        ++count;
+      },
+      0, false));
+    fiber->resume();
+  }
+  SYLAR_ASSERT(count == 10000);
+  SYLAR_LOG_INFO(g_logger) << "fiber create/destroy x10000 with " << name
+                           << " used=" << sylar::util::GetCurrentUS() - begin << "us";
+}
+
+int main(int argc, char* argv[]) {
+  sylar::EnvMgr::GetInstance()->init(argc, argv);
+  sylar::Config::LoadFromConfDir(sylar::EnvMgr::GetInstance()->getConfigPath());
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+  for (auto& i : {"malloc", "mmap", "pooled"}) {
+    test_alloc(i);
+  }
+  test_pooled_reuse();
+  test_guard_page("mmap");
+  test_guard_page("pooled");
+  for (auto& i : {"malloc", "mmap", "pooled"}) {
+    test_fiber(i);
+  }
+  return 0;
+}
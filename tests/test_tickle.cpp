@@ -0,0 +1,77 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 23:48:12
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 23:48:12
+ * @FilePath: /sylar_from_nanasaki/tests/test_tickle.cpp
+ */
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 非调度线程成批添加任务，批内的tickle被合并，任务不会丢失
+ */
+void test_burst() {
+  const int ROUNDS = 200;
+  const int BATCH = 100;
+  std::atomic<int> count{0};
+  uint64_t issued = 0;
+  uint64_t suppressed = 0;
+  {
+    sylar::IOManager iom(4, false, "tickle_burst");
+    for (int r = 0; r < ROUNDS; ++r) {
+      for (int i = 0; i < BATCH; ++i) {
+        iom.schedule([&]() { ++count; });
+      }
+      // 等所有线程都回到idle再发下一批
+      usleep(500);
+    }
+    while (count < ROUNDS * BATCH) {
+      usleep(1000);
+    }
+    issued = iom.getTickleIssued();
+    suppressed = iom.getTickleSuppressed();
+  }
+  SYLAR_ASSERT(count == ROUNDS * BATCH);
+  SYLAR_ASSERT(issued < (uint64_t)ROUNDS * BATCH / 2);
+  SYLAR_LOG_INFO(g_logger) << "test_burst ok, tasks=" << ROUNDS * BATCH << " tickle issued=" << issued
+                           << " suppressed=" << suppressed;
+}
+
+/**
+ * @brief 所有线程都在idle时，定时器和跨线程唤醒仍然及时
+ */
+void test_latency() {
+  std::atomic<int> count{0};
+  uint64_t max_delay = 0;
+  {
+    sylar::IOManager iom(4, false, "tickle_latency");
+    for (int i = 0; i < 50; ++i) {
+      uint64_t begin = sylar::util::GetCurrentMS();
+      iom.schedule([&, begin]() {
+        uint64_t delay = sylar::util::GetCurrentMS() - begin;
+        if (delay > max_delay) {
+          max_delay = delay;
+        }
+        ++count;
+      });
+      usleep(2000);
+    }
+  }
+  SYLAR_ASSERT(count == 50);
+  // 唤醒丢失时要等到epoll_wait超时才会执行
+  SYLAR_ASSERT(max_delay < 1000);
+  SYLAR_LOG_INFO(g_logger) << "test_latency ok, max_delay=" << max_delay << "ms";
+}
+
+int main(int argc, char** argv) {
+  test_burst();
+  test_latency();
+  return 0;
+}
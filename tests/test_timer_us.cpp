@@ -0,0 +1,80 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-17 10:36:18
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-17 10:36:18
+ * @FilePath: /sylar_from_nanasaki/tests/test_timer_us.cpp
+ */
+#include "sylar/fiber_sync.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/util/util.h"
+#include <atomic>
+#include <time.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief hook后的usleep/nanosleep不再截断到毫秒
+ */
+void test_sleep() {
+  const int N = 200;
+  uint64_t usleep_avg = 0;
+  uint64_t nanosleep_avg = 0;
+  {
+    sylar::IOManager iom(1, false, "timer_us_sleep");
+    iom.schedule([&]() {
+      uint64_t begin = sylar::util::GetElapsedUS();
+      for (int i = 0; i < N; ++i) {
+        usleep(500);
+      }
+      usleep_avg = (sylar::util::GetElapsedUS() - begin) / N;
+
+      struct timespec req = {0, 300 * 1000};
+      begin = sylar::util::GetElapsedUS();
+      for (int i = 0; i < N; ++i) {
+        nanosleep(&req, nullptr);
+      }
+      nanosleep_avg = (sylar::util::GetElapsedUS() - begin) / N;
+    });
+  }
+  SYLAR_LOG_INFO(g_logger) << "usleep(500) avg=" << usleep_avg
+                           << "us nanosleep(300us) avg=" << nanosleep_avg << "us";
+  SYLAR_ASSERT(usleep_avg >= 500 && usleep_avg < 1000);
+  SYLAR_ASSERT(nanosleep_avg >= 300 && nanosleep_avg < 1000);
+  SYLAR_LOG_INFO(g_logger) << "test_sleep ok";
+}
+
+/**
+ * @brief 微秒精度的循环定时器，以及毫秒接口的行为不变
+ */
+void test_timer() {
+  std::atomic<int> ticks{0};
+  uint64_t ms_used = 0;
+  {
+    sylar::IOManager iom(1, false, "timer_us");
+    sylar::Timer::ptr timer = iom.addTimerUs(250, [&ticks]() { ++ticks; }, true);
+    uint64_t begin = sylar::util::GetElapsedUS();
+    iom.addTimer(50, [&, timer]() {
+      timer->cancel();
+      ms_used = sylar::util::GetElapsedUS() - begin;
+    });
+    // 还没超时的定时器向上取整到毫秒
+    uint64_t next = iom.getNextTimer();
+    SYLAR_ASSERT(next == 1);
+    SYLAR_ASSERT(iom.getNextTimerUs() <= 250);
+  }
+  SYLAR_LOG_INFO(g_logger) << "250us timer ticks=" << ticks << " in " << ms_used << "us";
+  SYLAR_ASSERT(ms_used >= 50 * 1000);
+  // 50ms内理论上200次，执行回调和调度有开销，这里只要求明显多于毫秒精度下的50次
+  SYLAR_ASSERT(ticks > 100 && ticks <= 200);
+  SYLAR_LOG_INFO(g_logger) << "test_timer ok";
+}
+
+int main(int argc, char** argv) {
+  test_sleep();
+  test_timer();
+  return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * @Author: Nana5aki
+ * @Date: 2026-10-16 11:02:13
+ * @LastEditors: Nana5aki
+ * @LastEditTime: 2026-10-16 11:02:13
+ * @FilePath: /sylar_from_nanasaki/tests/test_work_stealing.cpp
+ */
+#include "sylar/config.h"
+#include "sylar/env.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/macro.h"
+#include "sylar/scheduler.h"
+#include "sylar/util/util.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<uint64_t> s_done{0};
+static std::atomic<uint64_t> s_pinned_err{0};
+
+static const int FANOUT = 1000;
+
+/**
+ * @brief 子任务，只做计数
+ */
+void leaf_task() {
+  ++s_done;
+}
+
+/**
+ * @brief 在调度线程内部批量添加子任务，子任务进入本线程本地队列，由空闲线程窃取执行
+ */
+void spawn_task() {
+  for (int i = 0; i < FANOUT; ++i) {
+    sylar::Scheduler::GetThis()->schedule(&leaf_task);
+  }
+  // 指定线程的任务进入目标线程的亲和队列，执行时检查线程号
+  int tid = sylar::util::GetThreadId();
+  sylar::Scheduler::GetThis()->schedule(
+    [tid]() {
+      if (sylar::util::GetThreadId() != tid) {
+        ++s_pinned_err;
+      }
+      ++s_done;
+    },
+    tid);
+}
+
+void test_scheduler() {
+  s_done = 0;
+  s_pinned_err = 0;
+  uint64_t begin = sylar::util::GetCurrentMS();
+  {
+    sylar::Scheduler sc(4, false, "ws");
+    sc.setWorkStealing(true);
+    sc.start();
+    for (int i = 0; i < 16; ++i) {
+      sc.schedule(&spawn_task);
+    }
+    sc.stop();
+  }
+  SYLAR_LOG_INFO(g_logger) << "Scheduler work stealing done=" << s_done
+                           << " pinned_err=" << s_pinned_err
+                           << " used=" << sylar::util::GetCurrentMS() - begin << "ms";
+  SYLAR_ASSERT(s_done == 16 * (FANOUT + 1));
+  SYLAR_ASSERT(s_pinned_err == 0);
+}
+
+void test_iomanager() {
+  s_done = 0;
+  s_pinned_err = 0;
+  // IOManager在构造函数中就会start，只能通过配置项启用
+  sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(true);
+  uint64_t begin = sylar::util::GetCurrentMS();
+  {
+    sylar::IOManager iom(4, true, "ws_iom");
+    SYLAR_ASSERT(iom.isWorkStealing());
+    for (int i = 0; i < 16; ++i) {
+      iom.schedule(&spawn_task);
+    }
+  }
+  sylar::Config::Lookup<bool>("scheduler.work_stealing")->setValue(false);
+  SYLAR_LOG_INFO(g_logger) << "IOManager work stealing done=" << s_done
+                           << " pinned_err=" << s_pinned_err
+                           << " used=" << sylar::util::GetCurrentMS() - begin << "ms";
+  SYLAR_ASSERT(s_done == 16 * (FANOUT + 1));
+  SYLAR_ASSERT(s_pinned_err == 0);
+}
+
+int main(int argc, char* argv[]) {
+  sylar::EnvMgr::GetInstance()->init(argc, argv);
+  sylar::Config::LoadFromConfDir(sylar::EnvMgr::GetInstance()->getConfigPath());
+
+  test_scheduler();
+  test_iomanager();
+  return 0;
+}